@@ -0,0 +1,256 @@
+/*==============================================================================
+Module that implements a binary command engine over any CCom port.
+
+Commands and responses are carried in SLIP framed packets, so the start and
+end of every message can be found without a length field, and a corrupted
+message can't cause the decoder to lose synchronisation for longer than one
+frame. Responses also start with CMD_SLIP_END, so any text written to the port
+beforehand is separated from the frame. The decoded frame contents are...
+	[0]			Command ID code (CID)
+	[1..n-3]	Command parameters / response data
+	[n-2..n-1]	CRC16 of bytes [0..n-3], least significant byte first
+
+Received bytes are decoded straight into a single frame buffer allocated when
+the engine is created, and handlers read their parameters from that buffer in
+place, so no memory is allocated per message. Responses are SLIP encoded and
+checksummed as they are serialised, and written directly into the Com port's
+transmit ring without being assembled in an intermediate buffer.
+
+Every non-empty frame received produces exactly one response frame, in the
+order requests were received (frames that fail to decode are answered with a
+CID_ERROR response). This allows a host to pipeline requests back-to-back
+without waiting for each one to be acknowledged, and match up the responses
+by counting them. Frames are only decoded while the transmit ring has space
+for a response, so when the host sends faster than replies can be sent,
+further requests wait in the receive ring.
+
+Command handlers are found through a constant table of CID codes and member
+functions (see TCmdEngineEntry and CCmdEngine::Dispatch).
+
+09/03/2018 - Created v1.0 of file
+==============================================================================*/
+//Prevent multiple inclusions of this file
+#ifndef CMD_ENGINE_HPP
+#define CMD_ENGINE_HPP
+
+//Include system libraries
+#include <string.h>		//For memcpy function
+
+//Include common type definitions and macros
+#include "common.h"
+
+//Include helper classes
+#include "callback.hpp"
+#include "crc16.hpp"
+#include "serialize.hpp"
+
+//Include the com port commands are received through
+#include "com.hpp"
+
+//Include the service base class
+#include "service.hpp"
+
+//==============================================================================
+//General Definitions and Types
+//==============================================================================
+//SLIP framing characters
+#define CMD_SLIP_END					0xC0		/*!< Marks the end (and start) of a frame */
+#define CMD_SLIP_ESC					0xDB		/*!< Escapes the following character */
+#define CMD_SLIP_ESC_END				0xDC		/*!< Escaped value of CMD_SLIP_END */
+#define CMD_SLIP_ESC_ESC				0xDD		/*!< Escaped value of CMD_SLIP_ESC */
+
+#define CMD_FRAME_OVERHEAD				(1 + CRC16_LEN)		/*!< Number of bytes in a decoded frame that aren't parameters */
+
+#ifndef CMD_ENGINE_RX_CHUNK
+	#define CMD_ENGINE_RX_CHUNK			64			/*!< Number of bytes read from the Com port at once */
+#endif
+
+#ifndef CMD_ENGINE_SERVICE_FRAMES
+	#define CMD_ENGINE_SERVICE_FRAMES	8			/*!< Maximum number of frames executed each time the service is called */
+#endif
+
+#ifndef CMD_ENGINE_TX_RESERVE
+	#define CMD_ENGINE_TX_RESERVE		128			/*!< Free transmit ring space needed before a frame is executed */
+#endif
+
+//------------------------------------------------------------------------------
+/*! Defines the base type of a command processor ID code */
+typedef uint8 TCmdId;
+
+//Required command definitions
+//Define Command Processor ID Codes (CID)
+#define CID_READY						0x00	/*!< Response code send when bootloader is ready and an abort signal can be sent */
+#define CID_ERROR						0xFF	/*!< Command sent as a status response to unknown or incomplete commands, when a command decode error occurs */
+
+//Define Command Processor Status Codes (CST)
+#define CST_OK							0x00	/*!< Return when a function execution succeeds */
+#define CST_FAIL						0x01	/*!< Returned when a function execution fails (for generic reasons) */
+#define CST_CMD_ID_ERROR				0x02	/*!< Returned when a command cannot be found */
+#define CST_CMD_CHAR_ERROR				0x03	/*!< Returned when an invalid character is encountered when decoding a command */
+#define CST_CMD_OVERFLOW_ERROR			0x04	/*!< Returned when the received command exceeds the command storage length */
+#define CST_CMD_CSUM_ERROR				0x05	/*!< Returned when a commands checksum is invalid */
+#define CST_CMD_LENGTH_ERROR			0x06	/*!< Returned when the received command does not contain enough bytes of data in the payload */
+
+//------------------------------------------------------------------------------
+//Predeclare the command engine classes
+class CCmdEngine;
+class CCmdRxFrame;
+class CCmdTxFrame;
+
+/*! Define a pointer to a command engine */
+typedef CCmdEngine* PCmdEngine;
+
+/*! Define a pointer to a received command frame */
+typedef CCmdRxFrame* PCmdRxFrame;
+
+/*! Define a pointer to a response frame */
+typedef CCmdTxFrame* PCmdTxFrame;
+
+//------------------------------------------------------------------------------
+/*!
+Class that provides read access to the parameters of a received frame, in place
+in the engine's frame buffer.
+*/
+class CCmdRxFrame : public CSerialize {
+	private:
+		puint8 _data;						/*!< Pointer to the first parameter byte */
+		uint32 _len;						/*!< Number of parameter bytes */
+		uint32 _readIdx;					/*!< Index of the next byte to read */
+
+	public:
+		//Construction and disposal
+		CCmdRxFrame(puint8 data, uint32 len);
+
+		//Methods
+		bool AddData(puint8 data, uint16 len);
+		uint32 GetLength();
+		uint32 GetReadFree();
+		puint8 GetReadPtr(uint32 len);
+		bool ReadData(puint8 data, uint16 len);
+};
+
+//------------------------------------------------------------------------------
+/*!
+Class that SLIP encodes a response frame as it is serialised, writing it
+straight into a Com port's transmit ring with a running CRC.
+*/
+class CCmdTxFrame : public CSerialize {
+	private:
+		PCom _com;							/*!< Com port the frame is written to */
+		uint16 _crc;						/*!< CRC of the frame bytes written so far */
+
+		//Private Methods
+		void WriteEncoded(puint8 data, uint32 len);
+
+	public:
+		//Construction and disposal
+		CCmdTxFrame(PCom com, TCmdId id);
+
+		//Methods
+		bool AddData(puint8 data, uint16 len);
+		void End();
+		bool ReadData(puint8 data, uint16 len);
+};
+
+//------------------------------------------------------------------------------
+/*!
+Define a structure that is passed to methods/functions that are registered to
+handle commands. The struct contains necessary pointers/info to allow command execution
+*/
+struct TCmdEngineExecute {
+	PCmdEngine Engine;				/*!< Pointer to the engine that received the command */
+	PCmdRxFrame Msg;				/*!< Parameters of the received command */
+	TCmdId Id;						/*!< The ID code of the message being handled */
+	bool Handled;					/*!< Return flag that should be set to true to indicate the message was handled */
+};
+
+/*! Define a pointer to a command execution structure */
+typedef TCmdEngineExecute* PCmdEngineExecute;
+
+/*! Define a delegate type to handle execution of commands */
+typedef CCallback1<void, PCmdEngineExecute> CCmdEngineExecuteCallback;
+
+/*!
+Define an entry in a constant dispatch table, that maps a CID code to the member
+function of class T that handles it
+*/
+template <class T>
+struct TCmdEngineEntry {
+	TCmdId Id;										/*!< The ID code of the command */
+	void (T::*Handler)(PCmdEngineExecute params);	/*!< The member function that executes the command */
+};
+
+//==============================================================================
+//Class Definition...
+//==============================================================================
+/*!
+Class that implements a SLIP framed binary command engine as a service
+*/
+class CCmdEngine : public CService {
+	private:
+		typedef CService base;				/*!< Declare access to the parent class */
+
+		PCom _com;							/*!< Com port commands are received from and responses sent to */
+		puint8 _frame;						/*!< Buffer the current frame is decoded into */
+		uint32 _frameLen;					/*!< Number of bytes decoded into the frame buffer */
+		uint32 _frameSize;					/*!< Size of the frame buffer */
+		bool _frameEsc;						/*!< True if the last byte received was CMD_SLIP_ESC */
+		uint8 _frameStatus;					/*!< CST_OK, or the error found while decoding the current frame */
+		uint8 _rx[CMD_ENGINE_RX_CHUNK];		/*!< Bytes read from the Com port that haven't been decoded yet */
+		uint32 _rxIdx;						/*!< Index of the next byte in _rx to decode */
+		uint32 _rxLen;						/*!< Number of bytes held in _rx */
+
+		//Private Methods
+		bool Decode();
+		void Execute();
+
+	protected:
+		void DoDestroy();
+		bool DoService(bool timerEvent);
+		bool DoServiceStart();
+
+	public:
+		//Construction and Disposal
+		CCmdEngine(PCom com, uint32 frameSize);
+
+		//Methods
+		void Clear();
+		PCom GetCom();
+		uint32 GetFrameSize();
+		void SendError(uint8 error, uint8 data);
+		void SendStatus(TCmdId id, uint8 status);
+
+		//Static Methods
+		template <class T>
+		static bool Dispatch(T* obj, const TCmdEngineEntry<T>* table, uint32 count, PCmdEngineExecute params);
+
+		//Events
+		CCmdEngineExecuteCallback OnExecute;	/*!< Raised to execute each received command */
+};
+
+//==============================================================================
+//Template Implementation...
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that looks up the command being executed in a constant dispatch table,
+and calls its handler.
+@param obj Pointer to the object whose member functions handle the commands
+@param table Pointer to the dispatch table
+@param count The number of entries in the table
+@param params The command being executed
+@result True if the command was found in the table and executed
+*/
+template <class T>
+bool CCmdEngine::Dispatch(T* obj, const TCmdEngineEntry<T>* table, uint32 count, PCmdEngineExecute params)
+{
+	for(uint32 i = 0; i < count; i++) {
+		if(table[i].Id == params->Id) {
+			(obj->*table[i].Handler)(params);
+			return true;
+		}
+	}
+	return false;
+}
+
+//==============================================================================
+#endif
@@ -0,0 +1,227 @@
+/*==============================================================================
+Module that implements deferred binary logging.
+
+Rather than formatting text on the MCU, each DLOG_PRINT call site places its
+format string into the ".dlog_str" linker section (which is not loaded into
+the target), and only records the string's offset in that section as an ID,
+along with a timestamp and the raw argument values. These records are written
+into a RAM ring buffer, and the low priority CDlog service drains them as
+compact binary frames through a Com port (usually CCom::Terminal).
+
+The dlog_decode tool (in OculusHubMain/tools) reads the format strings back
+out of the ELF file and reconstructs the text on the host. Frames can be
+mixed with normal text output on the same port, as the decoder passes through
+any bytes that don't form a valid frame.
+
+Sharing the port: on the debug port the frames are mixed with COM_PRINT text
+and the command engine's SLIP frames. These never interleave, because:
+	- the service only writes whole frames, each in one block, and only once
+	  the port's transmit buffer has space for the whole frame, and
+	- text and SLIP frames are written from the main loop too, each in one call
+	  that completes before the service next runs.
+Entries logged from interrupt handlers only go into the ring, so interrupt
+handlers should use DLOG_PRINT rather than COM_PRINT, whose text could land
+part way through a frame.
+Log frames are escaped as SLIP frames are, so never contain a CMD_SLIP_END
+byte. To the SLIP host they are just bytes between the CMD_SLIP_END that
+ends one SLIP frame and the one that starts the next, which it discards (at
+worst as a frame that fails its CRC). The decoder in turn checks each frame's
+CRC16, so a DLOG_FRAME_SYNC byte inside a SLIP payload is only mistaken for
+the start of a frame about once in 65536, and never when the bytes that
+follow it contain a CMD_SLIP_END.
+
+Frame format, before escaping (all values little endian):
+	[0]		DLOG_FRAME_SYNC
+	[1]		Length of the argument data in bytes, with DLOG_FRAME_TRUNCATED set if
+			arguments were discarded because they didn't fit in the frame
+	[2..3]	Format string ID (offset into the .dlog_str section)
+	[4..7]	Low 32-bits of the SysTick counter when the entry was logged
+	[8..]	Argument data
+	[last-1..last]	CCrc16 of bytes [1..last-2]
+When sent, each DLOG_ESC_END (0xC0) byte is replaced by DLOG_ESC then
+DLOG_ESC_ESC_END, and each DLOG_ESC (0xDB) byte by DLOG_ESC then DLOG_ESC_ESC.
+
+Arguments are packed in the order they appear...
+	Integers and pointers of 32-bits or less	- 4 bytes
+	64-bit integers								- 8 bytes
+	float and double							- 8 bytes (as double)
+	Strings (char*)								- Length byte, then the characters (no terminator)
+The format string ID DLOG_ID_DROPPED is reserved for a frame containing a 4 byte
+count of entries discarded because the ring buffer was full.
+
+09/03/2018 - Created v1.0 of file
+==============================================================================*/
+//Prevent multiple inclusions of this file
+#ifndef DLOG_HPP
+#define DLOG_HPP
+
+//Include system libraries
+#include <string.h>		//For memcpy function
+
+//Include common type definitions and macros
+#include "common.h"
+#include "fifobuffer.hpp"
+#include "crc16.hpp"
+
+//Include the com port the log is drained through
+#include "com.hpp"
+
+//Include the system tick for entry time stamps
+#include "systick.hpp"
+
+//Include the service base class
+#include "service.hpp"
+
+//==============================================================================
+//General Definitions and Types
+//==============================================================================
+#define DLOG_FRAME_SYNC			0xD5		/*!< Byte that starts every frame */
+#define DLOG_FRAME_HEADER		8			/*!< Number of bytes before the argument data */
+#define DLOG_FRAME_ARGS_MAX		48			/*!< Maximum number of argument bytes in a frame, further arguments are discarded */
+#define DLOG_FRAME_CRC			CRC16_LEN	/*!< Number of bytes of CRC that end a frame */
+#define DLOG_FRAME_MAX			(DLOG_FRAME_HEADER + DLOG_FRAME_ARGS_MAX + DLOG_FRAME_CRC)
+#define DLOG_FRAME_SENT_MAX		(2 * DLOG_FRAME_MAX)	/*!< Maximum number of bytes a frame is sent as, once escaped */
+#define DLOG_FRAME_TRUNCATED	0x80		/*!< Flag in the frame length byte set if arguments were discarded */
+#define DLOG_STRING_MAX			32			/*!< Maximum number of characters stored for a string argument */
+#define DLOG_ID_DROPPED			0xFFFF		/*!< Format string ID reserved for a dropped entries frame */
+
+#define DLOG_ESC_END			0xC0		/*!< Byte escaped in sent frames, the command engine's CMD_SLIP_END */
+#define DLOG_ESC				0xDB		/*!< Byte that starts an escape, the command engine's CMD_SLIP_ESC */
+#define DLOG_ESC_ESC_END		0xDC		/*!< Escaped value of DLOG_ESC_END */
+#define DLOG_ESC_ESC			0xDD		/*!< Escaped value of DLOG_ESC */
+
+#ifndef DLOG_SERVICE_CHUNK
+	#define DLOG_SERVICE_CHUNK	64			/*!< Number of bytes drained from the ring each time the service is called, rounded up to whole frames */
+#endif
+
+/*!
+Macro that adds an entry to the deferred log.
+The format string must be a literal, and is checked against the arguments at
+compile time as though it were passed to printf.
+*/
+#define DLOG_PRINT(fmt, args...) \
+{ \
+	static const char _dlogFmt[] __attribute__((section(".dlog_str"), used)) = fmt; \
+	if(0) { CDlog::CheckFormat(fmt, ##args); } \
+	if(CDlog::Logger) { \
+		CDlog::Logger->Write(_dlogFmt, ##args); \
+	} \
+}
+
+//==============================================================================
+//Class Definition...
+//==============================================================================
+//Pre-declare the CDlog class
+class CDlog;
+
+/*! Define a pointer to a deferred log object */
+typedef CDlog* PDlog;
+
+/*!
+Class that implements a deferred binary log, and the service that drains it
+*/
+class CDlog : public CService {
+	private:
+		typedef CService base;				/*!< Declare access to the parent class */
+
+		PByteFifoBuffer _buffer;			/*!< Ring buffer holding encoded frames waiting to be sent */
+		PCom _com;							/*!< Com port frames are drained through */
+		uint32 _dropped;					/*!< Number of entries discarded since the last dropped frame was sent */
+
+		//Argument packing
+		static inline uint32 Pack(puint8 frame, uint32 len);
+		template<typename T, typename... TArgs>
+		static inline uint32 Pack(puint8 frame, uint32 len, T value, TArgs... args);
+		static uint32 PackArg(puint8 frame, uint32 len, int value);
+		static uint32 PackArg(puint8 frame, uint32 len, unsigned int value);
+		static uint32 PackArg(puint8 frame, uint32 len, long value);
+		static uint32 PackArg(puint8 frame, uint32 len, unsigned long value);
+		static uint32 PackArg(puint8 frame, uint32 len, long long value);
+		static uint32 PackArg(puint8 frame, uint32 len, unsigned long long value);
+		static uint32 PackArg(puint8 frame, uint32 len, double value);
+		static uint32 PackArg(puint8 frame, uint32 len, const char* value);
+		static uint32 PackArg(puint8 frame, uint32 len, const void* value);
+		static uint32 PackBytes(puint8 frame, uint32 len, const void* data, uint32 size);
+		static uint32 PackWord(puint8 frame, uint32 len, uint32 value);
+
+		//Private Methods
+		static uint32 Escape(puint8 out, puint8 frame, uint32 size);
+		void WriteFrame(const char* fmt, puint8 frame, uint32 len);
+
+	protected:
+		void DoDestroy();
+		bool DoService(bool timerEvent);
+
+	public:
+		//Construction and Disposal
+		CDlog(PCom com, uint32 capacity);
+
+		//Methods
+		void Clear();
+		uint32 GetCount();
+		uint32 GetDropped();
+		void SetCom(PCom com);
+		template<typename... TArgs>
+		void Write(const char* fmt, TArgs... args);
+
+		//Static Methods
+		static inline void CheckFormat(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+
+		//Static Variables
+		static PDlog Logger;				/*!< Global pointer to the log that DLOG_PRINT writes to */
+};
+
+//==============================================================================
+//Template Implementation...
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that is never called, but allows the compiler to check the arguments
+of DLOG_PRINT against its format string
+*/
+void CDlog::CheckFormat(const char* fmt, ...)
+{
+}
+
+/*!-----------------------------------------------------------------------------
+Function that terminates the recursion of packing arguments
+@param frame Pointer to the argument data area of the frame
+@param len The number of argument bytes already packed
+@result The number of argument bytes packed
+*/
+uint32 CDlog::Pack(puint8 frame, uint32 len)
+{
+	return len;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that packs the first argument into the frame, then recurses to pack
+the remaining arguments
+@param frame Pointer to the argument data area of the frame
+@param len The number of argument bytes already packed
+@param value The argument to pack
+@param args The remaining arguments to pack
+@result The number of argument bytes packed
+*/
+template<typename T, typename... TArgs>
+uint32 CDlog::Pack(puint8 frame, uint32 len, T value, TArgs... args)
+{
+	len = CDlog::PackArg(frame, len, value);
+	return CDlog::Pack(frame, len, args...);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that adds an entry to the log, packing the arguments into a frame.
+This is safe to call from interrupt handlers.
+@param fmt Pointer to the format string, which must be in the .dlog_str section
+@param args The arguments referenced by the format string
+*/
+template<typename... TArgs>
+void CDlog::Write(const char* fmt, TArgs... args)
+{
+	uint8 frame[DLOG_FRAME_MAX];
+	uint32 len = CDlog::Pack(frame + DLOG_FRAME_HEADER, 0, args...);
+	this->WriteFrame(fmt, frame, len);
+}
+
+//==============================================================================
+#endif
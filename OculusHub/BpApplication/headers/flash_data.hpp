@@ -41,13 +41,32 @@ struct TFlashDataHeader {
 	EFlashDataState State;	/*! The programming state of the following data (must be 8 bytes long) */
 	uint32 NextHeader;		/*! The address of the next header, or free programming location, on an 8-byte boundary - i.e. a linked list */
 	uint16 Length;			/*! The number of bytes in the following data record */
-	uint16 Checksum;		/*! The 16 bit CRC checksum of the following data record */
+	uint16 Checksum;		/*! Zero, with the CRC held in the TFlashDataCheck record, or the 16 bit CRC checksum of the following data record */
 };
 #pragma pack()
 
 /*! Define a pointer to a FTFL data header */
 typedef TFlashDataHeader* PFlashDataHeader;
 
+#define FDATA_CHECK_MAGIC	0x4B484346		/*!< Value ("FCHK") that marks a check record */
+
+/*! Record that follows the data of each record (padded to an 8-byte boundary),
+holding the CRC of the data. Firmware built before it was added reads the
+header's Checksum as zero, and never reads past the data, so still reads
+records with one (see CFlashData).
+This record MUST be one programming phrase (8 bytes) long.
+*/
+#pragma pack(8)
+struct TFlashDataCheck {
+	uint32 Magic;			/*! FDATA_CHECK_MAGIC */
+	uint16 Checksum;		/*! The 16 bit CRC checksum of the data record */
+	uint16 ChecksumInv;		/*! The checksum inverted, confirming this is a check record */
+};
+#pragma pack()
+
+/*! Define a pointer to a data record check */
+typedef TFlashDataCheck* PFlashDataCheck;
+
 /*! Enumeration specifying return codes from FlashData functions */
 enum EFlashDataReturn {
 	FDATA_OK = 0,
@@ -67,6 +86,17 @@ space in multiples of sectors (the minimum unit of flash erasure), then writes
 a header strut followed by the data into the flash. When the flash is changed,
 the header is invalidated, and a new header+data block appended, until the flash
 becomes full - at which point it is erased, and storage starts again.
+The storage area can also be erased in the background with EraseAsync, in which
+case reads and writes wait for the erase to finish.
+
+Firmware built before the CRC16 tables were generated at compile time never
+initialised them, so stored a Checksum of zero in every header, and only reads
+records whose header Checksum is zero. Records are therefore written with a
+zero header Checksum and their CRC in a TFlashDataCheck record after the data,
+which NextHeader skips, so that firmware (such as a fielded bootloader) still
+reads them. Records found without a check record were written by that
+firmware, so are read unchecked, and rewritten with one when the storage is
+opened.
 */
 class CFlashData {
 	private:
@@ -86,10 +116,12 @@ class CFlashData {
 		uint32	_storeSize;			//Length of data storage area, in bytes
 		uint32	_readAddr;			//Address of where valid data can be read from, 0 for invalid data
 		uint16	_readLength;		//The number of bytes valid data to be read occupies, 0 for invalid data
+		bool	_readChecked;		//True if the data to be read was checked against its CRC
 
 		//Private methods
 		bool EraseCheck();
-		EFlashDataReturn FindActiveRecord(puint32 dataAddr);
+		EFlashDataReturn FindActiveRecord(puint32 dataAddr, pbool checked = NULL);
+		PFlashDataCheck GetCheck(uint32 addr);
 		EFlashDataReturn ReadFind();
 
 	public:
@@ -99,7 +131,9 @@ class CFlashData {
 
 		//Methods
 		bool Erase();
+		bool EraseAsync(PFlashJobCallback onDone = NULL);
 		uint16 GetReadLength();
+		bool IsBusy();
 		uint16 Read(pointer destData, uint16 maxLength = 0);
 		template <typename T> int32 ReadType(T* destData);
 		bool Write(pointer srcData, uint16 length);
@@ -1,6 +1,39 @@
 /*==============================================================================
 Module that uses the low level FTFL device to impliment a In-Circuit application
 programmer.
+
+Compressed programs (see lz.hpp) are decompressed as blocks are programmed, in
+sequence order, through a FLASH_PROG_LZ_WINDOW byte window. The program length,
+checksum and hash all describe the decompressed program.
+
+Delta programs (see delta.hpp) are patches against the program already in the
+section being programmed, and are only applied if they were made against the
+program whose checksum was recorded when it was last updated. They are
+normally compressed, as most of a patch is zero bytes. The program length,
+checksum and hash describe the new program the patch rebuilds.
+
+Data is programmed into scratch memory in the background, so the link and the
+flash controller work at the same time. Each block is decoded and added to the
+checksum and hash, then gathered into one of two FLASH_PROG_STAGE_SIZE staging
+buffers. Each full buffer is queued as a background program job, and the next
+blocks are gathered into the other buffer while it's programmed. Blocks are
+acknowledged once they've been staged. If a background job fails, the next
+block (or ProgUpdate) reports the flash error. ProgUpdate programs the last
+part-filled buffer and waits for programming to finish before checking the
+program.
+
+UpdateCopy records each sector of the destination it finishes by programming a
+phrase of the progress map at FLASH_PROGDONE_START, which ProgUpdate erases
+before recording the update. An interrupted copy resumes from there, and the
+program information store (which is erased when full) is only written before
+and after the copy.
+
+With FLASH_SWAP_ENABLE set, scratch memory is the main program's place in the
+inactive half of flash. ProgUpdate copies the rest of the active half across
+and swaps the halves, so the new program runs at the next reset without being
+copied. The new program is on trial until it calls SwapConfirm, and if it is
+reset FLASH_SWAP_TRIAL_BOOTS times without doing so, SwapBootCheck swaps back
+to the previous program.
 ==============================================================================*/
 //Prevent multiple inclusions of this file
 #ifndef FLASH_PROG_HPP
@@ -8,6 +41,8 @@ programmer.
 
 //Include system libraries
 #include <stdio.h>		//For snprintf function
+#include <string.h>		//For memcpy function
+#include <stddef.h>		//For offsetof macro
 
 //Include common type definitions and macros
 #include "common.h"
@@ -18,6 +53,8 @@ programmer.
 #include "callback.hpp"
 #include "sha1.hpp"
 #include "tea.hpp"
+#include "lz.hpp"
+#include "delta.hpp"
 #include "serialize.hpp"
 
 //Include the Flash access device
@@ -55,12 +92,85 @@ programmer.
 //==============================================================================
 //General Definitions and Types
 //==============================================================================
-/*! Enumeration that describes how data will be presented when blocks are received */
+#ifndef FLASH_PROG_WINDOW_SLOTS
+	#define FLASH_PROG_WINDOW_SLOTS		4					/*!< Number of out-of-order blocks that can be staged in RAM during a windowed transfer */
+#endif
+
+#ifndef FLASH_PROG_WINDOW_BLOCK_MAX
+	#define FLASH_PROG_WINDOW_BLOCK_MAX	FLASH_SECTOR_SIZE	/*!< Maximum number of bytes in a windowed transfer block */
+#endif
+
+#ifndef FLASH_PROG_ERASE_AHEAD
+	#define FLASH_PROG_ERASE_AHEAD		FLASH_SECTOR_SIZE	/*!< Number of bytes past the programming address that scratch memory is erased ahead in the background */
+#endif
+
+#ifndef FLASH_PROG_STAGE_SIZE
+	#define FLASH_PROG_STAGE_SIZE		FLASH_SECTOR_SIZE	/*!< Number of bytes gathered in each staging buffer before it's programmed in the background */
+#endif
+
+#ifndef FLASH_PROG_LZ_WINDOW
+	#define FLASH_PROG_LZ_WINDOW		FLASH_SECTOR_SIZE	/*!< Number of bytes in the window compressed programs are decompressed through, which the compressor must match */
+#endif
+
+#ifndef FLASH_PROG_DELTA_BUFFER
+	#define FLASH_PROG_DELTA_BUFFER		0x400				/*!< Number of bytes delta programs are rebuilt in before they're programmed */
+#endif
+
+#ifndef FLASH_SWAP_ENABLE
+	#define FLASH_SWAP_ENABLE			false				/*!< True to update firmware by swapping halves of flash, rather than copying scratch memory */
+#endif
+
+#ifndef FLASH_SWAP_TRIAL_BOOTS
+	#define FLASH_SWAP_TRIAL_BOOTS		3					/*!< Number of times a swapped in program may boot without confirming itself before swapping back */
+#endif
+
+#ifndef FLASH_PROGDONE_START
+	PRAGMA_ERROR("The FLASH_PROGDONE_START definition must specify a sector reserved for recording the progress of update copies.")
+#endif
+
+#if (((FLASH_SCRATCH_SIZE / FLASH_SECTOR_SIZE) * FLASH_PHRASE_SIZE) > FLASH_PROGDONE_SIZE)
+	PRAGMA_ERROR("FLASH_PROGDONE_SIZE must hold a flash phrase for each sector of scratch memory.")
+#endif
+
+#if FLASH_SWAP_ENABLE
+	#ifndef FLASH_SWAP_INDICATOR_ADDR
+		PRAGMA_ERROR("The FLASH_SWAP_INDICATOR_ADDR definition must specify a sector in the lower half of flash reserved for the swap indicator.")
+	#endif
+	#if (FLASH_SCRATCH_START != (FLASH_MAIN_START + FLASH_HALF_SIZE))
+		PRAGMA_ERROR("FLASH_SCRATCH_START must be the main program's address in the upper half of flash, when FLASH_SWAP_ENABLE is set.")
+	#endif
+#endif
+
+#if (FLASH_PROG_LZ_WINDOW > FLASH_SECTOR_SIZE) || (FLASH_PROG_LZ_WINDOW < FLASH_PHRASE_SIZE) || (FLASH_PROG_LZ_WINDOW & (FLASH_PROG_LZ_WINDOW - 1))
+	PRAGMA_ERROR("FLASH_PROG_LZ_WINDOW must be a power of 2, between the flash phrase and sector sizes.")
+#endif
+
+#if (FLASH_PROG_DELTA_BUFFER > FLASH_SECTOR_SIZE) || (FLASH_PROG_DELTA_BUFFER < FLASH_PHRASE_SIZE) || (FLASH_PROG_DELTA_BUFFER % FLASH_PHRASE_SIZE)
+	PRAGMA_ERROR("FLASH_PROG_DELTA_BUFFER must be a multiple of the flash phrase size, up to the sector size.")
+#endif
+
+#if (FLASH_PROG_STAGE_SIZE < FLASH_PHRASE_SIZE) || (FLASH_PROG_STAGE_SIZE % FLASH_PHRASE_SIZE)
+	PRAGMA_ERROR("FLASH_PROG_STAGE_SIZE must be a multiple of the flash phrase size, so each staging buffer is programmed from a phrase boundary.")
+#endif
+
+#if (FLASH_PROG_WINDOW_SLOTS > 32)
+	PRAGMA_ERROR("FLASH_PROG_WINDOW_SLOTS must be 32 or less, so the staged blocks can be acknowledged in a 32-bit map.")
+#endif
+
+/*! Number of staging buffers data is programmed from, one being filled while the other is programmed */
+#define FLASH_PROG_STAGES				2
+
+/*! Enumeration that describes how data will be presented when blocks are received.
+Each format is a combination of the compressed, encrypted and delta bits. */
 enum EFlashProgDataFormat {
 	FPROG_DATA_BINARY = 0x00,		/*!< Data is in its raw binary form */
-	FPROG_DATA_COMPRESSED = 0x01,	/*!< Data is compressed */
+	FPROG_DATA_COMPRESSED = 0x01,	/*!< Data is compressed, using the LZ scheme in lz.hpp */
 	FPROG_DATA_ENCRYPTED = 0x02,	/*!< Data is encrypted, using the XXTEA algorithm */
-	FPROG_DATA_ENCCOMP = 0x03		/*!< Data is encrypted and compressed */
+	FPROG_DATA_ENCCOMP = 0x03,		/*!< Data is encrypted and compressed */
+	FPROG_DATA_DELTA = 0x04,		/*!< Data is a patch against the installed program, using the scheme in delta.hpp */
+	FPROG_DATA_COMPDELTA = 0x05,	/*!< Data is a compressed patch */
+	FPROG_DATA_ENCDELTA = 0x06,		/*!< Data is an encrypted patch */
+	FPROG_DATA_ENCCOMPDELTA = 0x07	/*!< Data is an encrypted and compressed patch */
 };
 
 //------------------------------------------------------------------------------
@@ -154,16 +264,28 @@ struct TFlashProgFirmwareInfo {
 	}
 };
 
+//------------------------------------------------------------------------------
+/*! Record that tracks if the program swapped in by the last update has
+confirmed it runs correctly (when FLASH_SWAP_ENABLE is set) */
+struct TFlashProgSwapInfo {
+	bool	Trial;		//True until the swapped in program has confirmed it runs
+	uint8	Boots;		//The number of times the program has booted while on trial
+};
+
 /*!
 Record that defines the identity information stored about the current
 firmware configuration.
 This status is typically stored in the upper sector of Flash and used by the
 firmware programming system.
+The layout is the same whatever the configuration, and new fields are only
+added at the end, so records stored by firmware built before or after them
+still line up (see ReadInfo).
 */
 struct TFlashProgInfo {
 	TFlashProgUpdateInfo FlashUpdate;		//Flash updater information
 	//TFlashProgHardwareInfo Hardware;		//Hardware information
 	TFlashProgFirmwareInfo Firmware[2];		//Firmware Sections
+	TFlashProgSwapInfo Swap;				//Trial state of the program swapped in (only used when FLASH_SWAP_ENABLE is set)
 };
 
 /*! Define a pointer for a Flash Program Device Info record */
@@ -216,7 +338,9 @@ enum EFlashProgReturn {
 	FPROG_CHECKSUM_ERROR,
 	FPROG_HASH_ERROR,
 	FPROG_COPY_NOW,
-	FPROG_REBOOT_NOW
+	FPROG_REBOOT_NOW,
+	FPROG_WINDOW_ERROR,
+	FPROG_DATA_ERROR
 };
 
 //==============================================================================
@@ -235,9 +359,39 @@ class CFlashProg {
 		uint32		_scratchAddr;
 		uint32		_scratchLength;
 		uint32		_scratchChecksum;
+		CSha1Context _scratchHash;								/*!< SHA1 hash of the data programmed into scratch memory */
+		puint8		_slotData;								/*!< Staging memory for blocks received ahead of the next expected block, or NULL until one is */
+		uint16		_slotLength[FLASH_PROG_WINDOW_SLOTS];	/*!< Length of the block held in each slot, or zero if the slot is empty */
+		uint16		_slotSeq[FLASH_PROG_WINDOW_SLOTS];		/*!< Sequence number of the block held in each slot */
+		puint8		_stageData;								/*!< Staging buffers data is gathered in, and programmed into scratch memory from */
+		uint8		_stage;									/*!< Index of the staging buffer being filled */
+		uint32		_stageLength;							/*!< Number of bytes in the staging buffer being filled */
+		volatile uint8 _stageQueued;						/*!< Number of staging buffers queued to be programmed in the background */
+		CFlashJobCallback _jobDone;							/*!< Callback raised when each background erase or program of scratch memory finishes */
+		volatile EFlashReturn _jobResult;					/*!< Result of the first background erase or program of scratch memory to fail, or FLASH_OK */
+		uint32		_eraseAddr;								/*!< Address scratch memory has been erased (or queued for erasing) up to */
+		uint32		_eraseEnd;								/*!< Address the program ends at, beyond which scratch memory is only erased if programmed */
+		PLzDecoder	_lz;									/*!< Decoder for compressed programs, or NULL if the transfer isn't compressed */
+		PDeltaDecoder _delta;								/*!< Decoder for delta programs, or NULL if the transfer isn't a delta */
 
 		//Private Methods
 		void DoAction(EFlashProgAction action);
+		void JobDoneEvent(PFlashJob job);
+		EFlashProgReturn ProgDecode(uint16 seq, puint8 data, uint16 length);
+		EFlashReturn ProgErase(uint32 addr, bool wait = true);
+		EFlashReturn ProgEraseAhead();
+		EFlashReturn ProgFlush();
+		EFlashReturn ProgStage();
+		EFlashProgReturn ProgWrite(puint8 data, uint16 length);
+		EFlashProgReturn ProgWriteData(puint8 data, uint16 length);
+		EFlashProgReturn ProgWriteDelta(puint8 data, uint32 length);
+		#if FLASH_SWAP_ENABLE
+		bool UpdateSwap();
+		bool UpdateSwapCopy(uint32 addr, uint32 size);
+		#endif
+		bool UpdateCompare(uint32 destAddr, uint32 srcAddr, uint32 length);
+		uint32 UpdateDoneRead();
+		bool UpdateDoneMark(uint32 offset);
 
 	public:
 		//Construction and Disposal
@@ -245,13 +399,18 @@ class CFlashProg {
 		~CFlashProg();
 
 		//Methods
+		bool IsBusy();
 		EFlashProgReturn ProgInit(PFlashProgInit init);
 		void ProgReset();
 		EFlashProgReturn ProgScratch(puint8 data, uint16 length);
-		EFlashProgReturn ProgUpdate();
+		EFlashProgReturn ProgScratchBlock(uint16 seq, puint8 data, uint16 length);
+		void ProgWindowAck(puint16 next, puint32 staged);
+		EFlashProgReturn ProgUpdate(puint8 hash = NULL);
 		void SetHardwareInfo(PFlashProgHardwareInfo value);
 		bool ReadInfo(PFlashProgInfo info);
 		bool WriteInfo(PFlashProgInfo info);
+		bool SwapBootCheck();
+		bool SwapConfirm();
 		bool UnsecureBackdoor();
 		bool UpdateClear();
 		bool UpdateCopy();
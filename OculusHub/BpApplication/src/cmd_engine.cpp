@@ -0,0 +1,370 @@
+#include "cmd_engine.hpp"
+
+//==============================================================================
+//Class Implementation...
+//==============================================================================
+//CCmdRxFrame
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Constructor for a view of the parameters of a received frame
+@param data Pointer to the first parameter byte
+@param len The number of parameter bytes
+*/
+CCmdRxFrame::CCmdRxFrame(puint8 data, uint32 len)
+{
+	_data = data;
+	_len = len;
+	_readIdx = 0;
+}
+
+/*!-----------------------------------------------------------------------------
+Received frames are read only, so data can't be added
+*/
+bool CCmdRxFrame::AddData(puint8 data, uint16 len)
+{
+	return false;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns the number of parameter bytes in the frame
+*/
+uint32 CCmdRxFrame::GetLength()
+{
+	return _len;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns the number of parameter bytes that haven't been read yet
+*/
+uint32 CCmdRxFrame::GetReadFree()
+{
+	return _len - _readIdx;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns a pointer to the next parameter bytes in the frame buffer,
+so they can be used without copying them, and advances past them.
+The bytes may be modified in place by the caller.
+@param len The number of bytes that will be accessed
+@result Pointer to the bytes, or NULL if fewer than len bytes remain
+*/
+puint8 CCmdRxFrame::GetReadPtr(uint32 len)
+{
+	if(len > (_len - _readIdx))
+		return NULL;
+
+	puint8 ptr = _data + _readIdx;
+	_readIdx += len;
+	return ptr;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that copies the next parameter bytes out of the frame
+@param data Pointer to where the bytes should be copied
+@param len The number of bytes to read
+@result False if fewer than len bytes remain
+*/
+bool CCmdRxFrame::ReadData(puint8 data, uint16 len)
+{
+	puint8 ptr = this->GetReadPtr(len);
+	if(!ptr)
+		return false;
+
+	memcpy(data, ptr, len);
+	return true;
+}
+
+//==============================================================================
+//CCmdTxFrame
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Constructor that starts a response frame, writing its start marker and ID code
+@param com Pointer to the com port the frame is written to
+@param id The ID code of the response
+*/
+CCmdTxFrame::CCmdTxFrame(PCom com, TCmdId id)
+{
+	uint8 end = CMD_SLIP_END;
+
+	_com = com;
+	_crc = 0;
+
+	_com->WriteBlock(&end, 1);
+	this->AddData(&id, 1);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that adds bytes to the response, updating the CRC and writing them
+straight to the com port
+@param data Pointer to the bytes to add
+@param len The number of bytes to add
+@result Always true, as the frame length isn't limited
+*/
+bool CCmdTxFrame::AddData(puint8 data, uint16 len)
+{
+	_crc = CCrc16::Calc(data, 0, len, _crc);
+	this->WriteEncoded(data, len);
+	return true;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that completes the response, writing its CRC and end marker.
+No more data should be added after this is called.
+*/
+void CCmdTxFrame::End()
+{
+	uint8 crc[CRC16_LEN] = { (uint8)_crc, (uint8)(_crc >> 8) };
+	uint8 end = CMD_SLIP_END;
+
+	this->WriteEncoded(crc, CRC16_LEN);
+	_com->WriteBlock(&end, 1);
+}
+
+/*!-----------------------------------------------------------------------------
+Response frames are write only, so data can't be read
+*/
+bool CCmdTxFrame::ReadData(puint8 data, uint16 len)
+{
+	return false;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that SLIP encodes bytes onto the com port. Runs of bytes that don't
+need escaping are written as a single block.
+@param data Pointer to the bytes to write
+@param len The number of bytes to write
+*/
+void CCmdTxFrame::WriteEncoded(puint8 data, uint32 len)
+{
+	uint8 esc[2] = { CMD_SLIP_ESC, 0 };
+	uint32 run = 0;
+
+	for(uint32 i = 0; i < len; i++) {
+		uint8 ch = data[i];
+		if((ch == CMD_SLIP_END) || (ch == CMD_SLIP_ESC)) {
+			if(i > run)
+				_com->WriteBlock(data + run, i - run);
+			esc[1] = (ch == CMD_SLIP_END) ? CMD_SLIP_ESC_END : CMD_SLIP_ESC_ESC;
+			_com->WriteBlock(esc, 2);
+			run = i + 1;
+		}
+	}
+
+	if(len > run)
+		_com->WriteBlock(data + run, len - run);
+}
+
+//==============================================================================
+//CCmdEngine
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Constructor for the command engine
+@param com Pointer to the com port commands are received from and responses sent to
+@param frameSize The size of the largest decoded frame (including the ID code and CRC) that can be received
+*/
+CCmdEngine::CCmdEngine(PCom com, uint32 frameSize)
+{
+	_com = com;
+	_frame = new uint8[frameSize];
+	_frameSize = frameSize;
+
+	this->Clear();
+}
+
+/*!-----------------------------------------------------------------------------
+Function that discards any partially decoded frame, and bytes read from the
+com port that haven't been decoded yet
+*/
+void CCmdEngine::Clear()
+{
+	_frameLen = 0;
+	_frameEsc = false;
+	_frameStatus = CST_OK;
+	_rxIdx = 0;
+	_rxLen = 0;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that decodes received bytes into the frame buffer, until the end of
+a frame is found or there are no more bytes to decode. Empty frames (such as
+between back-to-back end markers) are skipped.
+@result True if a complete frame has been decoded
+*/
+bool CCmdEngine::Decode()
+{
+	for(;;) {
+		//Read the next chunk of bytes from the com port
+		if(_rxIdx >= _rxLen) {
+			_rxIdx = 0;
+			_rxLen = _com->ReadBlock(_rx, CMD_ENGINE_RX_CHUNK);
+			if(_rxLen == 0)
+				return false;
+		}
+
+		while(_rxIdx < _rxLen) {
+			uint8 ch = _rx[_rxIdx];
+			_rxIdx++;
+
+			if(ch == CMD_SLIP_END) {
+				if((_frameLen > 0) || (_frameStatus != CST_OK))
+					return true;
+				else
+					continue;
+			}
+			else if(_frameEsc) {
+				_frameEsc = false;
+				if(ch == CMD_SLIP_ESC_END)
+					ch = CMD_SLIP_END;
+				else if(ch == CMD_SLIP_ESC_ESC)
+					ch = CMD_SLIP_ESC;
+				else
+					_frameStatus = CST_CMD_CHAR_ERROR;
+			}
+			else if(ch == CMD_SLIP_ESC) {
+				_frameEsc = true;
+				continue;
+			}
+
+			if(_frameLen < _frameSize) {
+				_frame[_frameLen] = ch;
+				_frameLen++;
+			}
+			else if(_frameStatus == CST_OK) {
+				_frameStatus = CST_CMD_OVERFLOW_ERROR;
+			}
+		}
+	}
+}
+
+/*!-----------------------------------------------------------------------------
+Function called when the service is destroyed to release resources
+*/
+void CCmdEngine::DoDestroy()
+{
+	delete[] _frame;
+
+	base::DoDestroy();
+}
+
+/*!-----------------------------------------------------------------------------
+Function called to service the engine, that decodes and executes any complete
+frames that have been received, up to CMD_ENGINE_SERVICE_FRAMES per call.
+Frames are only executed while the transmit buffer has space for a response,
+so the service doesn't stall the main loop waiting for the port to transmit.
+@param timerEvent True if the service interval timer has expired
+@result True if any frames were executed
+*/
+bool CCmdEngine::DoService(bool timerEvent)
+{
+	uint32 frames = 0;
+
+	if(!_com->IsOpen())
+		return false;
+
+	while(frames < CMD_ENGINE_SERVICE_FRAMES) {
+		if(_com->GetTxBufferFree() < CMD_ENGINE_TX_RESERVE)
+			break;
+		if(!this->Decode())
+			break;
+
+		this->Execute();
+		frames++;
+	}
+
+	return (frames > 0);
+}
+
+/*!-----------------------------------------------------------------------------
+Function called when the service is started, that discards any partial frame
+*/
+bool CCmdEngine::DoServiceStart()
+{
+	this->Clear();
+	return base::DoServiceStart();
+}
+
+/*!-----------------------------------------------------------------------------
+Function that checks the decoded frame and raises the OnExecute event to
+execute it, then prepares for the next frame. If the frame can't be executed,
+or isn't handled, an error response is sent in its place.
+*/
+void CCmdEngine::Execute()
+{
+	uint8 status = _frameStatus;
+
+	//Check the frame length and CRC
+	if((status == CST_OK) && (_frameLen < CMD_FRAME_OVERHEAD)) {
+		status = CST_CMD_LENGTH_ERROR;
+	}
+	else if(status == CST_OK) {
+		uint32 len = _frameLen - CRC16_LEN;
+		uint16 crc = (uint16)(_frame[len] | (_frame[len + 1] << 8));
+		if(CCrc16::Calc(_frame, 0, len) != crc)
+			status = CST_CMD_CSUM_ERROR;
+	}
+
+	if(status == CST_OK) {
+		CCmdRxFrame msg(_frame + 1, _frameLen - CMD_FRAME_OVERHEAD);
+		TCmdEngineExecute params;
+		params.Engine = this;
+		params.Msg = &msg;
+		params.Id = _frame[0];
+		params.Handled = false;
+
+		this->OnExecute.Call(&params);
+
+		if(!params.Handled)
+			this->SendError(CST_CMD_ID_ERROR, params.Id);
+	}
+	else {
+		this->SendError(status, (_frameLen > 0) ? _frame[0] : 0);
+	}
+
+	//Start the next frame
+	_frameLen = 0;
+	_frameEsc = false;
+	_frameStatus = CST_OK;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns the com port the engine communicates through
+*/
+PCom CCmdEngine::GetCom()
+{
+	return _com;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns the size of the largest frame that can be received
+*/
+uint32 CCmdEngine::GetFrameSize()
+{
+	return _frameSize;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that sends a CID_ERROR response
+@param error The CST code of the error
+@param data The ID code of the frame that caused the error
+*/
+void CCmdEngine::SendError(uint8 error, uint8 data)
+{
+	CCmdTxFrame tx(_com, CID_ERROR);
+	tx.AddUint8(error);
+	tx.AddUint8(data);
+	tx.End();
+}
+
+/*!-----------------------------------------------------------------------------
+Function that sends a response containing just a status code
+@param id The ID code of the command being responded to
+@param status The CST code to send
+*/
+void CCmdEngine::SendStatus(TCmdId id, uint8 status)
+{
+	CCmdTxFrame tx(_com, id);
+	tx.AddUint8(status);
+	tx.End();
+}
+
+//==============================================================================
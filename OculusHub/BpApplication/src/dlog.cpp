@@ -0,0 +1,328 @@
+#include "dlog.hpp"
+
+//==============================================================================
+//Class Implementation...
+//==============================================================================
+//CDlog
+//==============================================================================
+/*! Pointer to the log that DLOG_PRINT writes entries to */
+PDlog CDlog::Logger = NULL;
+
+/*!-----------------------------------------------------------------------------
+Constructor for the deferred log, that also makes it the global Logger
+@param com Pointer to the com port that frames are drained through
+@param capacity The size of the ring buffer holding frames, in bytes
+*/
+CDlog::CDlog(PCom com, uint32 capacity)
+{
+	_buffer = new CByteFifoBuffer(capacity);
+	_com = com;
+	_dropped = 0;
+
+	//Make this the log DLOG_PRINT writes to
+	CDlog::Logger = this;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that discards all entries waiting to be sent
+*/
+void CDlog::Clear()
+{
+	IRQ_DISABLE;
+	_buffer->Clear();
+	_dropped = 0;
+	IRQ_ENABLE;
+}
+
+/*!-----------------------------------------------------------------------------
+Function called when the service is destroyed to release resources
+*/
+void CDlog::DoDestroy()
+{
+	if(CDlog::Logger == this)
+		CDlog::Logger = NULL;
+
+	delete _buffer;
+
+	base::DoDestroy();
+}
+
+/*!-----------------------------------------------------------------------------
+Function called to service the log, which drains whole frames from the ring
+buffer through the com port, up to DLOG_SERVICE_CHUNK bytes on each call (or
+one frame, if larger), so the service doesn't stall the main loop when there
+is a large backlog.
+Each frame is escaped, then written to the port in one block, and only once
+the port has space for all of it, so frames are never split by other output
+sharing the port (see dlog.hpp).
+@param timerEvent True if the service interval timer has expired
+@result True if any bytes were sent
+*/
+bool CDlog::DoService(bool timerEvent)
+{
+	if(!_com || !_com->IsOpen())
+		return false;
+
+	//Report any entries that were dropped, once there is space for them again
+	if(_dropped && (_buffer->GetFree() >= (DLOG_FRAME_HEADER + 4 + DLOG_FRAME_CRC))) {
+		uint8 frame[DLOG_FRAME_MAX];
+		uint32 dropped;
+		IRQ_DISABLE;
+		dropped = _dropped;
+		_dropped = 0;
+		IRQ_ENABLE;
+
+		CDlog::PackWord(frame + DLOG_FRAME_HEADER, 0, dropped);
+		this->WriteFrame(NULL, frame, 4);
+	}
+
+	//Move whole frames into the com port
+	uint32 sent = 0;
+	while(sent < DLOG_SERVICE_CHUNK) {
+		uint8 frame[DLOG_FRAME_MAX];
+		uint8 out[DLOG_FRAME_SENT_MAX];
+		uint32 size = 0;
+		uint8 len;
+
+		//Frames are only ever added whole, so the ring always starts with a
+		//frame header, and the length byte gives the size of the frame. Only
+		//the service removes frames, so the first is copied out, and only
+		//removed once the port has space for it escaped
+		IRQ_DISABLE;
+		if(_buffer->Peek(&len, 1)) {
+			size = DLOG_FRAME_HEADER + (len & ~DLOG_FRAME_TRUNCATED) + DLOG_FRAME_CRC;
+			if(_com->GetTxBufferFree() >= size) {
+				for(uint32 idx = 0; idx < size; idx++)
+					_buffer->Peek(&frame[idx], idx);
+			}
+			else
+				size = 0;
+		}
+		IRQ_ENABLE;
+
+		if(size == 0)
+			break;
+
+		uint32 count = CDlog::Escape(out, frame, size);
+		if(_com->GetTxBufferFree() < count)
+			break;
+
+		IRQ_DISABLE;
+		_buffer->Discard(size);
+		IRQ_ENABLE;
+
+		_com->WriteBlock(out, count);
+		sent += count;
+	}
+
+	return (sent > 0);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that escapes a frame for sending, so it contains no DLOG_ESC_END bytes
+@param out Pointer to the buffer to fill, of at least twice the frame size
+@param frame Pointer to the frame
+@param size The number of bytes in the frame
+@result The number of bytes the frame is sent as
+*/
+uint32 CDlog::Escape(puint8 out, puint8 frame, uint32 size)
+{
+	uint32 count = 0;
+	for(uint32 idx = 0; idx < size; idx++) {
+		uint8 value = frame[idx];
+		if(value == DLOG_ESC_END) {
+			out[count++] = DLOG_ESC;
+			out[count++] = DLOG_ESC_ESC_END;
+		}
+		else if(value == DLOG_ESC) {
+			out[count++] = DLOG_ESC;
+			out[count++] = DLOG_ESC_ESC;
+		}
+		else {
+			out[count++] = value;
+		}
+	}
+	return count;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns the number of bytes waiting to be sent, before escaping
+*/
+uint32 CDlog::GetCount()
+{
+	return _buffer->GetCount();
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns the number of entries discarded because the ring buffer
+was full, that haven't been reported yet
+*/
+uint32 CDlog::GetDropped()
+{
+	return _dropped;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that packs a signed integer argument
+*/
+uint32 CDlog::PackArg(puint8 frame, uint32 len, int value)
+{
+	return CDlog::PackWord(frame, len, (uint32)value);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that packs an unsigned integer argument
+*/
+uint32 CDlog::PackArg(puint8 frame, uint32 len, unsigned int value)
+{
+	return CDlog::PackWord(frame, len, (uint32)value);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that packs a signed long argument, which is 32-bits on the target
+*/
+uint32 CDlog::PackArg(puint8 frame, uint32 len, long value)
+{
+	return CDlog::PackWord(frame, len, (uint32)value);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that packs an unsigned long argument, which is 32-bits on the target
+*/
+uint32 CDlog::PackArg(puint8 frame, uint32 len, unsigned long value)
+{
+	return CDlog::PackWord(frame, len, (uint32)value);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that packs a signed 64-bit integer argument
+*/
+uint32 CDlog::PackArg(puint8 frame, uint32 len, long long value)
+{
+	return CDlog::PackBytes(frame, len, &value, 8);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that packs an unsigned 64-bit integer argument
+*/
+uint32 CDlog::PackArg(puint8 frame, uint32 len, unsigned long long value)
+{
+	return CDlog::PackBytes(frame, len, &value, 8);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that packs a floating point argument (floats are promoted to double)
+*/
+uint32 CDlog::PackArg(puint8 frame, uint32 len, double value)
+{
+	return CDlog::PackBytes(frame, len, &value, 8);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that packs a string argument. The characters are copied (up to
+DLOG_STRING_MAX), as the string may no longer exist when the frame is decoded.
+*/
+uint32 CDlog::PackArg(puint8 frame, uint32 len, const char* value)
+{
+	if(len >= DLOG_FRAME_ARGS_MAX)
+		return len | DLOG_FRAME_TRUNCATED;
+
+	if(!value)
+		value = "(null)";
+
+	//Limit the string to the space left in the frame
+	uint32 max = DLOG_FRAME_ARGS_MAX - len - 1;
+	if(max > DLOG_STRING_MAX)
+		max = DLOG_STRING_MAX;
+	uint32 size = 0;
+	while(size < max && value[size])
+		size++;
+
+	frame[len] = (uint8)size;
+	memcpy(frame + len + 1, value, size);
+	return len + 1 + size;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that packs a pointer argument
+*/
+uint32 CDlog::PackArg(puint8 frame, uint32 len, const void* value)
+{
+	return CDlog::PackWord(frame, len, (uint32)value);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that copies raw argument bytes into the frame. If they would exceed
+DLOG_FRAME_ARGS_MAX, the frame is marked as truncated and no further arguments
+are packed
+@param frame Pointer to the argument data area of the frame
+@param len The number of argument bytes already packed
+@param data Pointer to the bytes to pack
+@param size The number of bytes to pack
+@result The number of argument bytes packed
+*/
+uint32 CDlog::PackBytes(puint8 frame, uint32 len, const void* data, uint32 size)
+{
+	if((len + size) > DLOG_FRAME_ARGS_MAX)
+		return len | DLOG_FRAME_TRUNCATED;
+
+	memcpy(frame + len, data, size);
+	return len + size;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that packs a 32-bit argument word
+*/
+uint32 CDlog::PackWord(puint8 frame, uint32 len, uint32 value)
+{
+	return CDlog::PackBytes(frame, len, &value, 4);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that sets the com port that frames are drained through
+*/
+void CDlog::SetCom(PCom com)
+{
+	_com = com;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that completes the header and CRC of a frame, and writes it
+into the ring buffer. If there isn't space for the whole frame, it is dropped.
+@param fmt Pointer to the format string in the .dlog_str section, or NULL for a dropped entries frame
+@param frame Pointer to the frame, with the arguments already packed
+@param len The number of argument bytes packed, and the DLOG_FRAME_TRUNCATED flag
+*/
+void CDlog::WriteFrame(const char* fmt, puint8 frame, uint32 len)
+{
+	//The .dlog_str section is located at address zero, so the string address is its offset
+	uint16 id = fmt ? (uint16)(uint32)fmt : DLOG_ID_DROPPED;
+
+	frame[0] = DLOG_FRAME_SYNC;
+	frame[1] = (uint8)len;
+	frame[2] = (uint8)id;
+	frame[3] = (uint8)(id >> 8);
+
+	IRQ_DISABLE;
+	uint32 ticks = (uint32)CSysTick::GetTicks();
+	frame[4] = (uint8)ticks;
+	frame[5] = (uint8)(ticks >> 8);
+	frame[6] = (uint8)(ticks >> 16);
+	frame[7] = (uint8)(ticks >> 24);
+
+	//Compute the CRC of everything after the sync byte
+	uint32 size = DLOG_FRAME_HEADER + (len & ~DLOG_FRAME_TRUNCATED);
+	uint16 crc = CCrc16::Calc(frame, 1, size - 1);
+	frame[size] = (uint8)crc;
+	frame[size + 1] = (uint8)(crc >> 8);
+	size += DLOG_FRAME_CRC;
+
+	//Only add whole frames to the buffer
+	if(_buffer->GetFree() >= size)
+		_buffer->PushBlock(frame, size);
+	else
+		_dropped++;
+	IRQ_ENABLE;
+}
+
+//==============================================================================
@@ -32,15 +32,24 @@ CFlashData::CFlashData(PFlash flash, uint32 storeAddr, uint32 storeSize)
 	//Find if we have valid data stored, ready for reading
 	EFlashDataReturn returnCode = this->ReadFind();
 
-	//If we have no valid read data record, then check to see if the data storage
-	//area is fully erased.
-	if(returnCode != FDATA_OK) {
-		//Check if the storage area is blank
+	if((returnCode == FDATA_OK) && !_readChecked) {
+		//Rewrite a record written by firmware that stored no CRC with its CRC.
+		//It's copied out first, as the write may erase the storage area.
+		puint8 data = new uint8[_readLength];
+		uint16 length = this->Read(data);
+		this->Write(data, length);
+		delete[] data;
+	}
+	else if(returnCode != FDATA_OK) {
+		//If we have no valid read data record, then check to see if the data
+		//storage area is fully erased.
 		bool blank = this->EraseCheck();
 
 		if(!blank) {
 			//If not fully erased, then erase it now so its ready and formatted for new writes.
-			this->Erase();
+			//Where possible this is done in the background, so startup isn't delayed.
+			if(!this->EraseAsync())
+				this->Erase();
 		}
 	}
 }
@@ -61,12 +70,33 @@ bool CFlashData::Erase()
 	//Reset internal params
 	_readAddr = 0;
 	_readLength = 0;
+	_readChecked = false;
 
 	//Erase the flash sectors for storage
 	EFlashReturn returnCode = _flash->FlashEraseSectors(_storeAddr, (_storeSize / FLASH_SECTOR_SIZE));
 	return (returnCode == FLASH_OK);
 }
 
+/*!-----------------------------------------------------------------------------
+Function that starts erasing all data in the storage area in the background,
+and resets everything back to defaults. Reads and writes made before the erase
+finishes wait for it.
+@param onDone Optional callback raised (from the ISR) when the erase finishes
+@result True if the erase was started, false if it couldn't be queued (such as
+if the storage area lies below FLASH_JOB_ADDR_MIN)
+*/
+bool CFlashData::EraseAsync(PFlashJobCallback onDone)
+{
+	//Reset internal params
+	_readAddr = 0;
+	_readLength = 0;
+	_readChecked = false;
+
+	//Queue the erase of the flash sectors for storage
+	EFlashReturn returnCode = _flash->FlashEraseRangeAsync(_storeAddr, _storeSize, onDone, this);
+	return (returnCode == FLASH_OK);
+}
+
 /*!-----------------------------------------------------------------------------
 Function that determines if the data storage area is blank and ready for programming
 @result True if the storage area read's as all 1's, ready for programming
@@ -95,21 +125,30 @@ Function that finds the start of the active data record within the allocated
 storage memory.
 This procedure traverses the data storage area like a Linked list, looking for the
 first Active data record in encounders.
+The record's data is checked against the CRC in its check record or header, but
+records with neither were written by firmware that stored no CRC, so are
+accepted unchecked.
 @param[out] dataAddr Pointer to where the address of the active data (or free) record should be stored.
+@param[out] checked Optional pointer to where true should be stored if the active record was checked against a CRC
 @result The address of the starting data record header for the active (or free) location
 */
-EFlashDataReturn CFlashData::FindActiveRecord(puint32 dataAddr)
+EFlashDataReturn CFlashData::FindActiveRecord(puint32 dataAddr, pbool checked)
 {
 	uint32 addr, addrEnd;
 	//puint32 state;
 	PFlashDataHeader header;
 
+	//Wait for any background erase of the storage area to finish
+	_flash->Wait(_storeAddr, _storeSize);
+
 	//Set the address to the start of storage
 	addr = _storeAddr;
 	addrEnd = _storeAddr + _storeSize;
 
 	//Set the initial contents of the data address result to 0
 	*dataAddr = 0;
+	if(checked)
+		*checked = false;
 
 	//Start loop traversing memory
 	while(addr < addrEnd) {
@@ -127,19 +166,27 @@ EFlashDataReturn CFlashData::FindActiveRecord(puint32 dataAddr)
 			//the valid storage area
 			uint32 dataStart = addr + sizeof(TFlashDataHeader);
 			uint32 dataEnd = dataStart + header->Length;
-			uint16 csum = CCrc16::Calc((puint8)dataStart, 0, header->Length);
 
 			if(dataEnd >= addrEnd) {
 				//Data lies outside the valid storage area, so return an error
 				return FDATA_ERR_RANGE;
 			}
-			else if(csum != header->Checksum) {
+
+			//Find the CRC the data was stored with, if any
+			PFlashDataCheck check = this->GetCheck(addr);
+			uint16 csum = CCrc16::Calc((puint8)dataStart, 0, header->Length);
+			bool crcStored = (check != NULL) || (header->Checksum != 0);
+			uint16 crc = check ? check->Checksum : header->Checksum;
+
+			if(crcStored && (csum != crc)) {
 				//The stored checksum does not match the data, so fail
 				return FDATA_ERR_CHECKSUM;
 			}
 			else {
 				//Data is valid and lies within the allowed storage area so return the address
 				*dataAddr = addr;
+				if(checked)
+					*checked = crcStored;
 				return FDATA_OK;
 			}
 		}
@@ -160,6 +207,28 @@ EFlashDataReturn CFlashData::FindActiveRecord(puint32 dataAddr)
 	return FDATA_ERR_RANGE;
 }
 
+/*!-----------------------------------------------------------------------------
+Function that returns the check record following a record's data, if it has one
+@param addr The address of the record's header
+@result Pointer to the check record, or NULL if the record was written without one
+*/
+PFlashDataCheck CFlashData::GetCheck(uint32 addr)
+{
+	PFlashDataHeader header = (PFlashDataHeader)addr;
+	uint32 checkAddr = addr + sizeof(TFlashDataHeader) + ((header->Length + 7) & ~0x7);
+	PFlashDataCheck check = (PFlashDataCheck)checkAddr;
+
+	//Records without one have the next header (or free space) here instead, so
+	//the check record must also be linked over, and confirm itself
+	if(((checkAddr + sizeof(TFlashDataCheck)) > (_storeAddr + _storeSize))
+		|| (header->NextHeader != (checkAddr + sizeof(TFlashDataCheck)))
+		|| (check->Magic != FDATA_CHECK_MAGIC)
+		|| (check->Checksum != (uint16)~check->ChecksumInv))
+		return NULL;
+
+	return check;
+}
+
 /*!-----------------------------------------------------------------------------
 Function that returns the length of the active data record available for reading.
 @result The length of available data, Zero indicates that data is not available.
@@ -169,6 +238,15 @@ uint16 CFlashData::GetReadLength()
 	return _readLength;
 }
 
+/*!-----------------------------------------------------------------------------
+Function that returns if the storage area can't be read yet, as the flash it
+lies in is being modified in the background
+*/
+bool CFlashData::IsBusy()
+{
+	return _flash->IsBusy(_storeAddr, _storeSize);
+}
+
 /*!-----------------------------------------------------------------------------
 Function that copies the current active data record into a user specified memory
 location.
@@ -196,6 +274,9 @@ uint16 CFlashData::Read(pointer destData, uint16 maxLength)
 		return 0;
 	}
 	else {
+		//Wait for the flash to be readable
+		_flash->Wait(_storeAddr, _storeSize);
+
 		//If auto is specified, set the number of bytes to read
 		if(maxLength == 0)
 			maxLength = _readLength;
@@ -240,7 +321,7 @@ EFlashDataReturn CFlashData::ReadFind()
 	EFlashDataReturn returnCode;
 
 	//Attempt to find the active data record within the flash storage area
-	returnCode = this->FindActiveRecord(&dataAddr);
+	returnCode = this->FindActiveRecord(&dataAddr, &_readChecked);
 
 	if(returnCode == FDATA_OK) {
 		//We have an active record, so setup pointers
@@ -252,6 +333,7 @@ EFlashDataReturn CFlashData::ReadFind()
 		//Indicate we have no valid data record
 		_readAddr = 0;
 		_readLength = 0;
+		_readChecked = false;
 	}
 
 	//Return the status code
@@ -270,6 +352,7 @@ bool CFlashData::Write(pointer srcData, uint16 length)
 {
 	//Initialise variables.
 	uint32 writeAddr = 0;
+	bool writeChecked = false;
 	bool writeStateEn = true;
 	EFlashDataWrState writeState = WR_FIND_ACTIVE;
 	bool writeSuccess = false;
@@ -285,7 +368,7 @@ bool CFlashData::Write(pointer srcData, uint16 length)
 		switch(writeState) {
 			case WR_FIND_ACTIVE : {
 				//Traverse the flash storage area to find any current active record
-				EFlashDataReturn returnCode = this->FindActiveRecord(&writeAddr);
+				EFlashDataReturn returnCode = this->FindActiveRecord(&writeAddr, &writeChecked);
 
 				if(returnCode == FDATA_OK) {
 					//If we have an active record, then determine if it needs modification
@@ -332,20 +415,16 @@ bool CFlashData::Write(pointer srcData, uint16 length)
 			case WR_MODIFY : {
 				//Determine if the current settings need modifying - if they're
 				//the same then don't do anything, and save some flash wear.
+				//Records stored without a CRC are always rewritten with one.
 				bool match;
 				PFlashDataHeader header;
-				uint16 csum;
 				puint8 psrc, pflash;
 
 				//Get a pointer to the header structure
 				header = (PFlashDataHeader)writeAddr;
 
-				//Check the lengths match
-				match = (length == header->Length);
-
-				//Check the checksums match
-				csum = CCrc16::Calc((puint8)srcData, 0, length);
-				match &= (csum == header->Checksum);
+				//Check the record was stored with a CRC, and the lengths match
+				match = writeChecked && (length == header->Length);
 
 				//Check the contents match
 				psrc = (puint8)srcData;
@@ -403,41 +482,50 @@ bool CFlashData::Write(pointer srcData, uint16 length)
 				//point to where the header should be written.
 				EFlashReturn flashCode;
 				TFlashDataHeader header;
+				TFlashDataCheck check;
 				uint16 blockLength;
+				uint32 checkAddr;
 				uint32 writeAddrEnd;
 
+				//Compute the record block length (length rounded up to the nearest 8 bytes)
+				blockLength = length & ~(0x7);	//Mask the lower 3 bits to 0
+				if((length % 8) > 0)
+					blockLength += 8;
+				checkAddr = writeAddr + sizeof(TFlashDataHeader) + blockLength;
+
 				//If write exceeds storage length, then erase and start again
-				writeAddrEnd = writeAddr + sizeof(TFlashDataHeader) + length;
+				writeAddrEnd = checkAddr + sizeof(TFlashDataCheck);
 				if(writeAddrEnd >= (_storeAddr + _storeSize)) {
 					//Store a range error, so the code below fails, and causes an erase cycle
 					flashCode = FLASH_ERR_RANGE;
 				}
 				else {
-					//Compute the record block length (length rounded up to the nearest 8 bytes)
-					blockLength = length & ~(0x7);	//Mask the lower 3 bits to 0
-					if((length % 8) > 0)
-						blockLength += 8;
-
-					//Make up a new header
+					//Make up a new header, with the CRC in the check record, so
+					//firmware that stores no CRC still reads it
 					header.State = FDATA_STATE_ACTIVE;
-					header.NextHeader = writeAddr + sizeof(TFlashDataHeader) + blockLength;
+					header.NextHeader = writeAddrEnd;
 					header.Length = length;
-					header.Checksum = CCrc16::Calc((puint8)srcData, 0, length);
-
-					//Program the header
-					flashCode = _flash->FlashProgram(writeAddr, (puint8)&header, sizeof(TFlashDataHeader), NULL);
-
-					if(flashCode == FLASH_OK) {
-						//Header programming ok, so program data
-						writeAddr += sizeof(TFlashDataHeader);
-						flashCode = _flash->FlashProgram(writeAddr, (puint8)srcData, length, NULL);
-					}
+					header.Checksum = 0;
+
+					check.Magic = FDATA_CHECK_MAGIC;
+					check.Checksum = CCrc16::Calc((puint8)srcData, 0, length);
+					check.ChecksumInv = ~check.Checksum;
+
+					//Program the data and check record, then the header, so the
+					//record is only active once it has its CRC
+					flashCode = _flash->FlashProgram(writeAddr + sizeof(TFlashDataHeader), (puint8)srcData, length, NULL);
+					if(flashCode == FLASH_OK)
+						flashCode = _flash->FlashProgramPhrase(checkAddr, (puint8)&check);
+					if(flashCode == FLASH_OK)
+						flashCode = _flash->FlashProgram(writeAddr, (puint8)&header, sizeof(TFlashDataHeader), NULL);
+					writeAddr += sizeof(TFlashDataHeader);
 				}
 
 				if(flashCode == FLASH_OK) {
 					//If data programmed OK, then setup the read pointers to the new data
 					_readAddr = writeAddr;
 					_readLength = length;
+					_readChecked = true;
 
 					//Exit with success
 					writeStateEn = false;	//Prevent further FSM execution
@@ -22,6 +22,22 @@ CFlashProg::CFlashProg(PFlash flash, uint32 infoStart, uint32 infoSize)
 	//Initially indicate we have no hardware information available
 	_hardware = NULL;
 
+	//The staging memory for windowed transfers, and the decoders for compressed
+	//and delta programs, are only allocated while a transfer needs them
+	_slotData = NULL;
+	_lz = NULL;
+	_delta = NULL;
+
+	//Allocate the buffers data is staged in while it's programmed in the background
+	_stageData = new uint8[FLASH_PROG_STAGES * FLASH_PROG_STAGE_SIZE];
+	_stage = 0;
+	_stageLength = 0;
+	_stageQueued = 0;
+
+	//Handle background erases and programs of scratch memory finishing
+	_jobDone.Set(this, &CFlashProg::JobDoneEvent);
+	_jobResult = FLASH_OK;
+
 	//Initialise flash programming variables
 	this->ProgReset();
 }
@@ -33,7 +49,10 @@ CFlashProg::~CFlashProg()
 	//Unregister commands
 	//###
 
-	//Tidy up
+	//Tidy up, once any background erase or program has finished
+	_flash->Wait();
+	this->ProgReset();
+	delete[] _stageData;
 	delete _info;
 }
 
@@ -47,14 +66,43 @@ void CFlashProg::DoAction(EFlashProgAction action)
 	this->OnAction.Call(&params);
 }
 
+/*!-----------------------------------------------------------------------------
+Function called (from the flash ISR) when a background erase or program of
+scratch memory finishes, which records the first one to fail, and frees the
+staging buffer a program was made from.
+*/
+void CFlashProg::JobDoneEvent(PFlashJob job)
+{
+	if((job->Result != FLASH_OK) && (_jobResult == FLASH_OK))
+		_jobResult = job->Result;
+	if((job->Type == FLASH_JOB_PROGRAM) && (_stageQueued > 0))
+		_stageQueued--;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns true while scratch memory is being erased in the
+background.
+*/
+bool CFlashProg::IsBusy()
+{
+	return _flash->IsBusy(FLASH_SCRATCH_START, FLASH_SCRATCH_SIZE);
+}
+
 /*!-----------------------------------------------------------------------------
 Function called to initialise the programming parameters for a section.
+Scratch memory isn't erased here. Instead, each block programmed makes sure the
+memory it's written to is erased, and starts erasing FLASH_PROG_ERASE_AHEAD
+further on in the background (up to the program length), while the next blocks
+are being sent. Only the first sector is erased from here, so this returns
+straight away, and the time taken scales with the program rather than the size
+of scratch memory.
 @param init		Pointer to the struct with the programming initialisation parameters
 @result			Return code indicating if the programming system was initialised.
 */
 EFlashProgReturn CFlashProg::ProgInit(PFlashProgInit init)
 {
 	TFlashProgInfo info;
+	bool infoRead;
 	EFlashReturn flashReturn;
 	uint32 sectionStart;
 	uint32 sectionSize;
@@ -66,7 +114,7 @@ EFlashProgReturn CFlashProg::ProgInit(PFlashProgInit init)
 	this->ProgReset();
 
 	//Read the device program status information from Flash
-	this->ReadInfo(&info);
+	infoRead = this->ReadInfo(&info);
 
 	//Recreate the validation SHA-1 hash
 	hashStrLen = snprintf((pchar)hashStr, 256, "%s-%.5u-%u-%u-%.6u-%u-%u-%.8X",
@@ -120,14 +168,18 @@ EFlashProgReturn CFlashProg::ProgInit(PFlashProgInit init)
 	//Check for supported data types
 	switch(init->DataFormat) {
 		case FPROG_DATA_BINARY :
+		case FPROG_DATA_COMPRESSED :
 		case FPROG_DATA_ENCRYPTED :
+		case FPROG_DATA_ENCCOMP :
+		case FPROG_DATA_DELTA :
+		case FPROG_DATA_COMPDELTA :
+		case FPROG_DATA_ENCDELTA :
+		case FPROG_DATA_ENCCOMPDELTA :
 		{
 			//Supported data formats, so skip check
 			break;
 		}
 
-		case FPROG_DATA_COMPRESSED :
-		case FPROG_DATA_ENCCOMP :
 		default : {
 			//Fail if we have an invalid data format
 			return FPROG_INIT_ERROR;
@@ -137,9 +189,11 @@ EFlashProgReturn CFlashProg::ProgInit(PFlashProgInit init)
 	//Fail the the length for the specified section is wrong
 	switch(init->Section) {
 		case FLASH_SECTION_BOOT : {
-			#if (FIRMWARE_SECTION == FLASH_SECTION_BOOT)
+			#if (FIRMWARE_SECTION == FLASH_SECTION_BOOT) || FLASH_SWAP_ENABLE
 				//If this firmware is compiled as the bootloader, then abort as we CAN'T
 				//reprogram the bootloader from the bootloader.
+				//When swapping halves, scratch memory only holds the main program, and the
+				//bootloader is carried across from the active half.
 				return FPROG_SECTION_ERROR;
 			#else
 				sectionStart = FLASH_BOOT_START;
@@ -165,12 +219,27 @@ EFlashProgReturn CFlashProg::ProgInit(PFlashProgInit init)
 		return FPROG_LENGTH_ERROR;
 	}
 
-	//Erase the scratch memory ready for a new program
-	flashReturn = _flash->FlashEraseRange(FLASH_SCRATCH_START, FLASH_SCRATCH_SIZE);
-	if(flashReturn != FLASH_OK) {
-		//Fail as Scratch memory couldn't be erased
-		return FPROG_FLASH_ERROR;
+	#if FLASH_SWAP_ENABLE
+	{
+		//Fail if the halves are already due to be swapped at the next reset, as
+		//the inactive half can't be changed until then
+		TFlashSwapState swapState;
+		flashReturn = _flash->CmdSwapGetStatus(FLASH_SWAP_INDICATOR_ADDR, &swapState);
+		if((flashReturn != FLASH_OK) || (swapState.CurrentState == FLASH_SWAP_COMPLETE))
+			return FPROG_INIT_ERROR;
 	}
+	#endif
+
+	//Fail delta programs unless the section holds a program whose checksum was
+	//recorded, for the patch to be checked against
+	if(IS_BITS_SET(init->DataFormat, FPROG_DATA_DELTA) && !(infoRead && info.Firmware[init->Section].Valid)) {
+		return FPROG_INIT_ERROR;
+	}
+
+	//Finish any erase or program left running from a previous program, so its
+	//result isn't confused with this one's
+	_flash->Wait(FLASH_SCRATCH_START, FLASH_SCRATCH_SIZE);
+	_jobResult = FLASH_OK;
 
 	//Indicate we're ready to receive data
 	_update.Update = true;
@@ -184,13 +253,35 @@ EFlashProgReturn CFlashProg::ProgInit(PFlashProgInit init)
 	_scratchAddr = FLASH_SCRATCH_START;
 	_scratchLength = 0;
 	_scratchChecksum = 0;
+	_scratchHash.Init();
+
+	_eraseAddr = FLASH_SCRATCH_START;
+	_eraseEnd = FLASH_SCRATCH_START + init->Length;
 
 	_blockCnt = 0;
 	_blockFormat = init->DataFormat;
 
+	//Create the decoder for compressed programs
+	if(IS_BITS_SET(_blockFormat, FPROG_DATA_COMPRESSED))
+		_lz = new CLzDecoder(FLASH_PROG_LZ_WINDOW);
+
+	//Patch the program currently in the section, if it is the one the patch was made against
+	if(IS_BITS_SET(_blockFormat, FPROG_DATA_DELTA)) {
+		_delta = new CDeltaDecoder(FLASH_PROG_DELTA_BUFFER);
+		_delta->Init((puint8)sectionStart, sectionSize, info.Firmware[init->Section].Checksum, init->Length);
+	}
+
 	//Raise an action event
 	this->DoAction(FPROG_ACTION_PROG_INIT);
 
+	//Start erasing the scratch memory the first block will be programmed into
+	flashReturn = this->ProgEraseAhead();
+	if(flashReturn != FLASH_OK) {
+		//Fail as Scratch memory couldn't be erased
+		this->ProgReset();
+		return FPROG_FLASH_ERROR;
+	}
+
 	//Indicate initialisation success
 	return FPROG_OK;
 }
@@ -212,9 +303,182 @@ void CFlashProg::ProgReset()
 	_scratchAddr = 0;
 	_scratchLength = 0;
 	_scratchChecksum = 0;
+	_scratchHash.Init();
+
+	//Discard any staged data (buffers already queued are programmed regardless)
+	_stage = 0;
+	_stageLength = 0;
+
+	_eraseAddr = 0;
+	_eraseEnd = 0;
 
 	_blockCnt = 0;
 	_blockFormat = FPROG_DATA_BINARY;
+
+	//Release the decoders, which are created again by ProgInit if needed
+	delete _lz;
+	_lz = NULL;
+	delete _delta;
+	_delta = NULL;
+
+	//Empty the window staging slots, and release their memory
+	for(uint16 slot = 0; slot < FLASH_PROG_WINDOW_SLOTS; slot++) {
+		_slotLength[slot] = 0;
+		_slotSeq[slot] = 0;
+	}
+	delete[] _slotData;
+	_slotData = NULL;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that decodes a received block in place, ready to be programmed.
+Compressed blocks are decompressed as they're programmed, by ProgWrite, as
+they can only be decompressed in sequence order.
+@param seq The sequence number of the block, which is used in its decryption key
+@param data Pointer to the block data
+@param length The number of bytes in the block
+*/
+EFlashProgReturn CFlashProg::ProgDecode(uint16 seq, puint8 data, uint16 length)
+{
+	bool decrypt;
+	uint8 decryptKey[16];
+
+	//Decode the data format
+	switch(_blockFormat) {
+		case FPROG_DATA_BINARY : { decrypt = false; break; }
+		case FPROG_DATA_COMPRESSED : { decrypt = false; break; }
+		case FPROG_DATA_ENCRYPTED : { decrypt = true; break; }
+		case FPROG_DATA_ENCCOMP : { decrypt = true; break; }
+		case FPROG_DATA_DELTA : { decrypt = false; break; }
+		case FPROG_DATA_COMPDELTA : { decrypt = false; break; }
+		case FPROG_DATA_ENCDELTA : { decrypt = true; break; }
+		case FPROG_DATA_ENCCOMPDELTA : { decrypt = true; break; }
+		default : { return FPROG_INIT_ERROR; } 	//This should never run, as PROG_INIT filters the allowed data types.
+	}
+
+	//If required, decrypt the data first (using the XXTEA algorithm)...
+	if(decrypt) {
+		//Copy the first 14 chararacters from the key into the decryption key array
+		//And zeroes any further bytes upto the 16 char length.
+		int len = snprintf((pchar)(&decryptKey[0]), 14+1, FLASH_HASH_KEY);
+		for(int idx = len; idx < 14; idx++) {
+			decryptKey[idx] = 0;
+		}
+		//Include the block sequence number in the last two bytes of the key
+		decryptKey[14] = (uint8)(seq & 0xFF);
+		decryptKey[15] = (uint8)((seq >> 8) & 0xFF);
+
+		//Perform the decryption in place, using the XXTEA algorithm
+		//To function, this required a minimum of 8 bytes (64 bits) or the data doesn't decode correctly.
+		CXxTea::Decrypt((puint32)data, length / 4, (puint32)decryptKey);
+	}
+
+	return FPROG_OK;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that makes sure scratch memory is erased up to the specified address,
+by queuing a background erase of any sectors not already erased (or queued).
+If the erase can't be queued, then it's done now instead, unless it can be
+left for later.
+@param addr The address scratch memory should be erased up to, which is rounded up to the end of its sector
+@param wait True to erase now if the job queue is full, false to leave the sectors to be erased later
+@result Success or error code from starting the erase
+*/
+EFlashReturn CFlashProg::ProgErase(uint32 addr, bool wait)
+{
+	EFlashReturn flashReturn;
+	uint32 size;
+
+	//Round the address up to a sector boundary, within scratch memory
+	addr += FLASH_SECTOR_SIZE - 1;
+	CLR_BITS(addr, (FLASH_SECTOR_SIZE - 1));
+	if(addr > (FLASH_SCRATCH_START + FLASH_SCRATCH_SIZE))
+		addr = FLASH_SCRATCH_START + FLASH_SCRATCH_SIZE;
+
+	if(addr <= _eraseAddr)
+		return FLASH_OK;
+
+	size = addr - _eraseAddr;
+	flashReturn = _flash->FlashEraseRangeAsync(_eraseAddr, size, &_jobDone);
+	if((flashReturn == FLASH_ERR_BUSY) && !wait)
+		return FLASH_OK;
+	if(flashReturn != FLASH_OK)
+		flashReturn = _flash->FlashEraseRange(_eraseAddr, size);
+	if(flashReturn == FLASH_OK)
+		_eraseAddr = addr;
+
+	return flashReturn;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that starts erasing scratch memory FLASH_PROG_ERASE_AHEAD past where
+the next block will be programmed, but not beyond the end of the program.
+If the job queue is full (the link is outpacing the flash), the erase is left
+for the program that needs it to queue, rather than waiting here for every
+queued job to finish.
+@result Success or error code from starting the erase
+*/
+EFlashReturn CFlashProg::ProgEraseAhead()
+{
+	uint32 addr = _scratchAddr + FLASH_PROG_ERASE_AHEAD;
+
+	if(addr > _eraseEnd)
+		addr = _eraseEnd;
+
+	return this->ProgErase(addr, false);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that queues the staging buffer being filled to be programmed into
+scratch memory in the background, once it has been erased, and starts filling
+the other buffer. If the program can't be queued, then it's done now instead.
+The flash driver uses section programming for aligned runs, and pads a partial
+phrase at the end with erased (0xFF) bytes.
+Only returns once the buffer to be filled next is free, which normally
+means the previous buffer has been programmed while this one was filled.
+@result Success or error code of the first erase or program to fail
+*/
+EFlashReturn CFlashProg::ProgStage()
+{
+	EFlashReturn flashReturn;
+	uint32 addr = _scratchAddr - _stageLength;
+	puint8 data = &_stageData[_stage * FLASH_PROG_STAGE_SIZE];
+
+	if(_stageLength == 0)
+		return _jobResult;
+
+	//Queue the program after an erase of the memory it needs
+	flashReturn = this->ProgErase(_scratchAddr);
+	if(flashReturn == FLASH_OK) {
+		IRQ_DISABLE;
+		_stageQueued++;
+		IRQ_ENABLE;
+		flashReturn = _flash->FlashProgramAsync(addr, data, _stageLength, &_jobDone);
+		if(flashReturn != FLASH_OK) {
+			IRQ_DISABLE;
+			_stageQueued--;
+			IRQ_ENABLE;
+			flashReturn = _flash->FlashProgram(addr, data, _stageLength, NULL);
+		}
+	}
+
+	//Start erasing the memory the next blocks will be programmed into, while
+	//they're being sent
+	if(flashReturn == FLASH_OK)
+		flashReturn = this->ProgEraseAhead();
+
+	//Switch to the other buffer, once its program (queued before this one's) has finished
+	_stage = (_stage + 1) % FLASH_PROG_STAGES;
+	_stageLength = 0;
+	while(_stageQueued >= FLASH_PROG_STAGES) {
+		_flash->Poll();
+	}
+
+	if(flashReturn == FLASH_OK)
+		flashReturn = _jobResult;
+
+	return flashReturn;
 }
 
 /*!-----------------------------------------------------------------------------
@@ -224,15 +488,50 @@ NB: The length must be a multiple of 4-bytes by definition for XXTEA decryption
 with a minimum of 8 bytes.
 */
 EFlashProgReturn CFlashProg::ProgScratch(puint8 data, uint16 length)
+{
+	//Blocks sent without a sequence number are always the next block expected
+	return this->ProgScratchBlock(_blockCnt, data, length);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that programs the staging buffer being filled and waits for all
+programming of scratch memory to finish, so it holds the whole program.
+@result Success or error code of the first erase or program to fail
+*/
+EFlashReturn CFlashProg::ProgFlush()
 {
 	EFlashReturn flashReturn;
-	uint8 dataTmp[FLASH_PHRASE_SIZE];
-	puint8 ptr;
-	uint16 progLen;
-	bool decrypt;
-	uint8 decryptKey[16];
-	bool decompress;
 
+	flashReturn = this->ProgStage();
+	_flash->Wait(FLASH_SCRATCH_START, FLASH_SCRATCH_SIZE);
+	if(flashReturn == FLASH_OK)
+		flashReturn = _jobResult;
+
+	return flashReturn;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that accepts a sequence numbered block of a windowed transfer, where
+the sender doesn't wait for each block to be acknowledged before sending more.
+Blocks are always programmed into scratch memory in sequence order. The next
+block expected is programmed immediately, followed by any staged blocks that now
+follow on from it. Blocks up to FLASH_PROG_WINDOW_SLOTS ahead of the next block
+are decoded and staged in RAM until the blocks before them arrive, with the
+staging memory only allocated when the first block arrives out of order.
+Blocks that have already been programmed or staged are retransmissions, and are
+ignored. Scratch memory holds fewer than 65536 of the smallest blocks, so the
+sequence number doesn't wrap within a transfer, and any block before the next
+expected has already been programmed.
+@param seq The sequence number of the block, starting from zero after ProgInit
+@param data Pointer to the block data, which is decoded in place
+@param length The number of bytes in the block, which must be a multiple of 4 bytes with a minimum of 8 bytes
+@result FPROG_WINDOW_ERROR if the block is too far ahead to be staged
+*/
+EFlashProgReturn CFlashProg::ProgScratchBlock(uint16 seq, puint8 data, uint16 length)
+{
+	EFlashProgReturn result;
+	uint16 offset;
+	uint16 slot;
 
 	//Abort if we're not initialised to receive data
 	if(!_update.Update) {
@@ -241,92 +540,181 @@ EFlashProgReturn CFlashProg::ProgScratch(puint8 data, uint16 length)
 
 	//Abort if we don't have at least 2 unit32's to program,
 	//of the length isn't a multiple of 4 bytes (a uint32).
-	if((length < 8) || IS_BITS_SET(length, 0x03)) {
+	if((length < 8) || IS_BITS_SET(length, 0x03) || (length > FLASH_PROG_WINDOW_BLOCK_MAX)) {
 		this->ProgReset();
 		return FPROG_LENGTH_ERROR;
 	}
 
-	//Decode the data format
-	switch(_blockFormat) {
-		case FPROG_DATA_BINARY : { decompress = false; decrypt = false; break; }
-		case FPROG_DATA_COMPRESSED : { decompress = true; decrypt = false; break; }
-		case FPROG_DATA_ENCRYPTED : { decompress = false; decrypt = true; break; }
-		case FPROG_DATA_ENCCOMP : { decompress = true; decrypt = true; break; }
-		default : { return FPROG_INIT_ERROR; } 	//This should never run, as PROG_INIT filters the allowed data types.
+	//Abort if erasing or programming scratch memory in the background failed
+	if(_jobResult != FLASH_OK) {
+		this->ProgReset();
+		return FPROG_FLASH_ERROR;
 	}
 
-	//If required, decrypt the data first (using the XXTEA algorithm)...
-	if(decrypt) {
-		//Copy the first 14 chararacters from the key into the decryption key array
-		//And zeroes any further bytes upto the 16 char length.
-		int len = snprintf((pchar)(&decryptKey[0]), 14+1, FLASH_HASH_KEY);
-		for(int idx = len; idx < 14; idx++) {
-			decryptKey[idx] = 0;
+	//Find where the block is relative to the next block expected
+	if(seq < _blockCnt) {
+		//The block has already been programmed
+		return FPROG_OK;
+	}
+	offset = seq - _blockCnt;
+	if(offset > FLASH_PROG_WINDOW_SLOTS) {
+		//The block is beyond the staging slots
+		return FPROG_WINDOW_ERROR;
+	}
+
+	//Stage blocks that are ahead of the next block expected
+	if(offset > 0) {
+		if(!_slotData)
+			_slotData = new uint8[FLASH_PROG_WINDOW_SLOTS * FLASH_PROG_WINDOW_BLOCK_MAX];
+
+		slot = seq % FLASH_PROG_WINDOW_SLOTS;
+		if(_slotLength[slot] == 0) {
+			result = this->ProgDecode(seq, data, length);
+			if(result != FPROG_OK)
+				return result;
+
+			memcpy(_slotData + (slot * FLASH_PROG_WINDOW_BLOCK_MAX), data, length);
+			_slotSeq[slot] = seq;
+			_slotLength[slot] = length;
 		}
-		//Include the block counter value in the last two bytes of the key
-		decryptKey[14] = (uint8)(_blockCnt & 0xFF);
-		decryptKey[15] = (uint8)((_blockCnt >> 8) & 0xFF);
+		return FPROG_OK;
+	}
 
-		//Perform the decryption in place, using the XXTEA algorithm
-		//To function, this required a minimum of 8 bytes (64 bits) or the data doesn't decode correctly.
-		CXxTea::Decrypt((puint32)data, length / 4, (puint32)decryptKey);
+	//Program the next block expected
+	result = this->ProgDecode(seq, data, length);
+	if(result == FPROG_OK)
+		result = this->ProgWrite(data, length);
+
+	//Program any staged blocks that now follow on from it
+	while(result == FPROG_OK) {
+		slot = _blockCnt % FLASH_PROG_WINDOW_SLOTS;
+		if((_slotLength[slot] == 0) || (_slotSeq[slot] != _blockCnt))
+			break;
+
+		length = _slotLength[slot];
+		_slotLength[slot] = 0;
+		result = this->ProgWrite(_slotData + (slot * FLASH_PROG_WINDOW_BLOCK_MAX), length);
 	}
 
-	//If required decompress the data...
-	if(decompress) {
-		//##TODO
+	return result;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns the acknowledgement state of a windowed transfer
+@param next Pointer to where the sequence number of the next block expected
+	should be stored. All blocks before this have been programmed.
+@param staged Pointer to where a map of staged blocks should be stored, where
+	bit N is set if the block with sequence number (next + 1 + N) is staged.
+*/
+void CFlashProg::ProgWindowAck(puint16 next, puint32 staged)
+{
+	uint32 map = 0;
+
+	for(uint16 idx = 0; idx < FLASH_PROG_WINDOW_SLOTS; idx++) {
+		uint16 seq = _blockCnt + 1 + idx;
+		uint16 slot = seq % FLASH_PROG_WINDOW_SLOTS;
+		if((_slotLength[slot] > 0) && (_slotSeq[slot] == seq))
+			SET_BITS(map, BIT(idx));
 	}
 
-	//Compute the checksum of the current block
-	_scratchChecksum = CCrc32::CalcBuffer(data, length, CRC32_GEN_POLY, _scratchChecksum);
+	*next = _blockCnt;
+	*staged = map;
+}
 
-	//Loop program Flash phrases from the block.
-	while((length > 0) && (_scratchLength < _update.DestSize) && (_scratchLength < FLASH_SCRATCH_SIZE)) {
-		//Program the next 8-byte phrase of data
-		if(length >= FLASH_PHRASE_SIZE) {
-			progLen = FLASH_PHRASE_SIZE;
-			ptr = data;
-			data += FLASH_PHRASE_SIZE;
-		}
-		else {
-			progLen = length;
-			ptr = dataTmp;
-
-			//Copy the remaining bytes into a temporary '0xFF' padded buffer
-			//(as 0xFF is unprogrammed memory)
-			for(uint8 idx = 0; idx < progLen; idx++) {
-				dataTmp[idx] = *data;
-				data++;
-			}
-			for(uint8 idx = progLen; idx < FLASH_PHRASE_SIZE; idx++) {
-				//dataTmp[idx] = 0;
-				dataTmp[idx] = 0xFF;
+/*!-----------------------------------------------------------------------------
+Function that programs a decoded block into the scratch memory at the next free
+area, and updates the block counter.
+Compressed blocks are decompressed through the decoder's window, which is
+programmed each time it fills (and at the end of the stream), before the next
+data is decoded over it. As the window size divides the sector size, each
+window is programmed into a whole, aligned, run of flash phrases.
+Delta programs are then patched (see ProgWriteDelta).
+@param data Pointer to the decoded block data
+@param length The number of bytes in the block
+*/
+EFlashProgReturn CFlashProg::ProgWrite(puint8 data, uint16 length)
+{
+	EFlashProgReturn result = FPROG_OK;
+	uint32 used;
+	puint8 out;
+	uint32 outLength;
+
+	if(IS_BITS_SET(_blockFormat, FPROG_DATA_COMPRESSED)) {
+		do {
+			if(!_lz->Decode(data, length, &used, &out, &outLength)) {
+				//Abort if the compressed data is corrupt
+				this->ProgReset();
+				return FPROG_DATA_ERROR;
 			}
-		}
+			data += used;
+			length -= used;
+
+			if(outLength > 0)
+				result = this->ProgWriteDelta(out, outLength);
+		} while((result == FPROG_OK) && ((used > 0) || (outLength > 0)));
+	}
+	else {
+		result = this->ProgWriteDelta(data, length);
+	}
+
+	//Increase the block counter - the sequence number of the next block expected
+	if(result == FPROG_OK)
+		_blockCnt++;
+
+	return result;
+}
 
-		//Compute the CRC32 for the scratch area
-		//_scratchChecksum = CCrc32::CalcBuffer(ptr, progLen, CRC32_GEN_POLY, _scratchChecksum);
+/*!-----------------------------------------------------------------------------
+Function that programs data into the scratch memory at the next free area, and
+updates the scratch programming variables.
+The data is gathered into the staging buffer being filled, which is programmed
+in the background each time it fills, while the next blocks are received into
+the other buffer.
+@param data Pointer to the (decompressed) data
+@param length The number of bytes of data
+*/
+EFlashProgReturn CFlashProg::ProgWriteData(puint8 data, uint16 length)
+{
+	uint32 limit;
+	uint32 progLen;
+	uint32 copyLen;
 
-		//Program the data into the next available scratchpad memory
-		flashReturn = _flash->FlashProgramPhrase(_scratchAddr, ptr);
+	//Compute the checksum of the current block, and add it into the image hash
+	//while it is still in RAM, so scratch memory doesn't need reading back to check it
+	_scratchChecksum = CCrc32::CalcBuffer(data, length, CRC32_GEN_POLY, _scratchChecksum);
+	_scratchHash.Update(data, length);
+
+	//Limit programming to the smaller of the destination and scratch areas
+	limit = (_update.DestSize < FLASH_SCRATCH_SIZE) ? _update.DestSize : FLASH_SCRATCH_SIZE;
+	progLen = (_scratchLength < limit) ? (limit - _scratchLength) : 0;
+	if(progLen > length)
+		progLen = length;
+
+	//Stage the block for programming into the next available scratchpad memory,
+	//programming each staging buffer as it fills
+	length -= progLen;
+	while(progLen > 0) {
+		copyLen = FLASH_PROG_STAGE_SIZE - _stageLength;
+		if(copyLen > progLen)
+			copyLen = progLen;
+		memcpy(&_stageData[(_stage * FLASH_PROG_STAGE_SIZE) + _stageLength], data, copyLen);
+
+		//Update control variables
+		data += copyLen;
+		progLen -= copyLen;
+		_stageLength += copyLen;
+		_scratchAddr += copyLen;
+		_scratchLength += copyLen;
 
 		//If the flash failed to program, then abort programming
-		if(flashReturn != FLASH_OK) {
+		if((_stageLength == FLASH_PROG_STAGE_SIZE) && (this->ProgStage() != FLASH_OK)) {
 			this->ProgReset();
 			return FPROG_FLASH_ERROR;
 		}
-
-		//Update control variables
-		length -= progLen;
-		_scratchAddr += progLen;
-		_scratchLength += progLen;
 	}
 
-	//Increase the block counter - used for decryption key generation
-	_blockCnt++;
-
-	//If the loop finished with data left to program, as we filled scratch memory
-	//the report a length error
+	//If data was left to program, as we filled scratch memory, then report a
+	//length error
 	if(length > 0) {
 		this->ProgReset();
 		return FPROG_LENGTH_ERROR;
@@ -336,18 +724,56 @@ EFlashProgReturn CFlashProg::ProgScratch(puint8 data, uint16 length)
 	return FPROG_OK;
 }
 
+/*!-----------------------------------------------------------------------------
+Function that patches (decompressed) delta program data against the program
+currently in the section being programmed, and programs the new program into
+scratch memory. The decoder's buffer is programmed each time it fills (and at
+the end of the patch), so is always programmed into a whole run of flash phrases.
+Other programs are programmed as they are.
+@param data Pointer to the (decompressed) data
+@param length The number of bytes of data
+*/
+EFlashProgReturn CFlashProg::ProgWriteDelta(puint8 data, uint32 length)
+{
+	EFlashProgReturn result = FPROG_OK;
+	uint32 used;
+	puint8 out;
+	uint32 outLength;
+
+	if(!IS_BITS_SET(_blockFormat, FPROG_DATA_DELTA))
+		return this->ProgWriteData(data, (uint16)length);
+
+	do {
+		if(!_delta->Decode(data, length, &used, &out, &outLength)) {
+			//Abort if the patch is corrupt, or was made against a different program
+			this->ProgReset();
+			return FPROG_DATA_ERROR;
+		}
+		data += used;
+		length -= used;
+
+		if(outLength > 0)
+			result = this->ProgWriteData(out, (uint16)outLength);
+	} while((result == FPROG_OK) && ((used > 0) || (outLength > 0)));
+
+	return result;
+}
+
 /*!-----------------------------------------------------------------------------
 Function that is called to start the programming update sequence once the
 scratch memory contains the new program.
+@param hash Pointer to the expected 20 byte SHA1 hash of all the data programmed
+	into scratch memory, or NULL if only the checksum should be checked
 @result Returns eitehr COPY or REBOOT status codes indication if the UpdateCopy
 	routine should be run immediatly, or the device should be rebooted for the bootloader
 	to then perform the copy.
 */
-EFlashProgReturn CFlashProg::ProgUpdate()
+EFlashProgReturn CFlashProg::ProgUpdate(puint8 hash)
 {
 	TFlashProgInfo info;
 	bool success;
 	uint8 section;
+	uint8 hashVal[SHA1_HASH_SIZE];
 
 	//Abort if we're not initialised to update data
 	if(!_update.Update) {
@@ -356,7 +782,11 @@ EFlashProgReturn CFlashProg::ProgUpdate()
 
 	//Abort if the scratch memory length is less than the program length sent
 	//If length is larger, for encryption we may have had to send some padding bytes.
-	if(_scratchLength < _update.SrcLength) {
+	//Compressed programs must also have been sent up to the end of the stream.
+	//Delta programs must also have been patched up to the end of the program.
+	if((_scratchLength < _update.SrcLength)
+		|| (IS_BITS_SET(_blockFormat, FPROG_DATA_COMPRESSED) && !_lz->IsEnd())
+		|| (IS_BITS_SET(_blockFormat, FPROG_DATA_DELTA) && !_delta->IsEnd())) {
 		this->ProgReset();
 		return FPROG_LENGTH_ERROR;
 	}
@@ -367,6 +797,21 @@ EFlashProgReturn CFlashProg::ProgUpdate()
 		return FPROG_CHECKSUM_ERROR;
 	}
 
+	//Abort if the hash accumulated as blocks were programmed doesn't match the one sent
+	if(hash) {
+		_scratchHash.Final(hashVal);
+		if(memcmp(hash, hashVal, SHA1_HASH_SIZE) != 0) {
+			this->ProgReset();
+			return FPROG_HASH_ERROR;
+		}
+	}
+
+	//Program the last of the data, and abort if any programming failed
+	if(this->ProgFlush() != FLASH_OK) {
+		this->ProgReset();
+		return FPROG_FLASH_ERROR;
+	}
+
 	#if (FIRMWARE_SECTION == FLASH_SECTION_BOOT)
 	//Abort if we're trying to program the bootloader section when we're executing as the bootloader.
 	//This isn't allowed, as it will lead to a flash conflict and errors...
@@ -381,6 +826,21 @@ EFlashProgReturn CFlashProg::ProgUpdate()
 		return FPROG_SECTION_ERROR;
 	}
 
+	#if FLASH_SWAP_ENABLE
+		//Complete the inactive half around the new program and swap it in, so
+		//rebooting runs the new program without it being copied
+		success = this->UpdateSwap();
+		this->ProgReset();
+		if(!success) {
+			return FPROG_FLASH_ERROR;
+		}
+
+		//Raise an action event
+		this->DoAction(FPROG_ACTION_PROG_UPDATE);
+
+		return FPROG_REBOOT_NOW;
+	#else
+
 	//Read the device program status information from Flash
 	success = this->ReadInfo(&info);
 	//###Take action here if info can't be read
@@ -395,8 +855,11 @@ EFlashProgReturn CFlashProg::ProgUpdate()
 	info.Firmware[_update.DestSection].VersionMin = 0;
 	info.Firmware[_update.DestSection].VersionBuild = 0;
 
-	//Write the new information back into flash storage
-	success = this->WriteInfo(&info);
+	//Clear the progress of any previous copy, then write the new information
+	//back into flash storage
+	success = (_flash->FlashEraseRange(FLASH_PROGDONE_START, FLASH_PROGDONE_SIZE) == FLASH_OK);
+	if(success)
+		success = this->WriteInfo(&info);
 
 	//Reset the programming system, so program needs to be reloaded again.
 	section = _update.DestSection;	//Memorise the section before we clear the programming variables.
@@ -437,17 +900,21 @@ EFlashProgReturn CFlashProg::ProgUpdate()
 		}
 
 	#endif
+	#endif
 }
 
 /*!-----------------------------------------------------------------------------
-Function that reads the device programming information from non-volatile memory
+Function that reads the device programming information from non-volatile memory.
+Records stored by firmware built with fewer fields are read with the missing
+fields zeroed, and records with more fields have the extra ones ignored.
 @param info	Pointer to where the read information should be stored
-@result True if the information was read (and fitted the struct) otherwise false.
+@result True if the information was read (and held at least the update and
+	firmware information) otherwise false.
 */
 bool CFlashProg::ReadInfo(PFlashProgInfo info)
 {
 	int32 bytes = _info->ReadType(info);
-	return (bytes == sizeof(TFlashProgInfo));
+	return (bytes < 0) || (bytes >= (int32)offsetof(TFlashProgInfo, Swap));
 }
 
 /*!-----------------------------------------------------------------------------
@@ -460,13 +927,73 @@ void CFlashProg::SetHardwareInfo(PFlashProgHardwareInfo value)
 }
 
 /*!-----------------------------------------------------------------------------
-Function that write new device programming information to non-volatile memory
+Function that is called when the device boots (before UpdateFirmwareInfo) to
+count the boots of a program swapped in by an update that hasn't yet confirmed
+it runs correctly with SwapConfirm. Once it has booted FLASH_SWAP_TRIAL_BOOTS
+times on trial, the halves are swapped back to run the previous program.
+Does nothing unless FLASH_SWAP_ENABLE is set.
+@result False if the halves have been swapped back and the device should be
+	rebooted straight away, otherwise true.
+*/
+bool CFlashProg::SwapBootCheck()
+{
+	#if FLASH_SWAP_ENABLE
+		TFlashProgInfo info;
+
+		//Nothing to do unless the running program is on trial
+		if(!this->ReadInfo(&info) || !info.Swap.Trial)
+			return true;
+
+		//Swap back to the previous program if this one has had all its attempts
+		if(info.Swap.Boots >= FLASH_SWAP_TRIAL_BOOTS) {
+			if(_flash->CmdSwap(FLASH_SWAP_INDICATOR_ADDR) == FLASH_OK)
+				return false;
+		}
+		else {
+			//Count this boot
+			info.Swap.Boots++;
+			this->WriteInfo(&info);
+		}
+	#endif
+
+	return true;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that is called by a program once it has started up correctly, to end
+the trial of a program swapped in by an update, so it isn't swapped back out.
+Does nothing unless FLASH_SWAP_ENABLE is set.
+@result True if the program isn't on trial, or was confirmed successfully.
+*/
+bool CFlashProg::SwapConfirm()
+{
+	#if FLASH_SWAP_ENABLE
+		TFlashProgInfo info;
+
+		if(this->ReadInfo(&info) && info.Swap.Trial) {
+			info.Swap.Trial = false;
+			info.Swap.Boots = 0;
+			return this->WriteInfo(&info);
+		}
+	#endif
+
+	return true;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that write new device programming information to non-volatile memory.
+Unless FLASH_SWAP_ENABLE is set, the Swap field isn't stored, so the record has
+the length bootloaders built before it was added require.
 @param info	Pointer to where the read information should be programmed from
 @result True if the data was written successfully.
 */
 bool CFlashProg::WriteInfo(PFlashProgInfo info)
 {
-	return _info->WriteType(info);
+	#if FLASH_SWAP_ENABLE
+		return _info->WriteType(info);
+	#else
+		return _info->Write((pointer)info, offsetof(TFlashProgInfo, Swap));
+	#endif
 }
 
 /*!-----------------------------------------------------------------------------
@@ -518,11 +1045,86 @@ bool CFlashProg::UpdateClear()
 	return success;
 }
 
+/*!-----------------------------------------------------------------------------
+Function that compares a sector of the destination with the program that should
+be copied into it, where the rest of the sector past the program must be erased.
+@param destAddr	The sector aligned address of the destination sector
+@param srcAddr	The address of the program data for the sector (word aligned)
+@param length	The number of bytes of program data, up to a sector
+@result True if the sector already holds the program data.
+*/
+bool CFlashProg::UpdateCompare(uint32 destAddr, uint32 srcAddr, uint32 length)
+{
+	puint32 dest = (puint32)destAddr;
+	puint32 src = (puint32)srcAddr;
+	uint32 words = length / 4;
+	uint32 idx;
+
+	//Compare the program a word at a time
+	for(idx = 0; idx < words; idx++) {
+		if(dest[idx] != src[idx])
+			return false;
+	}
+
+	//Compare any last partial word, where the bytes past the program are erased
+	if(length & 0x03) {
+		uint32 erased = 0xFFFFFFFF << ((length & 0x03) * 8);
+		if(dest[idx] != ((src[idx] & ~erased) | erased))
+			return false;
+		idx++;
+	}
+
+	//Check the rest of the sector is erased
+	for(; idx < (FLASH_SECTOR_SIZE / 4); idx++) {
+		if(dest[idx] != 0xFFFFFFFF)
+			return false;
+	}
+
+	return true;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that reads how far a previous copy of the update got, from the last
+phrase of the progress map to be programmed.
+@result The number of bytes at the start of the destination already copied (a
+	whole number of sectors).
+*/
+uint32 CFlashProg::UpdateDoneRead()
+{
+	puint32 mark;
+
+	for(uint32 idx = FLASH_PROGDONE_SIZE / FLASH_PHRASE_SIZE; idx > 0; idx--) {
+		mark = (puint32)(FLASH_PROGDONE_START + ((idx - 1) * FLASH_PHRASE_SIZE));
+		if((mark[0] != 0xFFFFFFFF) || (mark[1] != 0xFFFFFFFF))
+			return idx * FLASH_SECTOR_SIZE;
+	}
+
+	return 0;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that records a sector of the destination has been copied, by
+programming its phrase of the progress map.
+@param offset	The offset of the sector into the destination
+@result True if the progress was recorded.
+*/
+bool CFlashProg::UpdateDoneMark(uint32 offset)
+{
+	uint8 mark[FLASH_PHRASE_SIZE];
+	uint32 addr = FLASH_PROGDONE_START + ((offset / FLASH_SECTOR_SIZE) * FLASH_PHRASE_SIZE);
+
+	memset(mark, 0, sizeof(mark));
+	return (_flash->FlashProgram(addr, mark, sizeof(mark), NULL) == FLASH_OK);
+}
+
 /*!-----------------------------------------------------------------------------
 Function that is called  once a new program has been loaded into the Scratch
 memory and the Info.Update structure configured for the copy accordingly.
 When run, this function, if required, copies the specified source memory contens from
 the Scratch memory area into the required destination position.
+Only sectors of the destination that differ from the new program are erased and
+programmed, and each one is recorded in the progress map once done, so if the
+copy is interrupted (i.e. by a power cut) it resumes from there.
 */
 bool CFlashProg::UpdateCopy()
 {
@@ -530,6 +1132,9 @@ bool CFlashProg::UpdateCopy()
 	TFlashProgUpdateInfo update;
 	bool success;
 	EFlashReturn flashReturn;
+	uint32 offset;
+	uint32 progEnd;
+	uint32 length;
 
 	//Read the device program status information from Flash
 	success = this->ReadInfo(&info);
@@ -542,6 +1147,8 @@ bool CFlashProg::UpdateCopy()
 		return false;
 	if(update.SrcLength == 0)
 		return false;
+	if(update.SrcLength > update.DestSize)
+		return false;
 
 	//Abort if we're trying to update the section we're operating in
 	if(update.DestSection == FIRMWARE_SECTION)
@@ -555,18 +1162,38 @@ bool CFlashProg::UpdateCopy()
 	//Raise an action event
 	this->DoAction(FPROG_ACTION_UPDATE_START);
 
-	//Disable Interrupts during programming
-	IRQ_DISABLE;
+	//Interrupts are left enabled, as the flash driver disables them itself for
+	//commands on the blocks code is read from
 
-	//Erase the destination memory prior to copying
-	if(success) {
-		flashReturn = _flash->FlashEraseRange(update.DestAddr, update.DestSize);
+	//Resume after the sectors a previous copy finished, if it was interrupted
+	progEnd = (update.SrcLength + FLASH_SECTOR_SIZE - 1) & ~(FLASH_SECTOR_SIZE - 1);
+	offset = this->UpdateDoneRead();
+	if(offset > progEnd)
+		offset = 0;
+
+	//Copy the program a sector at a time, skipping sectors that already match
+	for(; success && (offset < progEnd); offset += FLASH_SECTOR_SIZE) {
+		length = update.SrcLength - offset;
+		if(length > FLASH_SECTOR_SIZE)
+			length = FLASH_SECTOR_SIZE;
+
+		if(this->UpdateCompare(update.DestAddr + offset, update.SrcAddr + offset, length))
+			continue;
+
+		//Erase the sector (unless it's blank) and program it
+		flashReturn = _flash->FlashEraseRange(update.DestAddr + offset, FLASH_SECTOR_SIZE);
+		if(flashReturn == FLASH_OK)
+			flashReturn = _flash->FlashProgram(update.DestAddr + offset, (puint8)(update.SrcAddr + offset), length, NULL);
 		success = (flashReturn == FLASH_OK);
+
+		//Record the progress, so an interrupted copy doesn't start again
+		if(success)
+			success = this->UpdateDoneMark(offset);
 	}
 
-	//Copy the program memory
-	if(success) {
-		flashReturn = _flash->FlashProgram(update.DestAddr, (puint8)(update.SrcAddr), update.SrcLength, NULL);
+	//Erase the rest of the destination, skipping sectors that are already blank
+	if(success && (progEnd < update.DestSize)) {
+		flashReturn = _flash->FlashEraseRange(update.DestAddr + progEnd, update.DestSize - progEnd);
 		success = (flashReturn == FLASH_OK);
 	}
 
@@ -617,9 +1244,6 @@ bool CFlashProg::UpdateCopy()
 		success = this->WriteInfo(&info);
 	}
 
-	//Reenable Interrupts
-	IRQ_ENABLE;
-
 	//Raise an action event
 	if(success)
 		this->DoAction(FPROG_ACTION_UPDATE_DONE);
@@ -667,4 +1291,93 @@ bool CFlashProg::UpdateFirmwareInfo()
 	return success;
 }
 
+#if FLASH_SWAP_ENABLE
+/*!-----------------------------------------------------------------------------
+Function that completes the inactive half of flash around the new program held
+in scratch memory, and then swaps the halves at the next reset.
+The bootloader (with the flash configuration field) and settings are copied
+across from the active half, and program information is written for the new
+program, marking it as on trial.
+@result True if the halves will be swapped at the next reset.
+*/
+bool CFlashProg::UpdateSwap()
+{
+	TFlashProgInfo info;
+	EFlashReturn flashReturn;
+	bool success;
+
+	//Finish erasing any of scratch memory still going in the background
+	_flash->Wait();
+
+	//Copy the rest of the active half across
+	success = this->UpdateSwapCopy(FLASH_BOOT_START, FLASH_BOOT_SIZE);
+	success &= this->UpdateSwapCopy(FLASH_SETTINGS_START, FLASH_SETTINGS_SIZE);
+	if(!success)
+		return false;
+
+	//Build the program information for the new program from the current one
+	if(!this->ReadInfo(&info))
+		memset(&info, 0, sizeof(TFlashProgInfo));
+
+	info.FlashUpdate.Update = false;
+	info.FlashUpdate.SrcAddr = 0;
+	info.FlashUpdate.SrcLength = 0;
+	info.FlashUpdate.SrcChecksum = 0;
+	info.FlashUpdate.DestSection = 0;
+	info.FlashUpdate.DestAddr = 0;
+	info.FlashUpdate.DestSize = 0;
+
+	//Indicate the new firmware is valid, with its version filled in when it first runs
+	info.Firmware[_update.DestSection].Valid = true;
+	info.Firmware[_update.DestSection].PartNumber = 0;
+	info.Firmware[_update.DestSection].VersionMaj = 0;
+	info.Firmware[_update.DestSection].VersionMin = 0;
+	info.Firmware[_update.DestSection].VersionBuild = 0;
+	info.Firmware[_update.DestSection].Checksum = _update.SrcChecksum;
+
+	//Put the new program on trial until it confirms it runs
+	info.Swap.Trial = true;
+	info.Swap.Boots = 0;
+
+	//Write the program information into the inactive half
+	flashReturn = _flash->FlashEraseRange(FLASH_PROGINFO_START + FLASH_HALF_SIZE, FLASH_PROGINFO_SIZE);
+	if(flashReturn != FLASH_OK)
+		return false;
+	{
+		CFlashData store(_flash, FLASH_PROGINFO_START + FLASH_HALF_SIZE, FLASH_PROGINFO_SIZE);
+		if(!store.WriteType(&info))
+			return false;
+	}
+
+	//Swap the halves at the next reset
+	flashReturn = _flash->CmdSwap(FLASH_SWAP_INDICATOR_ADDR);
+	return (flashReturn == FLASH_OK);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that copies an area of the active half of flash to the same place in
+the inactive half, leaving any erased memory at the end of the area unprogrammed.
+@param addr	The start address of the area in the active half
+@param size	The number of bytes in the area
+@result True if the area was copied.
+*/
+bool CFlashProg::UpdateSwapCopy(uint32 addr, uint32 size)
+{
+	EFlashReturn flashReturn;
+	puint32 src = (puint32)addr;
+	uint32 words = size / 4;
+
+	flashReturn = _flash->FlashEraseRange(addr + FLASH_HALF_SIZE, size);
+	if(flashReturn != FLASH_OK)
+		return false;
+
+	//Only program up to the last word that isn't erased
+	while((words > 0) && (src[words - 1] == 0xFFFFFFFF))
+		words--;
+
+	flashReturn = _flash->FlashProgram(addr + FLASH_HALF_SIZE, (puint8)addr, words * 4, NULL);
+	return (flashReturn == FLASH_OK);
+}
+#endif
+
 //==============================================================================
@@ -13,25 +13,77 @@ enhanced CRC16 cyclic redundancy check algorithm
 //Include common type definitions and macros
 #include "common.h"
 
+//Include the compile time lookup table generator
+#include "lut.hpp"
+
 //==============================================================================
 //==============================================================================
 #define CRC16_GEN_POLY		0xA001u			/* CRC16-IBM Generator polynomial(x^16 + x^15 + x^2 + 1) - LSB first code */
 
 #define CRC16_LEN			sizeof(uint16)
 
+#define CRC16_LUT_SLICES	4				/* Number of 256 entry tables used to process 4 bytes per step */
+
+/*!
+Generator for the slice-by-4 CRC16 lookup tables of CRC16_GEN_POLY, which are
+held in one array of CRC16_LUT_SLICES x 256 entries.
+Entry (slice * 256 + n) is the CRC of byte n followed by 'slice' zero bytes.
+*/
+struct TCrc16LutGen {
+	typedef uint16 TValue;
+
+	/*! Function that shifts a CRC through a number of zero data bits */
+	static constexpr uint32 Shift(uint32 crc, uint32 bits) {
+		return (bits == 0) ? crc : Shift((crc & 1) ? ((crc >> 1) ^ CRC16_GEN_POLY) : (crc >> 1), bits - 1);
+	}
+
+	/*! Function that returns the table entry at the specified index */
+	static constexpr uint16 Entry(uint32 idx) {
+		return (uint16)Shift(idx & 0xFF, 8 * ((idx >> 8) + 1));
+	}
+};
+
+/*! Define the slice-by-4 CRC16 lookup tables, generated at compile time into flash */
+typedef TLut<TCrc16LutGen, CRC16_LUT_SLICES * 256> TCrc16Lut;
+
 /*!
 Class of static helper functions for manipulating acoustic messages and packets
 */
 class CCrc16 {
-	private:
-		//Declare static variables
-		static uint16 _lut[256];
-
 	public:
 		//Static Methods
-		static void Init(uint32 poly = CRC16_GEN_POLY);
 		static uint16 Calc(puint8 buf, uint32 offset, uint32 length, uint16 init = 0);
+
+	private:
+		//Private Static Methods
+		static inline uint32 LutByte(uint32 crc, uint8 value);
+		static inline uint32 LutWord(uint32 crc, uint32 value);
 };
 
+//==============================================================================
+//Inline Implementation...
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that adds a byte into a CRC16 using the lookup tables
+*/
+uint32 CCrc16::LutByte(uint32 crc, uint8 value)
+{
+	return TCrc16Lut::Table[(crc ^ value) & 0xFF] ^ (crc >> 8);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that adds a little endian 32-bit word into a CRC16, using all four
+lookup tables (slice-by-4)
+*/
+uint32 CCrc16::LutWord(uint32 crc, uint32 value)
+{
+	const uint16* lut = TCrc16Lut::Table.Values;
+	crc ^= value;
+	return lut[(3 * 256) + (crc & 0xFF)] ^
+		lut[(2 * 256) + ((crc >> 8) & 0xFF)] ^
+		lut[(1 * 256) + ((crc >> 16) & 0xFF)] ^
+		lut[crc >> 24];
+}
+
 //==============================================================================
 #endif
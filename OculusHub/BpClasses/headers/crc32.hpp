@@ -13,12 +13,39 @@ calculation algorithm
 //Include common type definitions and macros
 #include "common.h"
 
+//Include the compile time lookup table generator
+#include "lut.hpp"
+
 //==============================================================================
 //==============================================================================
 #define	CRC32_GEN_POLY		0xEDB88320u		/* CRC32 Generator (reversed) polynomial */
 
 #define CRC32_LEN			sizeof(uint32)
 
+#define CRC32_LUT_SLICES	8				/* Number of 256 entry tables used to process 8 bytes per step */
+
+/*!
+Generator for the slice-by-8 CRC32 lookup tables of CRC32_GEN_POLY, which are
+held in one array of CRC32_LUT_SLICES x 256 entries.
+Entry (slice * 256 + n) is the CRC of byte n followed by 'slice' zero bytes.
+*/
+struct TCrc32LutGen {
+	typedef uint32 TValue;
+
+	/*! Function that shifts a CRC through a number of zero data bits */
+	static constexpr uint32 Shift(uint32 crc, uint32 bits) {
+		return (bits == 0) ? crc : Shift((crc & 1) ? ((crc >> 1) ^ CRC32_GEN_POLY) : (crc >> 1), bits - 1);
+	}
+
+	/*! Function that returns the table entry at the specified index */
+	static constexpr uint32 Entry(uint32 idx) {
+		return Shift(idx & 0xFF, 8 * ((idx >> 8) + 1));
+	}
+};
+
+/*! Define the slice-by-8 CRC32 lookup tables, generated at compile time into flash */
+typedef TLut<TCrc32LutGen, CRC32_LUT_SLICES * 256> TCrc32Lut;
+
 /*!
 Class of static helper functions for manipulating acoustic messages and packets
 */
@@ -29,7 +56,56 @@ class CCrc32 {
 		static uint32 CalcBuffer(puint32 data, uint32 len, uint32 poly, uint32 last = 0);
 		static uint32 CalcValue(uint8 value, uint32 poly, uint32 last = 0);
 		static uint32 CalcValue(uint32 value, uint32 poly, uint32 last = 0);
+
+	private:
+		//Private Static Methods
+		static inline uint32 LutByte(uint32 crc, uint8 value);
+		static inline uint32 LutWord(uint32 crc, uint32 value);
+		static inline uint32 LutWords(uint32 crc, uint32 value0, uint32 value1);
 };
 
+//==============================================================================
+//Inline Implementation...
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that adds a byte into a CRC32_GEN_POLY CRC using the lookup tables
+*/
+uint32 CCrc32::LutByte(uint32 crc, uint8 value)
+{
+	return TCrc32Lut::Table[(crc ^ value) & 0xFF] ^ (crc >> 8);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that adds a little endian 32-bit word into a CRC32_GEN_POLY CRC,
+using four of the lookup tables (slice-by-4)
+*/
+uint32 CCrc32::LutWord(uint32 crc, uint32 value)
+{
+	const uint32* lut = TCrc32Lut::Table.Values;
+	crc ^= value;
+	return lut[(3 * 256) + (crc & 0xFF)] ^
+		lut[(2 * 256) + ((crc >> 8) & 0xFF)] ^
+		lut[(1 * 256) + ((crc >> 16) & 0xFF)] ^
+		lut[crc >> 24];
+}
+
+/*!-----------------------------------------------------------------------------
+Function that adds two consecutive little endian 32-bit words into a
+CRC32_GEN_POLY CRC, using all eight lookup tables (slice-by-8)
+*/
+uint32 CCrc32::LutWords(uint32 crc, uint32 value0, uint32 value1)
+{
+	const uint32* lut = TCrc32Lut::Table.Values;
+	crc ^= value0;
+	return lut[(7 * 256) + (crc & 0xFF)] ^
+		lut[(6 * 256) + ((crc >> 8) & 0xFF)] ^
+		lut[(5 * 256) + ((crc >> 16) & 0xFF)] ^
+		lut[(4 * 256) + (crc >> 24)] ^
+		lut[(3 * 256) + (value1 & 0xFF)] ^
+		lut[(2 * 256) + ((value1 >> 8) & 0xFF)] ^
+		lut[(1 * 256) + ((value1 >> 16) & 0xFF)] ^
+		lut[value1 >> 24];
+}
+
 //==============================================================================
 #endif
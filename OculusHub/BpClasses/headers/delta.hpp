@@ -0,0 +1,110 @@
+/*==============================================================================
+C++ Module that provides the definitions and implementation for binary delta
+patches (in the style of bsdiff), that rebuild a new image from an existing
+base image and the differences between them.
+
+The patch stream starts with a header...
+	Base length		Four byte (little-endian) length of the base image the patch was made against
+	Base checksum	Four byte (little-endian) CRC32 of the base image
+followed by a series of operations, each made up of...
+	Add length		Four byte (little-endian) count of bytes to add to the base image
+	Insert length	Four byte (little-endian) count of bytes to insert
+	Seek			Four byte (little-endian, signed) distance to move in the base image
+	Add bytes		Each added to the next byte of the base image to give the output
+	Insert bytes	The bytes to copy straight to the output
+After the add bytes, the position in the base image has moved on by the add
+length, and after the insert bytes it moves on by the seek distance. The patch
+ends once the new image length has been output, and anything after the end
+(such as padding) is ignored.
+
+Where the new image only moves code around, most add bytes are zero (or the
+small change in an address), so patches compress well (see lz.hpp).
+
+Patches are made in one call with CDelta::Diff (i.e. on the PC preparing a
+firmware update), and applied in any number of pieces through a CDeltaDecoder,
+which reads the base image directly from memory and hands back each full
+output buffer.
+==============================================================================*/
+//Prevent multiple inclusions of this file
+#ifndef DELTA_HPP
+#define DELTA_HPP
+
+//Include system libraries
+#include <string.h>		//For memcpy and memcmp functions
+
+//Include common type definitions and macros
+#include "common.h"
+
+//==============================================================================
+//General Definitions and Types
+//==============================================================================
+#define DELTA_HEADER_SIZE		8			/*!< Number of bytes in the patch header */
+#define DELTA_CONTROL_SIZE		12			/*!< Number of bytes at the start of each operation */
+
+//==============================================================================
+//Class Definition...
+//==============================================================================
+/*! Class providing the patch generator */
+class CDelta {
+	private:
+		static uint32 MatchLength(puint8 base, uint32 baseLength, puint8 src, uint32 srcLength);
+		static puint8 PutUint32(puint8 dest, puint8 destEnd, uint32 value);
+		static uint32 Search(int32* index, puint8 base, uint32 baseLength, puint8 src, uint32 srcLength, uint32 start, uint32 end, puint32 pos);
+		static void Sort(int32* index, puint8 base, uint32 baseLength);
+
+	public:
+		static uint32 Diff(puint8 base, uint32 baseLength, uint32 baseChecksum, puint8 src, uint32 srcLength, puint8 dest, uint32 destSize);
+};
+
+//------------------------------------------------------------------------------
+/*!
+Class that holds the state of a patch being applied
+*/
+class CDeltaDecoder {
+	private:
+		/*! Enumeration of the part of the patch the decoder expects next */
+		enum EDeltaState {
+			DELTA_HEADER,
+			DELTA_CONTROL,
+			DELTA_ADD,
+			DELTA_INSERT,
+			DELTA_END,
+			DELTA_ERROR
+		};
+
+	private:
+		puint8		_buffer;		/*!< Buffer the output is built up in */
+		uint32		_bufferSize;	/*!< Size of the output buffer */
+		uint32		_bufferPos;		/*!< Position in the buffer the next byte is output into */
+		uint32		_outputPos;		/*!< Position in the buffer of the first byte not yet handed back (non-zero only at the end of the patch) */
+		puint8		_base;			/*!< Pointer to the base image in memory */
+		uint32		_baseSize;		/*!< Largest base image length a patch may refer to */
+		uint32		_baseChecksum;	/*!< CRC32 the base image the patch was made against must have */
+		uint32		_baseLength;	/*!< Length of the base image, from the patch header */
+		uint32		_basePos;		/*!< Position in the base image the next added byte is taken from */
+		uint32		_length;		/*!< Length of the new image being output */
+		uint32		_total;			/*!< Total number of bytes output */
+		EDeltaState	_state;			/*!< Part of the patch expected next */
+		uint32		_field[3];		/*!< Header or operation values being read */
+		uint32		_fieldPos;		/*!< Number of header or operation bytes read */
+		uint32		_addLength;		/*!< Add bytes still to decode */
+		uint32		_insertLength;	/*!< Insert bytes still to decode */
+		int32		_seek;			/*!< Distance to move in the base image once the operation is decoded */
+
+	public:
+		//Construction and Disposal
+		CDeltaDecoder(uint32 bufferSize);
+		~CDeltaDecoder();
+
+		//Methods
+		bool Decode(puint8 src, uint32 srcLength, puint32 srcUsed, puint8* out, puint32 outLength);
+		uint32 GetTotal();
+		void Init(puint8 base, uint32 baseSize, uint32 baseChecksum, uint32 length);
+		bool IsEnd();
+};
+
+/*! Define a pointer to a delta patch decoder */
+typedef CDeltaDecoder* PDeltaDecoder;
+
+//==============================================================================
+#endif
@@ -5,6 +5,9 @@
 #ifndef FIFOBUFFER_HPP
 #define FIFOBUFFER_HPP
 
+//Include system libraries
+#include <string.h>		//For memcpy function
+
 //Include common type definitions and macros
 #include "common.h"
 
@@ -33,14 +36,18 @@ class CFifoBuffer {
 		CFifoBuffer(uint32 capacity);
 		~CFifoBuffer();	
 		void Clear();
+		void Discard(uint32 count);
 		inline uint32 GetCapacity();
 		inline uint32 GetCount();
 		inline uint32 GetFree();
 		inline bool IsEmpty();
 		inline bool IsFull();
 		bool Peek(T* pvalue, uint32 index);
+		uint32 PeekBlock(pT* pdata);
 		bool Push(T value);	
+		uint32 PushBlock(const T* pdata, uint32 count);
 		bool Pop(T* pvalue);	
+		uint32 PopBlock(T* pdata, uint32 count);
 		void SetCapacity(uint32 capacity);
 };
 
@@ -109,6 +116,23 @@ void CFifoBuffer<T>::Clear()
 	_idxWrite = 0;
 }
 
+/*!-----------------------------------------------------------------------------
+Function that removes elements from the start of the buffer without reading them.
+Used with PeekBlock once a peripheral (i.e. DMA) has consumed the elements.
+@param count The number of elements to remove (limited to the number held)
+*/
+template <class T>
+void CFifoBuffer<T>::Discard(uint32 count)
+{
+	if(count > _count)
+		count = _count;
+
+	_idxRead += count;
+	if(_idxRead >= _capacity)
+		_idxRead -= _capacity;
+	_count -= count;
+}
+
 /*!-----------------------------------------------------------------------------
 Function that returns the capacity of the buffer
 @result The number of elements the buffer can hold
@@ -178,6 +202,24 @@ bool CFifoBuffer<T>::Peek(T* pvalue, uint32 index)
 	}	
 }
 
+/*!-----------------------------------------------------------------------------
+Function that returns a pointer to the elements at the start of the buffer, and
+how many of them are held contiguously in memory (up to the wrap point of the
+ring). Elements are not removed - call Discard once they have been used.
+@param pdata Pointer to where the address of the first element should be stored
+@result The number of contiguous elements available at the returned address
+*/
+template <class T>
+uint32 CFifoBuffer<T>::PeekBlock(pT* pdata)
+{
+	uint32 count = _capacity - _idxRead;
+	if(count > _count)
+		count = _count;
+
+	*pdata = &_data[_idxRead];
+	return count;
+}
+
 /*!-----------------------------------------------------------------------------
 Function that pushes an element onto the end of the buffer
 @param value The element to push onto the buffer
@@ -201,6 +243,36 @@ bool CFifoBuffer<T>::Push(T value)
 	}
 }
 
+/*!-----------------------------------------------------------------------------
+Function that pushes a block of elements onto the end of the buffer, copying
+them in (at most) two contiguous runs either side of the wrap point.
+@param pdata Pointer to the elements to push onto the buffer
+@param count The number of elements to push
+@result The number of elements pushed, which is less than count if the buffer filled
+*/
+template <class T>
+uint32 CFifoBuffer<T>::PushBlock(const T* pdata, uint32 count)
+{
+	uint32 space = _capacity - _count;
+	if(count > space)
+		count = space;
+
+	//Copy up to the end of the storage, then any remainder to the start
+	uint32 run = _capacity - _idxWrite;
+	if(run > count)
+		run = count;
+	memcpy(&_data[_idxWrite], pdata, run * sizeof(T));
+	if(count > run)
+		memcpy(&_data[0], pdata + run, (count - run) * sizeof(T));
+
+	_idxWrite += count;
+	if(_idxWrite >= _capacity)
+		_idxWrite -= _capacity;
+	_count += count;
+
+	return count;
+}
+
 /*!-----------------------------------------------------------------------------
 Function that pops an element of the start of the buffer
 @param pvalue Pointer to where the element should be stored
@@ -223,6 +295,35 @@ bool CFifoBuffer<T>::Pop(T* pvalue)
 	}
 }
 
+/*!-----------------------------------------------------------------------------
+Function that pops a block of elements off the start of the buffer, copying
+them out in (at most) two contiguous runs either side of the wrap point.
+@param pdata Pointer to where the elements should be stored
+@param count The maximum number of elements to pop
+@result The number of elements popped, which is less than count if the buffer emptied
+*/
+template <class T>
+uint32 CFifoBuffer<T>::PopBlock(T* pdata, uint32 count)
+{
+	if(count > _count)
+		count = _count;
+
+	//Copy up to the end of the storage, then any remainder from the start
+	uint32 run = _capacity - _idxRead;
+	if(run > count)
+		run = count;
+	memcpy(pdata, &_data[_idxRead], run * sizeof(T));
+	if(count > run)
+		memcpy(pdata + run, &_data[0], (count - run) * sizeof(T));
+
+	_idxRead += count;
+	if(_idxRead >= _capacity)
+		_idxRead -= _capacity;
+	_count -= count;
+
+	return count;
+}
+
 /*!-----------------------------------------------------------------------------
 Function that sets the maximum storage capacity of the buffer
 @param capacity The new capacity of the buffer
@@ -0,0 +1,90 @@
+/*==============================================================================
+C++ Module that provides templates for generating constant lookup tables at
+compile time, so they are placed in flash and need no RAM or initialisation
+code at startup.
+
+A table is described by a generator struct, that defines the element type as
+TValue and a constexpr Entry function returning the value for each index...
+	struct TMyLutGen {
+		typedef uint16 TValue;
+		static constexpr TValue Entry(uint32 idx) { return ...; }
+	};
+The table is then accessed through TLut<TMyLutGen, size>::Table, which can be
+indexed directly, or through its Values array.
+
+09/03/2018 - Created v1.0 of file
+==============================================================================*/
+//Prevent multiple inclusions of this file
+#ifndef LUT_HPP
+#define LUT_HPP
+
+//Include system libraries
+
+//Include common type definitions and macros
+#include "common.h"
+
+//==============================================================================
+//Template Definitions...
+//==============================================================================
+/*! Struct holding a compile time sequence of indices 0..N-1 */
+template <uint32... Is>
+struct TLutIndexSeq {
+	typedef TLutIndexSeq type;
+};
+
+/*! Struct that joins two index sequences, offsetting the second by the length of the first */
+template <class TSeq1, class TSeq2>
+struct TLutIndexSeqJoin;
+
+template <uint32... Is1, uint32... Is2>
+struct TLutIndexSeqJoin<TLutIndexSeq<Is1...>, TLutIndexSeq<Is2...> > : TLutIndexSeq<Is1..., (sizeof...(Is1) + Is2)...> {
+};
+
+/*!
+Struct that builds the index sequence 0..N-1, by halving the length at each
+level so large tables don't exceed the template recursion depth
+*/
+template <uint32 N>
+struct TLutMakeIndexSeq : TLutIndexSeqJoin<typename TLutMakeIndexSeq<N / 2>::type, typename TLutMakeIndexSeq<N - (N / 2)>::type> {
+};
+
+template <>
+struct TLutMakeIndexSeq<0> : TLutIndexSeq<> {
+};
+
+template <>
+struct TLutMakeIndexSeq<1> : TLutIndexSeq<0> {
+};
+
+/*! Struct holding the elements of a lookup table, so it can be returned by a constexpr function */
+template <typename T, uint32 N>
+struct TLutArray {
+	T Values[N];
+
+	/*! Function that returns the element at the specified index */
+	constexpr const T& operator[](uint32 idx) const {
+		return Values[idx];
+	}
+};
+
+/*! Function that expands the generator's entries for an index sequence into a table */
+template <class TGen, uint32... Is>
+constexpr TLutArray<typename TGen::TValue, sizeof...(Is)> LutBuild(TLutIndexSeq<Is...>)
+{
+	return {{ TGen::Entry(Is)... }};
+}
+
+/*!
+Struct that provides a constant lookup table of N elements, whose values are
+generated at compile time by TGen::Entry
+*/
+template <class TGen, uint32 N>
+struct TLut {
+	static constexpr TLutArray<typename TGen::TValue, N> Table = LutBuild<TGen>(typename TLutMakeIndexSeq<N>::type());
+};
+
+template <class TGen, uint32 N>
+constexpr TLutArray<typename TGen::TValue, N> TLut<TGen, N>::Table;
+
+//==============================================================================
+#endif
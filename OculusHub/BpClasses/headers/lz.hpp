@@ -0,0 +1,94 @@
+/*==============================================================================
+C++ Module that provides the definitions and implementation for a small LZ77
+(LZ4 style) compression scheme, with a streaming decoder that only needs a
+window of recently decoded data in RAM.
+
+The compressed stream is a series of sequences, each made up of...
+	Token			High nibble is the literal count, low nibble is the match length - LZ_MATCH_MIN
+	Literal count	If the token count is 15, further bytes are added on, until one isn't 255
+	Literals		The bytes to copy straight to the output
+	Offset			Two byte (little-endian) distance back to copy the match from,
+					where zero marks the end of the stream (no match length follows)
+	Match length	If the token length is 15, further bytes are added on, until one isn't 255
+Offsets are never larger than the decoder's window size, and anything after the
+end of the stream (such as padding) is ignored.
+
+Data can be compressed in one call with CLz::Compress (i.e. on the PC preparing
+a firmware update), and decompressed in any number of pieces through a
+CLzDecoder, which decodes into its window and hands back each full window.
+==============================================================================*/
+//Prevent multiple inclusions of this file
+#ifndef LZ_HPP
+#define LZ_HPP
+
+//Include system libraries
+#include <string.h>		//For memcpy and memset functions
+
+//Include common type definitions and macros
+#include "common.h"
+
+//==============================================================================
+//General Definitions and Types
+//==============================================================================
+#define LZ_MATCH_MIN		4			/*!< Shortest match encoded, as shorter matches take no less space than literals */
+#define LZ_WINDOW_MAX		0x8000		/*!< Largest window size (a power of 2), limited by the two byte offset */
+
+//==============================================================================
+//Class Definition...
+//==============================================================================
+/*! Class providing the compressor */
+class CLz {
+	private:
+		static puint8 PutLength(puint8 dest, puint8 destEnd, uint32 length);
+
+	public:
+		static uint32 Compress(puint8 src, uint32 srcLength, puint8 dest, uint32 destSize, uint32 windowSize);
+};
+
+//------------------------------------------------------------------------------
+/*!
+Class that holds the state of a stream being decompressed
+*/
+class CLzDecoder {
+	private:
+		/*! Enumeration of the part of a sequence the decoder expects next */
+		enum ELzState {
+			LZ_TOKEN,
+			LZ_LITERAL_LENGTH,
+			LZ_LITERALS,
+			LZ_OFFSET_LO,
+			LZ_OFFSET_HI,
+			LZ_MATCH_LENGTH,
+			LZ_MATCH,
+			LZ_END,
+			LZ_ERROR
+		};
+
+	private:
+		puint8		_window;		/*!< Ring buffer holding the most recently decoded data */
+		uint32		_windowSize;	/*!< Size of the window, which must be a power of 2 */
+		uint32		_windowPos;		/*!< Position in the window the next byte is decoded into */
+		uint32		_outputPos;		/*!< Position in the window of the first byte not yet handed back (non-zero only at the end of the stream) */
+		uint32		_total;			/*!< Total number of bytes decoded */
+		ELzState	_state;			/*!< Part of the sequence expected next */
+		uint8		_token;			/*!< Token of the sequence being decoded */
+		uint32		_length;		/*!< Literal or match bytes still to decode */
+		uint32		_offset;		/*!< Offset of the match being decoded */
+
+	public:
+		//Construction and Disposal
+		CLzDecoder(uint32 windowSize);
+		~CLzDecoder();
+
+		//Methods
+		bool Decode(puint8 src, uint32 srcLength, puint32 srcUsed, puint8* out, puint32 outLength);
+		uint32 GetTotal();
+		void Init();
+		bool IsEnd();
+};
+
+/*! Define a pointer to a LZ decoder */
+typedef CLzDecoder* PLzDecoder;
+
+//==============================================================================
+#endif
@@ -2,6 +2,10 @@
 C++ Module that provides the definitions and implementation for an SHA1 hashing
 algorithm
 
+Data can either be hashed in one call with CSha1::Calc, or streamed through a
+CSha1Context in any number of pieces (Init, Update... Final), so large amounts
+of data (such as firmware images) can be hashed as they arrive.
+
 01/05/2014 - Created v1.0 of file based on from https://code.google.com/p/smallsha1/
 ==============================================================================*/
 //Prevent multiple inclusions of this file
@@ -9,26 +13,65 @@ algorithm
 #define SHA1_HPP
 
 //Include system libraries
+#include <string.h>		//For memcpy and memset functions
 
 //Include common type definitions and macros
 #include "common.h"
 
+//==============================================================================
+//General Definitions and Types
+//==============================================================================
+#define SHA1_BLOCK_SIZE		64			/*!< Number of bytes in each block of the message processed by the hash */
+#define SHA1_HASH_SIZE		20			/*!< Number of bytes in the hash result */
+
 /*! Define a type representing an array for the 20 byte (160 bit) Hash result */
 //typedef Uint8[20] TSha1Hash;
 
 //typedef PUint8 PSha1Hash;
 
-
+//==============================================================================
+//Class Definition...
+//==============================================================================
 class CSha1 {
 	private:
-		static inline void ClearW(puint32 w);
-		static void InnerHash(puint32 result, puint32 w);
 		static inline uint32 RotateLeft(const uint32 value, const uint32 steps);
-	
+
 	public:
-		static void Calc(puint8 src, uint32 bytes, puint8 hash);	
+		static void Calc(puint8 src, uint32 bytes, puint8 hash);
+		static void InnerHash(puint32 result, puint32 w);
 		static void ToHexString(puint8 hash, pchar hexStr);
 };
 
+//------------------------------------------------------------------------------
+//Pre-declare the CSha1Context class
+class CSha1Context;
+
+/*! Define a pointer to a SHA1 context */
+typedef CSha1Context* PSha1Context;
+
+/*!
+Class that holds the state of a SHA1 hash being computed incrementally
+*/
+class CSha1Context {
+	private:
+		uint32 _state[5];					/*!< The intermediate hash value */
+		uint8 _buffer[SHA1_BLOCK_SIZE];		/*!< Bytes of a partial block waiting for the rest of the block */
+		uint32 _bufferLen;					/*!< Number of bytes held in _buffer */
+		uint64 _length;						/*!< Total number of bytes added to the hash */
+
+		//Private Methods
+		void HashBlock(puint8 data);
+
+	public:
+		//Construction and Disposal
+		CSha1Context();
+
+		//Methods
+		void Final(puint8 hash);
+		uint64 GetLength();
+		void Init();
+		void Update(puint8 data, uint32 bytes);
+};
+
 //==============================================================================
 #endif
@@ -0,0 +1,400 @@
+/*==============================================================================
+Template class that implements a lock-free FIFO buffer for use between exactly
+one producer and one consumer, typically an interrupt handler and the main loop.
+
+The producer only ever writes the head index and the consumer only ever writes
+the tail index. Both indices run freely (wrapping at 2^32), and are masked into
+the storage, so the capacity is always rounded up to a power of two. The count
+is derived from the difference between the indices, so neither side needs to
+disable interrupts to access the buffer.
+
+As well as single element Push/Pop, contiguous spans of the storage can be
+accessed directly, allowing DMA or memcpy to fill or drain the buffer:
+	Producer: ReserveSpan to get free space, write into it, then CommitWrite
+	Consumer: PeekSpan to get held elements, read from them, then CommitRead
+
+Clear and SetCapacity modify both indices, so must only be called when neither
+the producer or consumer can access the buffer.
+
+Nothing here stops a second producer (or consumer) corrupting the indices. If
+more than one context needs to write (for example the main loop and an
+interrupt handler both printing), the writers must be serialised by the owner,
+such as CComUart::WriteAsync pushing each block with interrupts disabled.
+
+08/03/2018 - Created v1.0 of file
+==============================================================================*/
+//Prevent multiple inclusions of this file
+#ifndef SPSCFIFOBUFFER_HPP
+#define SPSCFIFOBUFFER_HPP
+
+//Include system libraries
+#include <string.h>		//For memcpy function
+
+//Include common type definitions and macros
+#include "common.h"
+
+//==============================================================================
+//Class Definition...
+//==============================================================================
+/*!
+Class that implements a single-producer, single-consumer FIFO buffer with a
+power-of-two capacity, that can be accessed without interrupt masking.
+*/
+template <class T>
+class CSpscFifoBuffer {
+	protected:
+		typedef T* pT;
+
+	private:
+		uint32 _capacity;
+		pT _data;
+		volatile uint32 _head;		/*!< Free running write index, only modified by the producer */
+		uint32 _mask;
+		volatile uint32 _tail;		/*!< Free running read index, only modified by the consumer */
+
+		//Private Methods
+		inline uint32 LoadHead();
+		inline uint32 LoadTail();
+
+	public:
+		CSpscFifoBuffer(uint32 capacity);
+		~CSpscFifoBuffer();
+		void Clear();
+		inline uint32 GetCapacity();
+		inline uint32 GetCount();
+		inline uint32 GetFree();
+		inline bool IsEmpty();
+		inline bool IsFull();
+		bool Peek(T* pvalue, uint32 index);
+		bool Push(T value);
+		uint32 PushBlock(const T* pdata, uint32 count);
+		bool Pop(T* pvalue);
+		uint32 PopBlock(T* pdata, uint32 count);
+		void SetCapacity(uint32 capacity);
+
+		//Span access
+		uint32 PeekSpan(pT* pdata);
+		void CommitRead(uint32 count);
+		uint32 ReserveSpan(pT* pdata);
+		void CommitWrite(uint32 count);
+};
+
+//Declare other types of SPSC FIFO Buffer
+typedef CSpscFifoBuffer<uint8> CByteSpscFifoBuffer;
+typedef CByteSpscFifoBuffer* PByteSpscFifoBuffer;
+
+typedef CSpscFifoBuffer<uint16> CUInt16SpscFifoBuffer;
+typedef CUInt16SpscFifoBuffer* PUInt16SpscFifoBuffer;
+
+typedef CSpscFifoBuffer<uint32> CUInt32SpscFifoBuffer;
+typedef CUInt32SpscFifoBuffer* PUInt32SpscFifoBuffer;
+
+//==============================================================================
+//Class Implementation...
+//==============================================================================
+//CSpscFifoBuffer
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Create the ring buffer and allocate memory resources
+@param capacity The minimum number of elements the buffer should hold (rounded up to a power of two)
+*/
+template <class T>
+CSpscFifoBuffer<T>::CSpscFifoBuffer(uint32 capacity)
+{
+	//Allocate the capacity and initialise
+	_data = NULL;
+	this->SetCapacity(capacity);
+}
+
+/*!-----------------------------------------------------------------------------
+Destroy the ring buffer and release resources used
+*/
+template <class T>
+CSpscFifoBuffer<T>::~CSpscFifoBuffer()
+{
+	//Release the data used
+	free(_data);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that clears the contents of the buffer.
+Must not be called while the producer or consumer may access the buffer.
+*/
+template <class T>
+void CSpscFifoBuffer<T>::Clear()
+{
+	_head = 0;
+	_tail = 0;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that marks elements returned by PeekSpan as read, releasing their
+space back to the producer. Must only be called by the consumer.
+@param count The number of elements that have been read
+*/
+template <class T>
+void CSpscFifoBuffer<T>::CommitRead(uint32 count)
+{
+	//Ensure the elements have been read before releasing their space
+	__atomic_store_n(&_tail, _tail + count, __ATOMIC_RELEASE);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that marks elements written into a ReserveSpan as held, making them
+available to the consumer. Must only be called by the producer.
+@param count The number of elements that have been written
+*/
+template <class T>
+void CSpscFifoBuffer<T>::CommitWrite(uint32 count)
+{
+	//Ensure the elements have been written before publishing them
+	__atomic_store_n(&_head, _head + count, __ATOMIC_RELEASE);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns the capacity of the buffer
+@result The number of elements the buffer can hold
+*/
+template <class T>
+uint32 CSpscFifoBuffer<T>::GetCapacity()
+{
+	return _capacity;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns how many elements the buffer currently contains
+*/
+template <class T>
+uint32 CSpscFifoBuffer<T>::GetCount()
+{
+	return this->LoadHead() - this->LoadTail();
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns the number of free elements on the buffer
+*/
+template <class T>
+uint32 CSpscFifoBuffer<T>::GetFree()
+{
+	return _capacity - this->GetCount();
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns if the buffer is empty
+*/
+template <class T>
+bool CSpscFifoBuffer<T>::IsEmpty()
+{
+	return (this->GetCount() == 0);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns if the buffer is full
+*/
+template <class T>
+bool CSpscFifoBuffer<T>::IsFull()
+{
+	return (this->GetCount() >= _capacity);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that reads the head index written by the producer, ensuring any
+elements it publishes are visible before they are accessed
+*/
+template <class T>
+uint32 CSpscFifoBuffer<T>::LoadHead()
+{
+	return __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that reads the tail index written by the consumer, ensuring any
+elements it releases have been read before their space is reused
+*/
+template <class T>
+uint32 CSpscFifoBuffer<T>::LoadTail()
+{
+	return __atomic_load_n(&_tail, __ATOMIC_ACQUIRE);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns a value at the specified index (relative to the start/head
+of the buffer), without removing the value from the buffer.
+Must only be called by the consumer.
+@param pvalue Pointer to where the element should be stored
+@param index The offset relative to the front of the buffer, where the value should be retreived
+@result False if the index is beyond the number of elements held
+*/
+template <class T>
+bool CSpscFifoBuffer<T>::Peek(T* pvalue, uint32 index)
+{
+	uint32 tail = _tail;
+	if(index < (this->LoadHead() - tail)) {
+		*pvalue = _data[(tail + index) & _mask];
+		return true;
+	}
+	else {
+		//The index is beyond the end of the buffer, so no data available
+		return false;
+	}
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns a pointer to the elements at the start of the buffer,
+and how many of them are held contiguously in memory (up to the wrap point).
+Must only be called by the consumer, followed by CommitRead.
+@param pdata Pointer to where the address of the first element should be stored
+@result The number of contiguous elements available at the returned address
+*/
+template <class T>
+uint32 CSpscFifoBuffer<T>::PeekSpan(pT* pdata)
+{
+	uint32 tail = _tail;
+	uint32 idx = tail & _mask;
+	uint32 count = this->LoadHead() - tail;
+	uint32 run = _capacity - idx;
+
+	*pdata = &_data[idx];
+	return (count < run) ? count : run;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that pops an element of the start of the buffer.
+Must only be called by the consumer.
+@param pvalue Pointer to where the element should be stored
+@result False if the buffer was empty and an element couldn't be removed
+*/
+template <class T>
+bool CSpscFifoBuffer<T>::Pop(T* pvalue)
+{
+	uint32 tail = _tail;
+	if(this->LoadHead() != tail) {
+		*pvalue = _data[tail & _mask];
+		this->CommitRead(1);
+		return true;
+	}
+	else {
+		//The buffer is empty, so nothing can be removed
+		return false;
+	}
+}
+
+/*!-----------------------------------------------------------------------------
+Function that pops a block of elements off the start of the buffer.
+Must only be called by the consumer.
+@param pdata Pointer to where the elements should be stored
+@param count The maximum number of elements to pop
+@result The number of elements popped, which is less than count if the buffer emptied
+*/
+template <class T>
+uint32 CSpscFifoBuffer<T>::PopBlock(T* pdata, uint32 count)
+{
+	uint32 tail = _tail;
+	uint32 held = this->LoadHead() - tail;
+	if(count > held)
+		count = held;
+
+	//Copy up to the end of the storage, then any remainder from the start
+	uint32 idx = tail & _mask;
+	uint32 run = _capacity - idx;
+	if(run > count)
+		run = count;
+	memcpy(pdata, &_data[idx], run * sizeof(T));
+	if(count > run)
+		memcpy(pdata + run, &_data[0], (count - run) * sizeof(T));
+
+	this->CommitRead(count);
+	return count;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that pushes an element onto the end of the buffer.
+Must only be called by the producer.
+@param value The element to push onto the buffer
+@result False is the buffer is full and the element couldn't be added
+*/
+template <class T>
+bool CSpscFifoBuffer<T>::Push(T value)
+{
+	uint32 head = _head;
+	if((head - this->LoadTail()) < _capacity) {
+		_data[head & _mask] = value;
+		this->CommitWrite(1);
+		return true;
+	}
+	else {
+		//The buffer is full
+		return false;
+	}
+}
+
+/*!-----------------------------------------------------------------------------
+Function that pushes a block of elements onto the end of the buffer.
+Must only be called by the producer.
+@param pdata Pointer to the elements to push onto the buffer
+@param count The number of elements to push
+@result The number of elements pushed, which is less than count if the buffer filled
+*/
+template <class T>
+uint32 CSpscFifoBuffer<T>::PushBlock(const T* pdata, uint32 count)
+{
+	uint32 head = _head;
+	uint32 space = _capacity - (head - this->LoadTail());
+	if(count > space)
+		count = space;
+
+	//Copy up to the end of the storage, then any remainder to the start
+	uint32 idx = head & _mask;
+	uint32 run = _capacity - idx;
+	if(run > count)
+		run = count;
+	memcpy(&_data[idx], pdata, run * sizeof(T));
+	if(count > run)
+		memcpy(&_data[0], pdata + run, (count - run) * sizeof(T));
+
+	this->CommitWrite(count);
+	return count;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns a pointer to the free space at the end of the buffer,
+and how many elements can be written contiguously there (up to the wrap point).
+Must only be called by the producer, followed by CommitWrite.
+@param pdata Pointer to where the address of the free space should be stored
+@result The number of elements that can be written at the returned address
+*/
+template <class T>
+uint32 CSpscFifoBuffer<T>::ReserveSpan(pT* pdata)
+{
+	uint32 head = _head;
+	uint32 idx = head & _mask;
+	uint32 space = _capacity - (head - this->LoadTail());
+	uint32 run = _capacity - idx;
+
+	*pdata = &_data[idx];
+	return (space < run) ? space : run;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that sets the storage capacity of the buffer, and clears it.
+Must not be called while the producer or consumer may access the buffer.
+@param capacity The minimum number of elements to hold (rounded up to a power of two)
+*/
+template <class T>
+void CSpscFifoBuffer<T>::SetCapacity(uint32 capacity)
+{
+	//Round the capacity up to the next power of two
+	if(capacity < 2)
+		capacity = 2;
+	_capacity = 1UL << (32 - CNT_LEADING_ZEROES(capacity - 1));
+	_mask = _capacity - 1;
+
+	//Allocate (if _data is null) or reallocate the data
+	_data = (pT)realloc(_data, _capacity * sizeof(T));
+
+	//Clear the data
+	this->Clear();
+}
+
+//==============================================================================
+#endif
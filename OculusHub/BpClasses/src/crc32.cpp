@@ -7,27 +7,77 @@
 //==============================================================================
 /*!-----------------------------------------------------------------------------
 Function that computes the CRC32 for an array of 8-bit data.
+For CRC32_GEN_POLY, the lookup tables are used to process 8 bytes at a time
+once the data is word aligned, otherwise the CRC is computed bit by bit.
 */
 uint32 CCrc32::CalcBuffer(puint8 data, uint32 len, uint32 poly, uint32 last)
 {
-	uint32 crc = last;	
-	for(uint32 i = 0; i < len; i++) {
-		crc = CCrc32::CalcValue(*data, poly, crc);
+	uint32 crc = last;
+
+	if(poly != CRC32_GEN_POLY) {
+		for(uint32 i = 0; i < len; i++) {
+			crc = CCrc32::CalcValue(*data, poly, crc);
+			data++;
+		}
+		return crc;
+	}
+
+	//Process bytes up to a word boundary
+	while((len > 0) && IS_BITS_SET((uint32)data, 0x03)) {
+		crc = CCrc32::LutByte(crc, *data);
 		data++;
+		len--;
 	}
+
+	//Process aligned pairs of words
+	puint32 words = (puint32)data;
+	while(len >= 8) {
+		crc = CCrc32::LutWords(crc, words[0], words[1]);
+		words += 2;
+		len -= 8;
+	}
+	if(len >= 4) {
+		crc = CCrc32::LutWord(crc, words[0]);
+		words++;
+		len -= 4;
+	}
+
+	//Process the remaining bytes
+	data = (puint8)words;
+	while(len > 0) {
+		crc = CCrc32::LutByte(crc, *data);
+		data++;
+		len--;
+	}
+
 	return crc;
 }
 
 /*!-----------------------------------------------------------------------------
 Function that computes the CRC32 for an array of 32-bit data.
+For CRC32_GEN_POLY, the lookup tables are used to process 2 words at a time,
+otherwise the CRC is computed bit by bit.
 */
 uint32 CCrc32::CalcBuffer(puint32 data, uint32 len, uint32 poly, uint32 last)
 {
-	uint32 crc = last;	
-	for(uint32 i = 0; i < len; i++) {
-		crc = CCrc32::CalcValue(*data, poly, crc);
-		data++;
+	uint32 crc = last;
+
+	if(poly != CRC32_GEN_POLY) {
+		for(uint32 i = 0; i < len; i++) {
+			crc = CCrc32::CalcValue(*data, poly, crc);
+			data++;
+		}
+		return crc;
+	}
+
+	while(len >= 2) {
+		crc = CCrc32::LutWords(crc, data[0], data[1]);
+		data += 2;
+		len -= 2;
 	}
+	if(len > 0)
+		crc = CCrc32::LutWord(crc, data[0]);
+
 	return crc;
 }
 
@@ -0,0 +1,475 @@
+#include "delta.hpp"
+
+//==============================================================================
+//Class Implementation...
+//==============================================================================
+//CDelta
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that makes a patch that rebuilds one buffer from another, in one call.
+Following bsdiff, matches are found through a sorted index of every suffix of
+the base, and extended while more bytes agree than differ, so code that has
+only moved (changing the addresses within it) is patched with mostly zero add
+bytes. This allocates working memory in proportion to the base length, and is
+intended for use where memory is plentiful (i.e. on a PC preparing a firmware
+update).
+@param base Pointer to the base image the patch is applied to
+@param baseLength The number of bytes in the base image
+@param baseChecksum The CRC32 of the base image, stored in the patch header
+@param src Pointer to the new image the patch rebuilds
+@param srcLength The number of bytes in the new image
+@param dest Pointer to where the patch is written
+@param destSize The number of bytes available at dest
+@result The number of bytes in the patch, or 0 if it didn't fit into dest
+*/
+uint32 CDelta::Diff(puint8 base, uint32 baseLength, uint32 baseChecksum, puint8 src, uint32 srcLength, puint8 dest, uint32 destSize)
+{
+	puint8 destPtr = dest;
+	puint8 destEnd = dest + destSize;
+	int32* index = NULL;
+	uint32 scan = 0;
+	uint32 len = 0;
+	uint32 pos = 0;
+	uint32 lastScan = 0;
+	uint32 lastPos = 0;
+	int32 lastOffset = 0;
+
+	destPtr = CDelta::PutUint32(destPtr, destEnd, baseLength);
+	destPtr = CDelta::PutUint32(destPtr, destEnd, baseChecksum);
+
+	if(baseLength > 0) {
+		index = new int32[baseLength];
+		CDelta::Sort(index, base, baseLength);
+	}
+
+	while(destPtr && (scan < srcLength)) {
+		uint32 oldScore = 0;
+		uint32 scsc;
+
+		//Find the next match that isn't just a continuation of the last one
+		for(scsc = scan += len; scan < srcLength; scan++) {
+			len = index ? CDelta::Search(index, base, baseLength, src + scan, srcLength - scan, 0, baseLength - 1, &pos) : 0;
+
+			for(; scsc < (scan + len); scsc++) {
+				if(((scsc + lastOffset) < baseLength) && (base[scsc + lastOffset] == src[scsc]))
+					oldScore++;
+			}
+			if(((len == oldScore) && (len != 0)) || (len > (oldScore + 8)))
+				break;
+			if(((scan + lastOffset) < baseLength) && (base[scan + lastOffset] == src[scan]))
+				oldScore--;
+		}
+
+		if((len == oldScore) && (scan != srcLength))
+			continue;
+
+		//Extend the last match forwards, while more bytes agree than differ
+		int32 score = 0;
+		int32 bestScore = 0;
+		uint32 lenFwd = 0;
+		for(uint32 i = 0; ((lastScan + i) < scan) && ((lastPos + i) < baseLength); ) {
+			if(base[lastPos + i] == src[lastScan + i])
+				score++;
+			i++;
+			if(((score * 2) - (int32)i) > ((bestScore * 2) - (int32)lenFwd)) {
+				bestScore = score;
+				lenFwd = i;
+			}
+		}
+
+		//Extend the new match backwards in the same way
+		uint32 lenBack = 0;
+		if(scan < srcLength) {
+			score = 0;
+			bestScore = 0;
+			for(uint32 i = 1; (scan >= (lastScan + i)) && (pos >= i); i++) {
+				if(base[pos - i] == src[scan - i])
+					score++;
+				if(((score * 2) - (int32)i) > ((bestScore * 2) - (int32)lenBack)) {
+					bestScore = score;
+					lenBack = i;
+				}
+			}
+		}
+
+		//If the extensions overlap, split them where the most bytes agree
+		if((lastScan + lenFwd) > (scan - lenBack)) {
+			uint32 overlap = (lastScan + lenFwd) - (scan - lenBack);
+			uint32 lenSplit = 0;
+			score = 0;
+			bestScore = 0;
+			for(uint32 i = 0; i < overlap; i++) {
+				if(src[lastScan + lenFwd - overlap + i] == base[lastPos + lenFwd - overlap + i])
+					score++;
+				if(src[scan - lenBack + i] == base[pos - lenBack + i])
+					score--;
+				if(score > bestScore) {
+					bestScore = score;
+					lenSplit = i + 1;
+				}
+			}
+			lenFwd += lenSplit - overlap;
+			lenBack -= lenSplit;
+		}
+
+		//Write the operation, with the differences over the extended last match
+		//added, and the bytes up to the extended new match inserted
+		uint32 insertLen = (scan - lenBack) - (lastScan + lenFwd);
+		destPtr = CDelta::PutUint32(destPtr, destEnd, lenFwd);
+		destPtr = CDelta::PutUint32(destPtr, destEnd, insertLen);
+		destPtr = CDelta::PutUint32(destPtr, destEnd, (uint32)((pos - lenBack) - (lastPos + lenFwd)));
+		if(!destPtr || ((uint32)(destEnd - destPtr) < (lenFwd + insertLen))) {
+			destPtr = NULL;
+			break;
+		}
+		for(uint32 i = 0; i < lenFwd; i++)
+			*destPtr++ = (uint8)(src[lastScan + i] - base[lastPos + i]);
+		memcpy(destPtr, src + lastScan + lenFwd, insertLen);
+		destPtr += insertLen;
+
+		lastScan = scan - lenBack;
+		lastPos = pos - lenBack;
+		lastOffset = pos - scan;
+	}
+
+	delete[] index;
+
+	return destPtr ? (destPtr - dest) : 0;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns the number of bytes two buffers have in common at their start
+*/
+uint32 CDelta::MatchLength(puint8 base, uint32 baseLength, puint8 src, uint32 srcLength)
+{
+	uint32 len = 0;
+
+	while((len < baseLength) && (len < srcLength) && (base[len] == src[len]))
+		len++;
+	return len;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that writes a little-endian 32-bit value into the patch
+@param dest Pointer to where the value is written, or NULL if the patch has already overflowed
+@param destEnd Pointer to the end of the destination buffer
+@param value The value to write
+@result Pointer to the byte after the value, or NULL if it didn't fit
+*/
+puint8 CDelta::PutUint32(puint8 dest, puint8 destEnd, uint32 value)
+{
+	if(!dest || ((destEnd - dest) < 4))
+		return NULL;
+
+	*dest++ = (uint8)(value & 0xFF);
+	*dest++ = (uint8)((value >> 8) & 0xFF);
+	*dest++ = (uint8)((value >> 16) & 0xFF);
+	*dest++ = (uint8)((value >> 24) & 0xFF);
+	return dest;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that binary searches the sorted suffixes of the base for the longest
+match with the start of a buffer
+@param index The sorted suffix start positions of the base
+@param start The first entry of the index to search
+@param end The last entry of the index to search
+@param pos Pointer to where the position of the match in the base is stored
+@result The length of the match
+*/
+uint32 CDelta::Search(int32* index, puint8 base, uint32 baseLength, puint8 src, uint32 srcLength, uint32 start, uint32 end, puint32 pos)
+{
+	while((end - start) >= 2) {
+		uint32 mid = start + ((end - start) / 2);
+		uint32 len = baseLength - index[mid];
+		if(memcmp(base + index[mid], src, (len < srcLength) ? len : srcLength) < 0)
+			start = mid;
+		else
+			end = mid;
+	}
+
+	uint32 lenStart = CDelta::MatchLength(base + index[start], baseLength - index[start], src, srcLength);
+	uint32 lenEnd = CDelta::MatchLength(base + index[end], baseLength - index[end], src, srcLength);
+	if(lenStart > lenEnd) {
+		*pos = index[start];
+		return lenStart;
+	}
+	*pos = index[end];
+	return lenEnd;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that sorts the start positions of every suffix of the base, by doubling
+the length of the prefix they are ranked on until all ranks differ.
+*/
+void CDelta::Sort(int32* index, puint8 base, uint32 baseLength)
+{
+	int32* rank = new int32[baseLength];
+	int32* next = new int32[baseLength];
+	int32* count = new int32[(baseLength > 256) ? baseLength : 256];
+	int32* temp = new int32[baseLength];
+	uint32 ranks = 256;
+
+	//Start with the suffixes ordered and ranked on their first byte
+	for(uint32 r = 0; r < ranks; r++)
+		count[r] = 0;
+	for(uint32 idx = 0; idx < baseLength; idx++) {
+		rank[idx] = base[idx];
+		count[rank[idx]]++;
+	}
+	for(uint32 r = 1; r < ranks; r++)
+		count[r] += count[r - 1];
+	for(uint32 idx = baseLength; idx > 0; idx--)
+		index[--count[rank[idx - 1]]] = idx - 1;
+
+	for(uint32 step = 1; step < baseLength; step <<= 1) {
+		//Order the suffixes on the rank of the prefix following their own, where
+		//suffixes too short to have one come first
+		uint32 cnt = 0;
+		for(uint32 idx = baseLength - step; idx < baseLength; idx++)
+			temp[cnt++] = idx;
+		for(uint32 idx = 0; idx < baseLength; idx++) {
+			if((uint32)index[idx] >= step)
+				temp[cnt++] = index[idx] - step;
+		}
+
+		//Then (stably) on the rank of their own prefix
+		for(uint32 r = 0; r < ranks; r++)
+			count[r] = 0;
+		for(uint32 idx = 0; idx < baseLength; idx++)
+			count[rank[idx]]++;
+		for(uint32 r = 1; r < ranks; r++)
+			count[r] += count[r - 1];
+		for(uint32 idx = baseLength; idx > 0; idx--)
+			index[--count[rank[temp[idx - 1]]]] = temp[idx - 1];
+
+		//Re-rank the suffixes on the doubled prefix length
+		next[index[0]] = 0;
+		ranks = 1;
+		for(uint32 idx = 1; idx < baseLength; idx++) {
+			uint32 a = index[idx - 1];
+			uint32 b = index[idx];
+			int32 aNext = ((a + step) < baseLength) ? rank[a + step] : -1;
+			int32 bNext = ((b + step) < baseLength) ? rank[b + step] : -1;
+			if((rank[a] != rank[b]) || (aNext != bNext))
+				ranks++;
+			next[b] = ranks - 1;
+		}
+		int32* swap = rank;
+		rank = next;
+		next = swap;
+
+		//Stop once every suffix has its own rank
+		if(ranks == baseLength)
+			break;
+	}
+
+	delete[] temp;
+	delete[] count;
+	delete[] next;
+	delete[] rank;
+}
+
+//==============================================================================
+//CDeltaDecoder
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Constructor for a decoder, which must be initialised with the base image before
+it is used
+@param bufferSize The number of bytes in the output buffer, which is the most data handed back from each Decode call
+*/
+CDeltaDecoder::CDeltaDecoder(uint32 bufferSize)
+{
+	_bufferSize = bufferSize;
+	_buffer = new uint8[_bufferSize];
+	this->Init(NULL, 0, 0, 0);
+}
+
+/*!-----------------------------------------------------------------------------
+Destructor
+*/
+CDeltaDecoder::~CDeltaDecoder()
+{
+	delete[] _buffer;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that decodes the next piece of a patch.
+Decoding stops when either all of the source data has been used, or the output
+buffer is full. Decoded data is handed back a whole buffer at a time, and at the
+end of the patch, so each run starts at the same offset into a buffer sized
+block of the output (which suits programming it into flash). The data handed
+back stays valid until the next call. The function should be called until it
+neither uses any source data nor hands back any decoded data.
+@param src Pointer to the patch data
+@param srcLength The number of bytes of patch data
+@param srcUsed Pointer to where the number of bytes of patch data used is stored
+@param out Pointer to where a pointer to the newly decoded data is stored
+@param outLength Pointer to where the number of bytes of newly decoded data is stored
+@result False if the patch was made against a different base image, or is corrupt (referring outside the base image or past the new image length)
+*/
+bool CDeltaDecoder::Decode(puint8 src, uint32 srcLength, puint32 srcUsed, puint8* out, puint32 outLength)
+{
+	puint8 srcPtr = src;
+	puint8 srcEnd = src + srcLength;
+	uint32 count;
+	bool more = true;
+
+	while(more && (_bufferPos < _bufferSize)) {
+		switch(_state) {
+			case DELTA_HEADER :
+			case DELTA_CONTROL : {
+				if(srcPtr == srcEnd) { more = false; break; }
+				_field[_fieldPos >> 2] |= (uint32)(*srcPtr++) << ((_fieldPos & 0x03) * 8);
+				_fieldPos++;
+
+				if((_state == DELTA_HEADER) && (_fieldPos == DELTA_HEADER_SIZE)) {
+					//Only patch the base image the patch was made against
+					_baseLength = _field[0];
+					if((_field[1] != _baseChecksum) || (_baseLength > _baseSize)) {
+						_state = DELTA_ERROR;
+						return false;
+					}
+					_state = (_total == _length) ? DELTA_END : DELTA_CONTROL;
+				}
+				else if((_state == DELTA_CONTROL) && (_fieldPos == DELTA_CONTROL_SIZE)) {
+					_addLength = _field[0];
+					_insertLength = _field[1];
+					_seek = (int32)_field[2];
+					if((_addLength > (_length - _total)) || (_insertLength > ((_length - _total) - _addLength))
+						|| (_basePos > _baseLength) || (_addLength > (_baseLength - _basePos))) {
+						_state = DELTA_ERROR;
+						return false;
+					}
+					_state = DELTA_ADD;
+				}
+				else {
+					break;
+				}
+				_field[0] = 0;
+				_field[1] = 0;
+				_field[2] = 0;
+				_fieldPos = 0;
+				break;
+			}
+
+			case DELTA_ADD : {
+				//Add as many bytes onto the base image as there is source data and buffer for
+				count = _bufferSize - _bufferPos;
+				if(count > (uint32)(srcEnd - srcPtr))
+					count = srcEnd - srcPtr;
+				if(count > _addLength)
+					count = _addLength;
+				if(_addLength == 0) {
+					_state = DELTA_INSERT;
+					break;
+				}
+				if(count == 0) { more = false; break; }
+				for(uint32 idx = 0; idx < count; idx++)
+					_buffer[_bufferPos + idx] = srcPtr[idx] + _base[_basePos + idx];
+				srcPtr += count;
+				_bufferPos += count;
+				_basePos += count;
+				_total += count;
+				_addLength -= count;
+				break;
+			}
+
+			case DELTA_INSERT : {
+				//Copy as many bytes as there is source data and buffer for
+				count = _bufferSize - _bufferPos;
+				if(count > (uint32)(srcEnd - srcPtr))
+					count = srcEnd - srcPtr;
+				if(count > _insertLength)
+					count = _insertLength;
+				if(_insertLength == 0) {
+					_basePos += _seek;
+					_state = (_total == _length) ? DELTA_END : DELTA_CONTROL;
+					break;
+				}
+				if(count == 0) { more = false; break; }
+				memcpy(_buffer + _bufferPos, srcPtr, count);
+				srcPtr += count;
+				_bufferPos += count;
+				_total += count;
+				_insertLength -= count;
+				break;
+			}
+
+			case DELTA_END : {
+				//Ignore anything after the end of the patch
+				srcPtr = srcEnd;
+				more = false;
+				break;
+			}
+
+			case DELTA_ERROR :
+			default : {
+				return false;
+			}
+		}
+	}
+
+	//Hand back the decoded data once the buffer is full, or the patch has ended
+	*srcUsed = srcPtr - src;
+	*out = _buffer + _outputPos;
+	*outLength = 0;
+	if((_bufferPos == _bufferSize) || (_state == DELTA_END)) {
+		*outLength = _bufferPos - _outputPos;
+		_outputPos = _bufferPos;
+	}
+
+	//Once the end of the buffer has been handed back, decode from its start again
+	if(_bufferPos == _bufferSize) {
+		_bufferPos = 0;
+		_outputPos = 0;
+	}
+
+	return true;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns the total number of bytes decoded since Init
+*/
+uint32 CDeltaDecoder::GetTotal()
+{
+	return _total;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that resets the decoder, ready to accept the start of a new patch
+@param base Pointer to the base image in memory
+@param baseSize The largest base image length a patch may refer to
+@param baseChecksum The CRC32 of the base image, which must match the one the patch was made against
+@param length The length of the new image the patch rebuilds
+*/
+void CDeltaDecoder::Init(puint8 base, uint32 baseSize, uint32 baseChecksum, uint32 length)
+{
+	_bufferPos = 0;
+	_outputPos = 0;
+	_base = base;
+	_baseSize = baseSize;
+	_baseChecksum = baseChecksum;
+	_baseLength = 0;
+	_basePos = 0;
+	_length = length;
+	_total = 0;
+	_state = DELTA_HEADER;
+	_field[0] = 0;
+	_field[1] = 0;
+	_field[2] = 0;
+	_fieldPos = 0;
+	_addLength = 0;
+	_insertLength = 0;
+	_seek = 0;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns true once the whole new image has been decoded
+*/
+bool CDeltaDecoder::IsEnd()
+{
+	return (_state == DELTA_END);
+}
+
+//==============================================================================
@@ -0,0 +1,346 @@
+#include "lz.hpp"
+
+//==============================================================================
+//Class Implementation...
+//==============================================================================
+//CLz
+//==============================================================================
+#define LZ_HASH_BITS		16			/*!< Number of bits in the hash of the next LZ_MATCH_MIN bytes, used to find matches */
+#define LZ_CHAIN_MAX		256			/*!< Maximum number of earlier positions with the same hash checked for each match */
+
+#define LZ_HASH(p) ((((uint32)(p)[0] | ((uint32)(p)[1] << 8) | ((uint32)(p)[2] << 16) | ((uint32)(p)[3] << 24)) * 2654435761u) >> (32 - LZ_HASH_BITS))
+
+/*!-----------------------------------------------------------------------------
+Function that compresses a buffer in one call.
+Matches are found through hash chains of earlier positions, so this allocates
+working memory in proportion to the source length, and is intended for use
+where memory is plentiful (i.e. on a PC preparing a firmware update).
+@param src Pointer to the data to compress
+@param srcLength The number of bytes to compress
+@param dest Pointer to where the compressed stream is written
+@param destSize The number of bytes available at dest
+@param windowSize The window size of the decoder (a power of 2, up to LZ_WINDOW_MAX), which limits how far back matches are taken from
+@result The number of bytes in the compressed stream, or 0 if it didn't fit into dest
+*/
+uint32 CLz::Compress(puint8 src, uint32 srcLength, puint8 dest, uint32 destSize, uint32 windowSize)
+{
+	puint8 destPtr = dest;
+	puint8 destEnd = dest + destSize;
+	uint32 anchor = 0;
+	uint32 pos = 0;
+	int32* head;
+	int32* prev;
+
+	if(windowSize > LZ_WINDOW_MAX)
+		windowSize = LZ_WINDOW_MAX;
+
+	head = new int32[1 << LZ_HASH_BITS];
+	prev = new int32[srcLength + 1];
+	for(uint32 idx = 0; idx < (1 << LZ_HASH_BITS); idx++)
+		head[idx] = -1;
+
+	while(destPtr && ((pos + LZ_MATCH_MIN) <= srcLength)) {
+		uint32 hash = LZ_HASH(src + pos);
+		uint32 bestLen = 0;
+		uint32 bestDist = 0;
+		int32 cand = head[hash];
+
+		//Find the longest match from the earlier positions with the same hash
+		for(uint32 chain = 0; (cand >= 0) && (chain < LZ_CHAIN_MAX); chain++) {
+			uint32 dist = pos - cand;
+			if(dist > windowSize)
+				break;
+
+			uint32 len = 0;
+			while(((pos + len) < srcLength) && (src[cand + len] == src[pos + len]))
+				len++;
+			if(len > bestLen) {
+				bestLen = len;
+				bestDist = dist;
+			}
+			cand = prev[cand];
+		}
+
+		if(bestLen < LZ_MATCH_MIN) {
+			//No match, so leave the byte as a literal
+			prev[pos] = head[hash];
+			head[hash] = pos;
+			pos++;
+			continue;
+		}
+
+		//Write the sequence of literals before the match, and the match
+		uint32 litLen = pos - anchor;
+		uint32 matchLen = bestLen - LZ_MATCH_MIN;
+		if(destPtr >= destEnd) {
+			destPtr = NULL;
+			break;
+		}
+		*destPtr++ = (uint8)((((litLen < 15) ? litLen : 15) << 4) | ((matchLen < 15) ? matchLen : 15));
+		destPtr = CLz::PutLength(destPtr, destEnd, litLen);
+		if(!destPtr || ((uint32)(destEnd - destPtr) < (litLen + 2))) {
+			destPtr = NULL;
+			break;
+		}
+		memcpy(destPtr, src + anchor, litLen);
+		destPtr += litLen;
+		*destPtr++ = (uint8)(bestDist & 0xFF);
+		*destPtr++ = (uint8)((bestDist >> 8) & 0xFF);
+		destPtr = CLz::PutLength(destPtr, destEnd, matchLen);
+
+		//Add the matched positions into the hash chains
+		for(uint32 end = pos + bestLen; pos < end; pos++) {
+			if((pos + LZ_MATCH_MIN) <= srcLength) {
+				hash = LZ_HASH(src + pos);
+				prev[pos] = head[hash];
+				head[hash] = pos;
+			}
+		}
+		anchor = pos;
+	}
+
+	//Finish with the remaining literals, and an end of stream offset
+	if(destPtr) {
+		uint32 litLen = srcLength - anchor;
+		if(destPtr >= destEnd) {
+			destPtr = NULL;
+		}
+		else {
+			*destPtr++ = (uint8)(((litLen < 15) ? litLen : 15) << 4);
+			destPtr = CLz::PutLength(destPtr, destEnd, litLen);
+		}
+		if(!destPtr || ((uint32)(destEnd - destPtr) < (litLen + 2))) {
+			destPtr = NULL;
+		}
+		else {
+			memcpy(destPtr, src + anchor, litLen);
+			destPtr += litLen;
+			*destPtr++ = 0;
+			*destPtr++ = 0;
+		}
+	}
+
+	delete[] prev;
+	delete[] head;
+
+	return destPtr ? (destPtr - dest) : 0;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that writes the extra bytes of a literal or match length, that didn't
+fit in the 4 bits of the token.
+@param dest Pointer to where the bytes are written
+@param destEnd Pointer to the end of the destination buffer
+@param length The literal count, or match length less LZ_MATCH_MIN
+@result Pointer to the byte after those written, or NULL if they didn't fit
+*/
+puint8 CLz::PutLength(puint8 dest, puint8 destEnd, uint32 length)
+{
+	if(length < 15)
+		return dest;
+
+	length -= 15;
+	while(dest < destEnd) {
+		if(length < 255) {
+			*dest++ = (uint8)length;
+			return dest;
+		}
+		*dest++ = 255;
+		length -= 255;
+	}
+	return NULL;
+}
+
+#undef LZ_HASH
+
+//==============================================================================
+//CLzDecoder
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Constructor for a decoder, which is ready to accept the start of a stream
+@param windowSize The number of bytes in the window (a power of 2, up to LZ_WINDOW_MAX), which is the most data handed back from each Decode call
+*/
+CLzDecoder::CLzDecoder(uint32 windowSize)
+{
+	_windowSize = windowSize;
+	_window = new uint8[_windowSize];
+	this->Init();
+}
+
+/*!-----------------------------------------------------------------------------
+Destructor
+*/
+CLzDecoder::~CLzDecoder()
+{
+	delete[] _window;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that decodes the next piece of a compressed stream.
+Decoding stops when either all of the source data has been used, or the end of
+the window is reached. Decoded data is handed back a whole window at a time,
+and at the end of the stream, so each run starts at the same offset into a
+window sized block of the output (which suits programming it into flash). The
+data handed back stays valid until the next call. As a match can decode more
+data than fits in the window, the function should be called until it neither
+uses any source data nor hands back any decoded data.
+@param src Pointer to the compressed data
+@param srcLength The number of bytes of compressed data
+@param srcUsed Pointer to where the number of bytes of compressed data used is stored
+@param out Pointer to where a pointer to the newly decoded data is stored
+@param outLength Pointer to where the number of bytes of newly decoded data is stored
+@result False if the stream is corrupt (referring back beyond the start of the stream or the window)
+*/
+bool CLzDecoder::Decode(puint8 src, uint32 srcLength, puint32 srcUsed, puint8* out, puint32 outLength)
+{
+	puint8 srcPtr = src;
+	puint8 srcEnd = src + srcLength;
+	uint32 mask = _windowSize - 1;
+	uint32 count;
+	uint8 value;
+	bool more = true;
+
+	while(more && (_windowPos < _windowSize)) {
+		switch(_state) {
+			case LZ_TOKEN : {
+				if(srcPtr == srcEnd) { more = false; break; }
+				_token = *srcPtr++;
+				_length = _token >> 4;
+				_state = (_length == 15) ? LZ_LITERAL_LENGTH : LZ_LITERALS;
+				break;
+			}
+
+			case LZ_LITERAL_LENGTH :
+			case LZ_MATCH_LENGTH : {
+				if(srcPtr == srcEnd) { more = false; break; }
+				value = *srcPtr++;
+				_length += value;
+				if(value != 255)
+					_state = (_state == LZ_LITERAL_LENGTH) ? LZ_LITERALS : LZ_MATCH;
+				break;
+			}
+
+			case LZ_LITERALS : {
+				if(_length == 0) {
+					_state = LZ_OFFSET_LO;
+					break;
+				}
+				//Copy as many literals as there is source data and window for
+				count = _windowSize - _windowPos;
+				if(count > (uint32)(srcEnd - srcPtr))
+					count = srcEnd - srcPtr;
+				if(count > _length)
+					count = _length;
+				if(count == 0) { more = false; break; }
+				memcpy(_window + _windowPos, srcPtr, count);
+				srcPtr += count;
+				_windowPos += count;
+				_total += count;
+				_length -= count;
+				break;
+			}
+
+			case LZ_OFFSET_LO : {
+				if(srcPtr == srcEnd) { more = false; break; }
+				_offset = *srcPtr++;
+				_state = LZ_OFFSET_HI;
+				break;
+			}
+
+			case LZ_OFFSET_HI : {
+				if(srcPtr == srcEnd) { more = false; break; }
+				_offset |= (uint32)(*srcPtr++) << 8;
+				if(_offset == 0) {
+					_state = LZ_END;
+				}
+				else if((_offset > _windowSize) || (_offset > _total)) {
+					_state = LZ_ERROR;
+					return false;
+				}
+				else {
+					_length = (_token & 0x0F) + LZ_MATCH_MIN;
+					_state = ((_token & 0x0F) == 15) ? LZ_MATCH_LENGTH : LZ_MATCH;
+				}
+				break;
+			}
+
+			case LZ_MATCH : {
+				//Copy the match a byte at a time, as it may overlap the data being decoded
+				count = _windowSize - _windowPos;
+				if(count > _length)
+					count = _length;
+				_total += count;
+				_length -= count;
+				while(count > 0) {
+					_window[_windowPos] = _window[(_windowPos - _offset) & mask];
+					_windowPos++;
+					count--;
+				}
+				if(_length == 0)
+					_state = LZ_TOKEN;
+				break;
+			}
+
+			case LZ_END : {
+				//Ignore anything after the end of the stream
+				srcPtr = srcEnd;
+				more = false;
+				break;
+			}
+
+			case LZ_ERROR :
+			default : {
+				return false;
+			}
+		}
+	}
+
+	//Hand back the decoded data once the window is full, or the stream has ended
+	*srcUsed = srcPtr - src;
+	*out = _window + _outputPos;
+	*outLength = 0;
+	if((_windowPos == _windowSize) || (_state == LZ_END)) {
+		*outLength = _windowPos - _outputPos;
+		_outputPos = _windowPos;
+	}
+
+	//Once the end of the window has been handed back, decode from its start again
+	if(_windowPos == _windowSize) {
+		_windowPos = 0;
+		_outputPos = 0;
+	}
+
+	return true;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns the total number of bytes decoded since Init
+*/
+uint32 CLzDecoder::GetTotal()
+{
+	return _total;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that resets the decoder, ready to accept the start of a new stream
+*/
+void CLzDecoder::Init()
+{
+	_windowPos = 0;
+	_outputPos = 0;
+	_total = 0;
+	_state = LZ_TOKEN;
+	_token = 0;
+	_length = 0;
+	_offset = 0;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns true once the end of the stream has been decoded
+*/
+bool CLzDecoder::IsEnd()
+{
+	return (_state == LZ_END);
+}
+
+//==============================================================================
@@ -3,6 +3,8 @@
 //==============================================================================
 //Class Implementation...
 //==============================================================================
+//CSha1
+//==============================================================================
 /*!-----------------------------------------------------------------------------
 Rotate an integer value to left.
 */
@@ -12,17 +14,12 @@ uint32 CSha1::RotateLeft(const uint32 value, const uint32 steps)
 }
 
 /*!-----------------------------------------------------------------------------
-Sets the first 16 integers in the buffer to zero.
-Used for clearing the W buffer.
-*/
-void CSha1::ClearW(puint32 w)
-{
-	for(uint32 idx = 0; idx < 16; idx++) {
-		w[idx] = 0;
-	}
-}
-
-/*!-----------------------------------------------------------------------------
+Function that hashes one 512-bit block into the intermediate hash value.
+Only a 16 word message schedule is used, with each new word overwriting the
+word it is calculated from, and the 80 rounds are unrolled so the working
+variables rotate between registers rather than being moved each round.
+@param result Pointer to the 5 word intermediate hash value to update
+@param w Pointer to the 16 words of the block (big-endian order), which are overwritten
 */
 void CSha1::InnerHash(puint32 result, puint32 w)
 {
@@ -32,44 +29,47 @@ void CSha1::InnerHash(puint32 result, puint32 w)
 	uint32 d = result[3];
 	uint32 e = result[4];
 
-	int32 round = 0;
-
-	#define sha1macro(func, val) \
-	{ \
-		const uint32 t = CSha1::RotateLeft(a, 5) + (func) + e + val + w[round]; \
-		e = d; \
-		d = c; \
-		c = CSha1::RotateLeft(b, 30); \
-		b = a; \
-		a = t; \
-	}
-
-	while(round < 16) {
-		sha1macro((b & c) | (~b & d), 0x5a827999)
-		++round;
-	}
-	while(round < 20) {
-		w[round] = CSha1::RotateLeft((w[round - 3] ^ w[round - 8] ^ w[round - 14] ^ w[round - 16]), 1);
-		sha1macro((b & c) | (~b & d), 0x5a827999)
-		++round;
-	}
-	while(round < 40) {
-		w[round] = CSha1::RotateLeft((w[round - 3] ^ w[round - 8] ^ w[round - 14] ^ w[round - 16]), 1);
-		sha1macro(b ^ c ^ d, 0x6ed9eba1)
-		++round;
-	}
-	while(round < 60) {
-		w[round] = CSha1::RotateLeft((w[round - 3] ^ w[round - 8] ^ w[round - 14] ^ w[round - 16]), 1);
-		sha1macro((b & c) | (b & d) | (c & d), 0x8f1bbcdc)
-		++round;
-	}
-	while(round < 80) {
-		w[round] = CSha1::RotateLeft((w[round - 3] ^ w[round - 8] ^ w[round - 14] ^ w[round - 16]), 1);
-		sha1macro(b ^ c ^ d, 0xca62c1d6)
-		++round;
-	}
-
-	#undef sha1macro
+	//Compute the next word of the message schedule in place
+	#define SHA1_W(i) \
+		(w[(i) & 15] = CSha1::RotateLeft(w[((i) + 13) & 15] ^ w[((i) + 8) & 15] ^ w[((i) + 2) & 15] ^ w[(i) & 15], 1))
+
+	//Perform one round, where the variables passed in are rotated by the caller
+	#define SHA1_R0(v, x, y, z, u, i) { u += ((x & (y ^ z)) ^ z) + w[i] + 0x5a827999 + CSha1::RotateLeft(v, 5); x = CSha1::RotateLeft(x, 30); }
+	#define SHA1_R1(v, x, y, z, u, i) { u += ((x & (y ^ z)) ^ z) + SHA1_W(i) + 0x5a827999 + CSha1::RotateLeft(v, 5); x = CSha1::RotateLeft(x, 30); }
+	#define SHA1_R2(v, x, y, z, u, i) { u += (x ^ y ^ z) + SHA1_W(i) + 0x6ed9eba1 + CSha1::RotateLeft(v, 5); x = CSha1::RotateLeft(x, 30); }
+	#define SHA1_R3(v, x, y, z, u, i) { u += (((x | y) & z) | (x & y)) + SHA1_W(i) + 0x8f1bbcdc + CSha1::RotateLeft(v, 5); x = CSha1::RotateLeft(x, 30); }
+	#define SHA1_R4(v, x, y, z, u, i) { u += (x ^ y ^ z) + SHA1_W(i) + 0xca62c1d6 + CSha1::RotateLeft(v, 5); x = CSha1::RotateLeft(x, 30); }
+
+	SHA1_R0(a, b, c, d, e,  0); SHA1_R0(e, a, b, c, d,  1); SHA1_R0(d, e, a, b, c,  2); SHA1_R0(c, d, e, a, b,  3);
+	SHA1_R0(b, c, d, e, a,  4); SHA1_R0(a, b, c, d, e,  5); SHA1_R0(e, a, b, c, d,  6); SHA1_R0(d, e, a, b, c,  7);
+	SHA1_R0(c, d, e, a, b,  8); SHA1_R0(b, c, d, e, a,  9); SHA1_R0(a, b, c, d, e, 10); SHA1_R0(e, a, b, c, d, 11);
+	SHA1_R0(d, e, a, b, c, 12); SHA1_R0(c, d, e, a, b, 13); SHA1_R0(b, c, d, e, a, 14); SHA1_R0(a, b, c, d, e, 15);
+	SHA1_R1(e, a, b, c, d, 16); SHA1_R1(d, e, a, b, c, 17); SHA1_R1(c, d, e, a, b, 18); SHA1_R1(b, c, d, e, a, 19);
+
+	SHA1_R2(a, b, c, d, e, 20); SHA1_R2(e, a, b, c, d, 21); SHA1_R2(d, e, a, b, c, 22); SHA1_R2(c, d, e, a, b, 23);
+	SHA1_R2(b, c, d, e, a, 24); SHA1_R2(a, b, c, d, e, 25); SHA1_R2(e, a, b, c, d, 26); SHA1_R2(d, e, a, b, c, 27);
+	SHA1_R2(c, d, e, a, b, 28); SHA1_R2(b, c, d, e, a, 29); SHA1_R2(a, b, c, d, e, 30); SHA1_R2(e, a, b, c, d, 31);
+	SHA1_R2(d, e, a, b, c, 32); SHA1_R2(c, d, e, a, b, 33); SHA1_R2(b, c, d, e, a, 34); SHA1_R2(a, b, c, d, e, 35);
+	SHA1_R2(e, a, b, c, d, 36); SHA1_R2(d, e, a, b, c, 37); SHA1_R2(c, d, e, a, b, 38); SHA1_R2(b, c, d, e, a, 39);
+
+	SHA1_R3(a, b, c, d, e, 40); SHA1_R3(e, a, b, c, d, 41); SHA1_R3(d, e, a, b, c, 42); SHA1_R3(c, d, e, a, b, 43);
+	SHA1_R3(b, c, d, e, a, 44); SHA1_R3(a, b, c, d, e, 45); SHA1_R3(e, a, b, c, d, 46); SHA1_R3(d, e, a, b, c, 47);
+	SHA1_R3(c, d, e, a, b, 48); SHA1_R3(b, c, d, e, a, 49); SHA1_R3(a, b, c, d, e, 50); SHA1_R3(e, a, b, c, d, 51);
+	SHA1_R3(d, e, a, b, c, 52); SHA1_R3(c, d, e, a, b, 53); SHA1_R3(b, c, d, e, a, 54); SHA1_R3(a, b, c, d, e, 55);
+	SHA1_R3(e, a, b, c, d, 56); SHA1_R3(d, e, a, b, c, 57); SHA1_R3(c, d, e, a, b, 58); SHA1_R3(b, c, d, e, a, 59);
+
+	SHA1_R4(a, b, c, d, e, 60); SHA1_R4(e, a, b, c, d, 61); SHA1_R4(d, e, a, b, c, 62); SHA1_R4(c, d, e, a, b, 63);
+	SHA1_R4(b, c, d, e, a, 64); SHA1_R4(a, b, c, d, e, 65); SHA1_R4(e, a, b, c, d, 66); SHA1_R4(d, e, a, b, c, 67);
+	SHA1_R4(c, d, e, a, b, 68); SHA1_R4(b, c, d, e, a, 69); SHA1_R4(a, b, c, d, e, 70); SHA1_R4(e, a, b, c, d, 71);
+	SHA1_R4(d, e, a, b, c, 72); SHA1_R4(c, d, e, a, b, 73); SHA1_R4(b, c, d, e, a, 74); SHA1_R4(a, b, c, d, e, 75);
+	SHA1_R4(e, a, b, c, d, 76); SHA1_R4(d, e, a, b, c, 77); SHA1_R4(c, d, e, a, b, 78); SHA1_R4(b, c, d, e, a, 79);
+
+	#undef SHA1_W
+	#undef SHA1_R0
+	#undef SHA1_R1
+	#undef SHA1_R2
+	#undef SHA1_R3
+	#undef SHA1_R4
 
 	result[0] += a;
 	result[1] += b;
@@ -79,81 +79,16 @@ void CSha1::InnerHash(puint32 result, puint32 w)
 }
 
 /*!-----------------------------------------------------------------------------
+Function that computes the SHA1 hash of a buffer in one call
 @param src Pointer to the source data to hash
 @param bytes The number of bytes to run through the hash function.
 @param hash Pointer to a 20-byte array where the resultant hash is stored
 */
 void CSha1::Calc(puint8 src, uint32 bytes, puint8 hash)
 {
-	//Init the result array.
-	uint32 result[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
-
-	//The reusable round buffer
-	uint32 w[80];
-	uint32 wIdx;
-	uint32 wByte;
-	uint32 wShift;
-	int64 bits;
-
-	//Loop through all complete 64 byte blocks.
-	uint32 remaining = bytes;
-	while(remaining >= 64) {
-		//Break each 512 bit block into sixteen 32-bit big-endian words w[i], 0 <= i <= 15
-		for(wIdx = 0; wIdx < 16; wIdx++) {
-			uint32 wVal;
-			wVal = ((uint32)*src) << 24; src++;
-			wVal |= ((uint32)*src) << 16; src++;
-			wVal |= ((uint32)*src) << 8; src++;
-			wVal |= ((uint32)*src) << 0; src++;
-			w[wIdx] = wVal;
-		}
-
-		//Hash the block
-		CSha1::InnerHash(result, w);
-
-		//Decrease bytes remaining by the block size.
-		remaining -= 64;
-	}
-
-	//Handle the last and not full 64 byte block if existing.
-	//i.e. we should have 15 or less bytes at this point
-	CSha1::ClearW(w);
-	wByte = 0;
-	while(remaining > 0) {
-		//Make 32-bit big-endian words from remaining bytes
-		wIdx = wByte / 4;
-		wShift = (3 - (wByte % 4)) * 8;
-		w[wIdx] |= ((uint32)*src) << wShift;
-		remaining--;
-		src++;
-		wByte++;
-	}
-
-	//Append the bit '1' to the message, i.e. by adding 0x80 for 8-bit characters
-	wIdx = wByte / 4;
-	wShift = (3 - (wByte % 4)) * 8;
-	w[wIdx] |= (0x80 << wShift);
-	wByte++;
-
-	//If we havn't room in the w buffer of 512-bits to append the 64-bit number of
-	//bits encoded then hash the current block
-	if(wByte >= 56) {
-		CSha1::InnerHash(result, w);
-		CSha1::ClearW(w);
-	}
-
-	//Finally append the number of bits as a big-endian integer
-	bits = ((int64)bytes) * 8;
-	w[14] = (uint32)(bits >> 32);
-	w[15] = (uint32)(bits & 0xFFFFFFFF);
-	CSha1::InnerHash(result, w);
-
-	//Store hash result pointer, and make sure we get in in the correct endian order.
-	for(wByte = 0; wByte < 20; wByte++) {
-		wIdx = wByte / 4;
-		wShift = (3 - (wByte % 4)) * 8;
-		hash[wByte] = (result[wIdx] >> wShift) & 0xFF;
-	};
+	CSha1Context ctx;
+	ctx.Update(src, bytes);
+	ctx.Final(hash);
 }
 
 /*!-----------------------------------------------------------------------------
@@ -175,3 +110,132 @@ void CSha1::ToHexString(puint8 hash, pchar hexStr)
 }
 
 //==============================================================================
+//CSha1Context
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Constructor for a hash context, which is ready to accept data
+*/
+CSha1Context::CSha1Context()
+{
+	this->Init();
+}
+
+/*!-----------------------------------------------------------------------------
+Function that completes the hash, padding the message and appending its length.
+The context must be initialised again before it is reused.
+@param hash Pointer to a 20-byte array where the resultant hash is stored
+*/
+void CSha1Context::Final(puint8 hash)
+{
+	uint64 bits = _length * 8;
+	uint32 idx;
+
+	//Append the bit '1' to the message, i.e. by adding 0x80 for 8-bit characters
+	_buffer[_bufferLen] = 0x80;
+	_bufferLen++;
+
+	//If we haven't room in the block to append the 64-bit number of bits
+	//encoded, then pad and hash the current block
+	if(_bufferLen > (SHA1_BLOCK_SIZE - 8)) {
+		memset(&_buffer[_bufferLen], 0, SHA1_BLOCK_SIZE - _bufferLen);
+		this->HashBlock(_buffer);
+		_bufferLen = 0;
+	}
+
+	//Pad the block, and finally append the number of bits as a big-endian integer
+	memset(&_buffer[_bufferLen], 0, (SHA1_BLOCK_SIZE - 8) - _bufferLen);
+	for(idx = 0; idx < 8; idx++) {
+		_buffer[SHA1_BLOCK_SIZE - 1 - idx] = (uint8)(bits >> (idx * 8));
+	}
+	this->HashBlock(_buffer);
+
+	//Store the hash result in big-endian order
+	for(idx = 0; idx < SHA1_HASH_SIZE; idx++) {
+		hash[idx] = (uint8)(_state[idx / 4] >> ((3 - (idx % 4)) * 8));
+	}
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns the total number of bytes added to the hash
+*/
+uint64 CSha1Context::GetLength()
+{
+	return _length;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that loads a 64 byte block of the message as big-endian words and
+hashes it
+@param data Pointer to the block to hash
+*/
+void CSha1Context::HashBlock(puint8 data)
+{
+	uint32 w[16];
+
+	//Break the 512 bit block into sixteen 32-bit big-endian words w[i], 0 <= i <= 15
+	for(uint32 idx = 0; idx < 16; idx++) {
+		w[idx] = ((uint32)data[0] << 24) | ((uint32)data[1] << 16) | ((uint32)data[2] << 8) | (uint32)data[3];
+		data += 4;
+	}
+
+	CSha1::InnerHash(_state, w);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that starts a new hash, discarding any data previously added
+*/
+void CSha1Context::Init()
+{
+	_state[0] = 0x67452301;
+	_state[1] = 0xefcdab89;
+	_state[2] = 0x98badcfe;
+	_state[3] = 0x10325476;
+	_state[4] = 0xc3d2e1f0;
+	_bufferLen = 0;
+	_length = 0;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that adds data to the hash. Complete blocks are hashed straight from
+the source data, and only a partial block at the end is held in the context
+until more data is added.
+@param data Pointer to the data to add
+@param bytes The number of bytes to add
+*/
+void CSha1Context::Update(puint8 data, uint32 bytes)
+{
+	_length += bytes;
+
+	//Complete any partial block held from a previous call
+	if(_bufferLen > 0) {
+		uint32 len = SHA1_BLOCK_SIZE - _bufferLen;
+		if(len > bytes)
+			len = bytes;
+
+		memcpy(&_buffer[_bufferLen], data, len);
+		_bufferLen += len;
+		data += len;
+		bytes -= len;
+
+		if(_bufferLen < SHA1_BLOCK_SIZE)
+			return;
+
+		this->HashBlock(_buffer);
+		_bufferLen = 0;
+	}
+
+	//Hash complete blocks in place
+	while(bytes >= SHA1_BLOCK_SIZE) {
+		this->HashBlock(data);
+		data += SHA1_BLOCK_SIZE;
+		bytes -= SHA1_BLOCK_SIZE;
+	}
+
+	//Hold any remaining bytes until the block is completed
+	if(bytes > 0) {
+		memcpy(_buffer, data, bytes);
+		_bufferLen = bytes;
+	}
+}
+
+//==============================================================================
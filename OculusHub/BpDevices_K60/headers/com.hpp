@@ -9,7 +9,6 @@ C++ Module that provides a base communication interface framework.
 
 //Include system libraries
 #include <string.h>		//For strlen function
-#include <stdio.h>		//For vnsprintf function
 #include <stdarg.h>		//For variable length arguments in functions
 
 //Include class libraries
@@ -22,9 +21,24 @@ C++ Module that provides a base communication interface framework.
 //==============================================================================
 //Class Definition...
 //==============================================================================
-//Size of the buffer for PRINTF like commands
-#define COM_PRINT_BUFFER	256
+//Size of the stack buffer used to format a single numeric PRINTF field
+//(enough for a 64-bit integer, a decimal point and the maximum float precision)
+#define COM_PRINT_FIELD_BUFFER		32
 
+//Size of the stack chunk PRINTF output is gathered in, which is written to the
+//port as one block when full or at the end of the format string
+#define COM_PRINT_CHUNK_SIZE		64
+
+//Maximum number of decimal places that %f fields are formatted to
+#define COM_PRINT_FLOAT_PREC_MAX	9
+
+//Flags used while formatting a PRINTF field
+#define COM_PRINT_FLAG_LEFT			BIT(0)		/*!< '-' Left justify within the field width */
+#define COM_PRINT_FLAG_ZERO			BIT(1)		/*!< '0' Pad numbers with leading zeroes */
+#define COM_PRINT_FLAG_PLUS			BIT(2)		/*!< '+' Always show the sign of signed numbers */
+#define COM_PRINT_FLAG_SPACE		BIT(3)		/*!< ' ' Show a space in place of a positive sign */
+#define COM_PRINT_FLAG_ALT			BIT(4)		/*!< '#' Use the alternate form (0x prefix, decimal point) */
+#define COM_PRINT_FLAG_PREC			BIT(5)		/*!< A precision has been specified */
 
 #define COM_PRINT(fmt, args...) \
 { \
@@ -46,8 +60,20 @@ class CCom;
 /*! Define a pointer to a communications object */
 typedef CCom* PCom;
 
+/*! Structure holding the PRINTF output not yet written to the port */
+typedef struct {
+	char Data[COM_PRINT_CHUNK_SIZE];			/*!< The gathered characters */
+	uint32 Len;									/*!< The number of characters held */
+} TComPrintChunk;
+
 /*! Abstract base class from which communication interface modules are derived */
 class CCom {
+	protected:
+		//Protected Methods
+		void PrintField(TComPrintChunk* chunk, const char* prefix, uint32 prefixLen, const char* str, uint32 len, uint32 zeros, uint32 width, uint8 flags);
+		void PrintOut(TComPrintChunk* chunk, const char* str, uint32 len);
+		void PrintPad(TComPrintChunk* chunk, char ch, uint32 count);
+
 	public:
 		//Methods
 		virtual void Clear(bool rx = true, bool tx = true) = 0;
@@ -55,14 +81,16 @@ class CCom {
 		virtual void Flush(void) = 0;
 		virtual uint32 GetRxBufferCount() = 0;
 		virtual uint32 GetTxBufferCount() = 0;
+		virtual uint32 GetTxBufferFree() = 0;
 		virtual bool IsOpen(void) = 0;
 		virtual bool Open(void) = 0;
-		void Print(string str, ...);
-		//void Print(const pchar str, ...);	//Deprecated in C99
-		void PrintArgs(pchar str, va_list args);
+		void Print(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+		void PrintArgs(const char* fmt, va_list args);
 		void Read(puint8 pBuf, uint32 count);
+		virtual uint32 ReadBlock(puint8 pBuf, uint32 count);
 		virtual uint8 ReadByte() = 0;
 		void Write(puint8 pBuf, uint32 count);
+		virtual void WriteBlock(puint8 pBuf, uint32 count);
 		virtual void WriteByte(uint8 data) = 0;
 		inline void WriteHexUint8(uint8 data);
 		inline void WriteHexUint16(uint16 data);
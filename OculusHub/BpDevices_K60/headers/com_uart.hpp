@@ -9,6 +9,36 @@ property, and the connection is made (and severed) with the issuing of the "Open
 Interrupts for each implemented UART should be enabled by defining the appropriate
 UARTx_CONNECT_IRQ preprocessor symbol.
 
+Writes block while the transmit buffer is full, unless SetTxBlocking(false) is
+used, in which case data that doesn't fit is discarded and UART_TXBUF_ERR is
+flagged. WriteAsync never blocks, and returns how many bytes were accepted.
+The OnTxComplete event is raised (from the ISR) when the accepted bytes have
+left the shift register, and OnTxHighWater when the buffer fills past the level
+set by SetTxHighWater, allowing writers to apply backpressure.
+
+Writes may be made from both the main loop and interrupt handlers, as each
+block is queued with interrupts briefly disabled (so blocks from different
+contexts are never interleaved). Reads must all be made from one context.
+
+Each port can be switched (while closed) into a DMA mode with SetMode. In this
+mode the eDMA controller receives continuously into a circular ring, and transmits
+straight from the transmit buffer, so interrupts are only raised when the receive
+ring is half or completely full, when the receive line goes idle, or when a
+transmit segment completes. Each UART uses a pair of DMA channels (see
+UART_DMA_CHANNEL_RX and UART_DMA_CHANNEL_TX), and their interrupts must be
+connected by defining the UARTx_CONNECT_DMA preprocessor symbol. A third channel
+(see UART_DMA_CHANNEL_LAP) counts the laps of the receive ring, so the total
+received is known exactly. If the ring isn't drained (by reads, or the ring
+interrupts) before the receive channel comes back round to unread data, the
+ring contents are discarded, and UART_OVERRUN_ERR is flagged.
+
+The UART_MODE_FIFO mode enables the hardware FIFOs of the UART (where the
+peripheral has them), and only interrupts when the receive FIFO reaches its
+watermark, or the transmit FIFO drains to its watermark, moving several bytes
+per interrupt. In all modes, the OnRxIdle event is raised (from the ISR) when
+the receive line goes idle after data, which also collects any bytes left
+below the receive watermark, giving protocol parsers an end-of-frame signal.
+
 The static CComUart::Terminal pointer, allows a global Uart define to be mapped to
 handle the "PrintF" C type functions by overriding the GetChar and PutChar functions.
 This feature is enabled by default. To disable, define UART_TERMINAL as false.
@@ -25,8 +55,14 @@ This feature is enabled by default. To disable, define UART_TERMINAL as false.
 //Include the MCG device to get clock timings
 #include "mcg.hpp"
 
+//Include the callback class for transmit events
+#include "callback.hpp"
+
 //Include the FIFO buffer used by the UART transmit and receive routines
-#include "fifobuffer.hpp"
+#include "spscfifobuffer.hpp"
+
+//Include the serializer for reporting statistics
+#include "serialize.hpp"
 
 //==============================================================================
 //Class Definition...
@@ -55,6 +91,92 @@ enum EUartBaud {
 /*! Define the upper value of the EUartBaud, for range checking */
 #define EUART_BAUD_HIGH		BAUD_921600
 
+/*! Table of the baud rate values for each EUartBaud enumeration */
+constexpr uint32 UART_BAUD_VALUES[EUART_BAUD_HIGH + 1] = {
+	75, 110, 150, 300, 600, 1200, 2400, 4800, 9600, 14400, 19200, 38400, 57600,
+	115200, 230400, 460800, 921600
+};
+
+/*! Define the maximum error allowed between the requested and achieved baud
+rate, in parts-per-million, for configurations checked with UART_BAUD_ASSERT */
+#ifndef UART_BAUD_TOLERANCE_PPM
+	#define UART_BAUD_TOLERANCE_PPM		20000
+#endif
+
+/*! Define the largest value the 13-bit SBR baud rate divisor can hold */
+#define UART_BAUD_SBR_MAX			8191
+
+/*!
+Function that returns the baud rate value of an EUartBaud enumeration
+@param baud The baud rate enumeration
+@result The baud rate in bits per second, or 0 if the enumeration is invalid
+*/
+constexpr uint32 UartBaudValue(EUartBaud baud)
+{
+	return ((uint32)baud <= EUART_BAUD_HIGH) ? UART_BAUD_VALUES[baud] : 0;
+}
+
+/*!
+Function that computes the UART baud rate divisor, in 1/32'nds of the module
+clock divided by 16, rounded to the nearest value.
+The upper bits are loaded into SBR, and the lower 5 bits into BRFD (BRFA).
+@param clk The frequency of the UART module clock in Hz
+@param baud The required baud rate in bits per second
+*/
+constexpr uint32 UartBaudDivisor(uint32 clk, uint32 baud)
+{
+	return (baud == 0) ? 0 : (uint32)((((uint64)clk * 2) + (baud / 2)) / baud);
+}
+
+/*!
+Function that returns the baud rate a divisor generates from the module clock
+*/
+constexpr uint32 UartBaudActual(uint32 clk, uint32 divisor)
+{
+	return (divisor == 0) ? 0 : (uint32)((((uint64)clk * 2) + (divisor / 2)) / divisor);
+}
+
+/*!
+Function that returns the error between the requested baud rate and the rate
+achieved from the module clock, in parts-per-million. If the divisor doesn't
+fit the SBR register the largest possible error is returned.
+*/
+constexpr uint32 UartBaudErrorPpm(uint32 clk, uint32 baud)
+{
+	return ((baud == 0) || ((UartBaudDivisor(clk, baud) >> 5) == 0) || ((UartBaudDivisor(clk, baud) >> 5) > UART_BAUD_SBR_MAX))
+		? 0xFFFFFFFF
+		: (uint32)(((uint64)((UartBaudActual(clk, UartBaudDivisor(clk, baud)) > baud)
+			? (UartBaudActual(clk, UartBaudDivisor(clk, baud)) - baud)
+			: (baud - UartBaudActual(clk, UartBaudDivisor(clk, baud)))) * 1000000) / baud);
+}
+
+/*!
+Template that computes the UART baud rate registers for a module clock and
+baud rate at compile time, and fails the build if the baud rate can't be
+generated within UART_BAUD_TOLERANCE_PPM.
+*/
+template <uint32 clk, EUartBaud baud>
+struct TUartBaudDivisor {
+	static constexpr uint32 Baud = UartBaudValue(baud);
+	static constexpr uint32 Divisor = UartBaudDivisor(clk, Baud);
+	static constexpr uint16 SBR = (uint16)(Divisor >> 5);
+	static constexpr uint8 BRFD = (uint8)(Divisor & 0x1F);
+	static constexpr uint32 Actual = UartBaudActual(clk, Divisor);
+	static constexpr uint32 ErrorPpm = UartBaudErrorPpm(clk, Baud);
+
+	static_assert(ErrorPpm <= UART_BAUD_TOLERANCE_PPM, "The UART baud rate cannot be generated from the module clock within UART_BAUD_TOLERANCE_PPM");
+};
+
+/*!
+Macro that checks at compile time that a UART port can generate a baud rate.
+UART0 and UART1 are clocked from the system clock (CLK_SYS_Hz), and the other
+ports from the bus clock (CLK_BUS_Hz), which must be defined where this is used.
+*/
+#define UART_BAUD_CLK_Hz(port)		(((port) <= 1) ? CLK_SYS_Hz : CLK_BUS_Hz)
+#define UART_BAUD_ASSERT(port, baud) \
+	static_assert(TUartBaudDivisor<UART_BAUD_CLK_Hz(port), baud>::ErrorPpm <= UART_BAUD_TOLERANCE_PPM, \
+		"The baud rate for UART " #port " cannot be generated within UART_BAUD_TOLERANCE_PPM")
+
 /*! Enumeration that defines the types of parity available */
 enum EUartParity {
 	PARITY_NONE = 0,
@@ -62,6 +184,36 @@ enum EUartParity {
 	PARITY_EVEN = 2
 };
 
+/*! Enumeration that defines how data is moved between the UART and its buffers */
+enum EUartMode {
+	UART_MODE_IRQ = 0,		/*!< An interrupt is raised for every byte received and transmitted */
+	UART_MODE_DMA = 1,		/*!< The eDMA controller moves the data, interrupting per ring half, idle-line or transmit segment */
+	UART_MODE_FIFO = 2		/*!< The hardware FIFOs are used, interrupting when they cross their watermarks, or on idle-line */
+};
+
+/*! Define the eDMA channels used by each UART port in DMA mode (DMAMUX0 provides channels 0 to 15) */
+#define UART_DMA_CHANNEL_RX(port)	((port) * 2)
+#define UART_DMA_CHANNEL_TX(port)	(((port) * 2) + 1)
+
+/*! Define the eDMA channel that counts the laps of each port's receive ring. It is
+started by a link from the receive channel at the end of each major loop, so needs
+no request source, and raises no interrupts (channels 16 to 31 are used) */
+#define UART_DMA_CHANNEL_LAP(port)	(((port) * 2) + 16)
+
+/*! Define the DMAMUX request sources for each UART port (from the K60 DMA request source table) */
+#define UART_DMA_SOURCE_RX(port)	(((port) * 2) + 2)
+#define UART_DMA_SOURCE_TX(port)	(((port) * 2) + 3)
+
+/*! Define the default size of the DMA receive ring (must be even, for the half-full interrupt) */
+#define UART_DMA_RX_RING_SIZE		64
+
+/*! Define the maximum number of bytes a single DMA major loop can transfer (15-bit CITER) */
+#define UART_DMA_MAJOR_MAX			0x7FFF
+
+/*! Define the number of receive FIFO entries left free above the watermark in FIFO mode,
+to allow for interrupt latency before the FIFO overflows */
+#define UART_FIFO_RX_HEADROOM		2
+
 /*! Define an enumeration of flags that the serial port reports its status with */
 typedef uint8 TUartFlags;
 
@@ -70,11 +222,13 @@ typedef uint8 TUartFlags;
 #define UART_FRAMING_ERR_BIT		1
 #define UART_OVERRUN_ERR_BIT		2
 #define UART_RXBUF_ERR_BIT			3
+#define UART_TXBUF_ERR_BIT			4
 
 #define UART_PARITY_ERR_MASK		BIT(UART_PARITY_ERR_BIT)
 #define UART_FRAMING_ERR_MASK		BIT(UART_FRAMING_ERR_BIT)
 #define UART_OVERRUN_ERR_MASK		BIT(UART_OVERRUN_ERR_BIT)
 #define UART_RXBUF_ERR_MASK			BIT(UART_RXBUF_ERR_BIT)
+#define UART_TXBUF_ERR_MASK			BIT(UART_TXBUF_ERR_BIT)
 
 //------------------------------------------------------------------------------
 //Predefine the class
@@ -83,6 +237,84 @@ class CComUart;
 /*! Define a pointer to a serial port */
 typedef CComUart* PComUart;
 
+/*! Record that holds the throughput and error statistics of a serial port,
+accumulated since the port was created or the statistics were last cleared */
+struct TComUartStats {
+	uint32 RxBytes;				/*!< Bytes received from the line (including those dropped) */
+	uint32 TxBytes;				/*!< Bytes passed to the transmitter hardware */
+	uint32 OverrunErrors;		/*!< Receiver (or receive FIFO) overruns */
+	uint32 FramingErrors;
+	uint32 ParityErrors;
+	uint32 RxBufferDrops;		/*!< Bytes received and discarded because the receive buffer was full */
+	uint32 TxBufferDrops;		/*!< Bytes written and discarded because the transmit buffer was full (non-blocking writes) */
+	uint32 RxBufferHighWater;	/*!< Highest number of bytes held in the receive buffer */
+	uint32 TxBufferHighWater;	/*!< Highest number of bytes held in the transmit buffer */
+	uint32 RxFifoHighWater;		/*!< Highest number of bytes found in the hardware receive FIFO (FIFO mode) */
+	uint32 IsrCount;			/*!< Number of UART interrupts serviced */
+	uint32 DmaIsrCount;			/*!< Number of DMA channel interrupts serviced (DMA mode) */
+	uint32 DmaRxLaps;			/*!< Times the receive DMA channel overwrote unread bytes in its ring, which were discarded (DMA mode) */
+
+	/*! Function the deserialises an object into the struct */
+	bool Deserialize(PSerialize serialize) {
+		bool success;
+		success = serialize->ReadUint32(&this->RxBytes, 0);
+		success &= serialize->ReadUint32(&this->TxBytes, 0);
+		success &= serialize->ReadUint32(&this->OverrunErrors, 0);
+		success &= serialize->ReadUint32(&this->FramingErrors, 0);
+		success &= serialize->ReadUint32(&this->ParityErrors, 0);
+		success &= serialize->ReadUint32(&this->RxBufferDrops, 0);
+		success &= serialize->ReadUint32(&this->TxBufferDrops, 0);
+		success &= serialize->ReadUint32(&this->RxBufferHighWater, 0);
+		success &= serialize->ReadUint32(&this->TxBufferHighWater, 0);
+		success &= serialize->ReadUint32(&this->RxFifoHighWater, 0);
+		success &= serialize->ReadUint32(&this->IsrCount, 0);
+		success &= serialize->ReadUint32(&this->DmaIsrCount, 0);
+		success &= serialize->ReadUint32(&this->DmaRxLaps, 0);
+		return success;
+	}
+
+	/*! Function that serializes the struct */
+	bool Serialize(PSerialize serialize) {
+		bool success;
+		success = serialize->AddUint32(this->RxBytes);
+		success &= serialize->AddUint32(this->TxBytes);
+		success &= serialize->AddUint32(this->OverrunErrors);
+		success &= serialize->AddUint32(this->FramingErrors);
+		success &= serialize->AddUint32(this->ParityErrors);
+		success &= serialize->AddUint32(this->RxBufferDrops);
+		success &= serialize->AddUint32(this->TxBufferDrops);
+		success &= serialize->AddUint32(this->RxBufferHighWater);
+		success &= serialize->AddUint32(this->TxBufferHighWater);
+		success &= serialize->AddUint32(this->RxFifoHighWater);
+		success &= serialize->AddUint32(this->IsrCount);
+		success &= serialize->AddUint32(this->DmaIsrCount);
+		success &= serialize->AddUint32(this->DmaRxLaps);
+		return success;
+	}
+};
+
+typedef TComUartStats* PComUartStats;
+
+/*! Record that is passed as part of the serial port transmit events */
+struct TComUartTxParams {
+	PComUart Uart;		/*!< The serial port raising the event */
+	uint32 Count;		/*!< OnTxComplete - bytes sent since the last event, OnTxHighWater - bytes held in the buffer */
+};
+
+typedef TComUartTxParams* PComUartTxParams;
+
+typedef CCallback1<void, PComUartTxParams> CComUartTxCallback;
+
+/*! Record that is passed as part of the serial port receive events */
+struct TComUartRxParams {
+	PComUart Uart;		/*!< The serial port raising the event */
+	uint32 Count;		/*!< OnRxIdle - bytes held in the receive buffer */
+};
+
+typedef TComUartRxParams* PComUartRxParams;
+
+typedef CCallback1<void, PComUartRxParams> CComUartRxCallback;
+
 /*! Define a class that creates an interface to a hardware UART */
 class CComUart : public CCom {
 	private:
@@ -90,18 +322,48 @@ class CComUart : public CCom {
 
 	protected:
 		EUartBaud			_baud;
+		uint32				_baudActual;			/*!< The baud rate achieved from the module clock when opened */
+		puint8				_dmaRxRing;				/*!< Circular buffer the receive DMA channel writes into */
+		uint32				_dmaRxRingIdx;			/*!< Index of the next unread byte in the DMA receive ring */
+		uint32				_dmaRxRingSize;
+		uint8				_dmaRxLapDummy;			/*!< Byte the lap counting DMA channel copies onto itself */
+		uint32				_dmaRxPos;				/*!< Receive position (from the lap count and ring index) at the last drain */
+		volatile uint32		_dmaTxCount;			/*!< Number of bytes in the active transmit DMA segment (0 when idle) */
+		uint8				_fifoRxSize;			/*!< Number of entries in the hardware receive FIFO (in FIFO mode) */
+		uint8				_fifoTxSize;			/*!< Number of entries in the hardware transmit FIFO (in FIFO mode) */
 		TUartFlags			_flags;
 		bool				_loopback;
+		EUartMode			_mode;
 		EUartParity			_parity;
 		bool				_open;					/*!< True if the Serial port is open */
 		uint8				_port;					/*!< The COM port number of the serial port */
-		PByteFifoBuffer		_rxBuffer;
-		PByteFifoBuffer		_txBuffer;
+		PByteSpscFifoBuffer	_rxBuffer;				/*!< Receive buffer, filled by the ISR and emptied by the application */
+		TComUartStats		_stats;					/*!< Throughput and error counters, updated by the ISR */
+		PByteSpscFifoBuffer	_txBuffer;				/*!< Transmit buffer, filled by the application and emptied by the ISR */
+		bool				_txBlocking;			/*!< True if writes wait for space in a full transmit buffer */
 		bool				_txEnable;
+		uint32				_txHighWater;			/*!< Buffer level that raises the OnTxHighWater event (0 disables) */
+		bool				_txHighWaterRaised;
+		volatile uint32		_txQueued;				/*!< Running count of bytes accepted into the transmit buffer */
+		uint32				_txReported;			/*!< Running count of bytes reported through OnTxComplete */
 		UART_Type*			_uart;					/*!< Pointer to the struct accessing the UART registers */
 
 		//Protected methods
+		void DmaClose();
+		void DmaOpen();
+		void DmaRxDrain();
+		void DmaRxPoll();
+		void DmaTxStart();
+		void FifoClose();
+		void FifoOpen();
+		void FifoRxDrain();
+		void FifoTxFill();
+		void DoRxIdle();
+		void DoTxComplete();
+		void DoTxHighWater();
 		virtual void DoTxMode(bool state, bool force = false);
+		void StatsRx(uint32 count);
+		void TxStart();
 
 	public:
 		//Construction & Disposal
@@ -111,26 +373,46 @@ class CComUart : public CCom {
 		//Methods
 		void Clear(bool rx = true, bool tx = true);
 		void Close(void);
+		void DoDmaRxISR(void);
+		void DoDmaTxISR(void);
 		void DoISR(void);
 		void Flush(void);
+		uint32 GetBaudActual();
 		EUartBaud GetBaudRate();
 		TUartFlags GetFlags(bool clear = false);
 		bool GetLoopback();
+		EUartMode GetMode();
 		EUartParity GetParity();
 		uint8 GetPort();
+		void GetStats(PComUartStats stats, bool clear = false);
 		uint32 GetRxBufferCount();
 		uint32 GetTxBufferCount();
+		uint32 GetTxBufferFree();
+		bool GetTxBlocking();
+		uint32 GetTxHighWater();
 		bool IsOpen(void);
 		bool Open(void);
+		uint32 ReadBlock(puint8 pBuf, uint32 count);
 		uint8 ReadByte();
 		void SetBaudRate(EUartBaud value);
+		void SetDmaRxRingSize(uint32 value);
+		void SetMode(EUartMode value);
 		void SetParity(EUartParity value);
 		void SetPort(uint8 value);
 		void SetLoopback(bool value);
 		void SetRxBufferSize(uint32 value);
+		void SetTxBlocking(bool value);
 		void SetTxBufferSize(uint32 value);
+		void SetTxHighWater(uint32 value);
+		uint32 WriteAsync(puint8 pBuf, uint32 count);
+		void WriteBlock(puint8 pBuf, uint32 count);
 		void WriteByte(uint8 data);
 
+		//Events
+		CComUartRxCallback OnRxIdle;				/*!< Raised from the ISR when the receive line goes idle after data */
+		CComUartTxCallback OnTxComplete;			/*!< Raised from the ISR when the transmitter has sent all buffered data */
+		CComUartTxCallback OnTxHighWater;			/*!< Raised from the writer when the transmit buffer reaches the high water level */
+
 		//Static Variables
 		static PComUart Uart[UART_PERIPHERALS];		/*!< Global method pointer for interrupt handlers */
 		//static PComUart Terminal;					/*!< Global pointer to the UArt to handle PrintF terminal io */
@@ -138,6 +420,7 @@ class CComUart : public CCom {
 		//Static Methods
 		static uint32 CalcBaudValue(EUartBaud baudRate);
 		static EUartBaud CalcBaudRate(uint32 baudValue);
+		static uint8 CalcFifoSize(uint8 value);
 };
 
 //==============================================================================
@@ -147,15 +430,8 @@ class CComUart : public CCom {
 	PRAGMA_ERROR("Number of UART peripherals not defined")
 #endif
 
-//Generate warnings if clock definitions are missing
-/*
-#if !defined(CLK_SYS_Hz)
-	#error CComUart requires the 'CLK_SYS_Hz' value to be defined for UART0 and UART1
-#endif
-#if !defined(CLK_BUS_Hz)
-	#error CComUart requires the 'CLK_BUS_Hz' value to be defined for UART2 to UART5
-#endif
-*/
+//Clock definitions are only required where UART_BAUD_ASSERT is used, as the
+//UART is opened using the clock frequencies configured in CMcg
 
 //If explicitly previously allowed, disable IRQ's for UART's
 #ifndef UART0_CONNECT_IRQ
@@ -177,6 +453,26 @@ class CComUart : public CCom {
 	#define UART5_CONNECT_IRQ	false
 #endif
 
+//If not explicitly previously allowed, disable DMA IRQ's for UART's
+#ifndef UART0_CONNECT_DMA
+	#define UART0_CONNECT_DMA	false
+#endif
+#ifndef UART1_CONNECT_DMA
+	#define UART1_CONNECT_DMA	false
+#endif
+#ifndef UART2_CONNECT_DMA
+	#define UART2_CONNECT_DMA	false
+#endif
+#ifndef UART3_CONNECT_DMA
+	#define UART3_CONNECT_DMA	false
+#endif
+#ifndef UART4_CONNECT_DMA
+	#define UART4_CONNECT_DMA	false
+#endif
+#ifndef UART5_CONNECT_DMA
+	#define UART5_CONNECT_DMA	false
+#endif
+
 //Include prototypes for hardware Interrupt handlers (See Interrupt Vector Table)
 #ifdef __cplusplus
 extern "C" {
@@ -201,6 +497,31 @@ void ISR_UART4_RX_TX(void)	__attribute__ ((interrupt));
 void ISR_UART5_RX_TX(void)	__attribute__ ((interrupt));
 #endif
 
+#if UART0_CONNECT_DMA
+void ISR_DMA0(void)			__attribute__ ((interrupt));
+void ISR_DMA1(void)			__attribute__ ((interrupt));
+#endif
+#if UART1_CONNECT_DMA
+void ISR_DMA2(void)			__attribute__ ((interrupt));
+void ISR_DMA3(void)			__attribute__ ((interrupt));
+#endif
+#if UART2_CONNECT_DMA
+void ISR_DMA4(void)			__attribute__ ((interrupt));
+void ISR_DMA5(void)			__attribute__ ((interrupt));
+#endif
+#if UART3_CONNECT_DMA
+void ISR_DMA6(void)			__attribute__ ((interrupt));
+void ISR_DMA7(void)			__attribute__ ((interrupt));
+#endif
+#if UART4_CONNECT_DMA
+void ISR_DMA8(void)			__attribute__ ((interrupt));
+void ISR_DMA9(void)			__attribute__ ((interrupt));
+#endif
+#if UART5_CONNECT_DMA
+void ISR_DMA10(void)		__attribute__ ((interrupt));
+void ISR_DMA11(void)		__attribute__ ((interrupt));
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,12 +1,49 @@
 /*==============================================================================
 Module that provides definitions and implementations for managing the FTFL
 Flash Memory module - allowing reading, reprogramming
+
+As well as the blocking functions, erase/program/verify jobs can be queued to
+run in the background (the "Async" functions). Each job is split into individual
+flash commands, which are launched back to back from the FTFE command complete
+interrupt (FLASH_CONNECT_IRQ), and the job's callback is raised (from the ISR)
+when it finishes. Without the interrupt connected, jobs only progress while Wait
+(or Poll) is called. As code can't be read from a flash block while it is being
+modified, jobs are only accepted at or above FLASH_JOB_ADDR_MIN, away from the
+blocks the program runs from. Any blocking command waits for the queue to empty
+before it runs, and data being read from a block that jobs are modifying should
+first be waited on with Wait.
+
+Erasing a range (with FlashEraseRange or an erase job) first checks each sector
+reads as erased, and skips those that already are. FlashEraseRange also erases
+a whole block with one command where the range covers it and enough of its
+sectors need erasing.
+
+Commands are run from a RAM resident routine, which is handed a list of
+commands already encoded as the words loaded into the FCCOB registers (see
+TFlashCmd). FlashProgram, FlashCheck and FlashEraseRange queue up to
+FLASH_CMD_LIST_SIZE phrase programs, checks, verifies or erases at a time, and
+run each list with one launch, stopping at the first command that fails.
+Interrupts are still serviced between the commands of a list.
+
+Code can still be read from one program flash block while another is being
+modified. The blocks holding the vector table and the running program (up to
+the end of its read-only data) are worked out when the driver is created. A list
+whose commands only address other blocks (such as scratch memory or settings
+storage) is run from flash with interrupts left enabled (FLASH_RWW_ENABLE), so
+the UARTs and timers are still serviced. Jobs queued from an interrupt while
+a blocking function runs its lists (or stages data between them) are started
+once the function has finished.
+
+CmdSwap uses the FTFE program flash swap system to exchange the two halves of
+program flash at the next reset, so an image programmed into the upper half
+can be run without copying it over the lower half.
 ==============================================================================*/
 //Prevent multiple inclusions of this file
 #ifndef FLASH_HPP
 #define FLASH_HPP
 
 //Include system libraries
+#include <string.h>		//For memcpy function
 
 //Include common type definitions and macros
 #include "common.h"
@@ -16,7 +53,7 @@ Flash Memory module - allowing reading, reprogramming
 
 //Include helper classes
 //#include "crc16.hpp"
-//#include "callbacks.hpp"
+#include "callback.hpp"
 
 //==============================================================================
 //General Definitions and Types
@@ -33,10 +70,63 @@ Flash Memory module - allowing reading, reprogramming
 	PRAGMA_ERROR("FLASH_BLOCK_SIZE constant not defined")
 #endif
 
+#ifndef FLASH_FLEXRAM_START
+	#define FLASH_FLEXRAM_START			0x14000000		/*!< Address of the FlexRAM (programming acceleration RAM) */
+#endif
+
+#ifndef FLASH_PGMSEC_SIZE
+	#define FLASH_PGMSEC_SIZE			0x0400			/*!< Maximum number of bytes staged in FlexRAM for one Program Section command */
+#endif
+
+#ifndef FLASH_PGMSEC_ENABLE
+	#define FLASH_PGMSEC_ENABLE			true			/*!< True if FlashProgram should use Program Section commands where possible */
+#endif
+
+#ifndef FLASH_ERASE_MARGIN
+	#define FLASH_ERASE_MARGIN			FLASH_MARGIN_USER	/*!< Margin level sectors are checked at, to see if they need erasing */
+#endif
+
+#ifndef FLASH_ERASE_BLOCK_SECTORS
+	#define FLASH_ERASE_BLOCK_SECTORS	9				/*!< Number of sectors in a block needing erasing, at which FlashEraseRange erases the whole block instead (a block erase takes about as long as 9 sector erases) */
+#endif
+
+#ifndef FLASH_CMD_LIST_SIZE
+	#define FLASH_CMD_LIST_SIZE			16				/*!< Number of commands FlashProgram, FlashEraseRange and FlashCheck queue up to run as one list */
+#endif
+
+#ifndef FLASH_RWW_ENABLE
+	#define FLASH_RWW_ENABLE			true			/*!< True if command lists that don't modify the blocks code is read from run with interrupts enabled, rather than from RAM with them disabled */
+#endif
+
+#ifndef FLASH_JOB_QUEUE_SIZE
+	#define FLASH_JOB_QUEUE_SIZE		4				/*!< Number of background jobs that can be queued at once */
+#endif
+
+#ifndef FLASH_JOB_ADDR_MIN
+	#define FLASH_JOB_ADDR_MIN			(FLASH_BLOCK_SIZE * 2)	/*!< Lowest address background jobs may modify, so the code in the blocks below can still be read */
+#endif
+
 //------------------------------------------------------------------------------
 /*! Base address of Flash area */
 #define FLASH_BASE						0x00000000
 
+/*! Number of sectors in each flash block */
+#define FLASH_BLOCK_SECTORS				(FLASH_BLOCK_SIZE / FLASH_SECTOR_SIZE)
+
+/*! Number of program flash blocks */
+#define FLASH_BLOCKS					(FLASH_SIZE / FLASH_BLOCK_SIZE)
+
+/*! Mask with a bit set for every program flash block */
+#define FLASH_BLOCKS_ALL				((uint8)((1 << FLASH_BLOCKS) - 1))
+
+#if (FLASH_BLOCKS > 8)
+	PRAGMA_ERROR("The blocks modified by a command list can only be mapped for up to 8 flash blocks")
+#endif
+
+#if (FLASH_BLOCK_SECTORS > 64)
+	PRAGMA_ERROR("FlashEraseRange can't plan blocks of more than 64 sectors")
+#endif
+
 //Base addresses of program flash blocks
 //#define FLASH_BLOCK0_BASE				FLASH_BASE
 //#define FLASH_BLOCK1_BASE				(FLASH_BLOCK0_BASE + FLASH_BLOCK_SIZE)
@@ -44,7 +134,7 @@ Flash Memory module - allowing reading, reprogramming
 //#define FLASH_BLOCK3_BASE				(FLASH_BLOCK2_BASE + FLASH_BLOCK_SIZE)
 
 //For PFlash Swapping, two halves are used - define size and base addresses of halves
-//#define FLASH_HALF_SIZE				(FLASH_BLOCK_SIZE * 2)	/*!< Program Flash block size, 512kB */
+#define FLASH_HALF_SIZE					(FLASH_BLOCK_SIZE * 2)	/*!< Program Flash half size (swapped as a unit), 512kB */
 //#define FLASH_HALF0_BASE				FLASH_BLOCK0_BASE
 //#define FLASH_HALF1_BASE				FLASH_BLOCK2_BASE
 
@@ -78,10 +168,10 @@ Flash Memory module - allowing reading, reprogramming
 //Alignment sizes for various programming operations
 #define FLASH_ERSBLK_ALIGN_SIZE			FLASH_DPHRASE_SIZE		/* Check align of erase block function */
 #define FLASH_PGMCHK_ALIGN_SIZE			FLASH_LONGWORD_SIZE		/* Check align of program check function */
-//#define FLASH_PPGMSEC_ALIGN_SIZE		FLASH_DPHRASE_SIZE		/* Check align of program section function */
+#define FLASH_PPGMSEC_ALIGN_SIZE		FLASH_DPHRASE_SIZE		/* Check align of program section function */
 //#define FLASH_DPGMSEC_ALIGN_SIZE		FLASH_DPHRASE_SIZE		/* Check align of program section function */
 #define FLASH_VERBLK_ALIGN_SIZE			FLASH_DPHRASE_SIZE		/* Check align of verify block function */
-//#define FLASH_PRD1SEC_ALIGN_SIZE		FLASH_DPHRASE_SIZE		/* Check align of verify section function */
+#define FLASH_PRD1SEC_ALIGN_SIZE		FLASH_DPHRASE_SIZE		/* Check align of verify section function */
 //#define FLASH_DRD1SEC_ALIGN_SIZE		FLASH_DPHRASE_SIZE		/* Check align of verify section function */
 #define FLASH_SWAP_ALIGN_SIZE			FLASH_DPHRASE_SIZE		/* Check align of swap function*/
 //#define FLASH_RDRSRC_ALIGN_SIZE		FLASH_PHRASE_SIZE		/* Check align of read resource function */
@@ -97,18 +187,21 @@ Flash Memory module - allowing reading, reprogramming
 #define FLASH_CMD_PROGRAM_PHRASE		0x07
 #define FLASH_CMD_ERASE_BLOCK			0x08
 #define FLASH_CMD_ERASE_SECTOR			0x09
-//#define FLASH_CMD_PROGRAM_SECTION		0x0B
+#define FLASH_CMD_PROGRAM_SECTION		0x0B
 //#define FLASH_CMD_VERIFY_ALL_BLOCK	0x40
 //#define FLASH_CMD_READ_ONCE			0x41
 //#define FLASH_CMD_PROGRAM_ONCE		0x43
 #define FLASH_CMD_ERASE_ALL_BLOCK		0x44
 #define FLASH_CMD_SECURITY_BY_PASS		0x45
-//#define FLASH_CMD_PFLASH_SWAP			0x46
+#define FLASH_CMD_PFLASH_SWAP			0x46
 //#define FLASH_CMD_PROGRAM_PARTITION	0x80
 //#define FLASH_CMD_SET_EERAM			0x81
 
 #define FLASH_RAM_PROG_SIZE				30
 
+/*! Mask of the address bits in the first word of a TFlashCmd */
+#define FLASH_CMD_ADDR_MASK				0x00FFFFFF
+
 //------------------------------------------------------------------------------
 /*! Structure that maps onto the flash configuration memory at address FLASH_CNFG_OFFSET
 */
@@ -123,6 +216,49 @@ struct TFlashConfig {
 
 typedef TFlashConfig* PFlashConfig;
 
+//------------------------------------------------------------------------------
+/*! Structure holding a flash command encoded as the three words written into the
+FCCOB registers, so a list of commands can be run back to back from RAM.
+Each word holds four FCCOB registers, with the lowest numbered in the top byte
+*/
+struct TFlashCmd {
+	uint32 Cmd;				//Command code (FCCOB0) and flash address (FCCOB1 to FCCOB3)
+	uint32 Param1;			//Parameters in FCCOB4 to FCCOB7
+	uint32 Param2;			//Parameters in FCCOB8 to FCCOBB
+};
+
+typedef TFlashCmd* PFlashCmd;
+
+//------------------------------------------------------------------------------
+/*! Structure holding counters of the work done by FlashProgram and the range
+erase functions, used to measure the programming rate */
+struct TFlashStats {
+	uint32 Bytes;			//Number of bytes programmed through FlashProgram
+	uint32 Commands;		//Number of flash commands launched
+	uint32 Lists;			//Number of command lists run (each launching one or more commands from RAM)
+	uint32 RwwLists;		//Number of those lists run from flash with interrupts enabled, as they didn't modify the blocks code is read from
+	uint32 Cycles;			//Number of processor cycles spent in FlashProgram
+	uint32 SectorsErased;	//Number of sectors erased by FlashEraseRange and erase jobs
+	uint32 SectorsSkipped;	//Number of sectors FlashEraseRange and erase jobs didn't erase, as they already were
+
+	/*! Function that returns the average time taken to program 1KB, given the processor clock frequency */
+	uint32 GetMicrosecondsPerKb(uint32 clkFreq) {
+		if((this->Bytes == 0) || (clkFreq < 1000000))
+			return 0;
+		return (uint32)(((uint64)this->Cycles * 1024) / ((uint64)this->Bytes * (clkFreq / 1000000)));
+	}
+};
+
+typedef TFlashStats* PFlashStats;
+
+//------------------------------------------------------------------------------
+/*! Enumeration of the types of background job that can be queued */
+enum EFlashJobType {
+	FLASH_JOB_ERASE = 0,		/*!< Erase a range of sectors */
+	FLASH_JOB_PROGRAM = 1,		/*!< Program a range of bytes */
+	FLASH_JOB_VERIFY = 2		/*!< Verify a range of sectors are erased */
+};
+
 //------------------------------------------------------------------------------
 /*! Enumeration specifying the Flash Command return codes */
 enum EFlashReturn {
@@ -133,7 +269,8 @@ enum EFlashReturn {
 	FLASH_ERR_ACCERR = 4,
 	FLASH_ERR_PVIOL = 5,
 	FLASH_ERR_MGSTAT0 = 6,
-	FLASH_ERR_PARAM = 7
+	FLASH_ERR_PARAM = 7,
+	FLASH_ERR_BUSY = 8
 	//FLASH_ERR_CHANGEPROT = 0x0020,
 	//FLASH_ERR_EEESIZE = 0x0040,
 	//FLASH_ERR_EFLASHSIZE = 0x0080,
@@ -153,16 +290,41 @@ enum EFlashReadMargin {
 };
 
 //------------------------------------------------------------------------------
-/*! Control codes for a FLASH_CMD_PFLASH_SWAP command
+//Predeclare the background job struct, so its callback can be defined
+struct TFlashJob;
+
+/*! Define a pointer to a background job */
+typedef TFlashJob* PFlashJob;
+
+/*! Define a callback raised (from the ISR) when a background job finishes */
+typedef CCallback1<void, PFlashJob> CFlashJobCallback;
+
+/*! Define a pointer to a background job callback */
+typedef CFlashJobCallback* PFlashJobCallback;
+
+/*! Structure describing a background job, and its result once finished */
+struct TFlashJob {
+	EFlashJobType Type;			//The type of job
+	uint32 Addr;				//Starting address (sector aligned for erase and verify, phrase aligned for program)
+	puint8 Data;				//Data to program, which must remain valid until the job finishes
+	uint32 Size;				//Number of bytes the job covers
+	EFlashReadMargin Margin;	//Margin level verify jobs are run at
+	PFlashJobCallback OnDone;	//Callback raised when the job finishes, or NULL if not required
+	pointer Tag;				//User value passed back with the job
+	EFlashReturn Result;		//Result of the job
+	uint32 FailAddr;			//Address of the command that failed, if Result isn't FLASH_OK
+};
+
+//------------------------------------------------------------------------------
+/*! Control codes for a FLASH_CMD_PFLASH_SWAP command */
 enum EFlashSwapCmd {
 	FLASH_SWAP_SET_INDICATOR_ADDR = 0x01,
 	FLASH_SWAP_SET_IN_PREPARE = 0x02,
 	FLASH_SWAP_SET_IN_COMPLETE = 0x04,
 	FLASH_SWAP_REPORT_STATUS = 0x08
 };
-*/
 
-/*! Status codes for the current swap state
+/*! Status codes for the current swap state */
 enum EFlashSwapState {
 	FLASH_SWAP_UNINIT = 0x00,
 	FLASH_SWAP_READY = 0x01,
@@ -170,26 +332,22 @@ enum EFlashSwapState {
 	FLASH_SWAP_UPDATE_ERASED = 0x03,
 	FLASH_SWAP_COMPLETE = 0x04
 };
-*/
 
-/*! Status codes for the Current and Next swap states
+/*! Status codes for the Current and Next swap states */
 enum EFlashSwapBlockStatus {
 	FLASH_BLOCK_0_ACTIVE = 0x00,
 	FLASH_BLOCK_1_ACTIVE = 0x01
 };
-*/
 
-/*! Struct holding the return codes from a SwapGetStatus command
+/*! Struct holding the return codes from a SwapGetStatus command */
 struct TFlashSwapState {
 	EFlashSwapState CurrentState;
 	EFlashSwapBlockStatus CurrentBlock;
 	EFlashSwapBlockStatus NextBlock;
 };
-*/
 
-/*! Define a pointer to a TFlashSwapState structure
+/*! Define a pointer to a TFlashSwapState structure */
 typedef TFlashSwapState* PFlashSwapState;
-*/
 
 //------------------------------------------------------------------------------
 /*! Define a struct for params passed in an CAcoXcvrRxErrorCallback event
@@ -225,15 +383,45 @@ class CFlash {
 		FMC_Type*	_fmc;
 		FLASH_Type*	_flash;
 		bool		_cfgLock;
+		bool		_pgmsecEnable;
+		TFlashStats	_stats;
+		TFlashJob	_jobs[FLASH_JOB_QUEUE_SIZE];	/*!< Ring of queued background jobs, the first being the one running */
+		volatile uint8	_jobHead;					/*!< Index of the running job in the ring */
+		volatile uint8	_jobCount;					/*!< Number of jobs in the ring */
+		uint32		_jobAddr;						/*!< Address of the next command of the running job */
+		puint8		_jobData;						/*!< Data for the next command of the running (program) job */
+		uint32		_jobRemain;						/*!< Bytes of the running job that haven't been launched yet */
+		volatile uint32	_jobCmdAddr;				/*!< Address of the command in progress for the running job */
+		bool		_jobChecking;					/*!< True if the command in progress is checking if an erase job's next sector is blank */
+		bool		_jobDirty;						/*!< True if the erase job's next sector was found not to be blank, so must be erased */
+		uint8		_codeBlocks;					/*!< Mask of the flash blocks the vector table and program are read from */
+		volatile bool	_listBusy;					/*!< True while command lists are being run, so jobs queued by interrupts aren't started until they're done */
 
 		//Private Methods
 		bool CheckAddress(uint32& addrStart, uint32 addrRange);
+		EFlashReturn CheckStatus();
 		EFlashReturn ExecuteCmd(uint8 cmdSize, puint8 cmdData);
-		EFlashReturn FlashCheckLWord(uint32 destAddr, puint8 verifyData, EFlashReadMargin marginLevel);
-		//EFlashReturn CmdSwapExecute(uint32 addr, EFlashSwapCmd swapCmd);
+		EFlashReturn ExecuteList(PFlashCmd cmds, uint16 count, puint16 failIdx);
+		uint8 GetCodeBlocks();
+		EFlashReturn CmdSwapExecute(uint32 addr, EFlashSwapCmd swapCmd, PFlashSwapState status);
+		void JobLaunch(PFlashJob job);
+		EFlashReturn JobQueue(PFlashJob job);
+		void JobStart();
+		void LaunchCmd();
+		void ListHold();
+		void ListRelease();
+		void LoadCmd(PFlashCmd cmd);
 
 		//Static methods
-		static void ExecuteCmdRam(FLASH_Type* flash);		/*!< Function programmed into RAM to execute a programming command */
+		static void Encode(PFlashCmd cmd, uint8 cmdSize, puint8 cmdData);
+		static void EncodeCheck(PFlashCmd cmd, uint32 addr, puint8 verifyData, EFlashReadMargin marginLevel);
+		static void EncodeErase(PFlashCmd cmd, uint32 addr);
+		static void EncodePhrase(PFlashCmd cmd, uint32 addr, puint8 srcData);
+		static void EncodeSection(PFlashCmd cmd, uint32 addr, uint32 size);
+		static void EncodeVerify(PFlashCmd cmd, uint32 addr, uint16 sectors, EFlashReadMargin marginLevel);
+		static void ExecuteListRam(FLASH_Type* flash, PFlashCmd cmds, uint16 count, bool irqWindow, puint16 done);	/*!< Function programmed into RAM to execute a list of programming commands */
+		static void ExecuteListRww(FLASH_Type* flash, PFlashCmd cmds, uint16 count, puint16 done);
+		static uint8 GetListBlocks(PFlashCmd cmds, uint16 count);
 
 	public:
 		//Construction and Disposal
@@ -244,27 +432,41 @@ class CFlash {
 		EFlashReturn ConfigProgram(PFlashConfig cfg);
 		void ConfigRead(PFlashConfig cfg);
 		void DebugReturnCode(EFlashReturn returnCode);
+		void DoISR();
 		bool GetConfigLock();
 		uint8 GetFlashActiveBlock();
+		bool GetSectionEnable();
+		void GetStats(PFlashStats stats, bool clear = false);
 		EFlashReturn FlashBackdoor(puint8 key);
 		EFlashReturn FlashCheck(uint32 destAddr, puint8 verifyData, uint32 size, EFlashReadMargin marginLevel, puint32 failAddr = NULL);
 		EFlashReturn FlashEraseAll(uint32 confirm);
 		EFlashReturn FlashEraseBlock(uint32 addr);
 		EFlashReturn FlashEraseRange(uint32 addr, uint32 size);
+		EFlashReturn FlashEraseRangeAsync(uint32 addr, uint32 size, PFlashJobCallback onDone, pointer tag = NULL);
 		EFlashReturn FlashEraseSector(uint32 addr);
 		EFlashReturn FlashEraseSectors(uint32 addr, uint16 sectors);
 		EFlashReturn FlashProgram(uint32 destAddr, puint8 srcData, uint32 size, puint32 failAddr = NULL);
+		EFlashReturn FlashProgramAsync(uint32 destAddr, puint8 srcData, uint32 size, PFlashJobCallback onDone, pointer tag = NULL);
 		EFlashReturn FlashProgramPhrase(uint32 destAddr, puint8 srcData);
+		EFlashReturn FlashProgramSection(uint32 destAddr, puint8 srcData, uint32 size);
 		EFlashReturn FlashVerifyBlock(uint32 addr, EFlashReadMargin marginLevel);
+		EFlashReturn FlashVerifyRangeAsync(uint32 addr, uint32 size, EFlashReadMargin marginLevel, PFlashJobCallback onDone, pointer tag = NULL);
 		EFlashReturn FlashVerifySector(uint32 addr, EFlashReadMargin marginLevel);
 		EFlashReturn FlashVerifySectors(uint32 addr, uint16 sectors, EFlashReadMargin marginLevel);
-		//EFlashReturn CmdSwap(uint32 flashAddr);
-		//EFlashReturn CmdSwapGetStatus(uint32 flashAddr, PFlashSwapState status);
+		EFlashReturn CmdSwap(uint32 flashAddr);
+		EFlashReturn CmdSwapGetStatus(uint32 flashAddr, PFlashSwapState status);
+		bool IsBusy(uint32 addr = FLASH_BASE, uint32 size = FLASH_SIZE);
+		void Poll();
 		void SetConfigLock(bool value);
+		void SetSectionEnable(bool value);
+		void Wait(uint32 addr = FLASH_BASE, uint32 size = FLASH_SIZE);
 
 		//Event Callbacks
 		//CFlashSwapCallback OnSwapStatus;
 
+		//Static Variables
+		static CFlash* Flash;							/*!< Global method pointer for the interrupt handler */
+
 		//Class functions
 		static void FlashDump(uint32 addr, uint32 length, uint8 rowLen = 16);
 };
@@ -272,5 +474,26 @@ class CFlash {
 /*! Define a pointer to a Flash class */
 typedef CFlash* PFlash;
 
+//==============================================================================
+//Interrupt Handler Definitions...
+//==============================================================================
+//If not explicitly previously allowed, disable the IRQ for background jobs
+#ifndef FLASH_CONNECT_IRQ
+	#define FLASH_CONNECT_IRQ	false
+#endif
+
+//Include prototypes for hardware Interrupt handlers (See Interrupt Vector Table)
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if FLASH_CONNECT_IRQ
+void ISR_FTFE(void)	__attribute__ ((interrupt));
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
 //==============================================================================
 #endif
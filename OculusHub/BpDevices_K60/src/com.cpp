@@ -10,52 +10,407 @@ PCom CCom::Terminal = NULL;
 
 /*!-----------------------------------------------------------------------------
 Function that implements a PrintF like capability to write text to the uart
-output
+output.
+The format string is checked against the arguments at compile time.
+@param fmt Pointer to a null-terminated Format string of characters
 */
-void CCom::Print(string str, ...)
+void CCom::Print(const char* fmt, ...)
 {
 	//Initialise the arguments list
 	va_list args;
-	va_start(args, str);
+	va_start(args, fmt);
 	//Call the print function for the arguments list
-	this->PrintArgs((pchar)str.c_str(), args);
+	this->PrintArgs(fmt, args);
 	//Tidy up
 	va_end(args);
 }
 
 /*!-----------------------------------------------------------------------------
 Function that implements a PrintF like capability to write text to the uart
-output
+output.
+Text is formatted with no heap allocation or line buffer - each numeric field
+is built in a small stack buffer, and the output is gathered in a stack chunk
+of COM_PRINT_CHUNK_SIZE bytes that is written to the port as one block when it
+fills (so a typical line costs a single write, however many fields it has).
+Supports the flags "-0+ #", field width and precision (including '*'), the
+length modifiers hh, h, l, ll, j, z and t, and the conversions d, i, u, o, x,
+X, c, s, p, f, F and %. Floats are formatted as fixed-point, with up to
+COM_PRINT_FLOAT_PREC_MAX decimal places (e, E, g and G are treated as f).
+@param fmt Pointer to a null-terminated Format string of characters
+@param args The variable args structure containing variables to insert in the format string
+*/
+void CCom::PrintArgs(const char* fmt, va_list args)
+{
+	//Table of powers of ten used to scale float fractions
+	static const uint32 pow10[COM_PRINT_FLOAT_PREC_MAX + 1] = {
+		1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+	};
+
+	if(!this->IsOpen())
+		return;
+
+	TComPrintChunk chunk;
+	chunk.Len = 0;
+
+	const char* run = fmt;
+	while(*fmt) {
+		if(*fmt != '%') {
+			fmt++;
+			continue;
+		}
+
+		//Output any literal text before the field
+		if(fmt > run)
+			this->PrintOut(&chunk, run, fmt - run);
+		fmt++;
+
+		//Parse the flags
+		uint8 flags = 0;
+		for(;;) {
+			if(*fmt == '-') SET_BITS(flags, COM_PRINT_FLAG_LEFT);
+			else if(*fmt == '0') SET_BITS(flags, COM_PRINT_FLAG_ZERO);
+			else if(*fmt == '+') SET_BITS(flags, COM_PRINT_FLAG_PLUS);
+			else if(*fmt == ' ') SET_BITS(flags, COM_PRINT_FLAG_SPACE);
+			else if(*fmt == '#') SET_BITS(flags, COM_PRINT_FLAG_ALT);
+			else break;
+			fmt++;
+		}
+
+		//Parse the field width
+		uint32 width = 0;
+		if(*fmt == '*') {
+			int32 arg = va_arg(args, int);
+			if(arg < 0) {
+				SET_BITS(flags, COM_PRINT_FLAG_LEFT);
+				arg = -arg;
+			}
+			width = (uint32)arg;
+			fmt++;
+		}
+		else {
+			while(*fmt >= '0' && *fmt <= '9') {
+				width = (width * 10) + (*fmt - '0');
+				fmt++;
+			}
+		}
+
+		//Parse the precision
+		uint32 prec = 0;
+		if(*fmt == '.') {
+			SET_BITS(flags, COM_PRINT_FLAG_PREC);
+			fmt++;
+			if(*fmt == '*') {
+				int32 arg = va_arg(args, int);
+				if(arg < 0)
+					CLR_BITS(flags, COM_PRINT_FLAG_PREC);
+				else
+					prec = (uint32)arg;
+				fmt++;
+			}
+			else {
+				while(*fmt >= '0' && *fmt <= '9') {
+					prec = (prec * 10) + (*fmt - '0');
+					fmt++;
+				}
+			}
+		}
+
+		//Parse the length modifier, counting the number of 'l's (or 'h's as negative)
+		int8 size = 0;
+		for(;;) {
+			if(*fmt == 'l') size++;
+			else if(*fmt == 'h') size--;
+			else if(*fmt == 'j') size = 2;
+			else if(*fmt == 'z' || *fmt == 't') size = (sizeof(size_t) > sizeof(int)) ? 2 : 0;
+			else break;
+			fmt++;
+		}
+
+		//Buffer the field is built in backwards, from the end
+		char buf[COM_PRINT_FIELD_BUFFER];
+		pchar end = buf + COM_PRINT_FIELD_BUFFER;
+		pchar str = end;
+		const char* prefix = "";
+		uint32 prefixLen = 0;
+		uint32 zeros = 0;
+		char conv = *fmt;
+
+		switch(conv) {
+			case 'd':
+			case 'i':
+			case 'u':
+			case 'o':
+			case 'x':
+			case 'X':
+			case 'p': {
+				//Get the value, extending it to 64-bits
+				uint64 value;
+				bool neg = false;
+				if(conv == 'p') {
+					value = (uintptr_t)va_arg(args, void*);
+					SET_BITS(flags, COM_PRINT_FLAG_ALT);
+				}
+				else if(conv == 'd' || conv == 'i') {
+					int64 sval;
+					if(size >= 2) sval = va_arg(args, long long);
+					else if(size == 1) sval = va_arg(args, long);
+					else if(size == -1) sval = (int16)va_arg(args, int);
+					else if(size <= -2) sval = (int8)va_arg(args, int);
+					else sval = va_arg(args, int);
+					neg = (sval < 0);
+					value = neg ? (uint64)0 - (uint64)sval : (uint64)sval;
+				}
+				else {
+					if(size >= 2) value = va_arg(args, unsigned long long);
+					else if(size == 1) value = va_arg(args, unsigned long);
+					else if(size == -1) value = (uint16)va_arg(args, unsigned int);
+					else if(size <= -2) value = (uint8)va_arg(args, unsigned int);
+					else value = va_arg(args, unsigned int);
+				}
+
+				//Convert the digits, only using 64-bit division when needed
+				uint32 base = (conv == 'o') ? 8 : ((conv == 'd' || conv == 'i' || conv == 'u') ? 10 : 16);
+				const char* digits = (conv == 'X') ? "0123456789ABCDEF" : "0123456789abcdef";
+				while(value > 0xFFFFFFFFULL) {
+					*--str = digits[value % base];
+					value /= base;
+				}
+				uint32 value32 = (uint32)value;
+				if(base == 10) {
+					//Dividing by a constant lets the compiler use a multiply
+					while(value32) {
+						*--str = '0' + (value32 % 10);
+						value32 /= 10;
+					}
+				}
+				else {
+					uint32 shift = (base == 8) ? 3 : 4;
+					while(value32) {
+						*--str = digits[value32 & (base - 1)];
+						value32 >>= shift;
+					}
+				}
+				uint32 len = end - str;
+
+				//Work out the sign or base prefix
+				if(neg) prefix = "-";
+				else if((conv == 'd' || conv == 'i') && IS_BITS_SET(flags, COM_PRINT_FLAG_PLUS)) prefix = "+";
+				else if((conv == 'd' || conv == 'i') && IS_BITS_SET(flags, COM_PRINT_FLAG_SPACE)) prefix = " ";
+				else if(IS_BITS_SET(flags, COM_PRINT_FLAG_ALT) && len > 0) {
+					if(conv == 'x' || conv == 'p') prefix = "0x";
+					else if(conv == 'X') prefix = "0X";
+					else if(conv == 'o' && prec <= len) prefix = "0";
+				}
+				prefixLen = strlen(prefix);
+
+				//Apply the minimum number of digits, where zero padding is ignored
+				if(IS_BITS_SET(flags, COM_PRINT_FLAG_PREC)) {
+					CLR_BITS(flags, COM_PRINT_FLAG_ZERO);
+					if(prec > len)
+						zeros = prec - len;
+				}
+				else if(len == 0) {
+					zeros = 1;
+				}
 
-void CCom::Print(const pchar str, ...)
+				this->PrintField(&chunk, prefix, prefixLen, str, len, zeros, width, flags);
+				break;
+			}
+
+			case 'f':
+			case 'F':
+			case 'e':
+			case 'E':
+			case 'g':
+			case 'G': {
+				double value = va_arg(args, double);
+				if(!IS_BITS_SET(flags, COM_PRINT_FLAG_PREC))
+					prec = 6;
+				else if(prec > COM_PRINT_FLOAT_PREC_MAX)
+					prec = COM_PRINT_FLOAT_PREC_MAX;
+
+				//Work out the sign prefix
+				if(value < 0.0) {
+					prefix = "-";
+					value = -value;
+				}
+				else if(IS_BITS_SET(flags, COM_PRINT_FLAG_PLUS)) prefix = "+";
+				else if(IS_BITS_SET(flags, COM_PRINT_FLAG_SPACE)) prefix = " ";
+				prefixLen = strlen(prefix);
+
+				if(value != value || value >= 1.8e19) {
+					//Values that don't fit the fixed-point conversion (including NaN and Inf)
+					CLR_BITS(flags, COM_PRINT_FLAG_ZERO);
+					str = (pchar)((value != value) ? "nan" : "inf");
+					this->PrintField(&chunk, prefix, prefixLen, str, 3, 0, width, flags);
+					break;
+				}
+
+				//Split into whole and rounded fractional parts
+				uint64 whole = (uint64)value;
+				uint32 scale = pow10[prec];
+				uint32 frac = (uint32)(((value - (double)whole) * (double)scale) + 0.5);
+				if(frac >= scale) {
+					whole++;
+					frac -= scale;
+				}
+
+				//Convert the fraction, then the decimal point and whole digits
+				for(uint32 i = 0; i < prec; i++) {
+					*--str = '0' + (frac % 10);
+					frac /= 10;
+				}
+				if(prec > 0 || IS_BITS_SET(flags, COM_PRINT_FLAG_ALT))
+					*--str = '.';
+				while(whole > 0xFFFFFFFFULL) {
+					*--str = '0' + (whole % 10);
+					whole /= 10;
+				}
+				uint32 whole32 = (uint32)whole;
+				do {
+					*--str = '0' + (whole32 % 10);
+					whole32 /= 10;
+				} while(whole32);
+
+				this->PrintField(&chunk, prefix, prefixLen, str, end - str, 0, width, flags);
+				break;
+			}
+
+			case 'c': {
+				buf[0] = (char)va_arg(args, int);
+				CLR_BITS(flags, COM_PRINT_FLAG_ZERO);
+				this->PrintField(&chunk, prefix, 0, buf, 1, 0, width, flags);
+				break;
+			}
+
+			case 's': {
+				const char* value = va_arg(args, const char*);
+				if(!value)
+					value = "(null)";
+				//Find the length, limited to the precision without reading beyond it
+				uint32 len = 0;
+				while(value[len] && (!IS_BITS_SET(flags, COM_PRINT_FLAG_PREC) || len < prec))
+					len++;
+				CLR_BITS(flags, COM_PRINT_FLAG_ZERO);
+				this->PrintField(&chunk, prefix, 0, value, len, 0, width, flags);
+				break;
+			}
+
+			case 'n': {
+				//Writing back the character count isn't supported, so just consume the argument
+				(void)va_arg(args, void*);
+				break;
+			}
+
+			case '%': {
+				this->PrintOut(&chunk, "%", 1);
+				break;
+			}
+
+			case 0: {
+				//The format string ended part way through a field, so step
+				//back to end the loop on the terminator below
+				fmt--;
+				break;
+			}
+
+			default: {
+				//Unknown conversions are written out as they appear
+				this->PrintOut(&chunk, fmt, 1);
+				break;
+			}
+		}
+
+		//Continue the literal text after the conversion character
+		fmt++;
+		run = fmt;
+	}
+
+	//Output any remaining literal text, and write what is still gathered
+	if(fmt > run)
+		this->PrintOut(&chunk, run, fmt - run);
+	if(chunk.Len)
+		this->WriteBlock((puint8)chunk.Data, chunk.Len);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that outputs a formatted PRINTF field, padded to the required width
+@param chunk Pointer to the chunk gathering the output
+@param prefix Pointer to the sign or base prefix characters to write before any zero padding
+@param prefixLen The number of prefix characters
+@param str Pointer to the characters of the field
+@param len The number of characters in the field
+@param zeros The number of leading zeroes needed to meet the precision
+@param width The minimum width of the field
+@param flags The COM_PRINT_FLAG values controlling justification and padding
+*/
+void CCom::PrintField(TComPrintChunk* chunk, const char* prefix, uint32 prefixLen, const char* str, uint32 len, uint32 zeros, uint32 width, uint8 flags)
 {
-	//Initialise the arguments list
-	va_list args;
-	va_start(args, str);
-	//Call the print function for the arguments list
-	this->Print(str, args);
-	//Tidy up
-	va_end(args);
+	uint32 total = prefixLen + zeros + len;
+	uint32 pad = (width > total) ? (width - total) : 0;
+
+	//Pad on the left with spaces, or with zeroes after the prefix
+	if(IS_BITS_SET(flags, COM_PRINT_FLAG_LEFT)) {
+		//Padding is added after the field
+	}
+	else if(IS_BITS_SET(flags, COM_PRINT_FLAG_ZERO)) {
+		zeros += pad;
+		pad = 0;
+	}
+	else {
+		this->PrintPad(chunk, ' ', pad);
+		pad = 0;
+	}
+
+	this->PrintOut(chunk, prefix, prefixLen);
+	this->PrintPad(chunk, '0', zeros);
+	this->PrintOut(chunk, str, len);
+	this->PrintPad(chunk, ' ', pad);
 }
+
+/*!-----------------------------------------------------------------------------
+Function that adds characters to the PRINTF output, writing the chunk to the
+port each time it fills. Runs that are too long for the chunk are written
+straight to the port, after what is already gathered.
+@param chunk Pointer to the chunk gathering the output
+@param str Pointer to the characters to output
+@param len The number of characters
 */
+void CCom::PrintOut(TComPrintChunk* chunk, const char* str, uint32 len)
+{
+	if((chunk->Len + len) > COM_PRINT_CHUNK_SIZE) {
+		if(chunk->Len) {
+			this->WriteBlock((puint8)chunk->Data, chunk->Len);
+			chunk->Len = 0;
+		}
+		if(len > COM_PRINT_CHUNK_SIZE) {
+			this->WriteBlock((puint8)str, len);
+			return;
+		}
+	}
+	//Copy by hand, as the runs are mostly too short to be worth a library call
+	pchar dest = chunk->Data + chunk->Len;
+	chunk->Len += len;
+	while(len--)
+		*dest++ = *str++;
+}
 
 /*!-----------------------------------------------------------------------------
-Function that implements a PrintF like capability to write text to the uart
-output
-@param str Pointer to a null-terminated Format string of characters
-@param args The variable args structure containing variables to insert in the format string
+Function that outputs a number of repeated padding characters
+@param chunk Pointer to the chunk gathering the output
+@param ch The padding character to write
+@param count The number of characters to write
 */
-void CCom::PrintArgs(pchar str, va_list args)
+void CCom::PrintPad(TComPrintChunk* chunk, char ch, uint32 count)
 {
-	if(this->IsOpen()) {
-		//Allocate a buffer for output characters
-		char buf[COM_PRINT_BUFFER];
-		//Convert the variable-args and string into a character buffer
-		vsnprintf(buf, COM_PRINT_BUFFER, str, args);
-		//Get the length of the string to send
-		uint32 len = strlen(buf);
-		//Write the character buffer to the Uart
-		this->Write((puint8)buf, len);
+	static const char spaces[] = "                ";
+	static const char zeros[] = "0000000000000000";
+	const char* pad = (ch == '0') ? zeros : spaces;
+
+	while(count) {
+		uint32 len = (count < (sizeof(spaces) - 1)) ? count : (sizeof(spaces) - 1);
+		this->PrintOut(chunk, pad, len);
+		count -= len;
 	}
 }
 
@@ -72,11 +427,40 @@ void CCom::Read(puint8 pBuf, uint32 count)
 	if(!this->IsOpen())
 		return;
 
-	//Read the requested number of bytes
+	//Read blocks of bytes as they arrive, until the requested number have been read
+	while(count > 0) {
+		uint32 read = this->ReadBlock(pBuf, count);
+		pBuf += read;
+		count -= read;
+		//### Perhaps need a Watchdog reset here!
+	}
+}
+
+/*!-----------------------------------------------------------------------------
+Function that reads the bytes currently held in the receive buffer, up to
+the specified number, without blocking.
+Inheriting classes should override this to copy the buffer contents in bulk,
+this default implementation reads one byte at a time.
+@param pBuf Pointer to the buffer where the received bytes should be copied
+@param count The maximum number of bytes to read
+@result The number of bytes read, which may be zero
+*/
+uint32 CCom::ReadBlock(puint8 pBuf, uint32 count)
+{
+	//Don't allow data to be read if the port is closed
+	if(!this->IsOpen())
+		return 0;
+
+	uint32 avail = this->GetRxBufferCount();
+	if(count > avail)
+		count = avail;
+
 	for(uint32 i = 0; i < count; i++) {
 		*pBuf = this->ReadByte();
 		pBuf++;
 	}
+
+	return count;
 }
 
 /*!-----------------------------------------------------------------------------
@@ -92,10 +476,24 @@ void CCom::Write(puint8 pBuf, uint32 count)
 	//Only write data if the port is open
 	if(this->IsOpen()) {
 		//Write the buffer contents into the transmitter
-		for(uint32 i = 0; i < count; i++) {
-			this->WriteByte(*pBuf);
-			pBuf++;
-		}
+		this->WriteBlock(pBuf, count);
+	}
+}
+
+/*!-----------------------------------------------------------------------------
+Function that is called to write a block of bytes onto the Serial Port.
+If the buffer capacity is full, then this function will block, until
+transmission frees further space in the buffer.
+Inheriting classes should override this to copy the data into their buffer in
+bulk, this default implementation writes one byte at a time.
+@param pBuf Pointer to the start of the buffer to get data from
+@param count The number of bytes to write
+*/
+void CCom::WriteBlock(puint8 pBuf, uint32 count)
+{
+	for(uint32 i = 0; i < count; i++) {
+		this->WriteByte(*pBuf);
+		pBuf++;
 	}
 }
 
@@ -154,20 +552,15 @@ Does NOT output a null-terminator at the end of the string
 */
 void CCom::WriteString(const string& value, bool newline)
 {
-	uint32 len = value.length();
-	const char* p = value.c_str();
-
 	//Only write data if the port is open
 	if(this->IsOpen()) {
-		//Write the buffer contents into the transmitter
-		for(uint32 i = 0; i < len; i++) {
-			this->WriteByte(*p);
-			p++;
-		}
+		//Write the string contents into the transmitter
+		this->WriteBlock((puint8)value.c_str(), value.length());
+
 		//If required, write a CR/LF character after the string
 		if(newline) {
-			this->WriteByte(13);
-			this->WriteByte(10);
+			uint8 crlf[2] = { 13, 10 };
+			this->WriteBlock(crlf, 2);
 		}
 	}
 }
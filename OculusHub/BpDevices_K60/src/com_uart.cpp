@@ -16,19 +16,42 @@ CComUart::CComUart(uint8 port, uint32 rxBufSize, uint32 txBufSize)
 	_port = port;
 	_flags = 0;
 	_baud = BAUD_9600;
+	_baudActual = 0;
 	_loopback = false;
+	_mode = UART_MODE_IRQ;
 	_parity = PARITY_NONE;
 	_open = false;
 
 	_uart = NULL;
 
+	//Initialise the DMA mode state (the receive ring is allocated when opened)
+	_dmaRxRing = NULL;
+	_dmaRxRingIdx = 0;
+	_dmaRxRingSize = UART_DMA_RX_RING_SIZE;
+	_dmaRxPos = 0;
+	_dmaTxCount = 0;
+
+	//Assume single entry hardware FIFOs until the FIFO mode is opened
+	_fifoRxSize = 1;
+	_fifoTxSize = 1;
+
 	//Create ring-buffers with default size
-	_rxBuffer = new CByteFifoBuffer(rxBufSize);
-	_txBuffer = new CByteFifoBuffer(txBufSize);
+	_rxBuffer = new CByteSpscFifoBuffer(rxBufSize);
+	_txBuffer = new CByteSpscFifoBuffer(txBufSize);
 
 	//Initialise the TxEnable to the false state
 	//(dont raise an interrupt here as nothing will be connected to it)
 	_txEnable = false;
+
+	//Initialise the transmit flow control
+	_txBlocking = true;
+	_txHighWater = 0;
+	_txHighWaterRaised = false;
+	_txQueued = 0;
+	_txReported = 0;
+
+	//Clear the statistics
+	memset(&_stats, 0, sizeof(_stats));
 }
 
 /*!-----------------------------------------------------------------------------
@@ -41,6 +64,7 @@ CComUart::~CComUart()
 	//Destroy resources
 	delete _rxBuffer;
 	delete _txBuffer;
+	free(_dmaRxRing);
 }
 
 /*!-----------------------------------------------------------------------------
@@ -50,26 +74,7 @@ Function used to convert the enumerated baud-rate type
 */
 uint32 CComUart::CalcBaudValue(EUartBaud baudRate)
 {
-	switch(baudRate) {
-		case BAUD_75 : return 75;
-		case BAUD_110 : return 110;
-		case BAUD_150 : return 150;
-		case BAUD_300 : return 300;
-		case BAUD_600 : return 600;
-		case BAUD_1200 : return 1200;
-		case BAUD_2400 : return 2400;
-		case BAUD_4800 : return 4800;
-		case BAUD_9600 : return 9600;
-		case BAUD_14400 : return 14400;
-		case BAUD_19200 : return 19200;
-		case BAUD_38400 : return 38400;
-		case BAUD_57600 : return 57600;
-		case BAUD_115200 : return 115200;
-		case BAUD_230400 : return 230400;
-		case BAUD_460800 : return 460800;
-		case BAUD_921600 : return 921600;
-		default : return 0;
-	}
+	return UartBaudValue(baudRate);
 }
 
 /*!-----------------------------------------------------------------------------
@@ -79,23 +84,27 @@ Function that returns a Baud Rate enumeration value for the specified baud value
 */
 EUartBaud CComUart::CalcBaudRate(uint32 baudValue)
 {
-	if(baudValue <= 75) return BAUD_75;
-	else if(baudValue <= 110) return BAUD_110;
-	else if(baudValue <= 150) return BAUD_150;
-	else if(baudValue <= 300) return BAUD_300;
-	else if(baudValue <= 600) return BAUD_600;
-	else if(baudValue <= 1200) return BAUD_1200;
-	else if(baudValue <= 2400) return BAUD_2400;
-	else if(baudValue <= 4800) return BAUD_4800;
-	else if(baudValue <= 9600) return BAUD_9600;
-	else if(baudValue <= 14400) return BAUD_14400;
-	else if(baudValue <= 19200) return BAUD_19200;
-	else if(baudValue <= 38400) return BAUD_38400;
-	else if(baudValue <= 57600) return BAUD_57600;
-	else if(baudValue <= 115200) return BAUD_115200;
-	else if(baudValue <= 230400) return BAUD_230400;
-	else if(baudValue <= 460800) return BAUD_460800;
-	else return BAUD_921600; //if(baudValue <= 921600)
+	//Find the first enumeration at or above the value
+	for(uint32 baud = 0; baud < EUART_BAUD_HIGH; baud++) {
+		if(baudValue <= UART_BAUD_VALUES[baud])
+			return (EUartBaud)baud;
+	}
+	return EUART_BAUD_HIGH;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that converts the encoded size of a UART hardware FIFO (from the
+PFIFO register) into the number of entries it holds
+@param value The RXFIFOSIZE or TXFIFOSIZE field value
+@result The number of entries in the FIFO
+*/
+uint8 CComUart::CalcFifoSize(uint8 value)
+{
+	//Sizes are 1, then powers of two from 4 to 128 entries (7 is reserved)
+	if(value == 0 || value > 6)
+		return 1;
+	else
+		return (uint8)(2 << value);
 }
 
 /*!-----------------------------------------------------------------------------
@@ -103,11 +112,14 @@ Function that clears down the specified UART buffers
 */
 void CComUart::Clear(bool rx, bool tx)
 {
+	//Clearing resets both ends of the buffers, so the ISR must be held off
 	IRQ_DISABLE;
 	if(rx)
 		_rxBuffer->Clear();
-	if(tx)
+	if(tx) {
 		_txBuffer->Clear();
+		_txReported = _txQueued;
+	}
 	IRQ_ENABLE;
 }
 
@@ -124,7 +136,13 @@ void CComUart::Close(void)
 		this->DoTxMode(false, true);
 
 		//Disable the UART hardware and interrupts
-		CLR_BITS(_uart->C2, UART_C2_TIE_MASK | UART_C2_RIE_MASK | UART_C2_TE_MASK | UART_C2_RE_MASK);
+		CLR_BITS(_uart->C2, UART_C2_TIE_MASK | UART_C2_RIE_MASK | UART_C2_ILIE_MASK | UART_C2_TE_MASK | UART_C2_RE_MASK);
+
+		//Release the DMA channels, or disable the hardware FIFOs
+		if(_mode == UART_MODE_DMA)
+			this->DmaClose();
+		else if(_mode == UART_MODE_FIFO)
+			this->FifoClose();
 
 		//Turn off the UART port clock
 		switch (_port) {
@@ -175,11 +193,267 @@ void CComUart::Close(void)
 
 	//Clear the Transmit Buffer
 	_txBuffer->Clear();
+	_txReported = _txQueued;
 
 	//Indicate the port is closed
 	_open = false;
 }
 
+/*!-----------------------------------------------------------------------------
+Function that stops the DMA channels used by the port, and disconnects them
+from the UART.
+*/
+void CComUart::DmaClose()
+{
+	uint8 chRx = UART_DMA_CHANNEL_RX(_port);
+	uint8 chTx = UART_DMA_CHANNEL_TX(_port);
+
+	//Stop the UART raising DMA requests and idle-line interrupts
+	CLR_BITS(_uart->C5, UART_C5_RDMAS_MASK | UART_C5_TDMAS_MASK);
+	CLR_BITS(_uart->C2, UART_C2_ILIE_MASK);
+
+	//Disable the channels and their interrupts
+	DMA0->CERQ = chRx;
+	DMA0->CERQ = chTx;
+	DMAMUX0->CHCFG[chRx] = 0;
+	DMAMUX0->CHCFG[chTx] = 0;
+	DMA0->TCD[chRx].CSR = 0;
+	NVIC_DisableIRQ((IRQn_Type)(DMA0_DMA16_IRQn + chRx));
+	NVIC_DisableIRQ((IRQn_Type)(DMA0_DMA16_IRQn + chTx));
+	DMA0->CINT = chRx;
+	DMA0->CINT = chTx;
+
+	_dmaTxCount = 0;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that configures the DMA channels used by the port.
+The receive channel runs continuously, writing the UART data register into the
+circular receive ring and interrupting when each half of the ring fills, and
+linking to the lap channel each time it goes round. The transmit channel is
+loaded with a contiguous segment of the transmit buffer each time it is
+started, and disables itself when the segment has been sent.
+*/
+void CComUart::DmaOpen()
+{
+	uint8 chRx = UART_DMA_CHANNEL_RX(_port);
+	uint8 chTx = UART_DMA_CHANNEL_TX(_port);
+	uint8 chLap = UART_DMA_CHANNEL_LAP(_port);
+
+	//Enable the clocks to the DMA controller and request multiplexer
+	SET_BITS(SIM->SCGC6, SIM_SCGC6_DMAMUX0_MASK);
+	SET_BITS(SIM->SCGC7, SIM_SCGC7_DMA_MASK);
+
+	//Setup the receive channel for 8-bit transfers from the UART into the ring,
+	//with the destination wound back to the start of the ring after each major loop
+	DMA0->CERQ = chRx;
+	DMAMUX0->CHCFG[chRx] = 0;
+	DMA0->TCD[chRx].SADDR = (uint32)&_uart->D;
+	DMA0->TCD[chRx].SOFF = 0;
+	DMA0->TCD[chRx].ATTR = DMA_ATTR_SSIZE(0) | DMA_ATTR_DSIZE(0);
+	DMA0->TCD[chRx].NBYTES_MLNO = DMA_NBYTES_MLNO_NBYTES(1);
+	DMA0->TCD[chRx].SLAST = 0;
+	DMA0->TCD[chRx].DADDR = (uint32)_dmaRxRing;
+	DMA0->TCD[chRx].DOFF = 1;
+	DMA0->TCD[chRx].CITER_ELINKNO = DMA_CITER_ELINKNO_CITER(_dmaRxRingSize);
+	DMA0->TCD[chRx].BITER_ELINKNO = DMA_BITER_ELINKNO_BITER(_dmaRxRingSize);
+	DMA0->TCD[chRx].DLAST_SGA = (uint32)(-(int32)_dmaRxRingSize);
+	DMA0->TCD[chRx].CSR = DMA_CSR_INTHALF_MASK | DMA_CSR_INTMAJOR_MASK | DMA_CSR_MAJORELINK_MASK | DMA_CSR_MAJORLINKCH(chLap);
+	DMAMUX0->CHCFG[chRx] = DMAMUX_CHCFG_ENBL_MASK | DMAMUX_CHCFG_SOURCE(UART_DMA_SOURCE_RX(_port));
+	_dmaRxRingIdx = 0;
+	_dmaRxPos = 0;
+
+	//Setup the lap counting channel, linked to at the end of each pass round the
+	//ring, to copy a byte onto itself, so its major loop count counts down the laps
+	DMA0->TCD[chLap].SADDR = (uint32)&_dmaRxLapDummy;
+	DMA0->TCD[chLap].SOFF = 0;
+	DMA0->TCD[chLap].ATTR = DMA_ATTR_SSIZE(0) | DMA_ATTR_DSIZE(0);
+	DMA0->TCD[chLap].NBYTES_MLNO = DMA_NBYTES_MLNO_NBYTES(1);
+	DMA0->TCD[chLap].SLAST = 0;
+	DMA0->TCD[chLap].DADDR = (uint32)&_dmaRxLapDummy;
+	DMA0->TCD[chLap].DOFF = 0;
+	DMA0->TCD[chLap].CITER_ELINKNO = DMA_CITER_ELINKNO_CITER(UART_DMA_MAJOR_MAX);
+	DMA0->TCD[chLap].BITER_ELINKNO = DMA_BITER_ELINKNO_BITER(UART_DMA_MAJOR_MAX);
+	DMA0->TCD[chLap].DLAST_SGA = 0;
+	DMA0->TCD[chLap].CSR = 0;
+
+	//Setup the transmit channel for 8-bit transfers into the UART, the source
+	//and length are loaded when a segment is started (see DmaTxStart)
+	DMA0->CERQ = chTx;
+	DMAMUX0->CHCFG[chTx] = 0;
+	DMA0->TCD[chTx].SOFF = 1;
+	DMA0->TCD[chTx].ATTR = DMA_ATTR_SSIZE(0) | DMA_ATTR_DSIZE(0);
+	DMA0->TCD[chTx].NBYTES_MLNO = DMA_NBYTES_MLNO_NBYTES(1);
+	DMA0->TCD[chTx].SLAST = 0;
+	DMA0->TCD[chTx].DADDR = (uint32)&_uart->D;
+	DMA0->TCD[chTx].DOFF = 0;
+	DMA0->TCD[chTx].DLAST_SGA = 0;
+	DMA0->TCD[chTx].CSR = DMA_CSR_INTMAJOR_MASK | DMA_CSR_DREQ_MASK;
+	DMAMUX0->CHCFG[chTx] = DMAMUX_CHCFG_ENBL_MASK | DMAMUX_CHCFG_SOURCE(UART_DMA_SOURCE_TX(_port));
+	_dmaTxCount = 0;
+
+	//Enable the channel interrupts and start receiving
+	NVIC_EnableIRQ((IRQn_Type)(DMA0_DMA16_IRQn + chRx));
+	NVIC_EnableIRQ((IRQn_Type)(DMA0_DMA16_IRQn + chTx));
+	DMA0->SERQ = chRx;
+
+	//Route the UART receive and transmit requests to the DMA controller,
+	//and interrupt when the receive line goes idle
+	SET_BITS(_uart->C5, UART_C5_RDMAS_MASK | UART_C5_TDMAS_MASK);
+	SET_BITS(_uart->C2, UART_C2_ILIE_MASK);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that moves any bytes the DMA controller has written into the receive
+ring across into the receive buffer.
+The receive position is taken from the lap count and the index within the
+ring, so if more than a ring has arrived since the last drain, the channel has
+lapped the reader and overwritten unread data, and the ring is discarded.
+Must be called from an interrupt, or with interrupts disabled.
+*/
+void CComUart::DmaRxDrain()
+{
+	uint8 chRx = UART_DMA_CHANNEL_RX(_port);
+	uint8 chLap = UART_DMA_CHANNEL_LAP(_port);
+	uint32 posWrap = _dmaRxRingSize * UART_DMA_MAJOR_MAX;
+	uint32 laps;
+	uint32 citer;
+
+	//The current major loop counts tell us how far through the ring the DMA
+	//is, and how many times it has been round (re-reading if it wraps as we look)
+	do {
+		laps = DMA0->TCD[chLap].CITER_ELINKNO & DMA_CITER_ELINKNO_CITER_MASK;
+		citer = DMA0->TCD[chRx].CITER_ELINKNO & DMA_CITER_ELINKNO_CITER_MASK;
+	} while(laps != (DMA0->TCD[chLap].CITER_ELINKNO & DMA_CITER_ELINKNO_CITER_MASK));
+
+	uint32 idxWrite = _dmaRxRingSize - citer;
+	if(idxWrite >= _dmaRxRingSize)
+		idxWrite = 0;
+	uint32 pos = ((UART_DMA_MAJOR_MAX - laps) * _dmaRxRingSize) + idxWrite;
+
+	//Count the new bytes. The lap count is linked to just after the ring wraps,
+	//so it may lag the index briefly, making the position appear to go backwards
+	uint32 count = (pos >= _dmaRxPos) ? (pos - _dmaRxPos) : (posWrap - _dmaRxPos + pos);
+	if(count > (posWrap - _dmaRxRingSize))
+		return;
+	_dmaRxPos = pos;
+	_stats.RxBytes += count;
+
+	if(count > _dmaRxRingSize) {
+		//The channel has lapped the reader, so what's in the ring isn't in order
+		//any more, discard it and set the error flag
+		SET_BITS(_flags, UART_OVERRUN_ERR_MASK);
+		_stats.DmaRxLaps++;
+		_stats.RxBufferDrops += count;
+		_dmaRxRingIdx = idxWrite;
+		count = 0;
+	}
+
+	//Copy the new bytes across in contiguous runs
+	while(count > 0) {
+		uint32 run = _dmaRxRingSize - _dmaRxRingIdx;
+		puint8 span;
+		uint32 space = _rxBuffer->ReserveSpan(&span);
+
+		if(space == 0) {
+			//The buffer is full, so discard the data, but set the error flag
+			SET_BITS(_flags, UART_RXBUF_ERR_MASK);
+			_stats.RxBufferDrops += count;
+			_dmaRxRingIdx = idxWrite;
+			break;
+		}
+
+		if(run > count)
+			run = count;
+		if(run > space)
+			run = space;
+		memcpy(span, &_dmaRxRing[_dmaRxRingIdx], run);
+		_rxBuffer->CommitWrite(run);
+		count -= run;
+
+		_dmaRxRingIdx += run;
+		if(_dmaRxRingIdx >= _dmaRxRingSize)
+			_dmaRxRingIdx = 0;
+	}
+
+	//Track how full the receive buffer gets
+	this->StatsRx(0);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that moves any bytes the DMA controller has written into the receive
+ring across into the receive buffer, from outside of an interrupt.
+*/
+void CComUart::DmaRxPoll()
+{
+	//The ring interrupts also drain the ring, so hold them off
+	IRQ_DISABLE;
+	this->DmaRxDrain();
+	IRQ_ENABLE;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that starts the transmit DMA channel sending the next contiguous
+segment of the transmit buffer. If the buffer is empty, the transmit complete
+interrupt is enabled instead, to end the transmission.
+Must be called from an interrupt, or with interrupts disabled.
+*/
+void CComUart::DmaTxStart()
+{
+	uint8 chTx = UART_DMA_CHANNEL_TX(_port);
+	puint8 data;
+	uint32 count = _txBuffer->PeekSpan(&data);
+
+	if(count == 0) {
+		//Nothing left to send, so wait for the last byte to leave the shifter
+		_dmaTxCount = 0;
+		CLR_BITS(_uart->C2, UART_C2_TIE_MASK);
+		SET_BITS(_uart->C2, UART_C2_TCIE_MASK);
+	}
+	else {
+		if(count > UART_DMA_MAJOR_MAX)
+			count = UART_DMA_MAJOR_MAX;
+		_dmaTxCount = count;
+
+		//Load the segment and enable the channel requests
+		DMA0->TCD[chTx].SADDR = (uint32)data;
+		DMA0->TCD[chTx].CITER_ELINKNO = DMA_CITER_ELINKNO_CITER(count);
+		DMA0->TCD[chTx].BITER_ELINKNO = DMA_BITER_ELINKNO_BITER(count);
+		DMA0->SERQ = chTx;
+
+		//Ensure the UART is requesting transfers (the transmit complete
+		//interrupt may have been armed by the end of a previous segment)
+		CLR_BITS(_uart->C2, UART_C2_TCIE_MASK);
+		SET_BITS(_uart->C2, UART_C2_TIE_MASK);
+	}
+}
+
+/*!-----------------------------------------------------------------------------
+Function that is called by the DMA handler when the receive channel has filled
+half or all of the receive ring.
+*/
+void CComUart::DoDmaRxISR(void)
+{
+	DMA0->CINT = UART_DMA_CHANNEL_RX(_port);
+	_stats.DmaIsrCount++;
+	this->DmaRxDrain();
+}
+
+/*!-----------------------------------------------------------------------------
+Function that is called by the DMA handler when the transmit channel has sent
+a segment of the transmit buffer.
+*/
+void CComUart::DoDmaTxISR(void)
+{
+	DMA0->CINT = UART_DMA_CHANNEL_TX(_port);
+	_stats.DmaIsrCount++;
+
+	//Release the sent bytes from the buffer, and start on the next segment
+	_stats.TxBytes += _dmaTxCount;
+	_txBuffer->CommitRead(_dmaTxCount);
+	this->DmaTxStart();
+}
+
 /*!-----------------------------------------------------------------------------
 Function that is called by the UART handler when the UART IRQ is raise.
 As this function is called from an Interrupt, any class fields or members it
@@ -191,6 +465,115 @@ void CComUart::DoISR(void)
 
 		//Read the UART status register
 		volatile uint8 status = _uart->S1;
+		_stats.IsrCount++;
+
+		//In DMA mode the DMA controller moves the data, so only the idle-line
+		//and transmit complete interrupts are serviced here
+		if(_mode == UART_MODE_DMA) {
+			if(status & UART_S1_OR_MASK) {
+				//An overrun error has occurred
+				SET_BITS(_flags, UART_OVERRUN_ERR_MASK);
+				_stats.OverrunErrors++;
+			}
+
+			if(status & (UART_S1_IDLE_MASK | UART_S1_OR_MASK)) {
+				//Clearing the flags needs the data register to be read, so stop
+				//the UART requesting DMA transfers while it is, then if the status
+				//shows a byte had arrived, this read has collected it instead.
+				//A byte arriving after the status was read stays in the register
+				//for the DMA controller, as the read doesn't clear RDRF for it
+				CLR_BITS(_uart->C5, UART_C5_RDMAS_MASK);
+				status = _uart->S1;
+				uint8 data = _uart->D;
+
+				//The line has gone quiet, so collect the bytes waiting in the ring
+				this->DmaRxDrain();
+
+				//Then any byte taken from the data register, which follows them
+				if(status & UART_S1_RDRF_MASK) {
+					if(!_rxBuffer->IsFull()) {
+						_rxBuffer->Push(data);
+					}
+					else {
+						SET_BITS(_flags, UART_RXBUF_ERR_MASK);
+						_stats.RxBufferDrops++;
+					}
+					this->StatsRx(1);
+				}
+				SET_BITS(_uart->C5, UART_C5_RDMAS_MASK);
+
+				if(status & UART_S1_IDLE_MASK)
+					this->DoRxIdle();
+			}
+
+			if(IS_BITS_SET(_uart->C2, UART_C2_TCIE_MASK) && IS_BITS_SET(status, UART_S1_TC_MASK)) {
+				CLR_BITS(_uart->C2, UART_C2_TCIE_MASK);
+				this->DoTxMode(false);
+				this->DoTxComplete();
+			}
+			return;
+		}
+
+		//In FIFO mode, several bytes are moved each time a FIFO crosses its watermark
+		if(_mode == UART_MODE_FIFO) {
+			//Error flags relate to the byte at the head of the receive FIFO, which is still stored
+			if(status & UART_S1_OR_MASK) {
+				SET_BITS(_flags, UART_OVERRUN_ERR_MASK);
+				_stats.OverrunErrors++;
+			}
+			if(status & UART_S1_FE_MASK) {
+				SET_BITS(_flags, UART_FRAMING_ERR_MASK);
+				_stats.FramingErrors++;
+			}
+			if(status & UART_S1_PF_MASK) {
+				SET_BITS(_flags, UART_PARITY_ERR_MASK);
+				_stats.ParityErrors++;
+			}
+			if(_uart->SFIFO & UART_SFIFO_RXOF_MASK) {
+				SET_BITS(_flags, UART_OVERRUN_ERR_MASK);
+				_stats.OverrunErrors++;
+				_uart->SFIFO = UART_SFIFO_RXOF_MASK;
+			}
+
+			//Service the Receiver, reading the data register also clears the status flags
+			if(status & (UART_S1_RDRF_MASK | UART_S1_IDLE_MASK | UART_S1_OR_MASK | UART_S1_FE_MASK | UART_S1_PF_MASK)) {
+				if(_uart->RCFIFO > 0) {
+					this->FifoRxDrain();
+				}
+				else {
+					//A read is needed to clear the flags, which underflows the empty FIFO, so flush it
+					volatile uint8 dummy = _uart->D;
+					(void)dummy;
+					SET_BITS(_uart->CFIFO, UART_CFIFO_RXFLUSH_MASK);
+					_uart->SFIFO = UART_SFIFO_RXUF_MASK;
+				}
+			}
+
+			//Service the Transmitter FIFO...
+			if(IS_BITS_SET(_uart->C2, UART_C2_TIE_MASK) && IS_BITS_SET(status, UART_S1_TDRE_MASK)) {
+				if(_txBuffer->IsEmpty()) {
+					//If the buffer is empty, turn off transmitter interrupts, but enable the complete interrupt
+					CLR_BITS(_uart->C2, UART_C2_TIE_MASK);
+					SET_BITS(_uart->C2, UART_C2_TCIE_MASK);
+				}
+				else {
+					//Top up the transmit FIFO from the buffer
+					this->FifoTxFill();
+				}
+			}
+
+			//Service the Transmit Complete, to return Half-Duplex to receive mode
+			if(IS_BITS_SET(_uart->C2, UART_C2_TCIE_MASK) && IS_BITS_SET(status, UART_S1_TC_MASK)) {
+				CLR_BITS(_uart->C2, UART_C2_TCIE_MASK);
+				this->DoTxMode(false);
+				this->DoTxComplete();
+			}
+
+			//Tell any listener the received frame has ended
+			if(status & UART_S1_IDLE_MASK)
+				this->DoRxIdle();
+			return;
+		}
 
 		//Always read the data register to clear the interrupt flags
 		uint8 data = _uart->D;
@@ -198,18 +581,21 @@ void CComUart::DoISR(void)
 		//Service the Receiver...
 		if(_uart->C2 & UART_C2_RIE_MASK) {
 
-			if(status & UART_S1_OR_MASK)
+			if(status & UART_S1_OR_MASK) {
 				//An overrun error has occurred
 				SET_BITS(_flags, UART_OVERRUN_ERR_MASK);
-
-			else if(status & UART_S1_FE_MASK)
+				_stats.OverrunErrors++;
+			}
+			else if(status & UART_S1_FE_MASK) {
 				//A framing error has occurred
 				SET_BITS(_flags, UART_FRAMING_ERR_MASK);
-
-			else if(status & UART_S1_PF_MASK)
+				_stats.FramingErrors++;
+			}
+			else if(status & UART_S1_PF_MASK) {
 				//A parity error has occurred
 				SET_BITS(_flags, UART_PARITY_ERR_MASK);
-
+				_stats.ParityErrors++;
+			}
 			else if(status & UART_S1_RDRF_MASK) {
 				//If the receiver has data, then read and store it...
 				//data = _uart->D;
@@ -221,7 +607,9 @@ void CComUart::DoISR(void)
 				else {
 					//The buffer is full, so discard the data, but set the error flag
 					SET_BITS(_flags, UART_RXBUF_ERR_MASK);
+					_stats.RxBufferDrops++;
 				}
+				this->StatsRx(1);
 			}
 		}
 
@@ -236,6 +624,7 @@ void CComUart::DoISR(void)
 				//If the buffer has data, then start transmitting it
 				_txBuffer->Pop(&data);
 				_uart->D = data;
+				_stats.TxBytes++;
 			}
 		}
 
@@ -246,11 +635,74 @@ void CComUart::DoISR(void)
 
 			//Disable the transmitter hardware (for Half-Duplex use)
 			this->DoTxMode(false);
+
+			//Tell any listener the data has gone
+			this->DoTxComplete();
 		}
 
+		//Tell any listener the received frame has ended
+		if(status & UART_S1_IDLE_MASK)
+			this->DoRxIdle();
+
 	//}
 }
 
+/*!-----------------------------------------------------------------------------
+Function called from the ISR when the receive line goes idle after receiving
+data, to raise the OnRxIdle event.
+*/
+void CComUart::DoRxIdle()
+{
+	TComUartRxParams params;
+	params.Uart = this;
+	params.Count = _rxBuffer->GetCount();
+	this->OnRxIdle.Call(&params);
+}
+
+/*!-----------------------------------------------------------------------------
+Function called from the ISR when the transmitter has finished sending, to raise
+the OnTxComplete event for the bytes sent since it was last raised.
+*/
+void CComUart::DoTxComplete()
+{
+	//If data was pushed as the transmitter finished, it will be reported
+	//when that has been sent instead
+	if(!_txBuffer->IsEmpty())
+		return;
+
+	TComUartTxParams params;
+	params.Uart = this;
+	params.Count = _txQueued - _txReported;
+	_txReported += params.Count;
+
+	if(params.Count > 0)
+		this->OnTxComplete.Call(&params);
+}
+
+/*!-----------------------------------------------------------------------------
+Function called after data has been written, to raise the OnTxHighWater event
+once each time the transmit buffer level rises to the high water mark.
+*/
+void CComUart::DoTxHighWater()
+{
+	if(_txHighWater == 0)
+		return;
+
+	uint32 count = _txBuffer->GetCount();
+	if(count < _txHighWater) {
+		//Re-arm the event once the buffer has drained below the mark
+		_txHighWaterRaised = false;
+	}
+	else if(!_txHighWaterRaised) {
+		_txHighWaterRaised = true;
+
+		TComUartTxParams params;
+		params.Uart = this;
+		params.Count = count;
+		this->OnTxHighWater.Call(&params);
+	}
+}
+
 /*!-----------------------------------------------------------------------------
 Function used to raise an OnTxEnableISR event when the Tx Enabled state changes
 (or we wish to force a new state)
@@ -278,6 +730,105 @@ void CComUart::DoTxMode(bool state, bool force)
 	IRQ_ENABLE;
 }
 
+/*!-----------------------------------------------------------------------------
+Function that disables the hardware FIFOs used in FIFO mode.
+Must be called with the transmitter and receiver disabled.
+*/
+void CComUart::FifoClose()
+{
+	CLR_BITS(_uart->PFIFO, UART_PFIFO_RXFE_MASK | UART_PFIFO_TXFE_MASK);
+	_uart->CFIFO = UART_CFIFO_RXFLUSH_MASK | UART_CFIFO_TXFLUSH_MASK;
+
+	_fifoRxSize = 1;
+	_fifoTxSize = 1;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that enables the hardware FIFOs of the UART, and sets the watermarks
+at which the receive and transmit interrupts are raised. The receive watermark
+leaves UART_FIFO_RX_HEADROOM entries free, and any bytes left below it are
+collected by the idle-line interrupt. The transmit interrupt is raised when
+the FIFO has drained to half full.
+Must be called with the transmitter and receiver disabled.
+*/
+void CComUart::FifoOpen()
+{
+	uint8 pfifo = _uart->PFIFO;
+	_fifoRxSize = CComUart::CalcFifoSize((pfifo & UART_PFIFO_RXFIFOSIZE_MASK) >> UART_PFIFO_RXFIFOSIZE_SHIFT);
+	_fifoTxSize = CComUart::CalcFifoSize((pfifo & UART_PFIFO_TXFIFOSIZE_MASK) >> UART_PFIFO_TXFIFOSIZE_SHIFT);
+
+	//Enable and empty the FIFOs, without the overflow/underflow interrupts
+	SET_BITS(_uart->PFIFO, UART_PFIFO_RXFE_MASK | UART_PFIFO_TXFE_MASK);
+	_uart->CFIFO = UART_CFIFO_RXFLUSH_MASK | UART_CFIFO_TXFLUSH_MASK;
+	_uart->SFIFO = UART_SFIFO_RXUF_MASK | UART_SFIFO_TXOF_MASK | UART_SFIFO_RXOF_MASK;
+
+	//Set the watermarks
+	_uart->RWFIFO = (_fifoRxSize > UART_FIFO_RX_HEADROOM) ? (_fifoRxSize - UART_FIFO_RX_HEADROOM) : 1;
+	_uart->TWFIFO = _fifoTxSize / 2;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that moves all the bytes held in the receive FIFO into the receive
+buffer. Must be called from an interrupt.
+*/
+void CComUart::FifoRxDrain()
+{
+	uint32 count = _uart->RCFIFO;
+	if(count > _stats.RxFifoHighWater)
+		_stats.RxFifoHighWater = count;
+	uint32 received = count;
+
+	while(count > 0) {
+		puint8 span;
+		uint32 run = _rxBuffer->ReserveSpan(&span);
+
+		if(run == 0) {
+			//The buffer is full, so discard the data, but set the error flag
+			SET_BITS(_flags, UART_RXBUF_ERR_MASK);
+			_stats.RxBufferDrops += count;
+			while(count > 0) {
+				volatile uint8 dummy = _uart->D;
+				(void)dummy;
+				count--;
+			}
+			break;
+		}
+
+		if(run > count)
+			run = count;
+		for(uint32 idx = 0; idx < run; idx++)
+			span[idx] = _uart->D;
+		_rxBuffer->CommitWrite(run);
+		count -= run;
+	}
+
+	this->StatsRx(received);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that copies as many bytes from the transmit buffer as there is space
+for in the transmit FIFO. Must be called from an interrupt.
+*/
+void CComUart::FifoTxFill()
+{
+	uint32 space = _fifoTxSize - _uart->TCFIFO;
+
+	while(space > 0) {
+		puint8 data;
+		uint32 run = _txBuffer->PeekSpan(&data);
+		if(run == 0)
+			break;
+
+		if(run > space)
+			run = space;
+		for(uint32 idx = 0; idx < run; idx++)
+			_uart->D = data[idx];
+		_txBuffer->CommitRead(run);
+		_stats.TxBytes += run;
+		space -= run;
+	}
+}
+
 /*!-----------------------------------------------------------------------------
 Function that is called to wait while the transmit buffer empites.
 Useful for waiting for chars to be transmitted before closing the UART
@@ -289,17 +840,21 @@ void CComUart::Flush()
 		return;
 
 	//Wait while the transmit buffer isn't empty
-	//Do this in an interrupt safe way, so the buffer cannot be accessed simultaneously
-	volatile bool wait = true;
-	while(wait) {
-		IRQ_DISABLE;
-		wait = !(_txBuffer->IsEmpty());
-		IRQ_ENABLE;
+	while(!_txBuffer->IsEmpty()) {
 		NOP;
 		//### Perhaps need a Watchdog reset here!
 	}
 }
 
+/*!-----------------------------------------------------------------------------
+Function that returns the baud rate actually generated from the module clock
+@result The baud rate in bits per second, or 0 if the port hasn't been opened
+*/
+uint32 CComUart::GetBaudActual()
+{
+	return _baudActual;
+}
+
 /*!-----------------------------------------------------------------------------
 */
 EUartBaud CComUart::GetBaudRate()
@@ -338,6 +893,13 @@ bool CComUart::GetLoopback()
 	return _loopback;
 }
 
+/*!-----------------------------------------------------------------------------
+*/
+EUartMode CComUart::GetMode()
+{
+	return _mode;
+}
+
 /*!-----------------------------------------------------------------------------
 */
 EUartParity CComUart::GetParity()
@@ -353,25 +915,60 @@ uint8 CComUart::GetPort()
 }
 
 /*!-----------------------------------------------------------------------------
+Function that takes a consistent snapshot of the port's statistics.
+@param stats Pointer to the record the statistics should be copied into
+@param clear True if the statistics should be reset after reading
 */
-uint32 CComUart::GetRxBufferCount()
+void CComUart::GetStats(PComUartStats stats, bool clear)
 {
 	IRQ_DISABLE;
-	uint32 count = _rxBuffer->GetCount();
+
+	*stats = _stats;
+
+	if(clear)
+		memset(&_stats, 0, sizeof(_stats));
+
 	IRQ_ENABLE;
+}
 
-	return count;
+/*!-----------------------------------------------------------------------------
+*/
+uint32 CComUart::GetRxBufferCount()
+{
+	//Collect any bytes the DMA has received since the last ring interrupt
+	if(_open && (_mode == UART_MODE_DMA))
+		this->DmaRxPoll();
+
+	return _rxBuffer->GetCount();
 }
 
 /*!-----------------------------------------------------------------------------
 */
 uint32 CComUart::GetTxBufferCount()
 {
-	IRQ_DISABLE;
-	uint32 count = _txBuffer->GetCount();
-	IRQ_ENABLE;
+	return _txBuffer->GetCount();
+}
 
-	return count;
+/*!-----------------------------------------------------------------------------
+Function that returns how many bytes can be written without blocking
+*/
+uint32 CComUart::GetTxBufferFree()
+{
+	return _txBuffer->GetFree();
+}
+
+/*!-----------------------------------------------------------------------------
+*/
+bool CComUart::GetTxBlocking()
+{
+	return _txBlocking;
+}
+
+/*!-----------------------------------------------------------------------------
+*/
+uint32 CComUart::GetTxHighWater()
+{
+	return _txHighWater;
 }
 
 /*!-----------------------------------------------------------------------------
@@ -392,7 +989,7 @@ bool CComUart::Open(void)
 	uint32 uartClk;
 	uint32 uartBaudMin;
 	uint32 uartBaud;
-	double uartDivisor;
+	uint32 uartDivisor;
 	uint16 uartSBR;
 	uint8 uartBRFD;
 
@@ -404,6 +1001,14 @@ bool CComUart::Open(void)
 	if((_port >= UART_PERIPHERALS) || (CComUart::Uart[_port] != NULL))
 		return false;
 
+	//In DMA mode, allocate the receive ring before claiming the hardware
+	if(_mode == UART_MODE_DMA) {
+		puint8 ring = (puint8)realloc(_dmaRxRing, _dmaRxRingSize);
+		if(!ring)
+			return false;
+		_dmaRxRing = ring;
+	}
+
 	//Get the UART access structure for the specified COM port
 	//and other hardware specific variables
 	switch (_port) {
@@ -472,7 +1077,7 @@ bool CComUart::Open(void)
 	//SETUP BAUD RATE...
 	//Calculate the minimum baud rate the UART can achieve from the CLK
 	//NB: 8191 is the maximum value than can be loaded into SBR (2^13 - 1)
-	uartBaudMin = uartClk / (16 * 8191);
+	uartBaudMin = uartClk / (16 * UART_BAUD_SBR_MAX);
 
 	//Calculate the actual baud rate from the enumeration
 	uartBaud = CComUart::CalcBaudValue(_baud);
@@ -483,13 +1088,18 @@ bool CComUart::Open(void)
 		uartBaud = CComUart::CalcBaudValue(_baud);
 	}
 
-	//Calculate the UART divisor (SBR + BRFD)
-	uartDivisor = (double)uartClk / (16.0 * (double)uartBaud);
+	//Calculate the UART divisor (SBR + BRFD) in 1/32'nds, using integer maths
+	uartDivisor = UartBaudDivisor(uartClk, uartBaud);
+	if((uartDivisor >> 5) > UART_BAUD_SBR_MAX)
+		uartDivisor = (UART_BAUD_SBR_MAX << 5) | 0x1F;
+	else if((uartDivisor >> 5) == 0)
+		uartDivisor = BIT(5);
+	_baudActual = UartBaudActual(uartClk, uartDivisor);
 
-	//Calculate the UART's baud rate divisors - SBR for the Serial Baud Rate
+	//Split into the UART's baud rate divisors - SBR for the Serial Baud Rate
 	//and BRFD for Baud Rate Fractional Divisor, in 1/32'nds
-	uartSBR = ((uint16)uartDivisor) & 0x0FFF;
-	uartBRFD = ((uint8)((uartDivisor - (double)uartSBR) * 32.0)) & 0x1F;
+	uartSBR = (uint16)(uartDivisor >> 5);
+	uartBRFD = (uint8)(uartDivisor & 0x1F);
 
 	//Setup the UART's baud rate
 	_uart->BDH = (uint8)((uartSBR >> 8) & 0xFF);
@@ -519,6 +1129,19 @@ bool CComUart::Open(void)
 	else
 		CLR_BITS(_uart->C1, UART_C1_LOOPS_MASK);
 
+	//------------------------------
+	//SETUP IDLE-LINE DETECTION...
+	//Count the idle time from after the stop bit, so only a whole idle character ends a frame
+	SET_BITS(_uart->C1, UART_C1_ILT_MASK);
+	SET_BITS(_uart->C2, UART_C2_ILIE_MASK);
+
+	//------------------------------
+	//SETUP DMA OR FIFOS...
+	if(_mode == UART_MODE_DMA)
+		this->DmaOpen();
+	else if(_mode == UART_MODE_FIFO)
+		this->FifoOpen();
+
 	//------------------------------
 	//Setup the Transmitter into Receive mode (regardless of current state)
 	//this disables the transmitter interrupts and allows reception interrupts to start
@@ -531,6 +1154,26 @@ bool CComUart::Open(void)
 	return true;
 }
 
+/*!-----------------------------------------------------------------------------
+Function that copies the bytes currently held in the receive buffer, up to the
+specified number, without blocking.
+@param pBuf Pointer to the buffer where the received bytes should be copied
+@param count The maximum number of bytes to read
+@result The number of bytes read, which may be zero
+*/
+uint32 CComUart::ReadBlock(puint8 pBuf, uint32 count)
+{
+	//Don't allow data to be read if the port is closed
+	if(!_open)
+		return 0;
+
+	//Collect any bytes the DMA has received since the last ring interrupt
+	if(_mode == UART_MODE_DMA)
+		this->DmaRxPoll();
+
+	return _rxBuffer->PopBlock(pBuf, count);
+}
+
 /*!-----------------------------------------------------------------------------
 Function that reads a single byte from the receive buffer. If no byte is present
 the function will block until the Serial Port received a byte
@@ -545,21 +1188,13 @@ uint8 CComUart::ReadByte()
 		return 0;
 
 	//If the buffer is empty, then loop until we receive a byte
-	//Do this in an interrupt safe way, so the buffer cannot be accessed simultaneously
-	volatile bool wait = true;
-	while(wait) {
-		IRQ_DISABLE;
-		wait = _rxBuffer->IsEmpty();
-		IRQ_ENABLE;
+	while(!_rxBuffer->Pop(&data)) {
+		if(_mode == UART_MODE_DMA)
+			this->DmaRxPoll();
 		NOP;
 		//### Perhaps need a Watchdog reset here!
 	}
 
-	//Read the byte from the buffer
-	IRQ_DISABLE;
-	_rxBuffer->Pop(&data);
-	IRQ_ENABLE;
-
 	return data;
 }
 
@@ -572,6 +1207,34 @@ void CComUart::SetBaudRate(EUartBaud value)
 		_baud = value;
 }
 
+/*!-----------------------------------------------------------------------------
+Function that sets the size of the circular ring the DMA controller receives
+into when in DMA mode. A half-full interrupt is raised as each half fills.
+@param value The ring size in bytes (rounded up to an even number)
+*/
+void CComUart::SetDmaRxRingSize(uint32 value)
+{
+	if(value < 2)
+		value = 2;
+	else if(value > UART_DMA_MAJOR_MAX)
+		value = UART_DMA_MAJOR_MAX;
+
+	//Store the size if the port is closed
+	if(!_open)
+		_dmaRxRingSize = (value + 1) & ~1;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that sets how data is moved between the UART and its buffers.
+@param value The transfer mode to use when the port is next opened
+*/
+void CComUart::SetMode(EUartMode value)
+{
+	//Store the mode if the port is closed
+	if(!_open)
+		_mode = value;
+}
+
 /*!-----------------------------------------------------------------------------
 */
 void CComUart::SetParity(EUartParity value)
@@ -593,6 +1256,20 @@ void CComUart::SetPort(uint8 value)
 		_port = value;
 }
 
+/*!-----------------------------------------------------------------------------
+Function called from the ISR as bytes are received, to count them, and track
+how full the receive buffer gets.
+@param count The number of bytes received from the line
+*/
+void CComUart::StatsRx(uint32 count)
+{
+	_stats.RxBytes += count;
+
+	uint32 held = _rxBuffer->GetCount();
+	if(held > _stats.RxBufferHighWater)
+		_stats.RxBufferHighWater = held;
+}
+
 /*!-----------------------------------------------------------------------------
 */
 void CComUart::SetLoopback(bool value)
@@ -610,6 +1287,15 @@ void CComUart::SetRxBufferSize(uint32 value)
 		_rxBuffer->SetCapacity(value);
 }
 
+/*!-----------------------------------------------------------------------------
+Function that sets what happens when data is written to a full transmit buffer
+@param value True to wait for space, false to discard what doesn't fit (and set UART_TXBUF_ERR)
+*/
+void CComUart::SetTxBlocking(bool value)
+{
+	_txBlocking = value;
+}
+
 /*!-----------------------------------------------------------------------------
 */
 void CComUart::SetTxBufferSize(uint32 value)
@@ -619,42 +1305,129 @@ void CComUart::SetTxBufferSize(uint32 value)
 }
 
 /*!-----------------------------------------------------------------------------
-Function that is called to write the contents of a buffer onto the Serial Port
-Data can only be written when the serial port is open.
-If the buffer capacity is full, then this function will block, until UART
-transmission frees further space in the buffer.
-@param data The data byte to write
+Function that sets the transmit buffer level at which the OnTxHighWater event
+is raised
+@param value The number of buffered bytes that raises the event, or 0 to disable it
 */
-void CComUart::WriteByte(uint8 data)
+void CComUart::SetTxHighWater(uint32 value)
+{
+	_txHighWater = value;
+	_txHighWaterRaised = false;
+}
+
+/*!-----------------------------------------------------------------------------
+Function called after data has been pushed into the transmit buffer, to ensure
+the transmitter is running to send it.
+*/
+void CComUart::TxStart()
+{
+	IRQ_DISABLE;
+
+	//Enable the transmitter hardware to start interrupt driven transmission
+	//(Inheriting classes can override DoTxMode to disable the receiver
+	//for half-duplex operation)
+	this->DoTxMode(true);
+
+	if(_mode == UART_MODE_DMA) {
+		//Start sending the buffer if the channel is idle
+		if(_dmaTxCount == 0)
+			this->DmaTxStart();
+	}
+	else if(!IS_BITS_SET(_uart->C2, UART_C2_TIE_MASK)) {
+		//The ISR may have found the buffer empty just before the data was
+		//pushed, and be waiting for transmit complete, so re-arm it
+		CLR_BITS(_uart->C2, UART_C2_TCIE_MASK);
+		SET_BITS(_uart->C2, UART_C2_TIE_MASK);
+	}
+
+	IRQ_ENABLE;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that copies as much of a block of bytes as will fit into the transmit
+buffer, and starts transmission, without ever blocking.
+The OnTxComplete event is raised once the accepted bytes have been sent.
+@param pBuf Pointer to the start of the buffer to get data from
+@param count The number of bytes to write
+@result The number of bytes accepted, which is less than count if the buffer filled
+*/
+uint32 CComUart::WriteAsync(puint8 pBuf, uint32 count)
 {
 	//Only write data if the port is open
-	if(_open) {
-		//If the buffer is full, wait for it to empty. Do this in an interrupt
-		//safe way, so the buffer cannot be accessed simultaneously
-		volatile bool wait = true;
-		while(wait) {
-			IRQ_DISABLE;
-			wait = _txBuffer->IsFull();
-			IRQ_ENABLE;
-			NOP;
+	if(!_open)
+		return 0;
 
-			//### Perhaps need a Watchdog reset here!
-		}
+	//Copy as much as possible into the buffer. The buffer only supports one
+	//producer, but writes may come from both the main loop and interrupts, so
+	//each block is pushed (and counted) in one short critical section, which
+	//also tracks how full the transmit buffer gets so a writer interrupting
+	//another can't lose a higher mark
+	IRQ_DISABLE;
+	count = _txBuffer->PushBlock(pBuf, count);
+	_txQueued += count;
+	uint32 held = _txBuffer->GetCount();
+	if(held > _stats.TxBufferHighWater)
+		_stats.TxBufferHighWater = held;
+	IRQ_ENABLE;
 
-		IRQ_DISABLE;
+	if(count > 0)
+		this->TxStart();
 
-		//Enable the transmitter hardware to start interrupt driven transmission
-		//(Inheriting classes can override DoTxMode to disable the receiver
-		//for half-duplex operation)
-		this->DoTxMode(true);
+	this->DoTxHighWater();
 
-		//Store the byte to the buffer
-		_txBuffer->Push(data);
+	return count;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that is called to write a block of bytes onto the Serial Port.
+As much of the block as will fit is copied into the transmit buffer in one
+go, and transmission is enabled once for the whole copy.
+If the buffer capacity is full, then this function will block until UART
+transmission frees further space in the buffer, unless blocking has been
+disabled with SetTxBlocking, when the remaining data is discarded.
+@param pBuf Pointer to the start of the buffer to get data from
+@param count The number of bytes to write
+*/
+void CComUart::WriteBlock(puint8 pBuf, uint32 count)
+{
+	//Only write data if the port is open
+	if(!_open)
+		return;
+
+	while(count > 0) {
+		uint32 written = this->WriteAsync(pBuf, count);
+		pBuf += written;
+		count -= written;
+
+		if(count > 0) {
+			if(!_txBlocking) {
+				//Discard what doesn't fit, but set the error flag
+				IRQ_DISABLE;
+				SET_BITS(_flags, UART_TXBUF_ERR_MASK);
+				_stats.TxBufferDrops += count;
+				IRQ_ENABLE;
+				break;
+			}
 
-		IRQ_ENABLE;
+			//Wait for transmission to free some space
+			NOP;
+			//### Perhaps need a Watchdog reset here!
+		}
 	}
 }
 
+/*!-----------------------------------------------------------------------------
+Function that is called to write the contents of a buffer onto the Serial Port
+Data can only be written when the serial port is open.
+If the buffer capacity is full, then this function will block, until UART
+transmission frees further space in the buffer (see SetTxBlocking).
+@param data The data byte to write
+*/
+void CComUart::WriteByte(uint8 data)
+{
+	this->WriteBlock(&data, 1);
+}
+
 //==============================================================================
 //Interrupt Handlers...
 //==============================================================================
@@ -718,4 +1491,118 @@ void ISR_UART5_RX_TX(void) {
 }
 #endif
 
+/*!-----------------------------------------------------------------------------
+Functions called from the Interrupt Vector Table, for the DMA channels of UART0.
+*/
+#if UART0_CONNECT_DMA
+void ISR_DMA0(void) {
+	if (CComUart::Uart[0])
+		CComUart::Uart[0]->DoDmaRxISR();
+	else
+		DMA0->CINT = 0;
+}
+
+void ISR_DMA1(void) {
+	if (CComUart::Uart[0])
+		CComUart::Uart[0]->DoDmaTxISR();
+	else
+		DMA0->CINT = 1;
+}
+#endif
+
+/*!-----------------------------------------------------------------------------
+Functions called from the Interrupt Vector Table, for the DMA channels of UART1.
+*/
+#if UART1_CONNECT_DMA
+void ISR_DMA2(void) {
+	if (CComUart::Uart[1])
+		CComUart::Uart[1]->DoDmaRxISR();
+	else
+		DMA0->CINT = 2;
+}
+
+void ISR_DMA3(void) {
+	if (CComUart::Uart[1])
+		CComUart::Uart[1]->DoDmaTxISR();
+	else
+		DMA0->CINT = 3;
+}
+#endif
+
+/*!-----------------------------------------------------------------------------
+Functions called from the Interrupt Vector Table, for the DMA channels of UART2.
+*/
+#if UART2_CONNECT_DMA
+void ISR_DMA4(void) {
+	if (CComUart::Uart[2])
+		CComUart::Uart[2]->DoDmaRxISR();
+	else
+		DMA0->CINT = 4;
+}
+
+void ISR_DMA5(void) {
+	if (CComUart::Uart[2])
+		CComUart::Uart[2]->DoDmaTxISR();
+	else
+		DMA0->CINT = 5;
+}
+#endif
+
+/*!-----------------------------------------------------------------------------
+Functions called from the Interrupt Vector Table, for the DMA channels of UART3.
+*/
+#if UART3_CONNECT_DMA
+void ISR_DMA6(void) {
+	if (CComUart::Uart[3])
+		CComUart::Uart[3]->DoDmaRxISR();
+	else
+		DMA0->CINT = 6;
+}
+
+void ISR_DMA7(void) {
+	if (CComUart::Uart[3])
+		CComUart::Uart[3]->DoDmaTxISR();
+	else
+		DMA0->CINT = 7;
+}
+#endif
+
+/*!-----------------------------------------------------------------------------
+Functions called from the Interrupt Vector Table, for the DMA channels of UART4.
+*/
+#if UART4_CONNECT_DMA
+void ISR_DMA8(void) {
+	if (CComUart::Uart[4])
+		CComUart::Uart[4]->DoDmaRxISR();
+	else
+		DMA0->CINT = 8;
+}
+
+void ISR_DMA9(void) {
+	if (CComUart::Uart[4])
+		CComUart::Uart[4]->DoDmaTxISR();
+	else
+		DMA0->CINT = 9;
+}
+#endif
+
+/*!-----------------------------------------------------------------------------
+Functions called from the Interrupt Vector Table, for the DMA channels of UART5.
+*/
+#if UART5_CONNECT_DMA
+void ISR_DMA10(void) {
+	if (CComUart::Uart[5])
+		CComUart::Uart[5]->DoDmaRxISR();
+	else
+		DMA0->CINT = 10;
+}
+
+void ISR_DMA11(void) {
+	if (CComUart::Uart[5])
+		CComUart::Uart[5]->DoDmaTxISR();
+	else
+		DMA0->CINT = 11;
+}
+#endif
+
 //==============================================================================
@@ -2,11 +2,16 @@
 
 #include "com.hpp"
 
+//End of the program's code and read-only data in flash (defined in the linker script)
+extern "C" char ___ROM_AT[] __attribute__((weak));
+
 //==============================================================================
 //Class Implementation...
 //==============================================================================
 //CFlash
 //==============================================================================
+CFlash* CFlash::Flash = NULL;
+
 /*!-----------------------------------------------------------------------------
 */
 CFlash::CFlash()
@@ -18,18 +23,48 @@ CFlash::CFlash()
 	//Indicate the config section of flash is locked to prevent programming access
 	_cfgLock = true;
 
+	//Use Program Section commands for aligned runs of data by default
+	_pgmsecEnable = FLASH_PGMSEC_ENABLE;
+
+	//Start the processor cycle counter used to time programming, and clear the statistics
+	SET_BITS(CoreDebug->DEMCR, CoreDebug_DEMCR_TRCENA_Msk);
+	SET_BITS(DWT->CTRL, DWT_CTRL_CYCCNTENA_Msk);
+	this->GetStats(NULL, true);
+
 	//Disable Data Cache in Flash memory Controller Module
 	CLR_BITS(_fmc->PFB01CR, FMC_PFB01CR_B01DCE_MASK);
     CLR_BITS(_fmc->PFB23CR, FMC_PFB23CR_B23DCE_MASK);
 	//CLR_BITS(_fmc->PFB0CR, FMC_PFB0CR_B0DCE_MASK);
 	//CLR_BITS(_fmc->PFB1CR, FMC_PFB1CR_B1DCE_MASK);
+
+	//Clear the background job queue, and connect the command complete interrupt
+	//(which is only enabled in the FTFE while jobs are running)
+	_jobHead = 0;
+	_jobCount = 0;
+	_jobCmdAddr = 0;
+	_jobChecking = false;
+	_jobDirty = false;
+	CLR_BITS(_flash->FCNFG, FTFE_FCNFG_CCIE_MASK);
+	CFlash::Flash = this;
+
+	//Find the blocks commands must not run on while interrupts are enabled
+	_codeBlocks = this->GetCodeBlocks();
+	_listBusy = false;
+#if FLASH_CONNECT_IRQ
+	NVIC_EnableIRQ(FTFE_IRQn);
+#endif
 }
 
 /*!-----------------------------------------------------------------------------
 */
 CFlash::~CFlash()
 {
-
+	//Finish any background jobs, then disconnect the interrupt
+	this->Wait();
+#if FLASH_CONNECT_IRQ
+	NVIC_DisableIRQ(FTFE_IRQn);
+#endif
+	CFlash::Flash = NULL;
 }
 
 /*!-----------------------------------------------------------------------------
@@ -55,6 +90,32 @@ bool CFlash::CheckAddress(uint32& addrStart, uint32 addrRange)
     }
 }
 
+/*!-----------------------------------------------------------------------------
+Function that returns the error status of the last flash command to complete
+@result The return code of the command
+*/
+EFlashReturn CFlash::CheckStatus()
+{
+	uint8 fstat = _flash->FSTAT;
+
+    if(IS_BIT_SET(fstat, FTFE_FSTAT_ACCERR_SHIFT)) {
+        //An access error occurred
+        return FLASH_ERR_ACCERR;
+    }
+    else if(IS_BIT_SET(fstat, FTFE_FSTAT_FPVIOL_SHIFT)) {
+        //A protection error occurred
+        return FLASH_ERR_PVIOL;
+    }
+    else if(IS_BIT_SET(fstat, FTFE_FSTAT_MGSTAT0_SHIFT)) {
+        //A MGSTAT0 non-correctable error occurred
+        return FLASH_ERR_MGSTAT0;
+    }
+	else {
+		//Return the return code
+		return FLASH_OK;
+	}
+}
+
 /*!-----------------------------------------------------------------------------
 Function that writes the configuration struct into the Flash configuration
 registers located at address FLASH_CNFG_START_ADDRESS.
@@ -103,6 +164,7 @@ void CFlash::DebugReturnCode(EFlashReturn returnCode)
 		case FLASH_ERR_PVIOL : { COM_PRINT("Error: ERR_PVIOL \r\n"); break; }
 		case FLASH_ERR_MGSTAT0 : { COM_PRINT("Error: ERR_MGSTAT0 \r\n"); break; }
 		case FLASH_ERR_PARAM : { COM_PRINT("Error: ERR_PARAM \r\n"); break; }
+		case FLASH_ERR_BUSY : { COM_PRINT("Error: ERR_BUSY \r\n"); break; }
 		default : { COM_PRINT("Unknown Error.\r\n"); break; }
 	}
 
@@ -144,86 +206,398 @@ void CFlash::DebugReturnCode(EFlashReturn returnCode)
 	*/
 }
 
+/*!-----------------------------------------------------------------------------
+Function that steps the running background job on from the FTFE command
+complete interrupt. If the command checked an erase job's next sector, then the
+sector is skipped if it's blank, or erased by the next command if it isn't.
+If the command that completed was the last of the job (or it
+failed), the job is removed from the queue, the next job started, and the
+finished job's callback raised.
+This is also called by Wait (with interrupts disabled) to step the jobs when
+the interrupt can't be serviced.
+*/
+void CFlash::DoISR()
+{
+	PFlashJob job;
+	TFlashJob done;
+	EFlashReturn result;
+
+	//Stop interrupting if there are no jobs running
+	if(_jobCount == 0) {
+		CLR_BITS(_flash->FCNFG, FTFE_FCNFG_CCIE_MASK);
+		return;
+	}
+
+	//Ignore the call if the command in progress hasn't completed yet (such as
+	//if Wait has already serviced a pending interrupt)
+	if(IS_BITS_CLR(_flash->FSTAT, FTFE_FSTAT_CCIF_MASK))
+		return;
+
+	//Launch the job's next command, unless it's finished or failed
+	job = &_jobs[_jobHead];
+	result = this->CheckStatus();
+	if(_jobChecking) {
+		_jobChecking = false;
+		if(result == FLASH_OK) {
+			_jobAddr += FLASH_SECTOR_SIZE;
+			_jobRemain -= FLASH_SECTOR_SIZE;
+			_stats.SectorsSkipped++;
+		}
+		else {
+			_jobDirty = true;
+			result = FLASH_OK;
+		}
+	}
+	if((result == FLASH_OK) && (_jobRemain > 0)) {
+		this->JobLaunch(job);
+		return;
+	}
+
+	//Store the result and remove the job from the queue
+	job->Result = result;
+	job->FailAddr = (result == FLASH_OK) ? 0 : _jobCmdAddr;
+	done = *job;
+	_jobHead = (_jobHead + 1) % FLASH_JOB_QUEUE_SIZE;
+	_jobCount--;
+
+	//Start the next job, or stop interrupting if there are none
+	if(_jobCount > 0)
+		this->JobStart();
+	else
+		CLR_BITS(_flash->FCNFG, FTFE_FCNFG_CCIE_MASK);
+
+	//Report the finished job
+	if(done.OnDone)
+		done.OnDone->Call(&done);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that encodes a command given as bytes (for the FCCOB0, FCCOB1... registers
+in turn) into the words loaded into the FCCOB registers. Registers the bytes
+don't cover are loaded with 0.
+@param cmd		Pointer to where the encoded command should be stored
+@param cmdSize	The number of bytes defining the command and its parameters (up to 12)
+@param cmdData	Pointer to an array of bytes defining the command and its parameters
+*/
+void CFlash::Encode(PFlashCmd cmd, uint8 cmdSize, puint8 cmdData)
+{
+	uint32 words[3] = { 0, 0, 0 };
+
+	//The lowest numbered register of each word is held in the top byte
+	for(uint8 i = 0; (i < cmdSize) && (i < 12); i++) {
+		words[i / 4] |= (uint32)cmdData[i] << ((3 - (i % 4)) * 8);
+	}
+
+	cmd->Cmd = words[0];
+	cmd->Param1 = words[1];
+	cmd->Param2 = words[2];
+}
+
+/*!-----------------------------------------------------------------------------
+Function that encodes a Program Check command for a long word
+@param cmd			Pointer to where the encoded command should be stored
+@param addr			The long word aligned address to check
+@param verifyData	Pointer to the 4 bytes the flash should read as
+@param marginLevel	The margin level to check at
+*/
+void CFlash::EncodeCheck(PFlashCmd cmd, uint32 addr, puint8 verifyData, EFlashReadMargin marginLevel)
+{
+	cmd->Cmd = ((uint32)FLASH_CMD_PROGRAM_CHECK << 24) | (addr & FLASH_CMD_ADDR_MASK);
+	cmd->Param1 = (uint32)marginLevel << 24;
+
+	//For Little Endian access (FCCOB8 holds the last byte)
+	cmd->Param2 = (uint32)verifyData[0] | ((uint32)verifyData[1] << 8) | ((uint32)verifyData[2] << 16) | ((uint32)verifyData[3] << 24);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that encodes an Erase Sector command
+@param cmd	Pointer to where the encoded command should be stored
+@param addr	Address at the start of the sector to erase
+*/
+void CFlash::EncodeErase(PFlashCmd cmd, uint32 addr)
+{
+	cmd->Cmd = ((uint32)FLASH_CMD_ERASE_SECTOR << 24) | (addr & FLASH_CMD_ADDR_MASK);
+	cmd->Param1 = 0;
+	cmd->Param2 = 0;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that encodes a Program Phrase command
+@param cmd		Pointer to where the encoded command should be stored
+@param addr		The 8-byte (Phrase) aligned address to program
+@param srcData	Pointer to the 8 bytes to program, which are copied into the command
+*/
+void CFlash::EncodePhrase(PFlashCmd cmd, uint32 addr, puint8 srcData)
+{
+	cmd->Cmd = ((uint32)FLASH_CMD_PROGRAM_PHRASE << 24) | (addr & FLASH_CMD_ADDR_MASK);
+
+	//For Little Endian access (FCCOB4 and FCCOB8 hold the last byte of each word)
+	cmd->Param1 = (uint32)srcData[0] | ((uint32)srcData[1] << 8) | ((uint32)srcData[2] << 16) | ((uint32)srcData[3] << 24);
+	cmd->Param2 = (uint32)srcData[4] | ((uint32)srcData[5] << 8) | ((uint32)srcData[6] << 16) | ((uint32)srcData[7] << 24);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that encodes a Program Section command, for data already staged in
+the FlexRAM
+@param cmd	Pointer to where the encoded command should be stored
+@param addr	The FLASH_PPGMSEC_ALIGN_SIZE aligned address to program
+@param size	The number of bytes to program, a multiple of FLASH_PPGMSEC_ALIGN_SIZE
+*/
+void CFlash::EncodeSection(PFlashCmd cmd, uint32 addr, uint32 size)
+{
+	//The command counts in units of FLASH_PPGMSEC_ALIGN_SIZE bytes
+	cmd->Cmd = ((uint32)FLASH_CMD_PROGRAM_SECTION << 24) | (addr & FLASH_CMD_ADDR_MASK);
+	cmd->Param1 = ((size / FLASH_PPGMSEC_ALIGN_SIZE) & 0xFFFF) << 16;
+	cmd->Param2 = 0;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that encodes a Verify Section command, checking whole sectors are erased
+@param cmd			Pointer to where the encoded command should be stored
+@param addr			Address at the start of the first sector to verify
+@param sectors		The number of flash sectors to check
+@param marginLevel	The margin level to verify the sector contents at
+*/
+void CFlash::EncodeVerify(PFlashCmd cmd, uint32 addr, uint16 sectors, EFlashReadMargin marginLevel)
+{
+	//The command counts in units of FLASH_PRD1SEC_ALIGN_SIZE bytes
+	uint16 size = sectors * (FLASH_SECTOR_SIZE / FLASH_PRD1SEC_ALIGN_SIZE);
+
+	cmd->Cmd = ((uint32)FLASH_CMD_VERIFY_SECTION << 24) | (addr & FLASH_CMD_ADDR_MASK);
+	cmd->Param1 = ((uint32)size << 16) | ((uint32)marginLevel << 8);
+	cmd->Param2 = 0;
+}
+
 /*!-----------------------------------------------------------------------------
 Function that is called to execute a Flash command sequence.
-NB: This routine MUST be placed in RAM to prevent Flash memory contentions.
+Any background jobs are finished first, as they share the command registers.
 @param cmdSize	The number of bytes defining the command and its parameters
 @param cmdData	Pointer to an array of bytes defining the command and its parameters to execute
 @result The return status of the command after execution.
 */
-//
 EFlashReturn CFlash::ExecuteCmd(uint8 cmdSize, puint8 cmdData)
 {
-    uint8 fstat;
-	uint8 i;
+	TFlashCmd cmd;
+
+	CFlash::Encode(&cmd, cmdSize, cmdData);
+	return this->ExecuteList(&cmd, 1, NULL);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that executes a list of encoded commands one after another, with a
+single call to the RAM resident ExecuteListRam function, stopping at the first
+command that fails.
+Any background jobs are finished first, as they share the command registers,
+and any queued by an interrupt while the list runs are held back until it has
+finished (see ListHold), unless the caller is already holding them back.
+Unless interrupts were already disabled by the caller, pending interrupts are
+serviced between commands, as the flash can be read then.
+If none of the commands address the blocks code is read from, the list is run
+from flash by ExecuteListRww instead, with interrupts left enabled throughout.
+@param cmds		Pointer to the list of commands to execute
+@param count	The number of commands in the list (none is allowed)
+@param failIdx	Optional pointer to where the index of the failing command should be stored (NULL if not required)
+@result The return status of the last command executed, so FLASH_OK if all succeeded.
+*/
+EFlashReturn CFlash::ExecuteList(PFlashCmd cmds, uint16 count, puint16 failIdx)
+{
+	uint16 done;
+	bool irqWindow;
+	bool hold;
+	EFlashReturn result;
+
+	if(count == 0)
+		return FLASH_OK;
+
+	//Wait for any background jobs to finish, and hold back any queued while
+	//the list runs, unless the caller already is
+	hold = !_listBusy;
+	if(hold)
+		this->ListHold();
 
 	//Check CCIF bit of the flash status register is set, indicating no command in progress
 	while(IS_BITS_CLR(_flash->FSTAT, FTFE_FSTAT_CCIF_MASK)) {};
 
-    //Do NOT clear RDCOLERR & ACCERR & FPVIOL flags here, this seems to cause
+	//Do NOT clear RDCOLERR & ACCERR & FPVIOL flags here, this seems to cause
 	//problems with timing that either hang the program, disconnect the debugger
 	//or cause the programming to fail, unless single-stepped through!
 	//SET_BITS(_flash->FSTAT, (uint8)(FTFE_FSTAT_RDCOLERR_MASK | FTFE_FSTAT_ACCERR_MASK | FTFE_FSTAT_FPVIOL_MASK));
 
-    //Load FCCOB registers
-    for(i = 0; i < cmdSize; i++) {
-        switch(i) {
-			case 0: { _flash->FCCOB0 = cmdData[i]; break; }
-			case 1: { _flash->FCCOB1 = cmdData[i]; break; }
-			case 2: { _flash->FCCOB2 = cmdData[i]; break; }
-			case 3: { _flash->FCCOB3 = cmdData[i]; break; }
-			case 4: { _flash->FCCOB4 = cmdData[i]; break; }
-			case 5: { _flash->FCCOB5 = cmdData[i]; break; }
-			case 6: { _flash->FCCOB6 = cmdData[i]; break; }
-			case 7: { _flash->FCCOB7 = cmdData[i]; break; }
-			case 8: { _flash->FCCOB8 = cmdData[i]; break; }
-			case 9: { _flash->FCCOB9 = cmdData[i]; break; }
-			case 10: { _flash->FCCOBA = cmdData[i]; break; }
-			case 11: { _flash->FCCOBB = cmdData[i]; break; }
-            default: break;
-        }
-    }
+	#if FLASH_RWW_ENABLE
+	if((CFlash::GetListBlocks(cmds, count) & _codeBlocks) == 0) {
+		//Code and interrupt handlers can still be read while the commands run,
+		//so leave interrupts enabled
+		CFlash::ExecuteListRww(_flash, cmds, count, &done);
+		_stats.RwwLists++;
+	}
+	else
+	#endif
+	{
+		//Only open windows for interrupts between commands if the caller hasn't disabled them
+		irqWindow = (g_irqLockCnt == 0);
 
-    IRQ_DISABLE;
+		IRQ_DISABLE;
 
-	//Perform the programming
-	CFlash::ExecuteCmdRam(_flash);
+		//Perform the programming
+		CFlash::ExecuteListRam(_flash, cmds, count, irqWindow, &done);
 
-	IRQ_ENABLE;
+		IRQ_ENABLE;
+	}
 
-    //Check for errors
-	fstat = _flash->FSTAT;
-    if(IS_BIT_SET(fstat, FTFE_FSTAT_ACCERR_SHIFT)) {
-        //An access error occurred
-        return FLASH_ERR_ACCERR;
-    }
-    else if(IS_BIT_SET(fstat, FTFE_FSTAT_FPVIOL_SHIFT)) {
-        //A protection error occurred
-        return FLASH_ERR_PVIOL;
-    }
-    else if(IS_BIT_SET(fstat, FTFE_FSTAT_MGSTAT0_SHIFT)) {
-        //A MGSTAT0 non-correctable error occurred
-        return FLASH_ERR_MGSTAT0;
-    }
-	else {
-		//Return the return code
-		return FLASH_OK;
+	//Count the commands launched, including any that failed
+	_stats.Commands += (done < count) ? (done + 1) : count;
+	_stats.Lists++;
+
+	if(failIdx)
+		*failIdx = done;
+
+	//Check for errors
+	result = this->CheckStatus();
+
+	//Start any job queued while the list was running
+	if(hold)
+		this->ListRelease();
+
+	return result;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that waits for any background jobs to finish, then holds back any job
+queued (by an interrupt handler) until ListRelease is called. This keeps jobs
+from sharing the command registers and FlexRAM with command lists, including
+between the lists of one operation while it stages data or reads the flash.
+NB: Must only be called from the main program, as it waits on the jobs.
+*/
+void CFlash::ListHold()
+{
+	IRQ_DISABLE;
+	while(_jobCount > 0) {
+		IRQ_ENABLE;
+		this->Wait();
+		IRQ_DISABLE;
 	}
+	_listBusy = true;
+	IRQ_ENABLE;
 }
 
 /*!-----------------------------------------------------------------------------
-Function that is programmed into RAM, and called to actually execute the
-Flash programming command.
+Function that stops holding back jobs, and starts any queued while they were held.
+*/
+void CFlash::ListRelease()
+{
+	IRQ_DISABLE;
+	_listBusy = false;
+	if(_jobCount > 0)
+		this->JobStart();
+	IRQ_ENABLE;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that is programmed into RAM, and called to actually execute a list of
+Flash programming commands. Each command is loaded into the FCCOB registers a
+word at a time, launched and waited on, and the list stops at the first
+command that reports an error.
+NB: As the flash can't be read while a command runs, nothing here may call
+into (or be placed in) flash.
 This is a static function to save on RAM usage.
+@param flash		Pointer to the flash module registers
+@param cmds			Pointer to the list of commands to execute
+@param count		The number of commands in the list
+@param irqWindow	True if interrupts should be briefly enabled between commands
+@param done			Pointer to where the number of commands that succeeded is stored
 */
-FUNC_RAM_OPTIMIZE_OFF CFlash::ExecuteCmdRam(FLASH_Type* flash)
+FUNC_RAM_OPTIMIZE_OFF CFlash::ExecuteListRam(FLASH_Type* flash, PFlashCmd cmds, uint16 count, bool irqWindow, puint16 done)
 {
-	//Launch command (and clear down error flags)
-	//SET_BITS(flash->FSTAT, FTFE_FSTAT_CCIF_MASK);
-	SET_BITS(flash->FSTAT, FTFE_FSTAT_CCIF_MASK | FTFE_FSTAT_RDCOLERR_MASK | FTFE_FSTAT_ACCERR_MASK | FTFE_FSTAT_FPVIOL_MASK);
+	uint16 idx;
+
+	for(idx = 0; idx < count; idx++) {
+		//Let any pending interrupts run while the flash is idle
+		if(irqWindow && (idx > 0)) {
+			SEI;
+			CLI;
+		}
 
-	//Wait for command completion
-	while(IS_BITS_CLR(flash->FSTAT, FTFE_FSTAT_CCIF_MASK)) {} ;
+		//Load FCCOB registers
+		*((volatile uint32*)&flash->FCCOB3) = cmds[idx].Cmd;
+		*((volatile uint32*)&flash->FCCOB7) = cmds[idx].Param1;
+		*((volatile uint32*)&flash->FCCOBB) = cmds[idx].Param2;
+
+		//Launch command (and clear down error flags)
+		SET_BITS(flash->FSTAT, FTFE_FSTAT_CCIF_MASK | FTFE_FSTAT_RDCOLERR_MASK | FTFE_FSTAT_ACCERR_MASK | FTFE_FSTAT_FPVIOL_MASK);
+
+		//Wait for command completion
+		while(IS_BITS_CLR(flash->FSTAT, FTFE_FSTAT_CCIF_MASK)) {} ;
+
+		//Stop at the first command that fails
+		if(IS_BITS_SET(flash->FSTAT, FTFE_FSTAT_ACCERR_MASK | FTFE_FSTAT_FPVIOL_MASK | FTFE_FSTAT_MGSTAT0_MASK))
+			break;
+	}
+
+	*done = idx;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that executes a list of Flash programming commands in the same way as
+ExecuteListRam, but from flash, for lists that don't address the blocks code is
+read from. Interrupts are left as the caller set them, as the program and its
+interrupt handlers can still be read while each command runs.
+@param flash		Pointer to the flash module registers
+@param cmds			Pointer to the list of commands to execute
+@param count		The number of commands in the list
+@param done			Pointer to where the number of commands that succeeded is stored
+*/
+void CFlash::ExecuteListRww(FLASH_Type* flash, PFlashCmd cmds, uint16 count, puint16 done)
+{
+	uint16 idx;
+
+	for(idx = 0; idx < count; idx++) {
+		//Load FCCOB registers
+		*((volatile uint32*)&flash->FCCOB3) = cmds[idx].Cmd;
+		*((volatile uint32*)&flash->FCCOB7) = cmds[idx].Param1;
+		*((volatile uint32*)&flash->FCCOBB) = cmds[idx].Param2;
+
+		//Launch command (and clear down error flags)
+		SET_BITS(flash->FSTAT, FTFE_FSTAT_CCIF_MASK | FTFE_FSTAT_RDCOLERR_MASK | FTFE_FSTAT_ACCERR_MASK | FTFE_FSTAT_FPVIOL_MASK);
+
+		//Wait for command completion
+		while(IS_BITS_CLR(flash->FSTAT, FTFE_FSTAT_CCIF_MASK)) {} ;
+
+		//Stop at the first command that fails
+		if(IS_BITS_SET(flash->FSTAT, FTFE_FSTAT_ACCERR_MASK | FTFE_FSTAT_FPVIOL_MASK | FTFE_FSTAT_MGSTAT0_MASK))
+			break;
+	}
+
+	*done = idx;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that works out which flash blocks code is read from, which commands
+can only run on from RAM with interrupts disabled. These are the blocks from
+the vector table (which holds the interrupt handlers) to the end of the
+program's read-only data. If the linker doesn't give the end of the program,
+it is taken to run up to FLASH_JOB_ADDR_MIN (or to the end of the vector
+table's block, if that is above it).
+@result Mask with a bit set for each block holding code
+*/
+uint8 CFlash::GetCodeBlocks()
+{
+	uint32 start = SCB->VTOR;
+	uint32 end = (uint32)___ROM_AT;
+	uint8 blocks = 0;
+
+	//A vector table held in RAM doesn't say where the program is
+	if(start >= FLASH_SIZE)
+		start = FLASH_BASE;
+	if(end <= start)
+		end = (start < FLASH_JOB_ADDR_MIN) ? FLASH_JOB_ADDR_MIN : (start + 1);
+	if(end > FLASH_SIZE)
+		end = FLASH_SIZE;
+
+	for(uint32 addr = start & ~(FLASH_BLOCK_SIZE - 1); addr < end; addr += FLASH_BLOCK_SIZE) {
+		SET_BITS(blocks, (uint8)(1 << (addr / FLASH_BLOCK_SIZE)));
+	}
+
+	return blocks;
 }
 
 /*!-----------------------------------------------------------------------------
@@ -249,6 +623,77 @@ uint8 CFlash::GetFlashActiveBlock()
 		return 0;
 }
 
+/*!-----------------------------------------------------------------------------
+Function that returns true if FlashProgram uses Program Section commands for
+aligned runs of data
+*/
+bool CFlash::GetSectionEnable()
+{
+	return _pgmsecEnable;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that works out which flash blocks a list of commands addresses.
+Commands that act on the whole device, its IFR or the swap system (or an
+address outside program flash) are taken to address every block.
+@param cmds		Pointer to the list of commands
+@param count	The number of commands in the list
+@result Mask with a bit set for each block addressed
+*/
+uint8 CFlash::GetListBlocks(PFlashCmd cmds, uint16 count)
+{
+	uint8 blocks = 0;
+	uint32 addr;
+
+	for(uint16 idx = 0; idx < count; idx++) {
+		addr = cmds[idx].Cmd & FLASH_CMD_ADDR_MASK;
+		switch((uint8)(cmds[idx].Cmd >> 24)) {
+			case FLASH_CMD_VERIFY_BLOCK:
+			case FLASH_CMD_VERIFY_SECTION:
+			case FLASH_CMD_PROGRAM_CHECK:
+			case FLASH_CMD_PROGRAM_PHRASE:
+			case FLASH_CMD_ERASE_BLOCK:
+			case FLASH_CMD_ERASE_SECTOR:
+			case FLASH_CMD_PROGRAM_SECTION:
+				if(addr >= FLASH_SIZE)
+					return FLASH_BLOCKS_ALL;
+				SET_BITS(blocks, (uint8)(1 << (addr / FLASH_BLOCK_SIZE)));
+				break;
+
+			default:
+				return FLASH_BLOCKS_ALL;
+		}
+	}
+
+	return blocks;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that reads the programming statistics
+@param stats Pointer to where the statistics should be copied, or NULL if not required
+@param clear True if the statistics should be reset after being read
+*/
+void CFlash::GetStats(PFlashStats stats, bool clear)
+{
+	//Erase jobs update the statistics from the interrupt
+	IRQ_DISABLE;
+
+	if(stats)
+		*stats = _stats;
+
+	if(clear) {
+		_stats.Bytes = 0;
+		_stats.Commands = 0;
+		_stats.Lists = 0;
+		_stats.RwwLists = 0;
+		_stats.Cycles = 0;
+		_stats.SectorsErased = 0;
+		_stats.SectorsSkipped = 0;
+	}
+
+	IRQ_ENABLE;
+}
+
 /*!-----------------------------------------------------------------------------
 Function that attempts to ulock the device using the backdoor access key
 @param key Pointer to 8-bytes of the backdoor access key
@@ -277,6 +722,7 @@ EFlashReturn CFlash::FlashBackdoor(puint8 key)
 The Program Check command tests a previously programmed program flash location
 to see if it reads correctly at the specified margin level.
 This function will accept any non-aligned destination address.
+The long words are checked FLASH_CMD_LIST_SIZE at a time, by one command list.
 @param destAddr		The address from which to read data, can be any address
 @param verifyData	Pointer to where the validating data to check against should be found
 @param size			The number of bytes to check
@@ -291,6 +737,9 @@ EFlashReturn CFlash::FlashCheck(uint32 destAddr, puint8 verifyData, uint32 size,
 	uint8 buf[FLASH_PGMCHK_ALIGN_SIZE];
 	puint8 destPtr;
 	EFlashReturn returnCode;
+	TFlashCmd cmds[FLASH_CMD_LIST_SIZE];
+	uint16 count = 0;
+	uint16 failIdx;
 
 	//Return a OK if no bytes are specified
 	if(size == 0)
@@ -300,6 +749,10 @@ EFlashReturn CFlash::FlashCheck(uint32 destAddr, puint8 verifyData, uint32 size,
 	if(!this->CheckAddress(destAddr, size))
 		return FLASH_ERR_RANGE;
 
+	//Wait for any background jobs to finish, so the edges can be read, and hold
+	//back any queued until done
+	this->ListHold();
+
 	while(size > 0) {
 		//Determine if the destAddr lies on an 4-byte boundry, or how far away it lies
 		destOffset = destAddr % FLASH_PGMCHK_ALIGN_SIZE;
@@ -332,25 +785,33 @@ EFlashReturn CFlash::FlashCheck(uint32 destAddr, puint8 verifyData, uint32 size,
 				destPtr++;
 			}
 
-			//Check the Flash against the buffered long word
-			returnCode = this->FlashCheckLWord(destAddr, buf, marginLevel);
+			//Queue a check of the Flash against the buffered long word
+			CFlash::EncodeCheck(&cmds[count], destAddr, buf, marginLevel);
 		}
 		else {
-			//Check the Flash long word sequence
-			returnCode = this->FlashCheckLWord(destAddr, verifyData, marginLevel);
+			//Queue a check of the Flash long word sequence
+			CFlash::EncodeCheck(&cmds[count], destAddr, verifyData, marginLevel);
 
 			//Update variables
 			verifyData += FLASH_PGMCHK_ALIGN_SIZE;
 			size -= FLASH_PGMCHK_ALIGN_SIZE;
 		}
-
-		//Abort if an error occured
-		if(returnCode != FLASH_OK) {
-			//If assigned, store the failing Flash Address
-			if(failAddr)
-				*failAddr = destAddr;
-			//Return the error code
-			return returnCode;
+		count++;
+
+		//Run the queued checks once the list is full, or everything has been queued
+		if((count == FLASH_CMD_LIST_SIZE) || (size == 0)) {
+			returnCode = this->ExecuteList(cmds, count, &failIdx);
+
+			//Abort if an error occured
+			if(returnCode != FLASH_OK) {
+				//If assigned, store the failing Flash Address
+				if(failAddr)
+					*failAddr = cmds[failIdx].Cmd & FLASH_CMD_ADDR_MASK;
+				//Return the error code
+				this->ListRelease();
+				return returnCode;
+			}
+			count = 0;
 		}
 
 		//Update the destination address
@@ -358,41 +819,10 @@ EFlashReturn CFlash::FlashCheck(uint32 destAddr, puint8 verifyData, uint32 size,
 	}
 
 	//Return sccuess
+	this->ListRelease();
 	return FLASH_OK;
 }
 
-/*!-----------------------------------------------------------------------------
-The Program Check command tests a previously programmed program flash location (long word)
-to see if it reads correctly at the specified margin level.
-@param destAddr		The address from which to read data, must be long word aligned
-@param verifyData	Pointer to where the validating data to check against should be found
-@param size			The number of bytes to check
-@param marginLevel	The margin level to test at
-@result Success or error code from the operation
-*/
-EFlashReturn CFlash::FlashCheckLWord(uint32 destAddr, puint8 verifyData, EFlashReadMargin marginLevel)
-{
-	uint8 cmdData[12];
-
-	//Ensure we have a LongWord address, by masking the lower address bits to zero
-	CLR_BITS(destAddr, (FLASH_PGMCHK_ALIGN_SIZE - 1));
-
-	//Prepare parameters to execute the command
-	cmdData[0] = FLASH_CMD_PROGRAM_CHECK;
-	cmdData[1] = (uint8)((destAddr >> 16) & 0xFF);
-	cmdData[2] = (uint8)((destAddr >> 8) & 0xFF);
-	cmdData[3] = (uint8)(destAddr & 0xFF);
-	cmdData[4] = (uint8)marginLevel;
-	//For Little Endian access
-	cmdData[8] = *(verifyData + 3);
-	cmdData[9] = *(verifyData + 2);
-	cmdData[10] = *(verifyData + 1);
-	cmdData[11] = *(verifyData + 0);
-
-	//Execute the command
-	return this->ExecuteCmd(12, cmdData);
-}
-
 /*!-----------------------------------------------------------------------------
 Function that dumps the specified area of Flash to the PrintF command
 */
@@ -476,10 +906,25 @@ Function that erases a the specified number of addresses from the starting
 address with the following caviats...
 Addr must lie on a 4kb (4096 bytes) address and Size must be a multiple of 4096.
 The lower bits of these values are masked to 0's so will always be rounded down
+The range is worked through a block at a time. Each sector is first checked to
+see if it already reads as erased (at FLASH_ERASE_MARGIN), and is skipped if so.
+Where the range covers a whole block, and at least FLASH_ERASE_BLOCK_SECTORS of
+its sectors need erasing, the block is erased with one command instead, as this
+takes a fraction of the time of erasing its sectors one by one.
+The sector verifies and erases are each run as command lists. As a list stops
+at the first sector that isn't blank, verifying carries on from the next one.
+The number of sectors erased and skipped are added to the statistics.
 */
 EFlashReturn CFlash::FlashEraseRange(uint32 addr, uint32 size)
 {
 	EFlashReturn returnCode;
+	uint64 dirty;
+	uint8 dirtyCount;
+	uint8 sectors;
+	uint8 idx;
+	TFlashCmd cmds[FLASH_CMD_LIST_SIZE];
+	uint16 count;
+	uint16 failIdx;
 
 	//Ensure we have a sector address, by masking the lower address bits to zero
 	CLR_BITS(addr, (FLASH_SECTOR_SIZE - 1));
@@ -491,25 +936,113 @@ EFlashReturn CFlash::FlashEraseRange(uint32 addr, uint32 size)
 	if(!this->CheckAddress(addr, size))
 		return FLASH_ERR_RANGE;
 
-	//Erase sectors
+	//Hold back any job queued until the whole range is done
+	this->ListHold();
+
 	while(size > 0) {
-		//Erase the sector
-		returnCode = this->FlashEraseSector(addr);
-		if(returnCode != FLASH_OK) {
-			return returnCode;
+		//Work out how many sectors of the current block the range covers
+		sectors = (FLASH_BLOCK_SIZE - (addr % FLASH_BLOCK_SIZE)) / FLASH_SECTOR_SIZE;
+		if(size < (sectors * FLASH_SECTOR_SIZE))
+			sectors = size / FLASH_SECTOR_SIZE;
+
+		//Find which sectors aren't blank. If the whole block is covered, check
+		//it all with one command first, as it's likely to be blank
+		dirty = 0;
+		dirtyCount = 0;
+		if((sectors < FLASH_BLOCK_SECTORS) || (this->FlashVerifyBlock(addr, FLASH_ERASE_MARGIN) != FLASH_OK)) {
+			idx = 0;
+			while(idx < sectors) {
+				//Verify the next sectors, up to a list at a time
+				for(count = 0; (count < FLASH_CMD_LIST_SIZE) && ((idx + count) < sectors); count++) {
+					CFlash::EncodeVerify(&cmds[count], addr + ((idx + count) * FLASH_SECTOR_SIZE), 1, FLASH_ERASE_MARGIN);
+				}
+
+				if(this->ExecuteList(cmds, count, &failIdx) == FLASH_OK) {
+					idx += count;
+				}
+				else {
+					//Mark the sector that failed, and carry on after it
+					idx += failIdx;
+					SET_BITS(dirty, ((uint64)1 << idx));
+					dirtyCount++;
+					idx++;
+				}
+			}
+		}
+
+		if((sectors == FLASH_BLOCK_SECTORS) && (dirtyCount >= FLASH_ERASE_BLOCK_SECTORS)) {
+			//Erase the whole block
+			returnCode = this->FlashEraseBlock(addr);
+			if(returnCode != FLASH_OK) {
+				this->ListRelease();
+				return returnCode;
+			}
+			_stats.SectorsErased += sectors;
 		}
+		else {
+			//Erase the sectors that aren't blank, up to a list at a time
+			count = 0;
+			for(idx = 0; idx < sectors; idx++) {
+				if(IS_BITS_CLR(dirty, ((uint64)1 << idx))) {
+					_stats.SectorsSkipped++;
+				}
+				else {
+					CFlash::EncodeErase(&cmds[count], addr + (idx * FLASH_SECTOR_SIZE));
+					count++;
+				}
 
-		//Move to the next sector
-		addr += FLASH_SECTOR_SIZE;
+				if((count == FLASH_CMD_LIST_SIZE) || ((count > 0) && ((idx + 1) == sectors))) {
+					returnCode = this->ExecuteList(cmds, count, &failIdx);
+					if(returnCode != FLASH_OK) {
+						_stats.SectorsErased += failIdx;
+						this->ListRelease();
+						return returnCode;
+					}
+					_stats.SectorsErased += count;
+					count = 0;
+				}
+			}
+		}
 
-		//Decrease bytes remaining
-		size -= FLASH_SECTOR_SIZE;
+		//Move to the next block
+		addr += sectors * FLASH_SECTOR_SIZE;
+		size -= sectors * FLASH_SECTOR_SIZE;
 	}
 
 	//Return success;
+	this->ListRelease();
 	return FLASH_OK;
 }
 
+/*!-----------------------------------------------------------------------------
+Function that queues a background job to erase a range of sectors, with the
+same rounding of the address and size as FlashEraseRange. Each sector is checked
+before it's erased, and skipped if it's already blank (but unlike FlashEraseRange,
+whole blocks aren't erased at once, so the job only holds the block it's working in).
+@param addr		Address of the first sector to erase, at or above FLASH_JOB_ADDR_MIN
+@param size		The number of bytes to erase
+@param onDone	Callback raised (from the ISR) when the job finishes, or NULL if not required
+@param tag		User value passed back with the job
+@result Success or error code from queuing the job, or FLASH_ERR_BUSY if the queue is full
+*/
+EFlashReturn CFlash::FlashEraseRangeAsync(uint32 addr, uint32 size, PFlashJobCallback onDone, pointer tag)
+{
+	TFlashJob job;
+
+	//Ensure we have a sector address and size, by masking the lower address bits to zero
+	CLR_BITS(addr, (FLASH_SECTOR_SIZE - 1));
+	CLR_BITS(size, (FLASH_SECTOR_SIZE - 1));
+
+	job.Type = FLASH_JOB_ERASE;
+	job.Addr = addr;
+	job.Data = NULL;
+	job.Size = size;
+	job.Margin = FLASH_MARGIN_NORMAL;
+	job.OnDone = onDone;
+	job.Tag = tag;
+	return this->JobQueue(&job);
+}
+
 /*!-----------------------------------------------------------------------------
 Function that erases a single program flash sector (i.e. 4kb chunk) back to all 1's.
 @param addr	Address at the start of the sector to erase.
@@ -517,19 +1050,14 @@ Function that erases a single program flash sector (i.e. 4kb chunk) back to all
 */
 EFlashReturn CFlash::FlashEraseSector(uint32 addr)
 {
-	uint8 cmdData[4];
+	TFlashCmd cmd;
 
 	//Ensure we have a sector address, by masking the lower address bits to zero
 	CLR_BITS(addr, (FLASH_SECTOR_SIZE - 1));
 
-	//Preparing passing parameter to erase a flash block
-	cmdData[0] = FLASH_CMD_ERASE_SECTOR;
-	cmdData[1] = (uint8)((addr >> 16) & 0xFF);
-	cmdData[2] = (uint8)((addr >> 8) & 0xFF);
-	cmdData[3] = (uint8)(addr & 0xFF);
-
 	//Calling flash command sequence function to execute the command
-	return this->ExecuteCmd(4, cmdData);
+	CFlash::EncodeErase(&cmd, addr);
+	return this->ExecuteList(&cmd, 1, NULL);
 }
 
 /*!-----------------------------------------------------------------------------
@@ -548,6 +1076,12 @@ EFlashReturn CFlash::FlashEraseSectors(uint32 addr, uint16 sectors)
 Function that programs any number of bytes from any address to any address.
 The function internally takes care of word/phrase boundries, and lengths length
 than 8-byte multiples.
+Runs of data that start on a FLASH_PPGMSEC_ALIGN_SIZE boundary are programmed
+with Program Section commands (when enabled and the FlexRAM is available), so
+up to FLASH_PGMSEC_SIZE bytes are written by each command rather than 8 bytes.
+Phrases are queued and programmed FLASH_CMD_LIST_SIZE at a time by one command
+list, and a section command ends the list it's queued in, as the FlexRAM only
+holds the data for one section.
 NB: Flash can only be programmed from a all 1's state to a value, attempts
 to reprogram already programmed non 1's areas will fail.
 The flash program mechanism includes a self verify, and will flag an error (MGSTAT)
@@ -564,7 +1098,15 @@ EFlashReturn CFlash::FlashProgram(uint32 destAddr, puint8 srcData, uint32 size,
 	uint8 i;
 	uint8 buf[FLASH_PHRASE_SIZE];
 	puint8 destPtr;
-	EFlashReturn returnCode;
+	puint8 phrase;
+	EFlashReturn returnCode = FLASH_OK;
+	uint32 progLen;
+	bool pgmsec;
+	bool section;
+	TFlashCmd cmds[FLASH_CMD_LIST_SIZE];
+	uint16 count = 0;
+	uint16 failIdx;
+	uint32 startCycles = DWT->CYCCNT;
 
 	//Return a OK if no bytes are specified
 	if(size == 0)
@@ -574,9 +1116,21 @@ EFlashReturn CFlash::FlashProgram(uint32 destAddr, puint8 srcData, uint32 size,
 	if(!this->CheckAddress(destAddr, size))
 		return FLASH_ERR_RANGE;
 
+	//Wait for any background jobs to finish, so the destination can be read, and
+	//hold back any queued until done, as they would share the FlexRAM
+	this->ListHold();
+
+	//Program Section commands can only be used if the FlexRAM is available as RAM
+	pgmsec = _pgmsecEnable && IS_BIT_SET(_flash->FCNFG, FTFE_FCNFG_RAMRDY_SHIFT);
+
+	_stats.Bytes += size;
+
 	while(size > 0) {
 		//Determine if the destAddr lies on an 8-byte boundry, or how far away it lies
 		destOffset = destAddr % FLASH_PHRASE_SIZE;
+		progLen = FLASH_PHRASE_SIZE;
+		phrase = NULL;
+		section = false;
 
 		if((destOffset > 0) || (size < FLASH_PHRASE_SIZE)) {
 			//Handle the starting and ending condition, where...
@@ -606,33 +1160,105 @@ EFlashReturn CFlash::FlashProgram(uint32 destAddr, puint8 srcData, uint32 size,
 				destPtr++;
 			}
 
-			//Program the phrase
-			returnCode = this->FlashProgramPhrase(destAddr, buf);
+			//Program the phrase from the buffer
+			phrase = buf;
 		}
 		else {
-			//Program the next 8-byte sequence
-			returnCode = this->FlashProgramPhrase(destAddr, srcData);
+			//Work out how much of the remaining data can be programmed as a section,
+			//which must not cross a sector boundary or the locked config area
+			if(pgmsec && ((destAddr % FLASH_PPGMSEC_ALIGN_SIZE) == 0)) {
+				progLen = size - (size % FLASH_PPGMSEC_ALIGN_SIZE);
+				if(progLen > FLASH_PGMSEC_SIZE)
+					progLen = FLASH_PGMSEC_SIZE;
+				if(progLen > (FLASH_SECTOR_SIZE - (destAddr % FLASH_SECTOR_SIZE)))
+					progLen = FLASH_SECTOR_SIZE - (destAddr % FLASH_SECTOR_SIZE);
+				if(_cfgLock && (destAddr <= FLASH_CNFG_END_ADDRESS) && ((destAddr + progLen) > FLASH_CNFG_START_ADDRESS)) {
+					progLen = (destAddr < FLASH_CNFG_START_ADDRESS) ? (FLASH_CNFG_START_ADDRESS - destAddr) : 0;
+				}
+			}
+			else {
+				progLen = 0;
+			}
+
+			if(progLen >= FLASH_PPGMSEC_ALIGN_SIZE) {
+				//Stage the data in the FlexRAM (no command is in progress between
+				//lists), and queue the section to end the list
+				memcpy((pointer)FLASH_FLEXRAM_START, srcData, progLen);
+				CFlash::EncodeSection(&cmds[count], destAddr, progLen);
+				count++;
+				section = true;
+			}
+			else {
+				//Program the next 8-byte sequence
+				progLen = FLASH_PHRASE_SIZE;
+				phrase = srcData;
+			}
 
 			//Update variables
-			srcData += FLASH_PHRASE_SIZE;
-			size -= FLASH_PHRASE_SIZE;
+			srcData += progLen;
+			size -= progLen;
 		}
 
-		//Abort if an error occured
-		if(returnCode != FLASH_OK) {
-			//If assigned, store the failing Flash Address
-			if(failAddr)
-				*failAddr = destAddr;
-			//Return the error code
-			return returnCode;
+		//Queue the phrase, unless it's in the CONFIG area of flash with the security
+		//settings in, which we should not change as it may lock the device
+		if(phrase && !(_cfgLock && (destAddr >= FLASH_CNFG_START_ADDRESS) && (destAddr <= FLASH_CNFG_END_ADDRESS))) {
+			CFlash::EncodePhrase(&cmds[count], destAddr, phrase);
+			count++;
+		}
+
+		//Run the queued commands once the list is full or ends with a section, or everything has been queued
+		if(section || (count == FLASH_CMD_LIST_SIZE) || (size == 0)) {
+			returnCode = this->ExecuteList(cmds, count, &failIdx);
+
+			//Abort if an error occured
+			if(returnCode != FLASH_OK) {
+				//If assigned, store the failing Flash Address
+				if(failAddr)
+					*failAddr = cmds[failIdx].Cmd & FLASH_CMD_ADDR_MASK;
+				break;
+			}
+			count = 0;
 		}
 
 		//Update the destination address
-		destAddr += FLASH_PHRASE_SIZE;
+		destAddr += progLen;
 	}
 
-	//Return sccuess
-	return FLASH_OK;
+	_stats.Cycles += DWT->CYCCNT - startCycles;
+
+	//Start any job queued while programming
+	this->ListRelease();
+
+	//Return the result
+	return returnCode;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that queues a background job to program a run of bytes, using Program
+Section commands for aligned runs where enabled (as FlashProgram does). If the
+size isn't a multiple of 8 bytes, the last phrase is padded with erased bytes.
+@param destAddr		An 8-byte (Phrase) aligned address, at or above FLASH_JOB_ADDR_MIN
+@param srcData		Pointer to the data to program, which must remain valid until the job finishes
+@param size			The number of bytes to program
+@param onDone		Callback raised (from the ISR) when the job finishes, or NULL if not required
+@param tag			User value passed back with the job
+@result Success or error code from queuing the job, or FLASH_ERR_BUSY if the queue is full
+*/
+EFlashReturn CFlash::FlashProgramAsync(uint32 destAddr, puint8 srcData, uint32 size, PFlashJobCallback onDone, pointer tag)
+{
+	TFlashJob job;
+
+	if(((destAddr % FLASH_PHRASE_SIZE) != 0) || !srcData)
+		return FLASH_ERR_ADDR;
+
+	job.Type = FLASH_JOB_PROGRAM;
+	job.Addr = destAddr;
+	job.Data = srcData;
+	job.Size = size;
+	job.Margin = FLASH_MARGIN_NORMAL;
+	job.OnDone = onDone;
+	job.Tag = tag;
+	return this->JobQueue(&job);
 }
 
 /*!-----------------------------------------------------------------------------
@@ -647,7 +1273,7 @@ if an attempt to program an already programmed byte is made.
 */
 EFlashReturn CFlash::FlashProgramPhrase(uint32 destAddr, puint8 srcData)
 {
-	uint8 cmdData[12];
+	TFlashCmd cmd;
 
 	//Ensure we have a Phrase address, by masking the lower address bits to zero
 	CLR_BITS(destAddr, (FLASH_PHRASE_SIZE - 1));
@@ -663,26 +1289,56 @@ EFlashReturn CFlash::FlashProgramPhrase(uint32 destAddr, puint8 srcData)
 		return FLASH_OK;
 	}
 
-	//Prepare the ProgramLongword command to send
-	cmdData[0] = FLASH_CMD_PROGRAM_PHRASE;
-	cmdData[1] = (uint8)((destAddr >> 16) & 0xFF);
-	cmdData[2] = (uint8)((destAddr >> 8) & 0xFF);
-	cmdData[3] = (uint8)(destAddr & 0xFF);
-
-	//For Little Endian access
-	//First Word
-	cmdData[4] = *(srcData + 3);
-	cmdData[5] = *(srcData + 2);
-	cmdData[6] = *(srcData + 1);
-	cmdData[7] = *(srcData + 0);
-	//Second Word
-	cmdData[8] = *(srcData + 7);
-	cmdData[9] = *(srcData + 6);
-	cmdData[10] = *(srcData + 5);
-	cmdData[11] = *(srcData + 4);
-
 	//Execute the ProgramPhrase command
-	return this->ExecuteCmd(12, cmdData);
+	CFlash::EncodePhrase(&cmd, destAddr, srcData);
+	return this->ExecuteList(&cmd, 1, NULL);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that programs a run of data with a single Program Section command. The
+data is first staged in the FlexRAM (which must be available as traditional RAM),
+and the flash controller then programs it all from there.
+NB: The bytes to be programmed in memory must have been erased first. The section
+must not cross a flash sector boundary. The config area lock is not checked here,
+so callers should normally use FlashProgram.
+@param destAddr		A FLASH_PPGMSEC_ALIGN_SIZE aligned address in Flash where programming should start
+@param srcData		Pointer to the data to program into the memory location
+@param size			The number of bytes to program, a multiple of FLASH_PPGMSEC_ALIGN_SIZE up to FLASH_PGMSEC_SIZE
+@result The return code indicating the success of the operation.
+*/
+EFlashReturn CFlash::FlashProgramSection(uint32 destAddr, puint8 srcData, uint32 size)
+{
+	TFlashCmd cmd;
+	EFlashReturn returnCode;
+
+	//Check the address and size alignment
+	if(((destAddr % FLASH_PPGMSEC_ALIGN_SIZE) != 0) || ((size % FLASH_PPGMSEC_ALIGN_SIZE) != 0))
+		return FLASH_ERR_ADDR;
+	if((size == 0) || (size > FLASH_PGMSEC_SIZE) || ((destAddr % FLASH_SECTOR_SIZE) + size > FLASH_SECTOR_SIZE))
+		return FLASH_ERR_SIZE;
+
+	//Check target addresses lie within memory
+	if(!this->CheckAddress(destAddr, size))
+		return FLASH_ERR_RANGE;
+
+	//Abort if the FlexRAM can't be used to stage the data
+	if(IS_BIT_CLR(_flash->FCNFG, FTFE_FCNFG_RAMRDY_SHIFT))
+		return FLASH_ERR_ACCERR;
+
+	//Wait for any command in progress or background job to complete, as it may
+	//be using the FlexRAM, and hold back any queued until the section is programmed
+	this->ListHold();
+	while(IS_BITS_CLR(_flash->FSTAT, FTFE_FSTAT_CCIF_MASK)) {};
+
+	//Stage the data in the FlexRAM
+	memcpy((pointer)FLASH_FLEXRAM_START, srcData, size);
+
+	//Execute the ProgramSection command
+	CFlash::EncodeSection(&cmd, destAddr, size);
+	returnCode = this->ExecuteList(&cmd, 1, NULL);
+
+	this->ListRelease();
+	return returnCode;
 }
 /*!-----------------------------------------------------------------------------
 The Verify (Read 1s) Block command checks to see if an entire program flash or data flash block
@@ -707,6 +1363,35 @@ EFlashReturn CFlash::FlashVerifyBlock(uint32 addr, EFlashReadMargin marginLevel)
     return this->ExecuteCmd(5, cmdData);
 }
 
+/*!-----------------------------------------------------------------------------
+Function that queues a background job to verify a range of sectors are erased
+at the specified margin level. The job fails with FLASH_ERR_MGSTAT0 at the first
+sector that isn't blank.
+@param addr			Address of the first sector to verify, at or above FLASH_JOB_ADDR_MIN
+@param size			The number of bytes to verify (rounded down to whole sectors)
+@param marginLevel	The margin level to verify the sector contents at
+@param onDone		Callback raised (from the ISR) when the job finishes, or NULL if not required
+@param tag			User value passed back with the job
+@result Success or error code from queuing the job, or FLASH_ERR_BUSY if the queue is full
+*/
+EFlashReturn CFlash::FlashVerifyRangeAsync(uint32 addr, uint32 size, EFlashReadMargin marginLevel, PFlashJobCallback onDone, pointer tag)
+{
+	TFlashJob job;
+
+	//Ensure we have a sector address and size, by masking the lower address bits to zero
+	CLR_BITS(addr, (FLASH_SECTOR_SIZE - 1));
+	CLR_BITS(size, (FLASH_SECTOR_SIZE - 1));
+
+	job.Type = FLASH_JOB_VERIFY;
+	job.Addr = addr;
+	job.Data = NULL;
+	job.Size = size;
+	job.Margin = marginLevel;
+	job.OnDone = onDone;
+	job.Tag = tag;
+	return this->JobQueue(&job);
+}
+
 /*!-----------------------------------------------------------------------------
 Function that verifies the erase of a single program flash sector was correctly
 performed at the specified margin level, and is ready for programming.
@@ -729,248 +1414,387 @@ performed at the specified margin level, and is ready for programming.
 */
 EFlashReturn CFlash::FlashVerifySectors(uint32 addr, uint16 sectors, EFlashReadMargin marginLevel)
 {
-	uint8 cmdData[7];
-
-	//Calcualte number of 128 byte sections to check for single flash sector
-	uint16 size = (FLASH_SECTOR_SIZE / 128) * sectors;
+	TFlashCmd cmd;
 
 	//Ensure we have a sector address, by masking the lower address bits to zero
 	CLR_BITS(addr, (FLASH_SECTOR_SIZE - 1));
 
-	//Preparing passing parameter to erase a flash block
-	cmdData[0] = FLASH_CMD_VERIFY_SECTION;
-	cmdData[1] = (uint8)((addr >> 16) & 0xFF);
-	cmdData[2] = (uint8)((addr >> 8) & 0xFF);
-	cmdData[3] = (uint8)(addr & 0xFF);
-	cmdData[4] = (uint8)((size >> 8) & 0xFF);
-	cmdData[5] = (uint8)(size & 0xFF);
-	cmdData[6] = (uint8)marginLevel;
-
 	//Calling flash command sequence function to execute the command
-	return this->ExecuteCmd(7, cmdData);
+	CFlash::EncodeVerify(&cmd, addr, sectors, marginLevel);
+	return this->ExecuteList(&cmd, 1, NULL);
 }
 
 /*!-----------------------------------------------------------------------------
-Function that sets the status of the config-lock flag, that prevents
-the config part of flash (Address 0x00000400 to 0x0000040F) from being
-programmed, affecting the security settings
+Function that returns if any background job is running or queued that uses the
+flash blocks holding the specified range, so they can't be read yet.
+For the running job, only the command in progress and those still to be launched
+are considered, so blocks it has already finished with are reported as free.
+@param addr		The starting address of the range
+@param size		The number of bytes in the range
+@result True if the range's flash blocks are in use
 */
-void CFlash::SetConfigLock(bool value)
+bool CFlash::IsBusy(uint32 addr, uint32 size)
 {
-	_cfgLock = value;
-}
+	bool busy = false;
+	uint32 first = addr / FLASH_BLOCK_SIZE;
+	uint32 last = (addr + size - 1) / FLASH_BLOCK_SIZE;
 
+	if(size == 0)
+		return false;
 
-/*!-----------------------------------------------------------------------------
-Function that issues a Swap command.
+	IRQ_DISABLE;
+	for(uint8 i = 0; (i < _jobCount) && !busy; i++) {
+		PFlashJob job = &_jobs[(_jobHead + i) % FLASH_JOB_QUEUE_SIZE];
+		uint32 start = (i == 0) ? _jobCmdAddr : job->Addr;
+		uint32 end = job->Addr + job->Size - 1;
 
-EFlashReturn CFlash::CmdSwap(uint32 flashAddr)
-{
-    EFlashReturn returnCode;
-    //UINT8 currentSwapMode = 0xFF;
-	TFlashSwapState swapState;
-	TFlashSwapParams params;
-	params.Continue = true;
+		busy = ((start / FLASH_BLOCK_SIZE) <= last) && ((end / FLASH_BLOCK_SIZE) >= first);
+	}
+	IRQ_ENABLE;
 
-    //Set the default return code as FTFx_OK
-    returnCode = OK;
+	return busy;
+}
 
-    //Check if the destination is not Longword aligned
-    if((flashAddr % FLASH_SWAP_ALIGN_SIZE) != 0) {
-        //Return error code FTFx_ERR_ADDR
-        return ERR_ADDR;
-    }
+/*!-----------------------------------------------------------------------------
+Function that builds and launches the next command of the running job, then
+advances the job past it.
+@param job Pointer to the running job
+*/
+void CFlash::JobLaunch(PFlashJob job)
+{
+	TFlashCmd cmd;
+	uint8 buf[FLASH_PHRASE_SIZE];
+	uint32 addr = _jobAddr;
+	uint32 len;
+
+	switch(job->Type) {
+		case FLASH_JOB_ERASE : {
+			if(_jobDirty) {
+				//Erase the next sector, as it's been found not to be blank
+				_jobDirty = false;
+				_stats.SectorsErased++;
+				CFlash::EncodeErase(&cmd, addr);
+				len = FLASH_SECTOR_SIZE;
+			}
+			else {
+				//Check if the next sector is already blank, without advancing past it
+				_jobChecking = true;
+				CFlash::EncodeVerify(&cmd, addr, 1, FLASH_ERASE_MARGIN);
+				len = 0;
+			}
+			break;
+		}
+		case FLASH_JOB_VERIFY : {
+			//Verify the next sector
+			CFlash::EncodeVerify(&cmd, addr, 1, job->Margin);
+			len = FLASH_SECTOR_SIZE;
+			break;
+		}
+		default : {
+			//Work out how much of the remaining data can be programmed as a section,
+			//which must not cross a sector boundary
+			len = 0;
+			if(_pgmsecEnable && IS_BIT_SET(_flash->FCNFG, FTFE_FCNFG_RAMRDY_SHIFT) && ((addr % FLASH_PPGMSEC_ALIGN_SIZE) == 0)) {
+				len = _jobRemain - (_jobRemain % FLASH_PPGMSEC_ALIGN_SIZE);
+				if(len > FLASH_PGMSEC_SIZE)
+					len = FLASH_PGMSEC_SIZE;
+				if(len > (FLASH_SECTOR_SIZE - (addr % FLASH_SECTOR_SIZE)))
+					len = FLASH_SECTOR_SIZE - (addr % FLASH_SECTOR_SIZE);
+			}
 
-	//Check if the flash address lies in the Active block (P-Flash block 0)
-	if((flashAddr < FLASH_BASE) || (flashAddr >= (FLASH_SIZE + FLASH_HALF_SIZE))) {
-        //Return error code FTFx_ERR_RANGE
-        return ERR_RANGE;
-    }
+			if(len >= FLASH_PPGMSEC_ALIGN_SIZE) {
+				//Stage the data in the FlexRAM, and program it as a section
+				memcpy((pointer)FLASH_FLEXRAM_START, _jobData, len);
+				CFlash::EncodeSection(&cmd, addr, len);
+			}
+			else {
+				//Program the next phrase, padding a short last phrase with erased bytes
+				len = (_jobRemain < FLASH_PHRASE_SIZE) ? _jobRemain : FLASH_PHRASE_SIZE;
+				memset(buf, 0xFF, FLASH_PHRASE_SIZE);
+				memcpy(buf, _jobData, len);
+				CFlash::EncodePhrase(&cmd, addr, buf);
+			}
+			_jobData += len;
+			break;
+		}
+	}
 
-	//Check if the flash address is in the P-Flash block 0 but is in Flash Configuration Field
-    if((flashAddr >= FLASH_CNFG_START_ADDRESS) && (flashAddr <= FLASH_CNFG_END_ADDRESS)) {
-        //Return error code FTFx_ERR_RANGE
-        return ERR_RANGE;
-    }
+	//Advance the job, and launch the command
+	_jobCmdAddr = addr;
+	_jobAddr += len;
+	_jobRemain -= len;
 
-	//Convert System memory address to FTFx internal memory address
-    flashAddr -= FLASH_BASE;
+	this->LoadCmd(&cmd);
+	this->LaunchCmd();
+}
 
-    //Report current swap state
-	returnCode = this->CmdSwapGetStatus(flashAddr, &swapState);
-	if(returnCode == OK) {
-		params.State = swapState.CurrentState;
-		OnSwapStatus.Call(&params);
-	}
-    if((returnCode != OK) || !params.Continue) {
-		return returnCode;
-    }
+/*!-----------------------------------------------------------------------------
+Function that adds a job to the background queue, and starts it if the queue
+was empty.
+Jobs should only be queued from the main program, or from a job's callback.
+@param job Pointer to the job to queue, which is copied into the queue
+@result Success or error code from queuing the job, or FLASH_ERR_BUSY if the queue is full
+*/
+EFlashReturn CFlash::JobQueue(PFlashJob job)
+{
+	PFlashJob entry;
 
-    //If current swap mode is Uninitialized
-    if(swapState.CurrentState == SWAP_UNINIT) {
-        //Initialize Swap to Initialized/READY state
-		returnCode = this->CmdSwapExecute(flashAddr, SWAP_SET_INDICATOR_ADDR);
-        if(returnCode != OK) {
-            return returnCode;
-        }
+	if(job->Size == 0)
+		return FLASH_ERR_SIZE;
 
-        //Wait for state transition from Uninitialized to expected state
-		while((EFlashSwapState)_flash->FCCOB5 == SWAP_UNINIT) {};
+	//Check target addresses lie within memory, in the blocks jobs may modify
+	if(!this->CheckAddress(job->Addr, job->Size) || (job->Addr < FLASH_JOB_ADDR_MIN))
+		return FLASH_ERR_RANGE;
 
-        //Report current swap state
-		//Should be READY.
-		returnCode = this->CmdSwapGetStatus(flashAddr, &swapState);
-		if(returnCode == OK) {
-			params.State = swapState.CurrentState;
-			OnSwapStatus.Call(&params);
-		}
-		if((returnCode != OK) || !params.Continue) {
-			return returnCode;
-		}
-    }
+	IRQ_DISABLE;
 
-    //If current swap mode is Initialized/Ready
-    if(swapState.CurrentState == SWAP_READY) {
-        //Progress Swap to UPDATE state
-		returnCode = this->CmdSwapExecute(flashAddr, SWAP_SET_IN_PREPARE);
-        if(returnCode != OK) {
-            return returnCode;
-        }
+	if(_jobCount >= FLASH_JOB_QUEUE_SIZE) {
+		IRQ_ENABLE;
+		return FLASH_ERR_BUSY;
+	}
 
-        //Wait for state transition from Initialized/Ready to others
-		while((EFlashSwapState)_flash->FCCOB5 == SWAP_READY) {};
+	//Add the job to the end of the queue
+	entry = &_jobs[(_jobHead + _jobCount) % FLASH_JOB_QUEUE_SIZE];
+	*entry = *job;
+	entry->Result = FLASH_OK;
+	entry->FailAddr = 0;
+	_jobCount++;
 
-        //Report current swap state
-		//Should be UPDATE or UPDATE_ERASED.
-		returnCode = this->CmdSwapGetStatus(flashAddr, &swapState);
-		if(returnCode == OK) {
-			params.State = swapState.CurrentState;
-			OnSwapStatus.Call(&params);
-		}
-		if((returnCode != OK) || !params.Continue) {
-			return returnCode;
-		}
-    }
+	//Start the job straight away if the queue was empty, unless a blocking
+	//function is running its command lists (queued from an interrupt), which
+	//will start it once it has finished
+	if((_jobCount == 1) && !_listBusy)
+		this->JobStart();
 
-    //If current swap mode is Update or Update-Erased
-    if((swapState.CurrentState == SWAP_UPDATE) || (swapState.CurrentState == SWAP_UPDATE_ERASED)) {
+	IRQ_ENABLE;
 
-		//If the current swap mode is not update-erase, erase swap indicator
-		//in non-active block by erasing the sector contains the swap indicator
-        if(swapState.CurrentState != SWAP_UPDATE_ERASED) {
-			//Erase the swap indicator in the non-active block
-			uint32 eraseAddr = flashAddr + FLASH_HALF_SIZE;
-			returnCode = this->CmdEraseSector(eraseAddr, FLASH_SECTOR_SIZE);
-            if(returnCode != OK) {
-				return returnCode;
-            }
-
-            //Now the swap state must be Update-Erased, so report current swap state
-			//Should be UPDATE_ERASED.
-			returnCode = this->CmdSwapGetStatus(flashAddr, &swapState);
-			if(returnCode == OK) {
-				params.State = swapState.CurrentState;
-				OnSwapStatus.Call(&params);
-			}
-			if((returnCode != OK) || !params.Continue) {
-				return returnCode;
-			}
-        }
+	return FLASH_OK;
+}
 
-        //Progress Swap to COMPLETE State
-		returnCode = this->CmdSwapExecute(flashAddr, SWAP_SET_IN_COMPLETE);
-        if(returnCode != OK) {
-        	return returnCode;
-        }
+/*!-----------------------------------------------------------------------------
+Function that starts the job at the head of the queue, launching its first
+command and enabling the command complete interrupt.
+*/
+void CFlash::JobStart()
+{
+	PFlashJob job = &_jobs[_jobHead];
 
-        //Wait for state transition from Update-Erased to Complete
-		while((EFlashSwapState)_flash->FCCOB5 != SWAP_COMPLETE) {};
+	_jobAddr = job->Addr;
+	_jobData = job->Data;
+	_jobRemain = job->Size;
+	_jobChecking = false;
+	_jobDirty = false;
 
-		//Report current swap state
-		//Should be COMPLETE.
-		returnCode = this->CmdSwapGetStatus(flashAddr, &swapState);
-		if(returnCode == OK) {
-			params.State = swapState.CurrentState;
-			OnSwapStatus.Call(&params);
-		}
-		if((returnCode != OK) || !params.Continue) {
-			return returnCode;
-		}
-    }
+	this->JobLaunch(job);
 
-    return returnCode;
+	SET_BITS(_flash->FCNFG, FTFE_FCNFG_CCIE_MASK);
 }
-*/
 
 /*!-----------------------------------------------------------------------------
-Function that issues a Swap command.
-
-EFlashReturn CFlash::CmdSwapExecute(uint32 addr, EFlashSwapCmd swapCmd)
+Function that launches the command loaded into the FCCOB registers (and clears
+down the error flags), without waiting for it to complete.
+NB: This is called from flash, so the command must not target the flash block
+this code runs from.
+*/
+void CFlash::LaunchCmd()
 {
-    EFlashReturn returnCode;
-	uint8 cmdData[8];
+	SET_BITS(_flash->FSTAT, FTFE_FSTAT_CCIF_MASK | FTFE_FSTAT_RDCOLERR_MASK | FTFE_FSTAT_ACCERR_MASK | FTFE_FSTAT_FPVIOL_MASK);
+}
 
-    //Prepare command
-    cmdData[0] = FLASH_CMD_PFLASH_SWAP;
-    cmdData[1] = (uint8)((addr >> 16) & 0xFF);
-    cmdData[2] = (uint8)((addr >> 8) & 0xFF);
-    cmdData[3] = (uint8)(addr & 0xFF);
-    cmdData[4] = (uint8)swapCmd;
-    cmdData[5] = 0xFF;
-    cmdData[6] = 0xFF;
-    cmdData[7] = 0xFF;
+/*!-----------------------------------------------------------------------------
+Function that loads an encoded command into the FCCOB registers, a word at a time
+@param cmd	Pointer to the encoded command
+*/
+void CFlash::LoadCmd(PFlashCmd cmd)
+{
+	*((volatile uint32*)&_flash->FCCOB3) = cmd->Cmd;
+	*((volatile uint32*)&_flash->FCCOB7) = cmd->Param1;
+	*((volatile uint32*)&_flash->FCCOBB) = cmd->Param2;
+}
 
-    //Call flash command sequence function to execute the command
-    returnCode = this->ExecuteCmd(8, cmdData);
+/*!-----------------------------------------------------------------------------
+Function that steps the background jobs if the command in progress has
+completed, so a job's callback can be waited on when the interrupt may not be
+connected. It does nothing if the interrupt has already serviced the command.
+*/
+void CFlash::Poll()
+{
+	if(IS_BITS_SET(_flash->FSTAT, FTFE_FSTAT_CCIF_MASK)) {
+		IRQ_DISABLE;
+		this->DoISR();
+		IRQ_ENABLE;
+	}
+}
 
-	return returnCode;
+/*!-----------------------------------------------------------------------------
+Function that sets the status of the config-lock flag, that prevents
+the config part of flash (Address 0x00000400 to 0x0000040F) from being
+programmed, affecting the security settings
+*/
+void CFlash::SetConfigLock(bool value)
+{
+	_cfgLock = value;
 }
+
+/*!-----------------------------------------------------------------------------
+Function that sets if FlashProgram should use Program Section commands for
+aligned runs of data, or program everything one phrase at a time
 */
+void CFlash::SetSectionEnable(bool value)
+{
+	_pgmsecEnable = value;
+}
 
 /*!-----------------------------------------------------------------------------
-Function that issues a Swap command to report on the current swap status, which
-is populated into the status parameter.
+Function that waits until no background job is using the flash blocks holding
+the specified range (by default, until all jobs have finished).
+If the interrupt can't be serviced (such as while interrupts are disabled), the
+jobs are stepped on from here instead.
+NB: This must not be called from a job's callback.
+@param addr		The starting address of the range
+@param size		The number of bytes in the range
+*/
+void CFlash::Wait(uint32 addr, uint32 size)
+{
+	while(this->IsBusy(addr, size)) {
+		this->Poll();
+	}
+}
 
-EFlashReturn CFlash::CmdSwapGetStatus(uint32 flashAddr, PFlashSwapState status)
+/*!-----------------------------------------------------------------------------
+Function that uses the program flash swap system to exchange the two halves of
+program flash at the next reset, so the upper half (holding the new program)
+appears at address 0 and the lower half becomes the inactive upper half.
+The swap state is progressed from wherever it currently is (initialising the
+swap system with the indicator address on first use) through to "complete",
+erasing the sector holding the swap indicator in the upper half on the way.
+Each state change is waited for by reporting the status until it moves on.
+NB: The swap indicator address must be the same every time this is called, and
+the sector holding it (in both halves) must not be used for anything else.
+@param flashAddr The address of the swap indicator in the lower half of program flash
+@result Success or error code from the operation, FLASH_OK indicating the halves will be swapped at the next reset
+*/
+EFlashReturn CFlash::CmdSwap(uint32 flashAddr)
 {
-    EFlashReturn returnCode;
+	EFlashReturn returnCode;
+	TFlashSwapState swapState;
 
-    //Set the default return code as FTFx_OK
-    returnCode = OK;
+	//Report current swap state (also checking the address)
+	returnCode = this->CmdSwapGetStatus(flashAddr, &swapState);
+	if(returnCode != FLASH_OK)
+		return returnCode;
 
-    //Check if the destination is not Longword aligned
-    if((flashAddr % FLASH_SWAP_ALIGN_SIZE) != 0) {
-        //Return error code FTFx_ERR_ADDR
-        return ERR_ADDR;
-    }
+	//If the swap system is uninitialised, set the indicator address to move it to READY
+	if(swapState.CurrentState == FLASH_SWAP_UNINIT) {
+		returnCode = this->CmdSwapExecute(flashAddr, FLASH_SWAP_SET_INDICATOR_ADDR, &swapState);
+		while((returnCode == FLASH_OK) && (swapState.CurrentState == FLASH_SWAP_UNINIT))
+			returnCode = this->CmdSwapExecute(flashAddr, FLASH_SWAP_REPORT_STATUS, &swapState);
+		if(returnCode != FLASH_OK)
+			return returnCode;
+	}
 
-    //Check if the flash address lies in the Active block (P-Flash block 0)
-	if((flashAddr < FLASH_BASE) || (flashAddr >= (FLASH_SIZE + FLASH_HALF_SIZE))) {
-        //Return error code FTFx_ERR_RANGE
-        return ERR_RANGE;
-    }
+	//If the swap system is ready, progress to the UPDATE (or UPDATE_ERASED) state
+	if(swapState.CurrentState == FLASH_SWAP_READY) {
+		returnCode = this->CmdSwapExecute(flashAddr, FLASH_SWAP_SET_IN_PREPARE, &swapState);
+		while((returnCode == FLASH_OK) && (swapState.CurrentState == FLASH_SWAP_READY))
+			returnCode = this->CmdSwapExecute(flashAddr, FLASH_SWAP_REPORT_STATUS, &swapState);
+		if(returnCode != FLASH_OK)
+			return returnCode;
+	}
 
-	//Check if the flash address is in the P-Flash block 0 but is in Flash Configuration Field
-    if((flashAddr >= FLASH_CNFG_START_ADDRESS) && (flashAddr <= FLASH_CNFG_END_ADDRESS)) {
-        //Return error code FTFx_ERR_RANGE
-        return ERR_RANGE;
-    }
+	//Erase the swap indicator in the inactive half, to move to the UPDATE_ERASED state
+	if(swapState.CurrentState == FLASH_SWAP_UPDATE) {
+		returnCode = this->FlashEraseSector(flashAddr + FLASH_HALF_SIZE);
+		if(returnCode != FLASH_OK)
+			return returnCode;
+
+		returnCode = this->CmdSwapGetStatus(flashAddr, &swapState);
+		if(returnCode != FLASH_OK)
+			return returnCode;
+	}
 
-	//Convert System memory address to FTFx internal memory address
-    flashAddr -= FLASH_BASE;
+	//Progress to the COMPLETE state, so the halves swap at the next reset
+	if(swapState.CurrentState == FLASH_SWAP_UPDATE_ERASED) {
+		returnCode = this->CmdSwapExecute(flashAddr, FLASH_SWAP_SET_IN_COMPLETE, &swapState);
+		while((returnCode == FLASH_OK) && (swapState.CurrentState == FLASH_SWAP_UPDATE_ERASED))
+			returnCode = this->CmdSwapExecute(flashAddr, FLASH_SWAP_REPORT_STATUS, &swapState);
+		if(returnCode != FLASH_OK)
+			return returnCode;
+	}
 
-	//Issue a Swap "Report Status" sub command
-	returnCode = this->CmdSwapExecute(flashAddr, SWAP_REPORT_STATUS);
+	if(swapState.CurrentState != FLASH_SWAP_COMPLETE)
+		return FLASH_ERR_ACCERR;
+
+	return FLASH_OK;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that issues a Swap command, and reads back the swap status it returns.
+@param addr		The address of the swap indicator, already checked
+@param swapCmd	The swap control code to issue
+@param status	Pointer to where the returned swap status is stored
+@result Success or error code from the operation
+*/
+EFlashReturn CFlash::CmdSwapExecute(uint32 addr, EFlashSwapCmd swapCmd, PFlashSwapState status)
+{
+	EFlashReturn returnCode;
+	uint8 cmdData[8];
+
+	//Prepare command
+	cmdData[0] = FLASH_CMD_PFLASH_SWAP;
+	cmdData[1] = (uint8)((addr >> 16) & 0xFF);
+	cmdData[2] = (uint8)((addr >> 8) & 0xFF);
+	cmdData[3] = (uint8)(addr & 0xFF);
+	cmdData[4] = (uint8)swapCmd;
+	cmdData[5] = 0xFF;
+	cmdData[6] = 0xFF;
+	cmdData[7] = 0xFF;
+
+	//Call flash command sequence function to execute the command
+	returnCode = this->ExecuteCmd(8, cmdData);
 
-    //If the command executed, read out the returned status codes
-    if(returnCode == OK) {
+	//If the command executed, read out the returned status codes
+	if(returnCode == FLASH_OK) {
 		status->CurrentState = (EFlashSwapState)_flash->FCCOB5;
 		status->CurrentBlock = (EFlashSwapBlockStatus)_flash->FCCOB6;
 		status->NextBlock = (EFlashSwapBlockStatus)_flash->FCCOB7;
-    }
+	}
+
+	return returnCode;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that issues a Swap command to report on the current swap status, which
+is populated into the status parameter.
+@param flashAddr The address of the swap indicator in the lower half of program flash
+@param status	Pointer to where the swap status is stored
+@result Success or error code from the operation
+*/
+EFlashReturn CFlash::CmdSwapGetStatus(uint32 flashAddr, PFlashSwapState status)
+{
+	//Check if the destination is not aligned
+	if((flashAddr % FLASH_SWAP_ALIGN_SIZE) != 0)
+		return FLASH_ERR_ADDR;
+
+	//Check if the flash address lies in the lower half, but not in the Flash Configuration Field
+	if((flashAddr >= FLASH_HALF_SIZE) || ((flashAddr >= FLASH_CNFG_START_ADDRESS) && (flashAddr <= FLASH_CNFG_END_ADDRESS)))
+		return FLASH_ERR_RANGE;
 
-    return returnCode;
+	//Issue a Swap "Report Status" sub command
+	return this->CmdSwapExecute(flashAddr, FLASH_SWAP_REPORT_STATUS, status);
 }
+
+//==============================================================================
+//Interrupt Handlers...
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function called from the Interrupt Vector Table.
 */
+#if FLASH_CONNECT_IRQ
+void ISR_FTFE(void) {
+	if (CFlash::Flash)
+		CFlash::Flash->DoISR();
+}
+#endif
 
 //==============================================================================
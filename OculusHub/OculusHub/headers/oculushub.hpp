@@ -25,7 +25,7 @@ using namespace std;	//Allow use of the standard namespace without explicit decl
 #include "cmd_defs.h"
 
 //Include helper classes
-//#include "crc16.hpp"
+#include "crc16.hpp"
 
 //Include device drivers
 #include "mcg.hpp"
@@ -40,7 +40,8 @@ using namespace std;	//Allow use of the standard namespace without explicit decl
 
 //Include the system level classes
 #include "app.hpp"
-//#include "cmd_proc.hpp"
+#include "dlog.hpp"
+#include "cmd_engine.hpp"
 
 //==============================================================================
 //Class Definitions...
@@ -64,27 +65,33 @@ class COculusHub : public CApp {
 		PFlash					_flash;				/*!< Flash memory controller */
 
 		//System Objects
-		//PCmdProc				_cmd;				/*!< Class that implements the command processor */
+		PDlog					_dlog;				/*!< Deferred binary log, drained through the debug port */
+		PCmdEngine				_cmd;				/*!< Class that implements the command processor */
 		PFlashProg				_flashProg;			/*!< Class that manages in-system programming of firmware */
 
 		//Variables
 		TFlashProgHardwareInfo	_hardware;			/*!< Struct containing hardware information */
 		volatile bool			_run;				/*!< True while the application is allowed to run */
+		bool					_swapConfirmed;		/*!< True once the program has confirmed it runs, after the first command from the host */
 
 		//Protected Methods
-		//virtual void CmdExecuteEvent(PCmdProcExecute params);	/*!< Handler that processes received serial commands */
-		//void CmdExecute_SysAlive(PCmdProcExecute params);
-		//void CmdExecute_SysInfo(PCmdProcExecute params);
-		//void CmdExecute_SysReboot(PCmdProcExecute params);
-		//void CmdExecute_ProgInit(PCmdProcExecute params);
-		//void CmdExecute_ProgBlock(PCmdProcExecute params);
-		//void CmdExecute_ProgUpdate(PCmdProcExecute params);
-		//void CmdSend_Ready();
+		virtual void CmdExecuteEvent(PCmdEngineExecute params);	/*!< Handler that processes received serial commands */
+		void CmdExecute_SysAlive(PCmdEngineExecute params);
+		void CmdExecute_SysInfo(PCmdEngineExecute params);
+		void CmdExecute_SysReboot(PCmdEngineExecute params);
+		void CmdExecute_ProgInit(PCmdEngineExecute params);
+		void CmdExecute_ProgBlock(PCmdEngineExecute params);
+		void CmdExecute_ProgUpdate(PCmdEngineExecute params);
+		void CmdExecute_ProgWindowBlock(PCmdEngineExecute params);
+		void CmdSend_Ready();
 		virtual void DoInitialiseGpio();
 		virtual void DoReboot() = 0;
 		virtual void DoRun() = 0;
 		virtual void FlashProgActionEvent(PFlashProgActionParams params);
 
+		//Static Variables
+		static const TCmdEngineEntry<COculusHub> CmdTable[];	/*!< Dispatch table of the common application commands */
+
 	public:
 		//Construction & Disposal
 		COculusHub();
@@ -57,24 +57,58 @@ objects.
 /*! Program Flash block size, 256kB */
 #define FLASH_BLOCK_SIZE				0x00040000			/*!< Flash built of 4 x 256kb blocks */
 
+/*! Set true to update firmware by programming the inactive half of flash and
+swapping the halves, rather than copying scratch memory over the main program.
+Each half then holds a complete copy of the memory map below, so the main
+program's m_text region in the linker script must be reduced to match. */
+#ifndef FLASH_SWAP_ENABLE
+	#define FLASH_SWAP_ENABLE			false
+#endif
+
 #define FLASH_BOOT_START				0x00000000			/*!< Boot loader starting address */
 #define FLASH_BOOT_SIZE					0x00010000			/*!< Boot loader size - 64kb */
 
 #define FLASH_MAIN_START				(FLASH_BOOT_SIZE)	/*!< Main application starting address, 64kb */
-#define FLASH_MAIN_SIZE					0x00070000			/*!< Main application size, 448kb */
 
-#define FLASH_SCRATCH_START				0x00080000			/*!< Temporary programming area starting address */
-#define FLASH_SCRATCH_SIZE				(FLASH_MAIN_SIZE)	/*!< Temporary programming area size - same as main application */
+#if FLASH_SWAP_ENABLE
+	#define FLASH_MAIN_SIZE				0x00060000			/*!< Main application size, 384kb */
+
+	#define FLASH_SCRATCH_START			0x00090000			/*!< Temporary programming area starting address - the main application's place in the inactive half */
+	#define FLASH_SCRATCH_SIZE			(FLASH_MAIN_SIZE)	/*!< Temporary programming area size - same as main application */
+
+	#define FLASH_SETTINGS_START		0x00070000			/*!< Settings data - 52kb, 13 x 4kb sectors of memory */
+	#define FLASH_SETTINGS_SIZE			0x0000D000
+
+	#define FLASH_PROGDONE_START		0x0007D000			/*!< Update copy progress map - 1 x 4kb sector of memory */
+	#define FLASH_PROGDONE_SIZE			0x00001000
+
+	#define FLASH_PROGINFO_START		0x0007E000			/*!< Program Identification data - 1 x 4kb sector of memory */
+	#define FLASH_PROGINFO_SIZE			0x00001000
+
+	#define FLASH_SWAP_INDICATOR_ADDR	0x0007F000			/*!< Swap indicator - 1 x 4kb sector of memory reserved in each half for the flash swap system */
+#else
+	#define FLASH_MAIN_SIZE				0x00070000			/*!< Main application size, 448kb */
+
+	#define FLASH_SCRATCH_START			0x00080000			/*!< Temporary programming area starting address */
+	#define FLASH_SCRATCH_SIZE			(FLASH_MAIN_SIZE)	/*!< Temporary programming area size - same as main application */
+
+	#define FLASH_SETTINGS_START		0x000F0000			/*!< Settings data - 56kb, 14 x 4kb sectors of memory */
+	#define FLASH_SETTINGS_SIZE			0x0000E000
 
-#define FLASH_SETTINGS_START			0x000F0000			/*!< Settings data - 56kb, 14 x 4kb sectors of memory */
-#define FLASH_SETTINGS_SIZE				0x0000F000
+	#define FLASH_PROGDONE_START		0x000FE000			/*!< Update copy progress map - 1 x 4kb sector of memory */
+	#define FLASH_PROGDONE_SIZE			0x00001000
 
-#define FLASH_PROGINFO_START			0x000FF000			/*!< Program Identification data - 1 x 4kb sector of memory */
-#define FLASH_PROGINFO_SIZE				0x00001000
+	#define FLASH_PROGINFO_START		0x000FF000			/*!< Program Identification data - 1 x 4kb sector of memory */
+	#define FLASH_PROGINFO_SIZE			0x00001000
+#endif
 
 #define FLASH_HASH_KEY					"u86TzXFTDci1I0sW"	/*!< Defines a string used as part of the hashing process to sign firmware, for decryption and user access - must be 16 chars long min*/
 
 #define FLASH_PROG_BLOCK_MAX			128					/*! Maximum number of bytes in a flash programming block */
+#define FLASH_PROG_WINDOW_BLOCK_MAX		(FLASH_SECTOR_SIZE)	/*! Maximum number of bytes in a windowed flash programming block */
+#define FLASH_PROG_WINDOW_SLOTS			4					/*! Number of windowed blocks that can be staged ahead of the next block expected */
+
+#define FLASH_CONNECT_IRQ				true				/*! Run background flash jobs from the FTFE command complete interrupt */
 
 //------------------------------------------------------------------------------
 //Define the bit values of the Hardware Flags field
@@ -88,6 +122,10 @@ objects.
 //------------------------------------------------------------------------------
 #define SYSTICK_TIMER_FREQ				10000.0				/*!< Define the frequency of the SysTick Timer overflow timebase */
 
+#define CLK_MCG_Hz						120000000			/*!< MCG output clock (from PLL0), that the system clocks are divided from */
+#define CLK_SYS_Hz						120000000			/*!< Core/system clock, which also clocks UART0 and UART1 */
+#define CLK_BUS_Hz						60000000			/*!< Peripheral bus clock, which clocks UART2 to UART5 */
+
 //------------------------------------------------------------------------------
 //UART Configuration
 //------------------------------------------------------------------------------
@@ -105,21 +143,32 @@ objects.
 //#define UART4_CONNECT_IRQ				true
 //#define UART5_CONNECT_IRQ				true
 
+//Enable UART DMA channel IRQ's (for ports opened in UART_MODE_DMA)...
+#define UART1_CONNECT_DMA				true			/*!< WIFI primary control uses eDMA channels 2 & 3 */
+
 //Define the setup each logical uart object uses...
 #define UART_DEBUG						3				/*! Map to UART3 */
 #define UART_DEBUG_TX_BUFFER			512
-#define UART_DEBUG_RX_BUFFER			128
+#define UART_DEBUG_RX_BUFFER			2048			/*! Holds pipelined command frames while windowed blocks are programmed */
 #define UART_DEBUG_BAUD					BAUD_115200
+#define UART_DEBUG_MODE					UART_MODE_FIFO
 
 #define UART_WIFICTRL					1				/*! Map to UART1 */
 #define UART_WIFICTRL_TX_BUFFER			256
 #define UART_WIFICTRL_RX_BUFFER			64
 #define UART_WIFICTRL_BAUD				BAUD_57600
+#define UART_WIFICTRL_MODE				UART_MODE_DMA
 
 //#define UART_WIFI_DATA					0				/*! Map to UART0 */
 //#define UART_WIFIDATA_TX_BUFFER			256
 //#define UART_WIFIDATA_RX_BUFFER			64
 
+//Define the deferred log setup (drained through the UART_DEBUG terminal)
+#define DLOG_BUFFER_SIZE				1024			/*! Size of the RAM ring holding log frames waiting to be sent */
+
+//Define the command engine setup (on the UART_DEBUG port)
+#define CMD_FRAME_SIZE					(FLASH_PROG_WINDOW_BLOCK_MAX + 16)	/*! Largest decoded command frame, enough for a PROG_WINDOW_BLOCK command */
+
 //------------------------------------------------------------------------------
 //Macros for controlling IO signals
 //------------------------------------------------------------------------------
@@ -1,5 +1,8 @@
 #include "oculushub.hpp"
 
+//Check the debug port baud rate can be generated from its clock
+UART_BAUD_ASSERT(UART_DEBUG, UART_DEBUG_BAUD);
+
 //==============================================================================
 //Class Implementation...
 //==============================================================================
@@ -26,9 +29,9 @@ COculusHub::COculusHub()
 	mcgCfg.PRDIV = 4;				/*!< PLL0 - Divide by factor of 5 for a PLL0 frequency of 5MHz (we think theres an extra div2 in here) */
 	mcgCfg.VDIV = 8;				/*!< PLL0 - Multiply 5MHz by 24 to give 120MHz */
 	mcgCfg.ClkSrcFreq = 50000000;
-	mcgCfg.ClkMcgFreq = 120000000;
-	mcgCfg.ClkDivSys = 1;			/*!< 120MHz system */
-	mcgCfg.ClkDivPeripheral = 2;	/*!< 60MHz bus/peripherals */
+	mcgCfg.ClkMcgFreq = CLK_MCG_Hz;
+	mcgCfg.ClkDivSys = CLK_MCG_Hz / CLK_SYS_Hz;			/*!< 120MHz system */
+	mcgCfg.ClkDivPeripheral = CLK_MCG_Hz / CLK_BUS_Hz;	/*!< 60MHz bus/peripherals */
 	mcgCfg.ClkDivBus = 3;			/*!< 40MHz for external bus */
 	mcgCfg.ClkDivFlash = 6;			/*!< 20MHz for flash */
 	CMcg::Initialise(&mcgCfg);
@@ -36,31 +39,22 @@ COculusHub::COculusHub()
 	//Set the SysTick master time-base
 	CSysTick::Initialise(SYSTICK_TIMER_FREQ);
 
-	//Initialise the CRC16 generator LUT
-	//CCrc16::Init();
-
 	//Setup the DEBUG Com Port
 	_comDebug = new CComUart(UART_DEBUG, UART_DEBUG_RX_BUFFER, UART_DEBUG_TX_BUFFER);
 	_comDebug->Close();
 	_comDebug->SetBaudRate(UART_DEBUG_BAUD);
 	_comDebug->SetParity(PARITY_NONE);
+	_comDebug->SetMode(UART_DEBUG_MODE);
 
 	//Setup the PrintF redirection to the AUX Com Port
 	CCom::Terminal = _comDebug;
 
-	/*
+	//Setup the deferred log to drain through the terminal
+	_dlog = new CDlog(CCom::Terminal, DLOG_BUFFER_SIZE);
+
 	//Initialise the command processor
-	_cmd = new CCmdProc();
-	#ifdef DEBUG
-		_cmd->SetRxUseCsum(false);
-	#else
-		_cmd->SetRxUseCsum(true);
-	#endif
-	_cmd->SetRxIgnoreBadChars(true);
-	_cmd->SetRxUseDeviceAddr(true, DEVICE_ADDR);
-	_cmd->SetUart(_comDebug);
+	_cmd = new CCmdEngine(_comDebug, CMD_FRAME_SIZE);
 	_cmd->OnExecute.Set(this, &COculusHub::CmdExecuteEvent);
-	*/
 
 	//Populate hardware information
 	_hardware.PartNumber = HARDWARE_PARTNUMBER;
@@ -79,6 +73,9 @@ COculusHub::COculusHub()
 
 	//Indicate the application is allowed to run
 	_run = true;
+
+	//A program swapped in by an update isn't confirmed until the host is heard from
+	_swapConfirmed = false;
 }
 
 /*!-----------------------------------------------------------------------------
@@ -88,29 +85,41 @@ COculusHub::~COculusHub()
 }
 
 /*!-----------------------------------------------------------------------------
-Handler that executes decoded commands from the serial port
+Dispatch table of the common application commands, searched by CmdExecuteEvent
+*/
+const TCmdEngineEntry<COculusHub> COculusHub::CmdTable[] = {
+	{ CID_SYS_ALIVE, &COculusHub::CmdExecute_SysAlive },
+	{ CID_SYS_INFO, &COculusHub::CmdExecute_SysInfo },
+	{ CID_SYS_REBOOT, &COculusHub::CmdExecute_SysReboot },
+	{ CID_PROG_INIT, &COculusHub::CmdExecute_ProgInit },
+	{ CID_PROG_BLOCK, &COculusHub::CmdExecute_ProgBlock },
+	{ CID_PROG_UPDATE, &COculusHub::CmdExecute_ProgUpdate },
+	{ CID_PROG_WINDOW_BLOCK, &COculusHub::CmdExecute_ProgWindowBlock }
+};
 
-void COculusHub::CmdExecuteEvent(PCmdProcExecute params)
+/*!-----------------------------------------------------------------------------
+Handler that executes decoded commands from the serial port.
+Inheriting classes can override this to handle further commands, calling this
+base method first and checking the Handled flag.
+*/
+void COculusHub::CmdExecuteEvent(PCmdEngineExecute params)
 {
+	//A valid command from the host shows the main loop, serial port and command
+	//engine all work, so confirm a program swapped in by an update runs
+	if(!_swapConfirmed)
+		_swapConfirmed = _flashProg->SwapConfirm();
+
 	//Process common application commands
-	switch(params->Id) {
-		case CID_SYS_ALIVE : { this->CmdExecute_SysAlive(params); params->Handled = true; break; }
-		case CID_SYS_INFO : { this->CmdExecute_SysInfo(params); params->Handled = true; break; }
-		case CID_SYS_REBOOT : { this->CmdExecute_SysReboot(params); params->Handled = true; break; }
-		case CID_PROG_INIT : { this->CmdExecute_ProgInit(params); params->Handled = true; break; }
-		case CID_PROG_BLOCK : { this->CmdExecute_ProgBlock(params); params->Handled = true; break; }
-		case CID_PROG_UPDATE : { this->CmdExecute_ProgUpdate(params); params->Handled = true; break; }
-	}
+	params->Handled = CCmdEngine::Dispatch(this, CmdTable, sizeof(CmdTable) / sizeof(CmdTable[0]), params);
 }
-*/
 
 /*!-----------------------------------------------------------------------------
 CmdProc function used to initialise a Flash Programming sequence.
 When executed, the flash programming system is initialised to receive new blocks,
 the Scratch memory area is erased ready to receive new data, and the running checksum
 is cleared.
-
-void COculusHub::CmdExecute_ProgInit(PCmdProcExecute params)
+*/
+void COculusHub::CmdExecute_ProgInit(PCmdEngineExecute params)
 {
 	bool success = true;
 	EFlashProgReturn progResult;
@@ -152,35 +161,33 @@ void COculusHub::CmdExecute_ProgInit(PCmdProcExecute params)
 	}
 
 	//Send the CmdProc message back
-	CCmdMsg cmdMsg;
-	cmdMsg.AddUint8(CID_PROG_INIT);
-	cmdMsg.AddUint8(status);
-	params->CmdProc->SendMsg(&cmdMsg);
+	params->Engine->SendStatus(CID_PROG_INIT, status);
 }
-*/
 
 /*!-----------------------------------------------------------------------------
 CmdProc function used to transfer a block of flash data into the Scratch memory
 ready for programming.
-
-void COculusHub::CmdExecute_ProgBlock(PCmdProcExecute params)
+The block data is programmed directly from the command engine's frame buffer.
+*/
+void COculusHub::CmdExecute_ProgBlock(PCmdEngineExecute params)
 {
 	bool success = true;
 	uint8 status = CST_FAIL;
-	uint16 length;
-	uint8 data[FLASH_PROG_BLOCK_MAX];
+	uint16 length = 0;
+	puint8 data = NULL;
 	EFlashProgReturn progResult;
 
 	//Read in the number of bytes following in the block command, and abort if too many
 	success &= params->Msg->ReadUint16(&length, 0);
-	//If valid, read in the data bytes
-	if(success && (length <= FLASH_PROG_BLOCK_MAX))
-		success &= params->Msg->ReadData(data, length);
+	//If valid, access the data bytes in place
+	if(success && (length <= FLASH_PROG_BLOCK_MAX)) {
+		data = params->Msg->GetReadPtr(length);
+		success &= (data != NULL);
+	}
 
 	//Report any errors in reading the data
 	if((length < 8) || (length > FLASH_PROG_BLOCK_MAX) || IS_BITS_SET(length, 0x03)) {
 		//Length must be >= 8, a multiple of 4 bytes and less than the maximum allowed length
-		//status = CST_CMD_PARAM_INVALID;
 		status = CST_PROG_LENGTH_ERROR;
 		success = false;
 	}
@@ -188,14 +195,6 @@ void COculusHub::CmdExecute_ProgBlock(PCmdProcExecute params)
 		status = CST_CMD_LENGTH_ERROR;
 	}
 
-	////Round up length to the nearest 4 bytes, and pad with 1's unused memory
-	////This is done for decryption purposes (as entity size is a Uint32).
-	//uint16 rawLen = length;
-	//length = CMaths::RoundMultipleUp(length, 8);
-	//for(uint16 idx = rawLen; idx < length; idx++) {
-	//	data[idx] = 0xFF;
-	//}
-
 	//Program the block into scratch memory
 	if(success) {
 		progResult = _flashProg->ProgScratch(data, length);
@@ -207,17 +206,81 @@ void COculusHub::CmdExecute_ProgBlock(PCmdProcExecute params)
 			case FPROG_FLASH_ERROR : {status = CST_PROG_FLASH_ERROR; break; }
 			case FPROG_INIT_ERROR : {status = CST_PROG_FIRMWARE_ERROR; break; }
 			case FPROG_LENGTH_ERROR : { status = CST_PROG_LENGTH_ERROR; break; }
+			case FPROG_DATA_ERROR : { status = CST_PROG_DATA_ERROR; break; }
 			default : { status = CST_FAIL; break; }
 		}
 	}
 
 	//Send the CmdProc ack message back
-	CCmdMsg cmdMsg;
-	cmdMsg.AddUint8(CID_PROG_BLOCK);
-	cmdMsg.AddUint8(status);
-	params->CmdProc->SendMsg(&cmdMsg);
+	params->Engine->SendStatus(CID_PROG_BLOCK, status);
 }
+
+/*!-----------------------------------------------------------------------------
+CmdProc function used to transfer a sequence numbered block of flash data into
+the Scratch memory, as part of a windowed transfer where the sender doesn't wait
+for each block to be acknowledged before sending the next.
+The acknowledgement returns the sequence number of the next block expected (all
+blocks before it have been programmed), a map of the blocks staged after it, and
+the number of staging slots, so the sender only needs to retransmit blocks that
+are missing. A block too far ahead to be staged is answered with
+CST_PROG_WINDOW_ERROR (rather than a data error), telling the sender to resend
+it once the window has moved on.
 */
+void COculusHub::CmdExecute_ProgWindowBlock(PCmdEngineExecute params)
+{
+	bool success = true;
+	uint8 status = CST_FAIL;
+	uint16 seq = 0;
+	uint16 length = 0;
+	puint8 data = NULL;
+	uint16 next;
+	uint32 staged;
+	EFlashProgReturn progResult;
+
+	//Read in the sequence number and length of the block
+	success &= params->Msg->ReadUint16(&seq, 0);
+	success &= params->Msg->ReadUint16(&length, 0);
+	//If valid, access the data bytes in place
+	if(success && (length <= FLASH_PROG_WINDOW_BLOCK_MAX)) {
+		data = params->Msg->GetReadPtr(length);
+		success &= (data != NULL);
+	}
+
+	//Report any errors in reading the data
+	if((length < 8) || (length > FLASH_PROG_WINDOW_BLOCK_MAX) || IS_BITS_SET(length, 0x03)) {
+		//Length must be >= 8, a multiple of 4 bytes and less than the maximum allowed length
+		status = CST_PROG_LENGTH_ERROR;
+		success = false;
+	}
+	else if(!success) {
+		status = CST_CMD_LENGTH_ERROR;
+	}
+
+	//Program or stage the block
+	if(success) {
+		progResult = _flashProg->ProgScratchBlock(seq, data, length);
+
+		//Select the appropriate error code to return
+		switch(progResult) {
+			case FPROG_OK : { status = CST_OK; break; }
+			case FPROG_FLASH_ERROR : {status = CST_PROG_FLASH_ERROR; break; }
+			case FPROG_INIT_ERROR : {status = CST_PROG_FIRMWARE_ERROR; break; }
+			case FPROG_LENGTH_ERROR : { status = CST_PROG_LENGTH_ERROR; break; }
+			case FPROG_WINDOW_ERROR : { status = CST_PROG_WINDOW_ERROR; break; }
+			case FPROG_DATA_ERROR : { status = CST_PROG_DATA_ERROR; break; }
+			default : { status = CST_FAIL; break; }
+		}
+	}
+
+	//Send the CmdProc ack message back
+	_flashProg->ProgWindowAck(&next, &staged);
+	CCmdTxFrame tx(params->Engine->GetCom(), CID_PROG_WINDOW_BLOCK);
+	tx.AddUint8(status);
+	tx.AddUint16(next);
+	tx.AddUint32(staged);
+	tx.AddUint8(FLASH_PROG_WINDOW_SLOTS);
+	tx.End();
+}
 
 /*!-----------------------------------------------------------------------------
 CmdProc function used to perform the actual flash programming once all the new
@@ -225,15 +288,22 @@ data blocks have been sent and programmed into the Scratch area of memory.
 When executed, the checksums are compared between the param sent in the command
 and that in Scratch memory, and if correct the Flash memory is copied from
 Scratch to the required area, then the processor is rebooted.
-
-void COculusHub::CmdExecute_ProgUpdate(PCmdProcExecute params)
+The command may optionally contain the 20 byte SHA1 hash of the programmed data,
+which is then also checked against the hash computed as blocks were received.
+*/
+void COculusHub::CmdExecute_ProgUpdate(PCmdEngineExecute params)
 {
 	bool success = true;
 	uint8 status = CST_FAIL;
 	EFlashProgReturn progResult;
+	puint8 hash = NULL;
+
+	//Access the image hash in place, if one was sent
+	if(params->Msg->GetReadFree() >= SHA1_HASH_SIZE)
+		hash = params->Msg->GetReadPtr(SHA1_HASH_SIZE);
 
 	//Start the firmware update process
-	progResult = _flashProg->ProgUpdate();
+	progResult = _flashProg->ProgUpdate(hash);
 
 	//Select the appropriate error code to return
 	success = false;
@@ -249,20 +319,18 @@ void COculusHub::CmdExecute_ProgUpdate(PCmdProcExecute params)
 		case FPROG_INIT_ERROR : { status = CST_PROG_FIRMWARE_ERROR; break; }
 		case FPROG_LENGTH_ERROR : { status = CST_PROG_LENGTH_ERROR; break; }
 		case FPROG_CHECKSUM_ERROR : { status = CST_PROG_CHECKSUM_ERROR; break; }
+		case FPROG_HASH_ERROR : { status = CST_PROG_CHECKSUM_ERROR; break; }
 		case FPROG_SECTION_ERROR : { status = CST_PROG_SECTION_ERROR; break; }
 		default : { status = CST_FAIL; break; }
 	}
 
 	//Send the CmdProc ack message back
-	CCmdMsg cmdMsg;
-	cmdMsg.AddUint8(CID_PROG_UPDATE);
-	cmdMsg.AddUint8(status);
-	params->CmdProc->SendMsg(&cmdMsg);
+	params->Engine->SendStatus(CID_PROG_UPDATE, status);
 
 	//If the Update command succeeded, then take the next programming action...
 	if(success) {
-		//Wait for a set time for the UART to send out any characters
-		CSysTick::WaitMilliseconds(200);
+		//Wait for the UART to send out any characters
+		params->Engine->GetCom()->Flush();
 
 		//If required, perform the flash copy now
 		if(progResult == FPROG_COPY_NOW) {
@@ -283,30 +351,27 @@ void COculusHub::CmdExecute_ProgUpdate(PCmdProcExecute params)
 		}
 	}
 }
-*/
 
 /*!-----------------------------------------------------------------------------
 CmdProc function called when an ALIVE request is issued
-
-void COculusHub::CmdExecute_SysAlive(PCmdProcExecute params)
+*/
+void COculusHub::CmdExecute_SysAlive(PCmdEngineExecute params)
 {
 	//Read the current time
-	uint32 seconds = CSysTick::GetSeconds();
+	uint32 seconds = (uint32)CSysTick::GetSeconds();
 
 	//Send the CmdProc ack message back
-	CCmdMsg cmdMsg;
-	cmdMsg.AddUint8(CID_SYS_ALIVE);
-	cmdMsg.AddUint32(seconds);
-	cmdMsg.AddUint8(FIRMWARE_SECTION);
-	params->CmdProc->SendMsg(&cmdMsg);
+	CCmdTxFrame tx(params->Engine->GetCom(), CID_SYS_ALIVE);
+	tx.AddUint32(seconds);
+	tx.AddUint8(FIRMWARE_SECTION);
+	tx.End();
 }
-*/
 
 /*!-----------------------------------------------------------------------------
 CmdProc function called when an CID_SYS_PROG_INFO request is issued,
 the command will return hardware/firmware details.
-
-void COculusHub::CmdExecute_SysInfo(PCmdProcExecute params)
+*/
+void COculusHub::CmdExecute_SysInfo(PCmdEngineExecute params)
 {
 	//Read the current RTC time
 	uint32 seconds = (uint32)CSysTick::GetSeconds();
@@ -316,48 +381,35 @@ void COculusHub::CmdExecute_SysInfo(PCmdProcExecute params)
 	_flashProg->ReadInfo(&info);
 
 	//Send the CmdProc ack message back
-	CCmdMsg cmdMsg;
-	cmdMsg.AddUint8(CID_SYS_INFO);
-	cmdMsg.AddUint32(seconds);
-	cmdMsg.AddUint8(FIRMWARE_SECTION);
+	CCmdTxFrame tx(params->Engine->GetCom(), CID_SYS_INFO);
+	tx.AddUint32(seconds);
+	tx.AddUint8(FIRMWARE_SECTION);
 
 	//Hardware
-	_hardware.Serialize(&cmdMsg);
+	_hardware.Serialize(&tx);
 
 	//Boot Firmware
-	info.Firmware[FLASH_SECTION_BOOT].Serialize(&cmdMsg);
+	info.Firmware[FLASH_SECTION_BOOT].Serialize(&tx);
 
 	//Main Firmware
-	info.Firmware[FLASH_SECTION_MAIN].Serialize(&cmdMsg);
+	info.Firmware[FLASH_SECTION_MAIN].Serialize(&tx);
 
-	//Send the message
-	params->CmdProc->SendMsg(&cmdMsg);
+	//Complete the message
+	tx.End();
 }
-*/
 
 /*!-----------------------------------------------------------------------------
 CmdProc function called when an CID_SYS_PROG_REBOOT request is issued,
 the command will return hardware/firmware details.
-
-void COculusHub::CmdExecute_SysReboot(PCmdProcExecute params)
+*/
+void COculusHub::CmdExecute_SysReboot(PCmdEngineExecute params)
 {
-	bool success = true;
-	uint8 status = CST_OK;
-	uint16 check;
-
 	//Send the CmdProc ack message back
-	CCmdMsg cmdMsg;
-	cmdMsg.AddUint8(CID_SYS_REBOOT);
-	cmdMsg.AddUint8(status);
-	params->CmdProc->SendMsg(&cmdMsg);
-	COM_PRINT("\r\n");
+	params->Engine->SendStatus(CID_SYS_REBOOT, CST_OK);
 
 	//Call the inheritable DoReboot method, to allow inheriting classes to shut down services
 	this->DoReboot();
 
-	//Wait for UART buffers to empty
-	//CSysTick::WaitMilliseconds(200);
-
 	//Shut down comms - wait for buffers to empty
 	_comDebug->Flush();
 	_comDebug->Close();
@@ -370,20 +422,17 @@ void COculusHub::CmdExecute_SysReboot(PCmdProcExecute params)
 
 	//This should never be executed
 }
-*/
 
 /*!-----------------------------------------------------------------------------
 Function called to send a READY message (on startup) - this is the only
 unsolicited message the thruster will send over the half-duplex link
-
+*/
 void COculusHub::CmdSend_Ready()
 {
-	CCmdMsg cmdMsg;
-	cmdMsg.AddUint8(CID_READY);
-	cmdMsg.AddUint8(FIRMWARE_SECTION);
-	_cmd->SendMsg(&cmdMsg);
+	CCmdTxFrame tx(_cmd->GetCom(), CID_READY);
+	tx.AddUint8(FIRMWARE_SECTION);
+	tx.End();
 }
-*/
 
 /*!-----------------------------------------------------------------------------
 Function that initialises the GPIO pins and clocks
@@ -539,14 +588,23 @@ Function called to start the application running
 */
 void COculusHub::Run()
 {
+	//If this program was swapped in by an update and has been reset
+	//FLASH_SWAP_TRIAL_BOOTS times without hearing from the host (see
+	//CmdExecuteEvent), swap back to the previous program
+	if(!_flashProg->SwapBootCheck())
+		REBOOT;
+
 	//Update firmware info details about the program if they don't match.
 	_flashProg->UpdateFirmwareInfo();
 
 	//Initialise the COM ports
 	_comDebug->Open();
 
+	//Start draining the deferred log
+	_dlog->ServiceStart();
+
 	//Start the command processor
-	//_cmd->ServiceStart();
+	_cmd->ServiceStart();
 
 	//Start interrupt generation (releasing the DISABLE set in the constructor)
 	IRQ_ENABLE;
@@ -1,5 +1,8 @@
 #include "oculushub_main.hpp"
 
+//Check the WIFI control port baud rate can be generated from its clock
+UART_BAUD_ASSERT(UART_WIFICTRL, UART_WIFICTRL_BAUD);
+
 //==============================================================================
 //Class Implementation...
 //==============================================================================
@@ -15,6 +18,7 @@ COculusHubMain::COculusHubMain()
 	_comWifi->Close();
 	_comWifi->SetBaudRate(UART_WIFICTRL_BAUD);
 	_comWifi->SetParity(PARITY_NONE);
+	_comWifi->SetMode(UART_WIFICTRL_MODE);
 
 	//Create a timer for the Heartbeat Alive LED
 	_tmrAlive = new CTickTimer();
@@ -62,8 +66,10 @@ void COculusHubMain::DoRun()
 	while(_run) {
 
 		//Service the command processor
-		//_cmd->Service();
+		_cmd->Service();
 
+		//Service the deferred log
+		_dlog->Service();
 
 		//Poll the alive timer, and flash the heartbeat LED
 		if(_tmrAlive->Poll()) {
@@ -77,9 +83,23 @@ Function that handles the action event from the flash programmer
 */
 void COculusHubMain::FlashProgActionEvent(PFlashProgActionParams params)
 {
+	DLOG_PRINT("FlashProg action %d\r\n", params->Action);
+
 	switch(params->Action) {
-		case FPROG_ACTION_PROG_INIT :
-		case FPROG_ACTION_PROG_UPDATE :
+		case FPROG_ACTION_PROG_INIT : {
+			//Start measuring the rate the new firmware is programmed into scratch memory
+			_flash->GetStats(NULL, true);
+			break;
+		}
+		case FPROG_ACTION_PROG_UPDATE : {
+			//Report the programming rate
+			TFlashStats stats;
+			_flash->GetStats(&stats, true);
+			DLOG_PRINT("Flash programmed %u bytes, %u commands in %u lists (%u with interrupts enabled), %u us/KB (section %u)\r\n",
+				stats.Bytes, stats.Commands, stats.Lists, stats.RwwLists, stats.GetMicrosecondsPerKb(CMcg::ClkSysFreq), _flash->GetSectionEnable());
+			DLOG_PRINT("Flash erased %u sectors, skipped %u blank sectors\r\n", stats.SectorsErased, stats.SectorsSkipped);
+			break;
+		}
 		case FPROG_ACTION_UPDATE_START : {
 			break;
 		}
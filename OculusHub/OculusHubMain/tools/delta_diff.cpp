@@ -0,0 +1,215 @@
+/*==============================================================================
+Host tool that makes a delta patch from the firmware binary installed on a unit
+to a new firmware binary, for sending with the FPROG_DATA_COMPDELTA (or
+FPROG_DATA_ENCCOMPDELTA) data format, so only the differences need to be
+transferred.
+
+The patch is compressed (as most of it is zero bytes) unless "-u" is given, for
+the FPROG_DATA_DELTA (or FPROG_DATA_ENCDELTA) format. It is checked by applying
+it again through the same decoders the firmware uses. The firmware only
+applies the patch if the checksum recorded when the base binary was programmed
+matches, so the base binary must be exactly the one sent in that update.
+
+The program length and checksum given to PROG_INIT describe the new binary, so
+are printed for the sender to use, along with the number of bytes sent for
+each way of sending it. The patch is split into blocks (and encrypted) in the
+same way as an uncompressed binary, and may be padded, as the firmware ignores
+anything after the end of the patch.
+
+Build (Linux):
+	g++ -O2 -I../../BpClasses/headers -o delta_diff delta_diff.cpp ../../BpClasses/src/delta.cpp ../../BpClasses/src/lz.cpp
+
+Usage:
+	delta_diff [-u] [-w windowSize] <installed.bin> <OculusHubMainDebug.bin> <output file>
+The window size must match FLASH_PROG_LZ_WINDOW in the firmware (default 4096).
+
+See BpClasses/headers/delta.hpp for the patch format.
+
+12/03/2018 - Created v1.0 of file
+==============================================================================*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "delta.hpp"
+#include "lz.hpp"
+
+//Default window size, that must match FLASH_PROG_LZ_WINDOW
+#define DELTA_TOOL_WINDOW		4096
+
+//Generator (reversed) polynomial of the firmware's CRC32, from crc32.hpp
+#define DELTA_TOOL_CRC32_POLY	0xEDB88320u
+
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that computes the CRC32 of a buffer bit by bit, as
+CCrc32::CalcBuffer(data, len, CRC32_GEN_POLY, 0) does in the firmware
+*/
+static uint32 Crc32(std::vector<uint8>& data)
+{
+	uint32 crc = 0;
+
+	for(uint32 i = 0; i < data.size(); i++) {
+		crc ^= data[i];
+		for(uint32 bit = 0; bit < 8; bit++)
+			crc = (crc & 1) ? ((crc >> 1) ^ DELTA_TOOL_CRC32_POLY) : (crc >> 1);
+	}
+	return crc;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that reads a whole file into a buffer
+*/
+static bool ReadFile(const char* name, std::vector<uint8>& data)
+{
+	FILE* file = fopen(name, "rb");
+	if(!file) {
+		fprintf(stderr, "Unable to open %s\n", name);
+		return false;
+	}
+	uint8 buf[4096];
+	size_t bytes;
+	while((bytes = fread(buf, 1, sizeof(buf), file)) > 0)
+		data.insert(data.end(), buf, buf + bytes);
+	fclose(file);
+	return true;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that compresses a buffer, allowing for data that doesn't compress
+*/
+static bool Compress(std::vector<uint8>& src, std::vector<uint8>& comp, uint32 windowSize)
+{
+	comp.resize(src.size() + (src.size() / 255) + 16);
+	uint32 length = CLz::Compress(src.data(), src.size(), comp.data(), comp.size(), windowSize);
+	comp.resize(length);
+	return (length > 0);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that decompresses a stream (if compressed) and applies the patch to the
+base, checking it gives the new image
+*/
+static bool Verify(std::vector<uint8>& base, std::vector<uint8>& image, std::vector<uint8>& patch, bool compressed, uint32 windowSize)
+{
+	CLzDecoder lz(windowSize);
+	CDeltaDecoder delta(DELTA_TOOL_WINDOW);
+	std::vector<uint8> plain;
+	std::vector<uint8> out;
+	puint8 data;
+	uint32 length;
+	uint32 used;
+	puint8 run;
+	uint32 runLength;
+
+	//Decompress the patch
+	if(compressed) {
+		data = patch.data();
+		length = patch.size();
+		do {
+			if(!lz.Decode(data, length, &used, &run, &runLength))
+				return false;
+			data += used;
+			length -= used;
+			plain.insert(plain.end(), run, run + runLength);
+		} while((used > 0) || (runLength > 0));
+		if(!lz.IsEnd())
+			return false;
+	}
+	else {
+		plain = patch;
+	}
+
+	//Apply the patch
+	delta.Init(base.data(), base.size(), Crc32(base), image.size());
+	data = plain.data();
+	length = plain.size();
+	do {
+		if(!delta.Decode(data, length, &used, &run, &runLength))
+			return false;
+		data += used;
+		length -= used;
+		out.insert(out.end(), run, run + runLength);
+	} while((used > 0) || (runLength > 0));
+
+	return delta.IsEnd() && (out == image);
+}
+
+/*!-----------------------------------------------------------------------------
+*/
+int main(int argc, char** argv)
+{
+	uint32 windowSize = DELTA_TOOL_WINDOW;
+	bool compressed = true;
+	int arg = 1;
+
+	while((arg < argc) && (argv[arg][0] == '-')) {
+		if(strcmp(argv[arg], "-u") == 0) {
+			compressed = false;
+			arg++;
+		}
+		else if((strcmp(argv[arg], "-w") == 0) && ((arg + 1) < argc)) {
+			windowSize = strtoul(argv[arg + 1], NULL, 0);
+			arg += 2;
+		}
+		else {
+			break;
+		}
+	}
+	if(((argc - arg) != 3) || (windowSize < 8) || (windowSize > LZ_WINDOW_MAX) || (windowSize & (windowSize - 1))) {
+		fprintf(stderr, "Usage: delta_diff [-u] [-w windowSize] <installed.bin> <new.bin> <output file>\n");
+		fprintf(stderr, "-u makes an uncompressed patch, and the window size must be a power of 2, from 8 to %u\n", LZ_WINDOW_MAX);
+		return 1;
+	}
+
+	std::vector<uint8> base;
+	std::vector<uint8> image;
+	if(!ReadFile(argv[arg], base) || !ReadFile(argv[arg + 1], image))
+		return 1;
+
+	//Make the patch, which is never much larger than the new image
+	std::vector<uint8> patch(image.size() + (image.size() / 8) + 1024);
+	uint32 patchLength = CDelta::Diff(base.data(), base.size(), Crc32(base), image.data(), image.size(), patch.data(), patch.size());
+	if(patchLength == 0) {
+		fprintf(stderr, "Unable to make the patch\n");
+		return 1;
+	}
+	patch.resize(patchLength);
+
+	//Compress the patch, and the new image for comparison
+	std::vector<uint8> patchComp;
+	std::vector<uint8> imageComp;
+	if(!Compress(patch, patchComp, windowSize) || !Compress(image, imageComp, windowSize)) {
+		fprintf(stderr, "Compression failed\n");
+		return 1;
+	}
+
+	std::vector<uint8>& output = compressed ? patchComp : patch;
+	if(!Verify(base, image, output, compressed, windowSize)) {
+		fprintf(stderr, "Patch failed to rebuild the new binary correctly\n");
+		return 1;
+	}
+
+	//Write out the patch
+	FILE* file = fopen(argv[arg + 2], "wb");
+	if(!file || (fwrite(output.data(), 1, output.size(), file) != output.size())) {
+		fprintf(stderr, "Unable to write %s\n", argv[arg + 2]);
+		return 1;
+	}
+	fclose(file);
+
+	printf("Bytes sent for the new binary...\n");
+	printf("  Binary             %8u\n", (uint32)image.size());
+	printf("  Compressed         %8u (%.2f:1)\n", (uint32)imageComp.size(), (double)image.size() / imageComp.size());
+	printf("  Delta              %8u (%.2f:1)\n", (uint32)patch.size(), (double)image.size() / patch.size());
+	printf("  Compressed delta   %8u (%.2f:1)\n", (uint32)patchComp.size(), (double)image.size() / patchComp.size());
+	printf("Installed Checksum = 0x%.8X (length %u)\n", Crc32(base), (uint32)base.size());
+	printf("Program Length     = %u\n", (uint32)image.size());
+	printf("Program Checksum   = 0x%.8X\n", Crc32(image));
+	printf("Data Format        = %s\n", compressed ? "FPROG_DATA_COMPDELTA (0x05), or FPROG_DATA_ENCCOMPDELTA (0x07)" : "FPROG_DATA_DELTA (0x04), or FPROG_DATA_ENCDELTA (0x06)");
+
+	return 0;
+}
+
+//==============================================================================
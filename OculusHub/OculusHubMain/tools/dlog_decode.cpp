@@ -0,0 +1,481 @@
+/*==============================================================================
+Host tool that decodes the deferred binary log (DLOG_PRINT) frames output by
+the firmware back into text.
+
+The format strings are read from the ".dlog_str" section of the firmware ELF
+file that produced the log, so the ELF must match the running firmware.
+Bytes that don't form a valid frame (such as normal COM_PRINT text sharing the
+same port) are passed through unchanged. Frames are escaped as SLIP frames are,
+and checked by their CRC16, so SLIP frames sharing the port are passed through
+too.
+
+Build (Linux):
+	g++ -O2 -o dlog_decode dlog_decode.cpp
+
+Usage:
+	dlog_decode [-f tickHz] <OculusHubMainDebug.elf> [capture file or serial device]
+If no capture is specified, the log is read from stdin. Serial devices should
+be configured first (i.e. "stty -F /dev/ttyUSB0 115200 raw").
+
+See BpApplication/headers/dlog.hpp for the frame format.
+
+09/03/2018 - Created v1.0 of file
+==============================================================================*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+//Definitions that must match dlog.hpp
+#define DLOG_FRAME_SYNC			0xD5
+#define DLOG_FRAME_HEADER		8
+#define DLOG_FRAME_ARGS_MAX		48
+#define DLOG_FRAME_CRC			2
+#define DLOG_FRAME_TRUNCATED	0x80
+#define DLOG_ID_DROPPED			0xFFFF
+#define DLOG_ESC_END			0xC0
+#define DLOG_ESC				0xDB
+#define DLOG_ESC_ESC_END		0xDC
+#define DLOG_ESC_ESC			0xDD
+#define DLOG_CRC_POLY			0xA001		/*!< CRC16_GEN_POLY */
+
+//Default frequency of the SysTick counter used for frame time stamps (SYSTICK_TIMER_FREQ)
+#define DLOG_TICK_FREQ			10000.0
+
+//==============================================================================
+//ELF String Table
+//==============================================================================
+static std::vector<char> g_strings;		/*!< Contents of the .dlog_str section */
+static uint32_t g_stringsAddr = 0;		/*!< Address the .dlog_str section is located at */
+
+/*!-----------------------------------------------------------------------------
+Function that reads a little endian value from a byte buffer
+*/
+static uint32_t GetLe(const uint8_t* data, uint32_t size)
+{
+	uint32_t value = 0;
+	for(uint32_t i = 0; i < size; i++)
+		value |= (uint32_t)data[i] << (i * 8);
+	return value;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that loads the .dlog_str section from a 32-bit little endian ELF file
+@param path The filename of the ELF file
+@result True if the section was found
+*/
+static bool LoadElfStrings(const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	if(!file) {
+		fprintf(stderr, "Unable to open ELF file '%s'\n", path);
+		return false;
+	}
+
+	std::vector<uint8_t> elf;
+	uint8_t buf[4096];
+	size_t read;
+	while((read = fread(buf, 1, sizeof(buf), file)) > 0)
+		elf.insert(elf.end(), buf, buf + read);
+	fclose(file);
+
+	//Check the identity is a 32-bit, little endian ELF
+	if(elf.size() < 0x34 || memcmp(&elf[0], "\x7F" "ELF", 4) != 0 || elf[4] != 1 || elf[5] != 1) {
+		fprintf(stderr, "'%s' is not a 32-bit little endian ELF file\n", path);
+		return false;
+	}
+
+	uint32_t shoff = GetLe(&elf[0x20], 4);
+	uint32_t shentsize = GetLe(&elf[0x2E], 2);
+	uint32_t shnum = GetLe(&elf[0x30], 2);
+	uint32_t shstrndx = GetLe(&elf[0x32], 2);
+	if(shstrndx >= shnum || (shoff + (shnum * shentsize)) > elf.size()) {
+		fprintf(stderr, "'%s' has an invalid section header table\n", path);
+		return false;
+	}
+
+	//Find the section name string table
+	const uint8_t* shstr = &elf[shoff + (shstrndx * shentsize)];
+	uint32_t namesOffset = GetLe(shstr + 16, 4);
+
+	//Search the sections for the log strings
+	for(uint32_t idx = 0; idx < shnum; idx++) {
+		const uint8_t* sh = &elf[shoff + (idx * shentsize)];
+		uint32_t nameOffset = namesOffset + GetLe(sh + 0, 4);
+		if(nameOffset >= elf.size() || strcmp((const char*)&elf[nameOffset], ".dlog_str") != 0)
+			continue;
+
+		uint32_t addr = GetLe(sh + 12, 4);
+		uint32_t offset = GetLe(sh + 16, 4);
+		uint32_t size = GetLe(sh + 20, 4);
+		if((offset + size) > elf.size()) {
+			fprintf(stderr, "'%s' has an invalid .dlog_str section\n", path);
+			return false;
+		}
+
+		g_strings.assign(elf.begin() + offset, elf.begin() + offset + size);
+		g_strings.push_back(0);
+		g_stringsAddr = addr;
+		return true;
+	}
+
+	fprintf(stderr, "'%s' has no .dlog_str section\n", path);
+	return false;
+}
+
+//==============================================================================
+//Frame Decoding
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that computes the CRC16 of a block of bytes, as CCrc16::Calc does
+*/
+static uint16_t Crc16(const uint8_t* data, uint32_t size)
+{
+	uint32_t crc = 0;
+	for(uint32_t i = 0; i < size; i++) {
+		crc ^= data[i];
+		for(int bit = 0; bit < 8; bit++)
+			crc = (crc & 1) ? ((crc >> 1) ^ DLOG_CRC_POLY) : (crc >> 1);
+	}
+	return (uint16_t)crc;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that removes the escapes from the start of a received frame
+@param buf The bytes received, starting with the frame
+@param size The number of frame bytes wanted
+@param frame Filled with the frame bytes
+@param used Set to the number of received bytes they were sent as
+@result 1 if the frame bytes were read, 0 if more must be received first, or
+-1 if the bytes can't be a frame (they contain DLOG_ESC_END, or a bad escape)
+*/
+static int Unescape(const std::vector<uint8_t>& buf, uint32_t size, std::vector<uint8_t>* frame, uint32_t* used)
+{
+	frame->clear();
+	uint32_t pos = 0;
+	while(frame->size() < size) {
+		if(pos >= buf.size())
+			return 0;
+		uint8_t value = buf[pos++];
+		if(value == DLOG_ESC_END)
+			return -1;
+		if(value == DLOG_ESC) {
+			if(pos >= buf.size())
+				return 0;
+			value = buf[pos++];
+			if(value == DLOG_ESC_ESC_END)
+				value = DLOG_ESC_END;
+			else if(value == DLOG_ESC_ESC)
+				value = DLOG_ESC;
+			else
+				return -1;
+		}
+		frame->push_back(value);
+	}
+	*used = pos;
+	return 1;
+}
+
+/*!-----------------------------------------------------------------------------
+Class that reads packed arguments out of a frame
+*/
+class CArgReader {
+	private:
+		const uint8_t* _data;
+		uint32_t _len;
+		uint32_t _pos;
+
+	public:
+		CArgReader(const uint8_t* data, uint32_t len) : _data(data), _len(len), _pos(0) {}
+
+		bool Read(void* value, uint32_t size) {
+			if((_pos + size) > _len)
+				return false;
+			memcpy(value, _data + _pos, size);
+			_pos += size;
+			return true;
+		}
+
+		bool ReadString(std::string* value) {
+			if(_pos >= _len || (_pos + 1 + _data[_pos]) > _len)
+				return false;
+			uint32_t size = _data[_pos];
+			value->assign((const char*)_data + _pos + 1, size);
+			_pos += 1 + size;
+			return true;
+		}
+};
+
+/*!-----------------------------------------------------------------------------
+Function that formats a log entry, using the same argument packing rules as
+CDlog in the firmware
+@param fmt The format string
+@param args Reader for the packed argument data
+@param truncated True if the firmware discarded arguments that didn't fit
+@result The formatted text
+*/
+static std::string FormatEntry(const char* fmt, CArgReader* args, bool truncated)
+{
+	std::string out;
+	char buf[512];
+
+	while(*fmt) {
+		if(*fmt != '%') {
+			out += *fmt++;
+			continue;
+		}
+
+		//Build up a host format specifier, without the length modifiers
+		std::string spec = "%";
+		fmt++;
+		while(*fmt && strchr("-0+ #", *fmt))
+			spec += *fmt++;
+
+		bool missing = false;
+		for(int part = 0; part < 2; part++) {
+			if(part == 1) {
+				if(*fmt != '.')
+					break;
+				spec += *fmt++;
+			}
+			if(*fmt == '*') {
+				int32_t value = 0;
+				missing |= !args->Read(&value, 4);
+				spec += std::to_string(value);
+				fmt++;
+			}
+			while(*fmt >= '0' && *fmt <= '9')
+				spec += *fmt++;
+		}
+
+		int size = 0;
+		while(*fmt && strchr("hljzt", *fmt)) {
+			if(*fmt == 'l') size++;
+			else if(*fmt == 'h') size--;
+			else if(*fmt == 'j') size = 2;
+			fmt++;
+		}
+
+		char conv = *fmt;
+		if(!conv)
+			break;
+		fmt++;
+
+		switch(conv) {
+			case 'd':
+			case 'i': {
+				int64_t value = 0;
+				if(size >= 2) {
+					missing |= !args->Read(&value, 8);
+				}
+				else {
+					int32_t value32 = 0;
+					missing |= !args->Read(&value32, 4);
+					value = (size == -1) ? (int16_t)value32 : ((size <= -2) ? (int8_t)value32 : value32);
+				}
+				spec += "lld";
+				snprintf(buf, sizeof(buf), spec.c_str(), (long long)value);
+				break;
+			}
+
+			case 'u':
+			case 'o':
+			case 'x':
+			case 'X': {
+				uint64_t value = 0;
+				if(size >= 2) {
+					missing |= !args->Read(&value, 8);
+				}
+				else {
+					uint32_t value32 = 0;
+					missing |= !args->Read(&value32, 4);
+					value = (size == -1) ? (uint16_t)value32 : ((size <= -2) ? (uint8_t)value32 : value32);
+				}
+				spec += "ll";
+				spec += conv;
+				snprintf(buf, sizeof(buf), spec.c_str(), (unsigned long long)value);
+				break;
+			}
+
+			case 'c': {
+				int32_t value = 0;
+				missing |= !args->Read(&value, 4);
+				spec += 'c';
+				snprintf(buf, sizeof(buf), spec.c_str(), (char)value);
+				break;
+			}
+
+			case 'p': {
+				uint32_t value = 0;
+				missing |= !args->Read(&value, 4);
+				spec += "#x";
+				snprintf(buf, sizeof(buf), spec.c_str(), value);
+				break;
+			}
+
+			case 's': {
+				std::string value;
+				missing |= !args->ReadString(&value);
+				spec += 's';
+				snprintf(buf, sizeof(buf), spec.c_str(), value.c_str());
+				break;
+			}
+
+			case 'f':
+			case 'F':
+			case 'e':
+			case 'E':
+			case 'g':
+			case 'G':
+			case 'a':
+			case 'A': {
+				double value = 0.0;
+				missing |= !args->Read(&value, 8);
+				spec += conv;
+				snprintf(buf, sizeof(buf), spec.c_str(), value);
+				break;
+			}
+
+			case '%': {
+				strcpy(buf, "%");
+				break;
+			}
+
+			default: {
+				snprintf(buf, sizeof(buf), "%c", conv);
+				break;
+			}
+		}
+
+		if(missing)
+			out += truncated ? "<truncated>" : "<missing>";
+		else
+			out += buf;
+	}
+
+	return out;
+}
+
+//==============================================================================
+//Main
+//==============================================================================
+int main(int argc, char** argv)
+{
+	double tickFreq = DLOG_TICK_FREQ;
+	int arg = 1;
+
+	//Parse options
+	if(arg + 1 < argc && strcmp(argv[arg], "-f") == 0) {
+		tickFreq = atof(argv[arg + 1]);
+		arg += 2;
+	}
+	if(arg >= argc || tickFreq <= 0.0) {
+		fprintf(stderr, "Usage: %s [-f tickHz] <firmware.elf> [capture file or serial device]\n", argv[0]);
+		return 1;
+	}
+
+	if(!LoadElfStrings(argv[arg]))
+		return 1;
+	arg++;
+
+	FILE* input = stdin;
+	if(arg < argc) {
+		input = fopen(argv[arg], "rb");
+		if(!input) {
+			fprintf(stderr, "Unable to open '%s'\n", argv[arg]);
+			return 1;
+		}
+	}
+
+	std::vector<uint8_t> buf;
+	std::vector<uint8_t> frame;
+	uint64_t ticksHigh = 0;
+	uint32_t ticksLast = 0;
+	bool lineStart = true;
+	int ch;
+
+	while((ch = fgetc(input)) != EOF) {
+		buf.push_back((uint8_t)ch);
+
+		//Process as much of the buffer as possible
+		while(!buf.empty()) {
+			if(buf[0] != DLOG_FRAME_SYNC) {
+				//Pass through text that isn't part of a frame
+				fputc(buf[0], stdout);
+				lineStart = (buf[0] == '\n');
+				buf.erase(buf.begin());
+				continue;
+			}
+
+			//Wait for the length, then the whole frame
+			uint32_t used = 0;
+			int status = Unescape(buf, 2, &frame, &used);
+			if(status == 0)
+				break;
+			uint32_t len = 0;
+			uint32_t size = 0;
+			bool valid = (status > 0);
+			if(valid) {
+				len = frame[1] & ~DLOG_FRAME_TRUNCATED;
+				size = DLOG_FRAME_HEADER + len + DLOG_FRAME_CRC;
+				valid = (len <= DLOG_FRAME_ARGS_MAX);
+			}
+			if(valid) {
+				status = Unescape(buf, size, &frame, &used);
+				if(status == 0)
+					break;
+				valid = (status > 0);
+			}
+
+			//Validate the CRC and string ID
+			uint32_t id = 0;
+			if(valid) {
+				uint32_t crc = GetLe(&frame[size - DLOG_FRAME_CRC], DLOG_FRAME_CRC);
+				id = GetLe(&frame[2], 2);
+				valid = (Crc16(&frame[1], size - 1 - DLOG_FRAME_CRC) == crc) && (id == DLOG_ID_DROPPED || (id >= g_stringsAddr && (id - g_stringsAddr) < g_strings.size()));
+			}
+
+			if(!valid) {
+				//Not a frame, so pass the sync byte through as text and search again
+				fputc(buf[0], stdout);
+				buf.erase(buf.begin());
+				continue;
+			}
+
+			//Unwrap the 32-bit tick count
+			uint32_t ticks = GetLe(&frame[4], 4);
+			if(ticks < ticksLast)
+				ticksHigh += 0x100000000ULL;
+			ticksLast = ticks;
+
+			CArgReader args(&frame[DLOG_FRAME_HEADER], len);
+			std::string text;
+			if(id == DLOG_ID_DROPPED) {
+				uint32_t dropped = 0;
+				args.Read(&dropped, 4);
+				text = "<" + std::to_string(dropped) + " log entries dropped>\r\n";
+			}
+			else {
+				text = FormatEntry(&g_strings[id - g_stringsAddr], &args, (frame[1] & DLOG_FRAME_TRUNCATED) != 0);
+			}
+
+			//Time stamp entries that start a new line
+			if(lineStart)
+				fprintf(stdout, "[%10.4fs] ", (double)(ticksHigh + ticks) / tickFreq);
+			fputs(text.c_str(), stdout);
+			if(!text.empty())
+				lineStart = (text[text.size() - 1] == '\n');
+
+			buf.erase(buf.begin(), buf.begin() + used);
+		}
+		fflush(stdout);
+	}
+
+	if(input != stdin)
+		fclose(input);
+	return 0;
+}
+
+//==============================================================================
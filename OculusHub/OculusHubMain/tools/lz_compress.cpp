@@ -0,0 +1,138 @@
+/*==============================================================================
+Host tool that compresses a firmware binary for sending with the
+FPROG_DATA_COMPRESSED (or FPROG_DATA_ENCCOMP) data format, so fewer bytes need
+to be transferred.
+
+The compressed stream is checked by decompressing it again through the same
+decoder the firmware uses. The program length and checksum given to PROG_INIT
+describe the uncompressed binary, so are printed for the sender to use. The
+stream is split into blocks (and encrypted for FPROG_DATA_ENCCOMP) in the same
+way as an uncompressed binary, and may be padded, as the firmware ignores
+anything after the end of the stream.
+
+Build (Linux):
+	g++ -O2 -I../../BpClasses/headers -o lz_compress lz_compress.cpp ../../BpClasses/src/lz.cpp
+
+Usage:
+	lz_compress [-w windowSize] <OculusHubMainDebug.bin> <output file>
+The window size must match FLASH_PROG_LZ_WINDOW in the firmware (default 4096).
+
+See BpClasses/headers/lz.hpp for the stream format.
+
+11/03/2018 - Created v1.0 of file
+==============================================================================*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "lz.hpp"
+#include "crc32.hpp"
+
+//Default window size, that must match FLASH_PROG_LZ_WINDOW
+#define LZ_TOOL_WINDOW		4096
+
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that computes the CRC32 of a buffer bit by bit, as
+CCrc32::CalcBuffer(data, len, CRC32_GEN_POLY, 0) does in the firmware (which
+builds its lookup tables for a 32-bit target)
+*/
+static uint32 Crc32(puint8 data, uint32 len)
+{
+	uint32 crc = 0;
+
+	for(uint32 i = 0; i < len; i++) {
+		crc ^= data[i];
+		for(uint32 bit = 0; bit < 8; bit++)
+			crc = (crc & 1) ? ((crc >> 1) ^ CRC32_GEN_POLY) : (crc >> 1);
+	}
+	return crc;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that decompresses a stream and checks it matches the original data
+*/
+static bool Verify(std::vector<uint8>& src, std::vector<uint8>& comp, uint32 windowSize)
+{
+	CLzDecoder decoder(windowSize);
+	puint8 data = comp.data();
+	uint32 length = comp.size();
+	uint32 pos = 0;
+	uint32 used;
+	puint8 out;
+	uint32 outLength;
+
+	do {
+		if(!decoder.Decode(data, length, &used, &out, &outLength))
+			return false;
+		data += used;
+		length -= used;
+		if(((pos + outLength) > src.size()) || (memcmp(&src[pos], out, outLength) != 0))
+			return false;
+		pos += outLength;
+	} while((used > 0) || (outLength > 0));
+
+	return decoder.IsEnd() && (pos == src.size());
+}
+
+/*!-----------------------------------------------------------------------------
+*/
+int main(int argc, char** argv)
+{
+	uint32 windowSize = LZ_TOOL_WINDOW;
+	int arg = 1;
+
+	if((argc > 2) && (strcmp(argv[1], "-w") == 0)) {
+		windowSize = strtoul(argv[2], NULL, 0);
+		arg += 2;
+	}
+	if(((argc - arg) != 2) || (windowSize < 8) || (windowSize > LZ_WINDOW_MAX) || (windowSize & (windowSize - 1))) {
+		fprintf(stderr, "Usage: lz_compress [-w windowSize] <input.bin> <output file>\n");
+		fprintf(stderr, "The window size must be a power of 2, from 8 to %u\n", LZ_WINDOW_MAX);
+		return 1;
+	}
+
+	//Read in the binary
+	FILE* file = fopen(argv[arg], "rb");
+	if(!file) {
+		fprintf(stderr, "Unable to open %s\n", argv[arg]);
+		return 1;
+	}
+	std::vector<uint8> src;
+	uint8 buf[4096];
+	size_t bytes;
+	while((bytes = fread(buf, 1, sizeof(buf), file)) > 0)
+		src.insert(src.end(), buf, buf + bytes);
+	fclose(file);
+
+	//Compress it, allowing for data that doesn't compress
+	std::vector<uint8> comp(src.size() + (src.size() / 255) + 16);
+	uint32 compLength = CLz::Compress(src.data(), src.size(), comp.data(), comp.size(), windowSize);
+	if(compLength == 0) {
+		fprintf(stderr, "Compression failed\n");
+		return 1;
+	}
+	comp.resize(compLength);
+
+	if(!Verify(src, comp, windowSize)) {
+		fprintf(stderr, "Compressed stream failed to decompress correctly\n");
+		return 1;
+	}
+
+	//Write out the compressed stream
+	file = fopen(argv[arg + 1], "wb");
+	if(!file || (fwrite(comp.data(), 1, comp.size(), file) != comp.size())) {
+		fprintf(stderr, "Unable to write %s\n", argv[arg + 1]);
+		return 1;
+	}
+	fclose(file);
+
+	printf("Compressed %u bytes to %u bytes (%.2f:1), window %u\n", (uint32)src.size(), compLength, (double)src.size() / compLength, windowSize);
+	printf("Program Length   = %u\n", (uint32)src.size());
+	printf("Program Checksum = 0x%.8X\n", Crc32(src.data(), src.size()));
+
+	return 0;
+}
+
+//==============================================================================
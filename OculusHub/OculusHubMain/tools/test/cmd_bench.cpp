@@ -0,0 +1,463 @@
+/*==============================================================================
+Host benchmark of the CCmdEngine command engine, talking to a host client over
+a pseudo-terminal, as it would over the debug serial port.
+
+The engine runs its service in a thread of its own, on a CCom whose transmit
+ring is drained into the pseudo-terminal between service calls (as the UART
+would drain it). The client measures...
+	- the latency of CID_SYS_ALIVE round trips, sending each request only once
+	  the previous response has arrived,
+	- the throughput of CID_PROG_BLOCK sized requests (128 bytes of parameters,
+	  covering every byte value so SLIP escaping is exercised), stop-and-wait
+	  and pipelined with several requests outstanding.
+Every response is checked to be in order and correct, and a corrupted frame
+sent in the middle of a pipeline is checked to be answered in its place with
+a CID_ERROR response.
+
+The figures are for the host and kernel's pseudo-terminal, so show how the
+engine behaves (and that pipelining hides the round trip), rather than how
+fast the target is.
+
+Build and run with run_tests.sh, or (Linux x86-64, from OculusHub):
+	g++ -O1 -no-pie -std=gnu++11 -fno-rtti -fno-exceptions -fpermissive -w
+		-Dinterrupt= '-D__asm(x)=' -pthread
+		-IBpClasses/headers -IBpApplication/headers -IBpDevices_K60/headers
+		-IOculusHub/headers -IOculusHubMain/headers
+		-o cmd_bench OculusHubMain/tools/test/cmd_bench.cpp
+		BpApplication/src/cmd_engine.cpp BpApplication/src/service.cpp
+		BpApplication/src/ticktimer.cpp BpClasses/src/crc16.cpp
+		BpClasses/src/serialize.cpp BpDevices_K60/src/com.cpp
+
+14/03/2018 - Created v1.0 of file
+==============================================================================*/
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "host_model.hpp"
+#include "systick_model.hpp"
+#include "cmd_engine.hpp"
+#include "cmd_defs.h"
+
+//Included after the firmware headers, as termios defines register names (CR0...)
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#define BENCH_TX_RING			512			/*!< Size of the modelled transmit ring, as UART_DEBUG_TX_BUFFER */
+#define BENCH_FRAME_SIZE		(128 + 16)	/*!< Largest decoded frame the engine accepts */
+#define BENCH_BLOCK_SIZE		128			/*!< Parameter bytes in each block request */
+#define BENCH_ALIVES			2000
+#define BENCH_BLOCKS			4000
+#define BENCH_WINDOW			16			/*!< Requests outstanding when pipelined */
+#define BENCH_TIMEOUT_MS		2000
+
+//==============================================================================
+//Models
+//==============================================================================
+/*!
+Class of com port on the slave side of a pseudo-terminal, with a transmit ring
+that is drained into the terminal by Flush
+*/
+class CComPty : public CCom {
+	private:
+		int _fd;
+		std::vector<uint8> _tx;
+
+	public:
+		CComPty(int fd) { _fd = fd; }
+
+		void Clear(bool rx, bool tx) { if(tx) _tx.clear(); }
+		void Close(void) {}
+		uint32 GetTxBufferCount() { return _tx.size(); }
+		uint32 GetTxBufferFree() { return BENCH_TX_RING - _tx.size(); }
+		bool IsOpen(void) { return true; }
+		bool Open(void) { return true; }
+		void WriteByte(uint8 data) { this->WriteBlock(&data, 1); }
+
+		uint32 GetRxBufferCount() {
+			int count = 0;
+			ioctl(_fd, FIONREAD, &count);
+			return (uint32)count;
+		}
+
+		uint32 ReadBlock(puint8 pBuf, uint32 count) {
+			ssize_t len = read(_fd, pBuf, count);
+			return (len > 0) ? (uint32)len : 0;
+		}
+
+		uint8 ReadByte() {
+			uint8 data = 0;
+			this->ReadBlock(&data, 1);
+			return data;
+		}
+
+		void WriteBlock(puint8 pBuf, uint32 count) {
+			_tx.insert(_tx.end(), pBuf, pBuf + count);
+		}
+
+		//Sends as much of the transmit ring as the terminal will take
+		void Flush(void) {
+			if(_tx.empty())
+				return;
+			ssize_t len = write(_fd, _tx.data(), _tx.size());
+			if(len > 0)
+				_tx.erase(_tx.begin(), _tx.begin() + len);
+		}
+};
+
+/*!
+Class that handles the benchmark's commands, through a dispatch table as the
+application does
+*/
+class CBenchDevice {
+	public:
+		static const TCmdEngineEntry<CBenchDevice> CmdTable[];
+
+		void CmdExecuteEvent(PCmdEngineExecute params);
+
+		//Replies to an alive request with a status
+		void CmdExecute_SysAlive(PCmdEngineExecute params) {
+			params->Engine->SendStatus(params->Id, CST_OK);
+		}
+
+		//Replies to a block with a status, the block's sequence number and the sum of its data
+		void CmdExecute_ProgBlock(PCmdEngineExecute params) {
+			uint16 seq = 0;
+			params->Msg->ReadUint16(&seq, 0);
+			uint32 len = params->Msg->GetReadFree();
+			puint8 data = params->Msg->GetReadPtr(len);
+			uint32 sum = 0;
+			for(uint32 idx = 0; idx < len; idx++)
+				sum += data[idx];
+
+			CCmdTxFrame tx(params->Engine->GetCom(), params->Id);
+			tx.AddUint8(CST_OK);
+			tx.AddUint16(seq);
+			tx.AddUint32(sum);
+			tx.End();
+		}
+};
+
+const TCmdEngineEntry<CBenchDevice> CBenchDevice::CmdTable[] = {
+	{ CID_SYS_ALIVE, &CBenchDevice::CmdExecute_SysAlive },
+	{ CID_PROG_BLOCK, &CBenchDevice::CmdExecute_ProgBlock }
+};
+
+void CBenchDevice::CmdExecuteEvent(PCmdEngineExecute params)
+{
+	params->Handled = CCmdEngine::Dispatch(this, CmdTable, sizeof(CmdTable) / sizeof(CmdTable[0]), params);
+}
+
+static std::atomic<bool> deviceStop(false);
+
+/*!-----------------------------------------------------------------------------
+Function that runs the device's main loop, servicing the engine and draining
+its transmit ring, and waiting on the terminal when there's nothing to do
+*/
+static void DeviceLoop(CCmdEngine* engine, CComPty* com, int fd)
+{
+	while(!deviceStop) {
+		bool busy = engine->Service();
+		com->Flush();
+		if(!busy) {
+			struct pollfd pfd;
+			pfd.fd = fd;
+			pfd.events = POLLIN | ((com->GetTxBufferCount() > 0) ? POLLOUT : 0);
+			poll(&pfd, 1, 1);
+		}
+	}
+}
+
+//==============================================================================
+//Client
+//==============================================================================
+static int clientFd;
+static std::vector<uint8> clientRx;
+static bool clientEsc = false;
+
+/*!-----------------------------------------------------------------------------
+Function that SLIP encodes a request frame, with its CRC, onto a buffer
+*/
+static void Encode(std::vector<uint8>* out, TCmdId id, puint8 data, uint32 len)
+{
+	std::vector<uint8> frame;
+	frame.push_back(id);
+	frame.insert(frame.end(), data, data + len);
+	uint16 crc = CCrc16::Calc(frame.data(), 0, frame.size());
+	frame.push_back((uint8)crc);
+	frame.push_back((uint8)(crc >> 8));
+
+	out->push_back(CMD_SLIP_END);
+	for(uint32 idx = 0; idx < frame.size(); idx++) {
+		uint8 ch = frame[idx];
+		if(ch == CMD_SLIP_END) {
+			out->push_back(CMD_SLIP_ESC);
+			out->push_back(CMD_SLIP_ESC_END);
+		}
+		else if(ch == CMD_SLIP_ESC) {
+			out->push_back(CMD_SLIP_ESC);
+			out->push_back(CMD_SLIP_ESC_ESC);
+		}
+		else {
+			out->push_back(ch);
+		}
+	}
+	out->push_back(CMD_SLIP_END);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that writes bytes to the terminal, waiting for it to take them all
+*/
+static void Send(const std::vector<uint8>& data)
+{
+	uint32 pos = 0;
+	while(pos < data.size()) {
+		ssize_t len = write(clientFd, data.data() + pos, data.size() - pos);
+		if(len > 0) {
+			pos += len;
+		}
+		else {
+			struct pollfd pfd = { clientFd, POLLOUT, 0 };
+			poll(&pfd, 1, BENCH_TIMEOUT_MS);
+		}
+	}
+}
+
+/*!-----------------------------------------------------------------------------
+Function that decodes received bytes until a whole response has arrived,
+checking its CRC and returning its ID and data.
+@param wait True to wait for a response, false to only decode what has arrived
+@result True if a response with a good CRC was decoded
+*/
+static bool Receive(std::vector<uint8>* frame, bool wait)
+{
+	static uint8 buf[4096];
+	static uint32 bufIdx = 0;
+	static uint32 bufLen = 0;
+
+	for(;;) {
+		if(bufIdx >= bufLen) {
+			ssize_t len = read(clientFd, buf, sizeof(buf));
+			if(len <= 0) {
+				if(!wait)
+					return false;
+				struct pollfd pfd = { clientFd, POLLIN, 0 };
+				if(poll(&pfd, 1, BENCH_TIMEOUT_MS) <= 0) {
+					printf("FAIL timed out waiting for a response\n");
+					g_fails++;
+					return false;
+				}
+				continue;
+			}
+			bufIdx = 0;
+			bufLen = len;
+		}
+
+		uint8 ch = buf[bufIdx++];
+		if(ch == CMD_SLIP_END) {
+			if(clientRx.size() < CMD_FRAME_OVERHEAD) {
+				clientRx.clear();
+				continue;
+			}
+			uint32 len = clientRx.size() - CRC16_LEN;
+			uint16 crc = clientRx[len] | (clientRx[len + 1] << 8);
+			bool good = (CCrc16::Calc(clientRx.data(), 0, len) == crc);
+			frame->assign(clientRx.begin(), clientRx.begin() + len);
+			clientRx.clear();
+			CHECK(good);
+			return good;
+		}
+		else if(clientEsc) {
+			clientEsc = false;
+			clientRx.push_back((ch == CMD_SLIP_ESC_END) ? CMD_SLIP_END : CMD_SLIP_ESC);
+		}
+		else if(ch == CMD_SLIP_ESC) {
+			clientEsc = true;
+		}
+		else {
+			clientRx.push_back(ch);
+		}
+	}
+}
+
+/*!-----------------------------------------------------------------------------
+Function that builds the request for a block
+*/
+static void BlockRequest(std::vector<uint8>* out, uint16 seq, uint32* sum)
+{
+	uint8 data[2 + BENCH_BLOCK_SIZE];
+	data[0] = (uint8)seq;
+	data[1] = (uint8)(seq >> 8);
+	*sum = 0;
+	for(uint32 idx = 0; idx < BENCH_BLOCK_SIZE; idx++) {
+		data[2 + idx] = (uint8)((seq * 3) + idx);
+		*sum += data[2 + idx];
+	}
+	Encode(out, CID_PROG_BLOCK, data, sizeof(data));
+}
+
+/*!-----------------------------------------------------------------------------
+Function that checks a block response
+*/
+static void BlockCheck(const std::vector<uint8>& frame, uint16 seq, uint32 sum)
+{
+	CHECK(frame.size() == 8);
+	if(frame.size() != 8)
+		return;
+	uint16 gotSeq = frame[2] | (frame[3] << 8);
+	uint32 gotSum;
+	memcpy(&gotSum, &frame[4], 4);
+	CHECK(frame[0] == CID_PROG_BLOCK);
+	CHECK(frame[1] == CST_OK);
+	CHECK(gotSeq == seq);
+	CHECK(gotSum == sum);
+}
+
+//==============================================================================
+//Benchmarks
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that measures the round trip latency of alive requests
+*/
+static void BenchLatency()
+{
+	std::vector<double> times;
+	std::vector<uint8> request, frame;
+	Encode(&request, CID_SYS_ALIVE, NULL, 0);
+
+	for(uint32 idx = 0; idx < BENCH_ALIVES; idx++) {
+		double start = HostTimeUs();
+		Send(request);
+		if(!Receive(&frame, true))
+			return;
+		times.push_back(HostTimeUs() - start);
+		CHECK(frame.size() == 2 && frame[0] == CID_SYS_ALIVE && frame[1] == CST_OK);
+	}
+
+	std::sort(times.begin(), times.end());
+	double total = 0;
+	for(uint32 idx = 0; idx < times.size(); idx++)
+		total += times[idx];
+	printf("latency alive: mean %.1f us, median %.1f us, 99%% %.1f us\n",
+		total / times.size(), times[times.size() / 2], times[(times.size() * 99) / 100]);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that measures the throughput of block requests, with a number of
+requests outstanding, returning the blocks per second
+*/
+static double BenchBlocks(uint32 window)
+{
+	std::vector<uint8> request, frame;
+	std::vector<uint32> sums(BENCH_BLOCKS);
+	uint32 sent = 0;
+	uint32 received = 0;
+
+	double start = HostTimeUs();
+	while(received < BENCH_BLOCKS) {
+		//Keep the window full
+		while((sent < BENCH_BLOCKS) && ((sent - received) < window)) {
+			request.clear();
+			BlockRequest(&request, (uint16)sent, &sums[sent]);
+			Send(request);
+			sent++;
+		}
+
+		//Take each response that has arrived, waiting only when nothing has
+		bool wait = true;
+		while(received < sent) {
+			if(!Receive(&frame, wait)) {
+				if(wait)
+					return 0;
+				break;
+			}
+			BlockCheck(frame, (uint16)received, sums[received]);
+			received++;
+			wait = false;
+		}
+	}
+	double us = HostTimeUs() - start;
+
+	double rate = BENCH_BLOCKS / (us / 1e6);
+	printf("blocks window %2u: %.0f blocks/s, %.1f KB/s of block data, %.1f us per block\n",
+		window, rate, (rate * BENCH_BLOCK_SIZE) / 1024, us / BENCH_BLOCKS);
+	return rate;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that checks a corrupted request in the middle of a pipeline is
+answered in its place, and the requests around it still are
+*/
+static void TestCorrupt()
+{
+	std::vector<uint8> data, frame;
+	uint32 sums[3];
+
+	BlockRequest(&data, 100, &sums[0]);
+	std::vector<uint8> bad;
+	BlockRequest(&bad, 101, &sums[1]);
+	bad[10] ^= 0x01;
+	data.insert(data.end(), bad.begin(), bad.end());
+	BlockRequest(&data, 102, &sums[2]);
+	Send(data);
+
+	Receive(&frame, true);
+	BlockCheck(frame, 100, sums[0]);
+	Receive(&frame, true);
+	CHECK(frame.size() == 3);
+	CHECK(frame[0] == CID_ERROR);
+	CHECK(frame[1] == CST_CMD_CSUM_ERROR);
+	Receive(&frame, true);
+	BlockCheck(frame, 102, sums[2]);
+	printf("corrupt: request answered with an error in place, pipeline carried on\n");
+}
+
+//==============================================================================
+int main(int argc, char** argv)
+{
+	//Open a pseudo-terminal, with the device on the raw slave side
+	clientFd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if((clientFd < 0) || grantpt(clientFd) || unlockpt(clientFd)) {
+		perror("posix_openpt");
+		return 1;
+	}
+	int deviceFd = open(ptsname(clientFd), O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if(deviceFd < 0) {
+		perror("open");
+		return 1;
+	}
+	struct termios tio;
+	tcgetattr(deviceFd, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(deviceFd, TCSANOW, &tio);
+	tcgetattr(clientFd, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(clientFd, TCSANOW, &tio);
+
+	CComPty* com = new CComPty(deviceFd);
+	CBenchDevice* device = new CBenchDevice();
+	CCmdEngine* engine = new CCmdEngine(com, BENCH_FRAME_SIZE);
+	engine->OnExecute.Set(device, &CBenchDevice::CmdExecuteEvent);
+	engine->ServiceStart();
+	std::thread thread(DeviceLoop, engine, com, deviceFd);
+
+	BenchLatency();
+	double single = BenchBlocks(1);
+	double piped = BenchBlocks(BENCH_WINDOW);
+	printf("blocks pipelining speedup: %.1fx\n", piped / single);
+	CHECK(piped > single);
+	TestCorrupt();
+
+	deviceStop = true;
+	thread.join();
+	delete engine;
+	delete device;
+	delete com;
+	close(deviceFd);
+	close(clientFd);
+	return HostResult();
+}
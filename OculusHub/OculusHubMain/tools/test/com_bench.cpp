@@ -0,0 +1,243 @@
+/*==============================================================================
+Host benchmark of the CCom write paths, through a CComUart on the register
+model of UART0 (see uart_model.hpp).
+
+The bulk WriteBlock path (used by Write and WriteString) is measured writing
+64 bytes at a time, against writing the same data a byte at a time through
+the virtual WriteByte. The speeds are measured with the register pages left
+open (so register accesses cost no more than memory accesses) and with nothing
+draining the transmit buffer, which is cleared between passes. The register
+accesses each path makes per 256 bytes are then counted with the pages trapped.
+
+CCom::Print, which formats straight into the transmit buffer, is measured in
+cycles (from the host's time stamp counter) per typical COM_PRINT line, taking
+the best of several alternating rounds to reduce the host's noise, against the
+path it replaced, which built a std::string from the format, ran
+vsnprintf into a 256 byte stack buffer, then measured and wrote that.
+
+Build and run with run_tests.sh, or (Linux x86-64, from OculusHub):
+	g++ -O1 -no-pie -std=gnu++11 -fno-rtti -fno-exceptions -fpermissive -w
+		-Dinterrupt= '-D__asm(x)=' -DUART0_CONNECT_IRQ=true -DUART0_CONNECT_DMA=true
+		-IBpClasses/headers -IBpDevices_K60/headers -IOculusHub/headers -IOculusHubMain/headers
+		-o com_bench OculusHubMain/tools/test/com_bench.cpp
+		BpDevices_K60/src/com_uart.cpp BpDevices_K60/src/com.cpp
+
+14/03/2018 - Created v1.0 of file
+==============================================================================*/
+#include <stdarg.h>
+#include <x86intrin.h>
+#include <string>
+
+#include "uart_model.hpp"
+
+#define BENCH_BUFFER_SIZE		65536
+#define BENCH_PASS_SIZE			16384
+#define BENCH_PASSES			400
+#define BENCH_WRITE_SIZE		64
+#define BENCH_PRINTS			40000
+#define BENCH_PRINT_ROUNDS		5
+
+static uint8 benchData[BENCH_PASS_SIZE];
+
+/*!-----------------------------------------------------------------------------
+Function that writes a pass a byte at a time
+*/
+static void WriteBytes(PCom com, puint8 data, uint32 count)
+{
+	for(uint32 idx = 0; idx < count; idx++)
+		com->WriteByte(data[idx]);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that writes a pass as blocks the size of a typical print
+*/
+static void WriteBlock(PCom com, puint8 data, uint32 count)
+{
+	for(uint32 idx = 0; idx < count; idx += BENCH_WRITE_SIZE)
+		com->Write(data + idx, BENCH_WRITE_SIZE);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that measures a write path, returning its speed in MB/s
+*/
+static double BenchWrite(CComUart* uart, void (*write)(PCom, puint8, uint32), const char* name)
+{
+	ModelProtect(false);
+	double start = HostTimeUs();
+	for(uint32 pass = 0; pass < BENCH_PASSES; pass++) {
+		write(uart, benchData, BENCH_PASS_SIZE);
+		CHECK(uart->GetTxBufferCount() == BENCH_PASS_SIZE);
+		uart->Clear(false, true);
+	}
+	double us = HostTimeUs() - start;
+
+	//Count the register accesses made writing 256 bytes
+	ModelProtect(true);
+	modelAccesses = 0;
+	write(uart, benchData, 256);
+	uint32 accesses = modelAccesses;
+	uart->Clear(false, true);
+
+	double mbs = ((double)BENCH_PASS_SIZE * BENCH_PASSES) / us;
+	printf("write %-6s: %8.1f MB/s, %4u register accesses per 256 bytes\n", name, mbs, accesses);
+	return mbs;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that prints as CCom::Print did before formatting into the buffer
+*/
+static void OldPrint(PCom com, std::string str, ...)
+{
+	va_list args;
+	va_start(args, str);
+	if(com->IsOpen()) {
+		char buf[256];
+		vsnprintf(buf, sizeof(buf), (char*)str.c_str(), args);
+		uint32 len = strlen(buf);
+		com->WriteBlock((puint8)buf, len);
+	}
+	va_end(args);
+}
+
+/*! Enumeration of the lines printed by the benchmark */
+enum EBenchPrint {
+	BENCH_PRINT_TIME = 0,
+	BENCH_PRINT_INTS = 1,
+	BENCH_PRINT_STRING = 2,
+	BENCH_PRINTS_COUNT = 3
+};
+
+static const char* benchPrintNames[BENCH_PRINTS_COUNT] = { "time", "ints", "string" };
+
+/*!-----------------------------------------------------------------------------
+Function that prints a typical line, through the old or new path
+*/
+static void PrintLine(PCom com, bool old, EBenchPrint line, uint32 idx)
+{
+	double secs = idx * 0.0123;
+	const char* name = "SeaTrac";
+
+	switch(line) {
+		case BENCH_PRINT_TIME:
+			if(old)
+				OldPrint(com, "[%7.1fs] ", secs);
+			else
+				com->Print("[%7.1fs] ", secs);
+			break;
+		case BENCH_PRINT_INTS:
+			if(old)
+				OldPrint(com, "Flash: %u bytes at 0x%08X, result %d\r\n", idx, idx * 4, -(int32)(idx & 7));
+			else
+				com->Print("Flash: %u bytes at 0x%08X, result %d\r\n", idx, idx * 4, -(int32)(idx & 7));
+			break;
+		default:
+			if(old)
+				OldPrint(com, "Connected to %s on port %u\r\n", name, idx & 3);
+			else
+				com->Print("Connected to %s on port %u\r\n", name, idx & 3);
+			break;
+	}
+}
+
+/*!-----------------------------------------------------------------------------
+Function that measures a print path, returning the cycles per line
+*/
+static double BenchPrint(CComUart* uart, bool old, EBenchPrint line)
+{
+	ModelProtect(false);
+	uint64 cycles = 0;
+	for(uint32 idx = 0; idx < BENCH_PRINTS; idx++) {
+		uint64 start = __rdtsc();
+		PrintLine(uart, old, line, idx);
+		cycles += __rdtsc() - start;
+
+		if(uart->GetTxBufferCount() > (BENCH_BUFFER_SIZE / 2))
+			uart->Clear(false, true);
+	}
+	uart->Clear(false, true);
+	ModelProtect(true);
+	return (double)cycles / BENCH_PRINTS;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that checks both print paths send the same text
+*/
+static void CheckPrint(CComUart* uart, EBenchPrint line)
+{
+	std::vector<uint8> text[2];
+
+	for(uint32 path = 0; path < 2; path++) {
+		modelLineOut.clear();
+		PrintLine(uart, path == 0, line, 1234);
+		ModelRun();
+		text[path] = modelLineOut;
+	}
+	printf("print %-6s: %.*s\n", benchPrintNames[line], (int)strcspn((char*)text[1].data(), "\r\n"), (char*)text[1].data());
+	CHECK(text[0].size() > 0);
+	CHECK(text[0] == text[1]);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that checks lines longer than the print chunk are sent whole and in
+order (against the host's snprintf, as the old path truncated them)
+*/
+static void CheckPrintLong(CComUart* uart)
+{
+	static const char* text = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ+-";
+	char expect[512];
+	snprintf(expect, sizeof(expect), "%s|%-70s|%080d|%s%s\r\n", text, "left", -42, text, text);
+
+	modelLineOut.clear();
+	uart->Print("%s|%-70s|%080d|%s%s\r\n", text, "left", -42, text, text);
+	ModelRun();
+	printf("print long  : %u characters\n", (uint32)modelLineOut.size());
+	CHECK(strlen(expect) > (COM_PRINT_CHUNK_SIZE * 4));
+	CHECK(modelLineOut == std::vector<uint8>(expect, expect + strlen(expect)));
+}
+
+//==============================================================================
+int main(int argc, char** argv)
+{
+	ModelInit();
+	ModelReset();
+
+	for(uint32 idx = 0; idx < BENCH_PASS_SIZE; idx++)
+		benchData[idx] = (uint8)('A' + (idx % 26));
+
+	CComUart* uart = new CComUart(0, 1024, BENCH_BUFFER_SIZE);
+	uart->SetBaudRate(BAUD_921600);
+	CHECK(uart->Open());
+
+	double bytes = BenchWrite(uart, WriteBytes, "byte");
+	double block = BenchWrite(uart, WriteBlock, "block");
+	printf("write block speedup: %.1fx\n", block / bytes);
+	CHECK(block > bytes);
+
+	CheckPrintLong(uart);
+
+	//The host's vsnprintf is far quicker than newlib's, and close to the new
+	//path for integer-only lines, so only the mix of lines is checked
+	double oldTotal = 0;
+	double newTotal = 0;
+	for(uint32 line = 0; line < BENCH_PRINTS_COUNT; line++) {
+		CheckPrint(uart, (EBenchPrint)line);
+		double oldCycles = 1e9;
+		double newCycles = 1e9;
+		for(uint32 round = 0; round < BENCH_PRINT_ROUNDS; round++) {
+			double cycles = BenchPrint(uart, true, (EBenchPrint)line);
+			if(cycles < oldCycles)
+				oldCycles = cycles;
+			cycles = BenchPrint(uart, false, (EBenchPrint)line);
+			if(cycles < newCycles)
+				newCycles = cycles;
+		}
+		printf("print %-6s: %6.0f cycles, was %6.0f cycles (%.1fx)\n", benchPrintNames[line], newCycles, oldCycles, oldCycles / newCycles);
+		oldTotal += oldCycles;
+		newTotal += newCycles;
+	}
+	printf("print speedup: %.1fx\n", oldTotal / newTotal);
+	CHECK(newTotal < oldTotal);
+
+	delete uart;
+	return HostResult();
+}
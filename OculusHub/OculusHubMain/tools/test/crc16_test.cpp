@@ -0,0 +1,165 @@
+/*==============================================================================
+Host test and benchmark of CCrc16.
+
+The compile time generated tables and the slice-by-4 path are checked against
+reference vectors (CRC-16/ARC, and CRC-16/MODBUS which starts from all ones),
+and against a bit by bit reference for random offsets, lengths and starting
+values. The speed is measured against the byte at a time table lookup that
+used the RAM table filled by CCrc16::Init.
+
+Build and run with run_tests.sh, or (Linux, from OculusHub):
+	g++ -O1 -std=gnu++11 -w -Dinterrupt= '-D__asm(x)='
+		-IBpClasses/headers -IOculusHub/headers -IOculusHubMain/headers
+		-o crc16_test OculusHubMain/tools/test/crc16_test.cpp BpClasses/src/crc16.cpp
+
+14/03/2018 - Created v1.0 of file
+==============================================================================*/
+#include "host_model.hpp"
+#include "crc16.hpp"
+
+#define BENCH_SIZE			4096
+#define BENCH_PASSES		20000
+
+static uint8 testData[BENCH_SIZE];
+
+//==============================================================================
+//Reference implementations
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that computes a CRC16 bit by bit
+*/
+static uint16 BitCalc(puint8 buf, uint32 offset, uint32 length, uint16 init)
+{
+	uint32 crc = init;
+	for(uint32 idx = 0; idx < length; idx++) {
+		crc ^= buf[offset + idx];
+		for(uint32 bit = 0; bit < 8; bit++)
+			crc = (crc & 1) ? ((crc >> 1) ^ CRC16_GEN_POLY) : (crc >> 1);
+	}
+	return (uint16)crc;
+}
+
+static uint16 oldLut[256];
+
+/*!-----------------------------------------------------------------------------
+Function that fills the RAM table, as CCrc16::Init did
+*/
+static void OldInit()
+{
+	for(uint32 idx = 0; idx < 256; idx++) {
+		uint8 byte = (uint8)idx;
+		oldLut[idx] = BitCalc(&byte, 0, 1, 0);
+	}
+}
+
+/*!-----------------------------------------------------------------------------
+Function that computes a CRC16 a byte at a time from the RAM table, as
+CCrc16::Calc did
+*/
+static uint16 OldCalc(puint8 buf, uint32 offset, uint32 length, uint16 init)
+{
+	uint16 crc = init;
+	buf += offset;
+	while(length--) {
+		crc = (crc >> 8) ^ oldLut[(crc ^ *buf) & 0xFF];
+		buf++;
+	}
+	return crc;
+}
+
+//==============================================================================
+//Tests
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that tests reference vectors
+*/
+static void TestVectors()
+{
+	//CRC-16/ARC, starting from zero as the command engine and settings records do
+	CHECK(CCrc16::Calc((puint8)"123456789", 0, 9) == 0xBB3D);
+	CHECK(CCrc16::Calc((puint8)"A", 0, 1) == 0x30C0);
+	CHECK(CCrc16::Calc((puint8)"", 0, 0) == 0x0000);
+
+	//CRC-16/MODBUS, starting from all ones
+	CHECK(CCrc16::Calc((puint8)"123456789", 0, 9, 0xFFFF) == 0x4B37);
+	CHECK(CCrc16::Calc((puint8)"A", 0, 1, 0xFFFF) == 0x707F);
+	CHECK(CCrc16::Calc((puint8)"", 0, 0, 0xFFFF) == 0xFFFF);
+
+	//Every byte value, long enough for the slice-by-4 path, from an offset
+	uint8 bytes[260];
+	for(uint32 idx = 0; idx < 256; idx++)
+		bytes[idx + 3] = (uint8)idx;
+	CHECK(CCrc16::Calc(bytes, 3, 256) == 0xBAD3);
+	CHECK(CCrc16::Calc(bytes, 3, 256, 0xFFFF) == 0xDE6C);
+
+	//Continuing a CRC across calls gives the same result as one call
+	uint16 part = CCrc16::Calc((puint8)"12345", 0, 5);
+	CHECK(CCrc16::Calc((puint8)"123456789", 5, 4, part) == 0xBB3D);
+
+	//The tables hold the CRC of each byte followed by zero bytes
+	CHECK(TCrc16Lut::Table[1] == 0xC0C1);
+	CHECK(TCrc16Lut::Table[255] == 0x4040);
+	CHECK(TCrc16Lut::Table[256 + 1] == BitCalc((puint8)"\x01\x00", 0, 2, 0));
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests the table driven path matches the bit by bit reference
+*/
+static void TestMatch()
+{
+	uint32 seed = 1;
+	uint32 bad = 0;
+	for(uint32 idx = 0; idx < sizeof(testData); idx++) {
+		seed = (seed * 1103515245) + 12345;
+		testData[idx] = (uint8)(seed >> 16);
+	}
+
+	for(uint32 pass = 0; pass < 200000; pass++) {
+		seed = (seed * 1103515245) + 12345;
+		uint32 offset = (seed >> 8) % 256;
+		uint32 len = (seed >> 16) % 600;
+		uint16 init = (uint16)(seed * 2654435761u);
+		if(CCrc16::Calc(testData, offset, len, init) != BitCalc(testData, offset, len, init))
+			bad++;
+	}
+	printf("match: %u mismatches against the bit by bit reference\n", bad);
+	CHECK(bad == 0);
+}
+
+//==============================================================================
+//Benchmark
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that measures the new path against the RAM table path it replaced
+*/
+static void Bench()
+{
+	OldInit();
+
+	uint16 oldCrc = 0;
+	double start = HostTimeUs();
+	for(uint32 pass = 0; pass < BENCH_PASSES; pass++)
+		oldCrc = OldCalc(testData, 0, BENCH_SIZE, oldCrc);
+	double oldUs = HostTimeUs() - start;
+
+	uint16 newCrc = 0;
+	start = HostTimeUs();
+	for(uint32 pass = 0; pass < BENCH_PASSES; pass++)
+		newCrc = CCrc16::Calc(testData, 0, BENCH_SIZE, newCrc);
+	double newUs = HostTimeUs() - start;
+
+	double bytes = (double)BENCH_SIZE * BENCH_PASSES;
+	printf("bench: byte table %.1f MB/s, slice-by-4 %.1f MB/s (%.1fx)\n", bytes / oldUs, bytes / newUs, oldUs / newUs);
+	CHECK(newCrc == oldCrc);
+	CHECK(newUs < oldUs);
+}
+
+//==============================================================================
+int main(int argc, char** argv)
+{
+	TestVectors();
+	TestMatch();
+	Bench();
+
+	return HostResult();
+}
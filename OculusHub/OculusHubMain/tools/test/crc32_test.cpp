@@ -0,0 +1,148 @@
+/*==============================================================================
+Host test and benchmark of CCrc32.
+
+The table driven CRC32_GEN_POLY path is checked against known answers (the
+standard CRC-32 check values), and against the bit by bit CalcValue path it
+replaced for random lengths, alignments and starting values, through both the
+byte and word overloads, so existing .fwx checksums still verify. The speed
+of both paths is measured over a buffer the size of the main image.
+
+Build and run with run_tests.sh, or (Linux, from OculusHub):
+	g++ -O1 -std=gnu++11 -w -Dinterrupt= '-D__asm(x)='
+		-IBpClasses/headers -IOculusHub/headers -IOculusHubMain/headers
+		-o crc32_test OculusHubMain/tools/test/crc32_test.cpp BpClasses/src/crc32.cpp
+
+14/03/2018 - Created v1.0 of file
+==============================================================================*/
+#include "host_model.hpp"
+#include "crc32.hpp"
+
+#define BENCH_SIZE			(448 * 1024)
+#define BENCH_PASSES		20
+
+static uint8 testData[BENCH_SIZE + 16];
+
+//==============================================================================
+//Tests
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that computes a CRC bit by bit, as CalcBuffer did before the tables
+*/
+static uint32 OldCalc(puint8 data, uint32 len, uint32 poly, uint32 last)
+{
+	uint32 crc = last;
+	for(uint32 idx = 0; idx < len; idx++)
+		crc = CCrc32::CalcValue(data[idx], poly, crc);
+	return crc;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that computes a CRC of 32-bit words bit by bit, as CalcBuffer did
+before the tables
+*/
+static uint32 OldCalc(puint32 data, uint32 len, uint32 poly, uint32 last)
+{
+	uint32 crc = last;
+	for(uint32 idx = 0; idx < len; idx++)
+		crc = CCrc32::CalcValue(data[idx], poly, crc);
+	return crc;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns the standard CRC-32 of a string (starting from all ones,
+and inverted at the end)
+*/
+static uint32 Standard(const char* str, uint32 poly)
+{
+	return ~CCrc32::CalcBuffer((puint8)str, strlen(str), poly, 0xFFFFFFFF);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests known answers
+*/
+static void TestKnown()
+{
+	//CRC-32 (ISO-HDLC) check values
+	CHECK(Standard("123456789", CRC32_GEN_POLY) == 0xCBF43926);
+	CHECK(Standard("The quick brown fox jumps over the lazy dog", CRC32_GEN_POLY) == 0x414FA339);
+	CHECK(Standard("", CRC32_GEN_POLY) == 0x00000000);
+	CHECK(Standard("a", CRC32_GEN_POLY) == 0xE8B7BE43);
+
+	//Other polynomials take the bit by bit path (CRC-32C check value)
+	CHECK(Standard("123456789", 0x82F63B78) == 0xE3069283);
+
+	//Without the inversions, as the firmware image checksums are computed
+	CHECK(CCrc32::CalcBuffer((puint8)"123456789", 9, CRC32_GEN_POLY) == 0x2DFD2D88);
+
+	//The word overload treats words as little endian bytes
+	uint32 words[2];
+	memcpy(words, "12345678", 8);
+	CHECK(CCrc32::CalcBuffer(words, 2, CRC32_GEN_POLY, 0xFFFFFFFF) == CCrc32::CalcBuffer((puint8)"12345678", 8, CRC32_GEN_POLY, 0xFFFFFFFF));
+	CHECK(CCrc32::CalcBuffer(words, 1, CRC32_GEN_POLY, 0xFFFFFFFF) == CCrc32::CalcBuffer((puint8)"1234", 4, CRC32_GEN_POLY, 0xFFFFFFFF));
+
+	//The lookup tables hold the CRC of each byte followed by zero bytes
+	CHECK(TCrc32Lut::Table[1] == 0x77073096);
+	CHECK(TCrc32Lut::Table[255] == 0x2D02EF8D);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests the table driven paths match the bit by bit path
+*/
+static void TestMatch()
+{
+	uint32 seed = 1;
+	uint32 bad = 0;
+	for(uint32 idx = 0; idx < sizeof(testData); idx++) {
+		seed = (seed * 1103515245) + 12345;
+		testData[idx] = (uint8)(seed >> 16);
+	}
+
+	for(uint32 pass = 0; pass < 20000; pass++) {
+		seed = (seed * 1103515245) + 12345;
+		uint32 offset = (seed >> 8) % 16;
+		uint32 len = (seed >> 12) % 300;
+		uint32 last = seed * 2654435761u;
+		puint8 data = testData + offset;
+
+		if(CCrc32::CalcBuffer(data, len, CRC32_GEN_POLY, last) != OldCalc(data, len, CRC32_GEN_POLY, last))
+			bad++;
+		if(CCrc32::CalcBuffer((puint32)testData, len / 4, CRC32_GEN_POLY, last) != OldCalc((puint32)testData, len / 4, CRC32_GEN_POLY, last))
+			bad++;
+	}
+	printf("match: %u mismatches against the bit by bit path\n", bad);
+	CHECK(bad == 0);
+}
+
+//==============================================================================
+//Benchmark
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that measures both paths over a main image sized buffer
+*/
+static void Bench()
+{
+	double start = HostTimeUs();
+	uint32 oldCrc = OldCalc(testData, BENCH_SIZE, CRC32_GEN_POLY, 0);
+	double oldUs = HostTimeUs() - start;
+
+	uint32 newCrc = 0;
+	start = HostTimeUs();
+	for(uint32 pass = 0; pass < BENCH_PASSES; pass++)
+		newCrc = CCrc32::CalcBuffer(testData, BENCH_SIZE, CRC32_GEN_POLY, 0);
+	double newUs = (HostTimeUs() - start) / BENCH_PASSES;
+
+	printf("bench %u KB: bit by bit %.1f MB/s, tables %.1f MB/s (%.1fx)\n",
+		BENCH_SIZE / 1024, BENCH_SIZE / oldUs, BENCH_SIZE / newUs, oldUs / newUs);
+	CHECK(newCrc == oldCrc);
+	CHECK(newUs < oldUs);
+}
+
+//==============================================================================
+int main(int argc, char** argv)
+{
+	TestKnown();
+	TestMatch();
+	Bench();
+
+	return HostResult();
+}
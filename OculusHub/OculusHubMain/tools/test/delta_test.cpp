@@ -0,0 +1,246 @@
+/*==============================================================================
+Host test of CDelta and CDeltaDecoder.
+
+Patches made by CDelta::Diff are checked against known streams for small
+images, and the decoder is checked to reject patches made against a different
+base image (by its checksum), and patches referring outside the base image or
+past the new image length. Modelled program images are then relinked (code
+inserted, moving the addresses that point past it) and patched, with the
+patches applied in pieces of every size from a byte to the whole patch through
+output buffers from a phrase to a sector, checking each run of output handed
+back fills its buffer. The bytes sent for each update, whole and patched, with
+and without compression, are printed.
+
+Build and run with run_tests.sh, or (Linux, from OculusHub):
+	g++ -O1 -std=gnu++11 -w -Dinterrupt= '-D__asm(x)='
+		-IBpClasses/headers -IOculusHub/headers -IOculusHubMain/headers
+		-o delta_test OculusHubMain/tools/test/delta_test.cpp
+		BpClasses/src/delta.cpp BpClasses/src/lz.cpp BpClasses/src/crc32.cpp
+
+14/03/2018 - Created v1.0 of file
+==============================================================================*/
+#include "host_model.hpp"
+#include "delta.hpp"
+#include "lz.hpp"
+#include "crc32.hpp"
+
+#define TEST_ORG			0x10000			/*!< Address the modelled program images are linked at */
+#define TEST_SIZE			0x20000			/*!< Size of the modelled program images */
+#define TEST_MAX			(TEST_SIZE + 0x1000)
+
+static uint8 testBase[TEST_MAX];
+static uint8 testImage[TEST_MAX];
+static uint8 testPatch[(TEST_MAX * 2) + 1024];
+static uint8 testComp[(TEST_MAX * 3) + 1024];
+static uint8 testOut[TEST_MAX];
+
+//==============================================================================
+//Models
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that applies a patch, fed to the decoder in pieces of up to the
+specified size. Returns the number of bytes output, or -1 if the decoder
+failed, handed back a run that didn't fill its buffer before the end, or didn't
+reach the end of the new image.
+*/
+static int32 Apply(puint8 base, uint32 baseSize, uint32 checksum, puint8 patch, uint32 patchLength, uint32 length, uint32 bufferSize, uint32 pieceMax)
+{
+	CDeltaDecoder decoder(bufferSize);
+	uint32 pos = 0;
+	uint32 used;
+	puint8 data;
+	uint32 dataLength;
+
+	decoder.Init(base, baseSize, checksum, length);
+	for(uint32 offset = 0; offset < patchLength; offset += pieceMax) {
+		puint8 src = patch + offset;
+		uint32 srcLength = patchLength - offset;
+		if(srcLength > pieceMax)
+			srcLength = pieceMax;
+
+		do {
+			if(!decoder.Decode(src, srcLength, &used, &data, &dataLength))
+				return -1;
+			if((dataLength > 0) && ((pos % bufferSize) != 0))
+				return -1;
+			if((dataLength != bufferSize) && (dataLength > 0) && !decoder.IsEnd())
+				return -1;
+			if((pos + dataLength) > sizeof(testOut))
+				return -1;
+			memcpy(testOut + pos, data, dataLength);
+			pos += dataLength;
+			src += used;
+			srcLength -= used;
+		} while((used > 0) || (dataLength > 0));
+	}
+
+	if(!decoder.IsEnd() || (decoder.GetTotal() != pos))
+		return -1;
+	return pos;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that checks a patch between small images matches the expected stream
+*/
+static void Known(const char* base, const char* image, const uint8* expect, uint32 expectLength)
+{
+	uint8 patch[128];
+	uint32 patchLength = CDelta::Diff((puint8)base, strlen(base), 0x11223344, (puint8)image, strlen(image), patch, sizeof(patch));
+	CHECK(patchLength == expectLength);
+	CHECK(memcmp(patch, expect, expectLength) == 0);
+	CHECK(Apply((puint8)base, 64, 0x11223344, patch, patchLength, strlen(image), 8, 1) == (int32)strlen(image));
+	CHECK(memcmp(testOut, image, strlen(image)) == 0);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that models a program image, of instruction words with one in four an
+address within the image (as literal pools and vector tables hold)
+*/
+static void MakeProgram(puint8 image, uint32 length, uint32 seed)
+{
+	for(uint32 idx = 0; idx < length; idx += 4) {
+		seed = (seed * 1103515245) + 12345;
+		uint32 word = seed >> 8;
+		if((seed & 0x300) == 0)
+			word = TEST_ORG + ((seed >> 12) % length);
+		memcpy(image + idx, &word, 4);
+	}
+}
+
+/*!-----------------------------------------------------------------------------
+Function that models relinking a program with code inserted at an offset,
+moving each address that pointed past it. Returns the new length.
+*/
+static uint32 Relink(puint8 base, uint32 length, puint8 image, uint32 offset, uint32 insert)
+{
+	uint32 seed = insert;
+
+	memcpy(image, base, offset);
+	for(uint32 idx = 0; idx < insert; idx++) {
+		seed = (seed * 1103515245) + 12345;
+		image[offset + idx] = (uint8)(seed >> 16);
+	}
+	memcpy(image + offset + insert, base + offset, length - offset);
+
+	for(uint32 idx = 0; (idx + 4) <= (length + insert); idx += 4) {
+		uint32 word;
+		memcpy(&word, image + idx, 4);
+		if((word >= (TEST_ORG + offset)) && (word < (TEST_ORG + length))) {
+			word += insert;
+			memcpy(image + idx, &word, 4);
+		}
+	}
+	return length + insert;
+}
+
+//==============================================================================
+//Tests
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that tests known patches, and patches the decoder must reject
+*/
+static void TestKnown()
+{
+	//Empty images are just the header
+	const uint8 empty[] = { 0x00, 0x00, 0x00, 0x00, 0x44, 0x33, 0x22, 0x11 };
+	Known("", "", empty, sizeof(empty));
+
+	//One byte changed, as an add byte, and two bytes appended, as inserts
+	const uint8 changed[] = {
+		0x1A, 0x00, 0x00, 0x00, 0x44, 0x33, 0x22, 0x11,
+		0x1A, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0xE7, 0xFF, 0xFF, 0xFF,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, '!', '!' };
+	Known("ABCDEFGHIJKLMNOPQRSTUVWXYZ", "ABCDEFGHIJKLMnOPQRSTUVWXYZ!!", changed, sizeof(changed));
+
+	//Halves exchanged, seeking forwards then back through the base image
+	const uint8 moved[] = {
+		0x14, 0x00, 0x00, 0x00, 0x44, 0x33, 0x22, 0x11,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0A, 0x00, 0x00, 0x00,
+		0x0A, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xEC, 0xFF, 0xFF, 0xFF,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x0A, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xF6, 0xFF, 0xFF, 0xFF,
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+	Known("0123456789abcdefghij", "abcdefghij0123456789", moved, sizeof(moved));
+
+	//Made against a different base image
+	CHECK(Apply((puint8)"ABCDEFGHIJKLMNOPQRSTUVWXYZ", 64, 0x11223345, (puint8)changed, sizeof(changed), 28, 8, 1) < 0);
+
+	//Base image longer than the decoder may read
+	CHECK(Apply((puint8)"ABCDEFGHIJKLMNOPQRSTUVWXYZ", 25, 0x11223344, (puint8)changed, sizeof(changed), 28, 8, 1) < 0);
+
+	//New image shorter than the patch outputs
+	CHECK(Apply((puint8)"ABCDEFGHIJKLMNOPQRSTUVWXYZ", 64, 0x11223344, (puint8)changed, sizeof(changed), 27, 8, 1) < 0);
+
+	//Adding past the end of the base image
+	const uint8 past[] = {
+		0x04, 0x00, 0x00, 0x00, 0x44, 0x33, 0x22, 0x11,
+		0x05, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x00, 0x00 };
+	CHECK(Apply((puint8)"ABCD", 64, 0x11223344, (puint8)past, sizeof(past), 5, 8, 1) < 0);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests patches between modelled program images are applied in
+pieces of every size, through different output buffers, and prints the bytes
+sent for each update
+*/
+static void TestRoundTrip()
+{
+	const char* names[] = { "same", "bytes changed", "64 bytes inserted", "512 bytes inserted", "unrelated" };
+	uint32 buffers[] = { 8, 1024, 4096 };
+	uint32 pieces[] = { 1, 7, 128, 4096, TEST_MAX * 2 };
+	uint32 sent[5];
+	uint32 full[5];
+	uint32 bad = 0;
+
+	MakeProgram(testBase, TEST_SIZE, 5);
+	uint32 checksum = CCrc32::CalcBuffer(testBase, TEST_SIZE, CRC32_GEN_POLY, 0);
+
+	for(uint32 kind = 0; kind < 5; kind++) {
+		uint32 length = TEST_SIZE;
+		switch(kind) {
+			case 0 : { memcpy(testImage, testBase, TEST_SIZE); break; }
+			case 1 : { memcpy(testImage, testBase, TEST_SIZE); testImage[0x400] ^= 1; testImage[TEST_SIZE - 100] ^= 0x10; break; }
+			case 2 : { length = Relink(testBase, TEST_SIZE, testImage, TEST_SIZE / 2, 64); break; }
+			case 3 : { length = Relink(testBase, TEST_SIZE, testImage, TEST_SIZE / 5, 512); break; }
+			default : { MakeProgram(testImage, TEST_SIZE, 6); break; }
+		}
+
+		uint32 patchLength = CDelta::Diff(testBase, TEST_SIZE, checksum, testImage, length, testPatch, sizeof(testPatch));
+		CHECK(patchLength > 0);
+		uint32 fullComp = CLz::Compress(testImage, length, testComp, sizeof(testComp), 4096);
+		uint32 patchComp = CLz::Compress(testPatch, patchLength, testComp, sizeof(testComp), 4096);
+		printf("%s: %u byte image, %u compressed, patch %u, %u compressed\n", names[kind], length, fullComp, patchLength, patchComp);
+		sent[kind] = patchComp;
+		full[kind] = fullComp;
+
+		for(uint32 buf = 0; buf < 3; buf++) {
+			for(uint32 piece = 0; piece < 5; piece++) {
+				int32 outLength = Apply(testBase, TEST_MAX, checksum, testPatch, patchLength, length, buffers[buf], pieces[piece]);
+				if((outLength != (int32)length) || (memcmp(testOut, testImage, length) != 0))
+					bad++;
+			}
+		}
+
+		//Patches are only applied to the base image they were made against
+		if(Apply(testBase, TEST_MAX, checksum ^ 1, testPatch, patchLength, length, 1024, 128) >= 0)
+			bad++;
+	}
+	printf("round trip: %u failed\n", bad);
+	CHECK(bad == 0);
+
+	//Relinking only needs a small fraction of the image sending
+	CHECK(sent[1] < (full[1] / 100));
+	CHECK(sent[2] < (full[2] / 10));
+	CHECK(sent[3] < (full[3] / 10));
+}
+
+//==============================================================================
+int main(int argc, char** argv)
+{
+	TestKnown();
+	TestRoundTrip();
+
+	return HostResult();
+}
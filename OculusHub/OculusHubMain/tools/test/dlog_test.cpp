@@ -0,0 +1,256 @@
+/*==============================================================================
+Host test of the CDlog service, draining through a com port that records each
+block written to it, and that has a small transmit buffer the test empties.
+
+Checked is that log frames always reach the port whole, each in a single
+write, while COM_PRINT text and SLIP-like frames are written between service
+calls, including when the port has less space than the next frame, and that
+the frames decode back to the entries logged. Entries whose bytes include
+the SLIP END and ESC values must be sent escaped, with no END byte that would
+split a SLIP host's frames, and the CRC16 ending each frame is checked
+against a known answer.
+
+Build and run with run_tests.sh, or (Linux x86-64, from OculusHub):
+	g++ -O1 -no-pie -std=gnu++11 -fno-rtti -fno-exceptions -fpermissive -w
+		-Dinterrupt= '-D__asm(x)='
+		-IBpClasses/headers -IBpApplication/headers -IBpDevices_K60/headers
+		-IOculusHub/headers -IOculusHubMain/headers
+		-o dlog_test OculusHubMain/tools/test/dlog_test.cpp
+		BpApplication/src/dlog.cpp BpApplication/src/service.cpp
+		BpApplication/src/ticktimer.cpp BpClasses/src/crc16.cpp
+		BpDevices_K60/src/com.cpp
+
+14/03/2018 - Created v1.0 of file
+==============================================================================*/
+#include <vector>
+
+#include "host_model.hpp"
+#include "systick_model.hpp"
+#include "dlog.hpp"
+
+//==============================================================================
+//Models
+//==============================================================================
+/*!
+Class of com port that records each block written, with a transmit buffer of
+limited size that the test drains
+*/
+class CComRecord : public CCom {
+	public:
+		std::vector<uint8> Line;					/*!< Everything written, in order */
+		std::vector<uint32> Blocks;					/*!< The size of each write */
+		uint32 TxHeld;								/*!< Bytes in the modelled transmit buffer */
+		uint32 TxSize;								/*!< Size of the modelled transmit buffer */
+
+		CComRecord(uint32 txSize) { TxHeld = 0; TxSize = txSize; }
+
+		void Clear(bool rx, bool tx) {}
+		void Close(void) {}
+		void Flush(void) {}
+		uint32 GetRxBufferCount() { return 0; }
+		uint32 GetTxBufferCount() { return TxHeld; }
+		uint32 GetTxBufferFree() { return TxSize - TxHeld; }
+		bool IsOpen(void) { return true; }
+		bool Open(void) { return true; }
+		uint8 ReadByte() { return 0; }
+		void WriteByte(uint8 data) { this->WriteBlock(&data, 1); }
+
+		void WriteBlock(puint8 pBuf, uint32 count) {
+			Line.insert(Line.end(), pBuf, pBuf + count);
+			Blocks.push_back(count);
+			TxHeld += count;
+			if(TxHeld > TxSize)
+				TxHeld = TxSize;
+		}
+};
+
+//==============================================================================
+//Tests
+//==============================================================================
+static const char* testFmt = "value %d, of %u";
+
+/*!-----------------------------------------------------------------------------
+Function that removes the escapes from a block written to the port, checking
+it contains no DLOG_ESC_END byte
+*/
+static std::vector<uint8> Unescape(puint8 data, uint32 size)
+{
+	std::vector<uint8> frame;
+	for(uint32 idx = 0; idx < size; idx++) {
+		CHECK(data[idx] != DLOG_ESC_END);
+		if(data[idx] == DLOG_ESC && (idx + 1) < size) {
+			idx++;
+			CHECK(data[idx] == DLOG_ESC_ESC_END || data[idx] == DLOG_ESC_ESC);
+			frame.push_back((data[idx] == DLOG_ESC_ESC_END) ? DLOG_ESC_END : DLOG_ESC);
+		}
+		else
+			frame.push_back(data[idx]);
+	}
+	return frame;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that finds the log frames in what was written to the port, checking
+each was written in a block of its own, and returns their first arguments
+*/
+static std::vector<uint32> Frames(CComRecord* com, uint32* dropped)
+{
+	std::vector<uint32> values;
+	uint32 pos = 0;
+	*dropped = 0;
+
+	for(uint32 block = 0; block < com->Blocks.size(); block++) {
+		puint8 data = com->Line.data() + pos;
+		pos += com->Blocks[block];
+		if(data[0] != DLOG_FRAME_SYNC)
+			continue;
+
+		//A frame must fill exactly the block it was written in, with a good CRC
+		std::vector<uint8> bytes = Unescape(data, com->Blocks[block]);
+		puint8 frame = bytes.data();
+		uint32 size = bytes.size();
+		uint32 len = frame[1] & ~DLOG_FRAME_TRUNCATED;
+		CHECK(size == (DLOG_FRAME_HEADER + len + DLOG_FRAME_CRC));
+		uint16 crc = frame[size - 2] | (frame[size - 1] << 8);
+		CHECK(crc == CCrc16::Calc(frame, 1, size - 1 - DLOG_FRAME_CRC));
+
+		uint16 id = frame[2] | (frame[3] << 8);
+		uint32 value;
+		memcpy(&value, frame + DLOG_FRAME_HEADER, 4);
+		if(id == DLOG_ID_DROPPED)
+			*dropped += value;
+		else
+			values.push_back(value);
+	}
+	return values;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests frames reach the port whole, with text and other frames
+written between service calls, and a transmit buffer that is often too full
+for the next frame
+*/
+static void TestShared()
+{
+	CComRecord* com = new CComRecord(100);
+	CDlog* dlog = new CDlog(com, 1024);
+	dlog->ServiceStart();
+	uint32 logged = 0;
+
+	for(uint32 pass = 0; pass < 2000; pass++) {
+		//Log a few entries, as interrupts would
+		uint32 entries = pass % 4;
+		for(uint32 idx = 0; idx < entries; idx++) {
+			dlog->Write(testFmt, (int)logged, 7u);
+			logged++;
+		}
+
+		//Other main loop output sharing the port
+		if((pass % 3) == 0)
+			com->Print("[%7.1fs] text line %u\r\n", pass * 0.1, pass);
+		if((pass % 5) == 0) {
+			uint8 slip[20] = { 0xC0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0xC0 };
+			com->WriteBlock(slip, 11);
+		}
+
+		dlog->Service();
+
+		//The line drains part of the transmit buffer between calls
+		com->TxHeld = (com->TxHeld > 40) ? (com->TxHeld - 40) : 0;
+	}
+
+	//Drain everything left
+	for(uint32 idx = 0; idx < 1000 && dlog->GetCount(); idx++) {
+		com->TxHeld = 0;
+		dlog->Service();
+	}
+
+	uint32 dropped;
+	std::vector<uint32> values = Frames(com, &dropped);
+	printf("shared: logged %u, frames %u, dropped %u, writes %u\n", logged, (uint32)values.size(), dropped, (uint32)com->Blocks.size());
+	CHECK(dlog->GetCount() == 0);
+	CHECK((values.size() + dropped) == logged);
+	for(uint32 idx = 1; idx < values.size(); idx++)
+		CHECK(values[idx] > values[idx - 1]);
+
+	delete dlog;
+	delete com;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests a service call drains whole frames up to the chunk size,
+and nothing while the port has no room for the next frame
+*/
+static void TestChunk()
+{
+	CComRecord* com = new CComRecord(4096);
+	CDlog* dlog = new CDlog(com, 1024);
+	dlog->ServiceStart();
+	for(uint32 idx = 0; idx < 10; idx++)
+		dlog->Write(testFmt, (int)idx, 7u);
+	uint32 frameSize = dlog->GetCount() / 10;
+
+	dlog->Service();
+	uint32 sent = com->Line.size();
+	printf("chunk: frame %u bytes, %u sent by one call\n", frameSize, sent);
+	CHECK((sent % frameSize) == 0);
+	CHECK(sent >= DLOG_SERVICE_CHUNK);
+	CHECK(sent < (DLOG_SERVICE_CHUNK + frameSize));
+
+	com->TxHeld = com->TxSize - (frameSize - 1);
+	dlog->Service();
+	CHECK(com->Line.size() == sent);
+
+	delete dlog;
+	delete com;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests entries holding the SLIP END and ESC values are sent
+escaped, and decode back, and the frame CRC against a known answer
+*/
+static void TestEscape()
+{
+	CComRecord* com = new CComRecord(4096);
+	CDlog* dlog = new CDlog(com, 1024);
+	dlog->ServiceStart();
+
+	//Arguments made of the escaped values, and a time stamp of them
+	CSysTick::_clkTicks = 0xC0DBC0DB;
+	dlog->Write(testFmt, (int)0xDBC0C0DB, 0xC0C0C0C0u);
+	dlog->Write(testFmt, (int)0xDBDBDBDB, 0xDBu);
+	uint32 count = dlog->GetCount();
+	dlog->Service();
+	CSysTick::_clkTicks = 0;
+
+	//Each argument byte and time stamp byte is sent as two
+	uint32 frameSize = DLOG_FRAME_HEADER + 8 + DLOG_FRAME_CRC;
+	CHECK(count == (2 * frameSize));
+	CHECK(com->Blocks.size() == 2);
+	CHECK(com->Blocks[0] >= (frameSize + 12));
+	CHECK(com->Blocks[1] >= (frameSize + 9));
+
+	uint32 dropped;
+	std::vector<uint32> values = Frames(com, &dropped);
+	CHECK(values.size() == 2);
+	CHECK(values[0] == 0xDBC0C0DB);
+	CHECK(values[1] == 0xDBDBDBDB);
+	CHECK(dropped == 0);
+
+	//Known answer for the frame CRC (CRC-16/ARC)
+	uint8 check[] = "123456789";
+	CHECK(CCrc16::Calc(check, 0, 9) == 0xBB3D);
+
+	delete dlog;
+	delete com;
+}
+
+//==============================================================================
+int main(int argc, char** argv)
+{
+	TestShared();
+	TestChunk();
+	TestEscape();
+
+	return HostResult();
+}
@@ -0,0 +1,290 @@
+/*==============================================================================
+Host test of CFlashProg copying an update from scratch memory over its
+destination (UpdateCopy), on the FTFE model (flash_model.hpp), with the power
+cut part way through.
+
+The main program updates the bootloader straight away (FPROG_COPY_NOW), the
+same way the bootloader updates the main program, so the bootloader section is
+updated here. Checked is that only the sectors that differ are erased and
+programmed, that a copy cut off part way resumes after the last sector
+recorded in the progress map (FLASH_PROGDONE_START) rather than starting
+again, that the program information store isn't written (so can't be erased)
+while the copy runs, even when it's nearly full, and that program information
+records stored with fewer or more fields than TFlashProgInfo are still read.
+
+The bootloader starts at address 0, so the first page must be mapped, which
+needs privileges (see /proc/sys/vm/mmap_min_addr). Without them the test is
+skipped.
+
+Build and run with run_tests.sh, which builds the flash driver with the
+routines the model replaces weakened.
+
+14/03/2018 - Created v1.0 of file
+==============================================================================*/
+#include "flash_model.hpp"
+#include "flash_prog.hpp"
+
+#define TEST_BLOCK_SIZE		1024
+#define TEST_PROG_SIZE		(40 * 1024 + 100)		/*!< A program ending part way into a sector */
+#define TEST_SAME_SIZE		(2 * FLASH_SECTOR_SIZE)	/*!< Bytes at the start of the program the same as the old bootloader */
+
+static uint8 testData[FLASH_BOOT_SIZE];
+static uint8 testInfo[FLASH_PROGINFO_SIZE];
+
+//==============================================================================
+//Models
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that fills the bootloader section with an old bootloader, and makes
+the start of the new program the same as it
+*/
+static void FillBoot(uint8 seed)
+{
+	for(uint32 addr = FLASH_BOOT_START; addr < (FLASH_BOOT_START + FLASH_BOOT_SIZE); addr++)
+		*HostMem(addr) = (uint8)((addr * 3) + 1);
+	for(uint32 idx = 0; idx < FLASH_BOOT_SIZE; idx++)
+		testData[idx] = (idx < TEST_SAME_SIZE) ? *HostMem(FLASH_BOOT_START + idx) : (uint8)((idx * 7) + seed);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that sends the new bootloader as an update, with the hash the sender
+signs the programming parameters with, and returns the result of ProgUpdate
+*/
+static EFlashProgReturn Update(CFlash* flash)
+{
+	CFlashProg prog(flash, FLASH_PROGINFO_START, FLASH_PROGINFO_SIZE);
+	TFlashProgInit init;
+	char hashStr[256];
+	EFlashProgReturn result;
+
+	memset(&init, 0, sizeof(init));
+	init.Section = FLASH_SECTION_BOOT;
+	init.DataFormat = FPROG_DATA_BINARY;
+	init.Length = TEST_PROG_SIZE;
+	init.Checksum = CCrc32::CalcBuffer(testData, TEST_PROG_SIZE, CRC32_GEN_POLY, 0);
+	int hashStrLen = snprintf(hashStr, sizeof(hashStr), "%s-%.5u-%u-%u-%.6u-%u-%u-%.8X", FLASH_HASH_KEY, init.PartNumber,
+		init.PartRevMin, init.PartRevMax, init.SerialNumber, init.DataFormat, init.Length, init.Checksum);
+	CSha1::Calc((puint8)hashStr, hashStrLen, init.Hash);
+
+	result = prog.ProgInit(&init);
+	for(uint32 offset = 0; (result == FPROG_OK) && (offset < TEST_PROG_SIZE); offset += TEST_BLOCK_SIZE) {
+		uint32 size = TEST_PROG_SIZE - offset;
+		if(size > TEST_BLOCK_SIZE)
+			size = TEST_BLOCK_SIZE;
+		result = prog.ProgScratch(testData + offset, (size + 3) & ~3);
+	}
+	if(result == FPROG_OK)
+		result = prog.ProgUpdate();
+
+	return result;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns true if the bootloader section holds the new program,
+apart from the flash configuration field (which the copy leaves to ConfigProgram)
+*/
+static bool SameAsProgram()
+{
+	uint32 progEnd = (TEST_PROG_SIZE + FLASH_SECTOR_SIZE - 1) & ~(FLASH_SECTOR_SIZE - 1);
+
+	return (memcmp(HostMem(FLASH_BOOT_START), testData, FLASH_CNFG_START_ADDRESS) == 0)
+		&& (memcmp(HostMem(FLASH_CNFG_END_ADDRESS + 1), testData + FLASH_CNFG_END_ADDRESS + 1, TEST_PROG_SIZE - FLASH_CNFG_END_ADDRESS - 1) == 0)
+		&& ModelBlank(FLASH_BOOT_START + TEST_PROG_SIZE, FLASH_BOOT_SIZE - TEST_PROG_SIZE);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns the number of sectors recorded in the progress map
+*/
+static uint32 SectorsDone()
+{
+	uint32 count = 0;
+	for(uint32 addr = FLASH_PROGDONE_START; addr < (FLASH_PROGDONE_START + FLASH_PROGDONE_SIZE); addr += FLASH_PHRASE_SIZE) {
+		if(!ModelBlank(addr, FLASH_PHRASE_SIZE))
+			count++;
+	}
+	return count;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that fills the program information store until it only has room for
+two more records, so a third write would erase it
+*/
+static void FillInfo(CFlash* flash)
+{
+	CFlashProg prog(flash, FLASH_PROGINFO_START, FLASH_PROGINFO_SIZE);
+	TFlashProgInfo info;
+	uint32 records = 0;
+
+	memset(&info, 0, sizeof(info));
+
+	//Write until the store is erased, then count the records it holds until it's erased again
+	uint32 erases = modelCmds[FLASH_CMD_ERASE_SECTOR];
+	while((modelCmds[FLASH_CMD_ERASE_SECTOR] == erases) && (info.Firmware[0].VersionBuild < 1000)) {
+		info.Firmware[0].VersionBuild++;
+		prog.WriteInfo(&info);
+	}
+	erases = modelCmds[FLASH_CMD_ERASE_SECTOR];
+	while((modelCmds[FLASH_CMD_ERASE_SECTOR] == erases) && (records < 1000)) {
+		info.Firmware[0].VersionBuild++;
+		prog.WriteInfo(&info);
+		records++;
+	}
+
+	for(uint32 idx = 0; idx < (records - 3); idx++) {
+		info.Firmware[0].VersionBuild++;
+		prog.WriteInfo(&info);
+	}
+	CHECK(modelCmds[FLASH_CMD_ERASE_SECTOR] == (erases + 1));
+}
+
+//==============================================================================
+//Tests
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that tests an update is copied, skipping sectors that already match
+*/
+static void TestCopy(CFlash* flash)
+{
+	TFlashProgInfo info;
+	uint32 progEnd = (TEST_PROG_SIZE + FLASH_SECTOR_SIZE - 1) & ~(FLASH_SECTOR_SIZE - 1);
+
+	ModelReset();
+	FillBoot(0x11);
+	CHECK(Update(flash) == FPROG_COPY_NOW);
+	CHECK(SectorsDone() == 0);
+
+	uint32 erases = modelCmds[FLASH_CMD_ERASE_SECTOR];
+	CFlashProg prog(flash, FLASH_PROGINFO_START, FLASH_PROGINFO_SIZE);
+	CHECK(prog.UpdateCopy());
+	erases = modelCmds[FLASH_CMD_ERASE_SECTOR] - erases;
+
+	printf("copy: %u sector erases, %u sectors recorded\n", erases, SectorsDone());
+	CHECK(SameAsProgram());
+	CHECK(erases == ((FLASH_BOOT_SIZE - TEST_SAME_SIZE) / FLASH_SECTOR_SIZE));
+	CHECK(SectorsDone() == ((progEnd - TEST_SAME_SIZE) / FLASH_SECTOR_SIZE));
+
+	CHECK(prog.ReadInfo(&info));
+	CHECK(!info.FlashUpdate.Update);
+	CHECK(info.Firmware[FLASH_SECTION_BOOT].Valid);
+	CHECK(info.Firmware[FLASH_SECTION_BOOT].Checksum == CCrc32::CalcBuffer(testData, TEST_PROG_SIZE, CRC32_GEN_POLY, 0));
+
+	//Another update clears the progress of this one
+	FillBoot(0x22);
+	CHECK(Update(flash) == FPROG_COPY_NOW);
+	CHECK(SectorsDone() == 0);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests a copy cut off by the power resumes where it got to,
+without writing to a nearly full program information store
+*/
+static void TestPowerCut(CFlash* flash)
+{
+	TFlashProgInfo info;
+	uint32 sectors = (FLASH_BOOT_SIZE - TEST_SAME_SIZE) / FLASH_SECTOR_SIZE;
+
+	ModelReset();
+	FillBoot(0x33);
+	FillInfo(flash);
+	CHECK(Update(flash) == FPROG_COPY_NOW);
+	memcpy(testInfo, HostMem(FLASH_PROGINFO_START), FLASH_PROGINFO_SIZE);
+
+	//Cut the power part way through the copy
+	{
+		CFlashProg prog(flash, FLASH_PROGINFO_START, FLASH_PROGINFO_SIZE);
+		modelPowerCmds = 25;
+		CHECK(!prog.UpdateCopy());
+		modelPowerCmds = -1;
+	}
+	uint32 done = SectorsDone();
+	CHECK(done > 0);
+	CHECK(done < 8);
+	CHECK(memcmp(HostMem(FLASH_PROGINFO_START), testInfo, FLASH_PROGINFO_SIZE) == 0);
+
+	//The copy resumes at the next boot, after the sectors recorded
+	uint32 erases = modelCmds[FLASH_CMD_ERASE_SECTOR];
+	CFlashProg prog(flash, FLASH_PROGINFO_START, FLASH_PROGINFO_SIZE);
+	CHECK(prog.ReadInfo(&info));
+	CHECK(info.FlashUpdate.Update);
+	CHECK(prog.UpdateCopy());
+	erases = modelCmds[FLASH_CMD_ERASE_SECTOR] - erases;
+
+	printf("power cut: %u of %u sectors recorded, resumed with %u sector erases\n", done, sectors, erases);
+	CHECK(SameAsProgram());
+	CHECK(erases <= (sectors - done));
+	CHECK(erases >= (sectors - done - 1));
+	CHECK(prog.ReadInfo(&info));
+	CHECK(!info.FlashUpdate.Update);
+	CHECK(info.Firmware[FLASH_SECTION_BOOT].Valid);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests program information records stored by firmware with fewer
+or more fields are still read
+*/
+static void TestInfoRecords(CFlash* flash)
+{
+	struct {
+		TFlashProgInfo Info;
+		uint32 Extra[4];
+	} longer;
+	TFlashProgInfo info;
+
+	//A record from before the swap information was added
+	ModelReset();
+	memset(&longer, 0xA5, sizeof(longer));
+	longer.Info.Firmware[FLASH_SECTION_MAIN].Checksum = 0x12345678;
+	{
+		CFlashData store(flash, FLASH_PROGINFO_START, FLASH_PROGINFO_SIZE);
+		CHECK(store.Write(&longer, offsetof(TFlashProgInfo, Swap)));
+	}
+	{
+		CFlashProg prog(flash, FLASH_PROGINFO_START, FLASH_PROGINFO_SIZE);
+		CHECK(prog.ReadInfo(&info));
+		CHECK(info.Firmware[FLASH_SECTION_MAIN].Checksum == 0x12345678);
+		CHECK(!info.Swap.Trial);
+		CHECK(info.Swap.Boots == 0);
+	}
+
+	//A record with fields added after this firmware
+	ModelReset();
+	longer.Info.Swap.Boots = 2;
+	{
+		CFlashData store(flash, FLASH_PROGINFO_START, FLASH_PROGINFO_SIZE);
+		CHECK(store.WriteType(&longer));
+	}
+	{
+		CFlashProg prog(flash, FLASH_PROGINFO_START, FLASH_PROGINFO_SIZE);
+		CHECK(prog.ReadInfo(&info));
+		CHECK(info.Firmware[FLASH_SECTION_MAIN].Checksum == 0x12345678);
+		CHECK(info.Swap.Boots == 2);
+	}
+
+	//A record too short to hold the firmware information
+	ModelReset();
+	{
+		CFlashData store(flash, FLASH_PROGINFO_START, FLASH_PROGINFO_SIZE);
+		CHECK(store.Write(&longer, sizeof(TFlashProgUpdateInfo)));
+	}
+	{
+		CFlashProg prog(flash, FLASH_PROGINFO_START, FLASH_PROGINFO_SIZE);
+		CHECK(!prog.ReadInfo(&info));
+	}
+}
+
+//==============================================================================
+int main(int argc, char** argv)
+{
+	if(!ModelMapFirstPage()) {
+		printf("skipped, the first page of flash can't be mapped without privileges\n");
+		return 0;
+	}
+	ModelInit();
+
+	CFlash flash;
+	TestCopy(&flash);
+	TestPowerCut(&flash);
+	TestInfoRecords(&flash);
+
+	return HostResult();
+}
@@ -0,0 +1,186 @@
+/*==============================================================================
+Host test of the CFlashData record store, on the FTFE model (flash_model.hpp).
+
+Firmware built before the CRC16 tables were generated at compile time stored a
+zero Checksum in every record header, and only reads records with one. Checked
+is that a store written by that firmware (an obsolete record, then the active
+one) is read, and rewritten with a check record holding its CRC rather than
+erased, and that every record written since, as the store fills and is erased,
+still reads through a model of that firmware's reader. A record whose data no
+longer matches its CRC must be refused, and the store erased.
+
+Build and run with run_tests.sh, which builds the flash driver with the
+routines the model replaces weakened.
+
+14/03/2018 - Created v1.0 of file
+==============================================================================*/
+#include "flash_model.hpp"
+#include "flash_data.hpp"
+
+#define TEST_STORE			0xF0000				/*!< Start of the store, in the settings storage */
+#define TEST_STORE_SIZE		0x2000
+#define TEST_LENGTH			100					/*!< Size of the records written, not a multiple of a phrase */
+
+static uint8 testData[TEST_LENGTH];
+
+//==============================================================================
+//Models
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that programs a record into the store as firmware that stored no CRC
+did, returning the address of the next record
+*/
+static uint32 LegacyWrite(uint32 addr, EFlashDataState state, puint8 data, uint16 length)
+{
+	TFlashDataHeader header;
+
+	header.State = state;
+	header.NextHeader = addr + sizeof(TFlashDataHeader) + ((length + 7) & ~0x7);
+	header.Length = length;
+	header.Checksum = 0;
+	memcpy(HostMem(addr), &header, sizeof(header));
+	memcpy(HostMem(addr + sizeof(header)), data, length);
+	return header.NextHeader;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that reads the active record as firmware that stored no CRC does,
+where the CRC it computed was always zero, returning its length, or 0 if it
+wouldn't read one
+*/
+static uint16 LegacyRead(puint8 data)
+{
+	uint32 addr = TEST_STORE;
+	uint32 addrEnd = TEST_STORE + TEST_STORE_SIZE;
+
+	while(addr < addrEnd) {
+		PFlashDataHeader header = (PFlashDataHeader)HostMem(addr);
+		if(header->State == FDATA_STATE_ACTIVE) {
+			if(((addr + sizeof(TFlashDataHeader) + header->Length) >= addrEnd) || (header->Checksum != 0))
+				return 0;
+			memcpy(data, HostMem(addr + sizeof(TFlashDataHeader)), header->Length);
+			return header->Length;
+		}
+		else if(header->State == FDATA_STATE_IGNORE)
+			addr = header->NextHeader;
+		else
+			return 0;
+	}
+	return 0;
+}
+
+//==============================================================================
+//Tests
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that tests a store written by firmware that stored no CRC is read, and
+rewritten with the record's CRC, which that firmware still reads
+*/
+static void TestLegacy(CFlash* flash)
+{
+	uint8 data[TEST_LENGTH];
+	uint8 old[TEST_LENGTH];
+
+	ModelReset();
+	memset(old, 0x55, sizeof(old));
+	uint32 addr = LegacyWrite(TEST_STORE, FDATA_STATE_IGNORE, old, 40);
+	uint32 active = addr;
+	LegacyWrite(addr, FDATA_STATE_ACTIVE, testData, TEST_LENGTH);
+
+	{
+		CFlashData store(flash, TEST_STORE, TEST_STORE_SIZE);
+		CHECK(store.GetReadLength() == TEST_LENGTH);
+		CHECK(store.Read(data) == TEST_LENGTH);
+		CHECK(memcmp(data, testData, TEST_LENGTH) == 0);
+	}
+
+	//The record was rewritten after the legacy one, with a check record
+	PFlashDataHeader header = (PFlashDataHeader)HostMem(active);
+	CHECK(header->State == FDATA_STATE_IGNORE);
+	addr = header->NextHeader;
+	header = (PFlashDataHeader)HostMem(addr);
+	CHECK(header->State == FDATA_STATE_ACTIVE);
+	CHECK(header->Checksum == 0);
+	uint32 checkAddr = addr + sizeof(TFlashDataHeader) + ((TEST_LENGTH + 7) & ~0x7);
+	PFlashDataCheck check = (PFlashDataCheck)HostMem(checkAddr);
+	CHECK(check->Magic == FDATA_CHECK_MAGIC);
+	CHECK(check->Checksum == CCrc16::Calc(testData, 0, TEST_LENGTH));
+	CHECK(header->NextHeader == (checkAddr + sizeof(TFlashDataCheck)));
+
+	//Which firmware that stored no CRC still reads
+	memset(data, 0, sizeof(data));
+	CHECK(LegacyRead(data) == TEST_LENGTH);
+	CHECK(memcmp(data, testData, TEST_LENGTH) == 0);
+
+	//Opening the store again finds it checked, and leaves it alone
+	uint32 programs = modelCmds[FLASH_CMD_PROGRAM_PHRASE] + modelCmds[FLASH_CMD_PROGRAM_SECTION];
+	{
+		CFlashData store(flash, TEST_STORE, TEST_STORE_SIZE);
+		CHECK(store.Read(data) == TEST_LENGTH);
+		CHECK(store.Write(testData, TEST_LENGTH));
+	}
+	CHECK((modelCmds[FLASH_CMD_PROGRAM_PHRASE] + modelCmds[FLASH_CMD_PROGRAM_SECTION]) == programs);
+	CHECK(modelCmds[FLASH_CMD_ERASE_SECTOR] == 0);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests each record written, as the store fills and is erased,
+reads back, and reads through firmware that stored no CRC
+*/
+static void TestWrites(CFlash* flash)
+{
+	uint8 data[TEST_LENGTH];
+
+	ModelReset();
+	CFlashData store(flash, TEST_STORE, TEST_STORE_SIZE);
+	for(uint32 idx = 0; idx < 200; idx++) {
+		testData[0] = (uint8)idx;
+		CHECK(store.Write(testData, TEST_LENGTH));
+		CHECK(LegacyRead(data) == TEST_LENGTH);
+		CHECK(memcmp(data, testData, TEST_LENGTH) == 0);
+	}
+	printf("writes: 200 records with %u sector erases\n", modelCmds[FLASH_CMD_ERASE_SECTOR]);
+	CHECK(modelCmds[FLASH_CMD_ERASE_SECTOR] > 0);
+
+	CFlashData reopened(flash, TEST_STORE, TEST_STORE_SIZE);
+	CHECK(reopened.Read(data) == TEST_LENGTH);
+	CHECK(memcmp(data, testData, TEST_LENGTH) == 0);
+	testData[0] = 0;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests a record whose data doesn't match its CRC is refused, and
+the store erased
+*/
+static void TestCorrupt(CFlash* flash)
+{
+	uint8 data[TEST_LENGTH];
+
+	ModelReset();
+	{
+		CFlashData store(flash, TEST_STORE, TEST_STORE_SIZE);
+		CHECK(store.Write(testData, TEST_LENGTH));
+	}
+	*HostMem(TEST_STORE + sizeof(TFlashDataHeader) + 10) &= 0x0F;
+
+	CFlashData store(flash, TEST_STORE, TEST_STORE_SIZE);
+	CHECK(store.GetReadLength() == 0);
+	CHECK(store.Read(data) == 0);
+	flash->Wait();
+	CHECK(ModelBlank(TEST_STORE, TEST_STORE_SIZE));
+}
+
+//==============================================================================
+int main(int argc, char** argv)
+{
+	ModelInit();
+	for(uint32 idx = 0; idx < sizeof(testData); idx++)
+		testData[idx] = (uint8)((idx * 29) + 0xC0);
+
+	CFlash flash;
+	TestLegacy(&flash);
+	TestWrites(&flash);
+	TestCorrupt(&flash);
+
+	return HostResult();
+}
@@ -0,0 +1,213 @@
+/*==============================================================================
+Host test of the CFlash background job queue, on the FTFE model
+(flash_model.hpp), with each job command held in progress until the test
+steps it, raising the command complete interrupt.
+
+Checked is that an erase job skips blank sectors and erases the rest
+(including sectors dirty only near their end), that IsBusy frees each flash
+block once the job has moved past it, that program jobs give the same contents
+as FlashProgram (padding a short last phrase with erased bytes), that a verify
+job of programmed flash fails at the right address, that jobs are refused when
+the queue is full or outside the blocks jobs may modify, that blocking commands
+finish the queue first (stepping the jobs themselves when the interrupt can't
+be serviced), and that CFlashData erases a used store in the background.
+
+Build and run with run_tests.sh, which builds the flash driver with the
+routines the model replaces weakened.
+
+14/03/2018 - Created v1.0 of file
+==============================================================================*/
+#include "flash_model.hpp"
+#include "flash_data.hpp"
+
+#define TEST_ADDR			0x80000				/*!< Start of scratch memory, in block 2 */
+#define TEST_SIZE			0x70000				/*!< Size of scratch memory, up to the settings in block 3 */
+#define TEST_PROG_SIZE		5003
+
+static uint8 testData[TEST_PROG_SIZE + 8];
+
+//==============================================================================
+//Models
+//==============================================================================
+/*!
+Class that records the jobs reported finished
+*/
+class CJobRecord {
+	public:
+		uint32 Count;								/*!< Number of jobs reported */
+		TFlashJob Last;								/*!< The last job reported */
+		CFlashJobCallback Callback;
+
+		CJobRecord() { Count = 0; Callback.Set(this, &CJobRecord::OnDone); }
+
+		void OnDone(PFlashJob job) {
+			Count++;
+			Last = *job;
+		}
+};
+
+/*!-----------------------------------------------------------------------------
+Function that fills a range of the mapped flash with a non-blank pattern
+*/
+static void FillFlash(uint32 addr, uint32 size)
+{
+	for(uint32 idx = 0; idx < size; idx++)
+		*HostMem(addr + idx) = (uint8)((addr + idx) * 7);
+}
+
+//==============================================================================
+//Tests
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that tests erasing scratch memory in the background
+*/
+static void TestErase(CFlash* flash)
+{
+	CJobRecord rec;
+	TFlashStats stats;
+	bool blockFreed = false;
+
+	ModelReset();
+	FillFlash(TEST_ADDR, TEST_SIZE);
+	memset(HostMem(TEST_ADDR + 0x3000), 0xFF, FLASH_SECTOR_SIZE);
+	memset(HostMem(TEST_ADDR + 0x4000), 0xFF, FLASH_SECTOR_SIZE - 1);
+	flash->GetStats(NULL, true);
+	modelDelay = true;
+
+	CHECK(flash->FlashEraseRangeAsync(TEST_ADDR, TEST_SIZE, &rec.Callback, (pointer)0x1234) == FLASH_OK);
+	CHECK(flash->IsBusy(TEST_ADDR, 1));
+	CHECK(flash->IsBusy(0xFF000, 16));
+	CHECK(!flash->IsBusy(0x10000, 0x100));
+	CHECK(IS_BITS_SET(FTFE->FCNFG, FTFE_FCNFG_CCIE_MASK));
+
+	//Block 2 is free to read once the job has moved into block 3
+	while(ModelStep()) {
+		if(!flash->IsBusy(TEST_ADDR, 16) && flash->IsBusy(0xC0000, 16) && (rec.Count == 0))
+			blockFreed = true;
+	}
+	flash->GetStats(&stats, true);
+	modelDelay = false;
+
+	printf("erase: %u verify and %u erase commands, %u sectors erased and %u skipped\n",
+		modelCmds[FLASH_CMD_VERIFY_SECTION], modelCmds[FLASH_CMD_ERASE_SECTOR], stats.SectorsErased, stats.SectorsSkipped);
+	CHECK(blockFreed);
+	CHECK(rec.Count == 1);
+	CHECK(rec.Last.Type == FLASH_JOB_ERASE);
+	CHECK(rec.Last.Result == FLASH_OK);
+	CHECK(rec.Last.Tag == (pointer)0x1234);
+	CHECK(ModelBlank(TEST_ADDR, TEST_SIZE));
+	CHECK(stats.SectorsErased == ((TEST_SIZE / FLASH_SECTOR_SIZE) - 1));
+	CHECK(stats.SectorsSkipped == 1);
+	CHECK(modelCmds[FLASH_CMD_ERASE_SECTOR] == stats.SectorsErased);
+	CHECK(modelCmds[FLASH_CMD_VERIFY_SECTION] == (TEST_SIZE / FLASH_SECTOR_SIZE));
+	CHECK(!flash->IsBusy());
+	CHECK(IS_BITS_CLR(FTFE->FCNFG, FTFE_FCNFG_CCIE_MASK));
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests program and verify jobs, and the jobs refused
+*/
+static void TestProgram(CFlash* flash)
+{
+	CJobRecord rec;
+	CJobRecord verify;
+
+	ModelReset();
+	modelDelay = true;
+
+	CHECK(flash->FlashProgramAsync(TEST_ADDR + 8, testData, TEST_PROG_SIZE, &rec.Callback) == FLASH_OK);
+	CHECK(flash->FlashVerifyRangeAsync(TEST_ADDR, 0x2000, FLASH_MARGIN_NORMAL, &verify.Callback) == FLASH_OK);
+	CHECK(flash->FlashProgramAsync(TEST_ADDR + 0x20000, testData, 64, NULL) == FLASH_OK);
+	CHECK(flash->FlashVerifyRangeAsync(TEST_ADDR + 0x21000, 0x1000, FLASH_MARGIN_NORMAL, &rec.Callback) == FLASH_OK);
+
+	//Refused jobs
+	CHECK(flash->FlashVerifyRangeAsync(TEST_ADDR + 0x21000, 0x1000, FLASH_MARGIN_NORMAL, &rec.Callback) == FLASH_ERR_BUSY);
+	CHECK(flash->FlashEraseRangeAsync(0x10000, 0x1000, &rec.Callback) == FLASH_ERR_RANGE);
+	CHECK(flash->FlashEraseRangeAsync(FLASH_SIZE - 0x1000, 0x2000, &rec.Callback) == FLASH_ERR_RANGE);
+	CHECK(flash->FlashProgramAsync(TEST_ADDR + 4, testData, 8, &rec.Callback) == FLASH_ERR_ADDR);
+	CHECK(flash->FlashProgramAsync(TEST_ADDR, testData, 0, &rec.Callback) == FLASH_ERR_SIZE);
+
+	ModelRun();
+	modelDelay = false;
+
+	CHECK(rec.Count == 2);
+	CHECK(rec.Last.Type == FLASH_JOB_VERIFY);
+	CHECK(rec.Last.Result == FLASH_OK);
+	CHECK(memcmp(HostMem(TEST_ADDR + 8), testData, TEST_PROG_SIZE) == 0);
+	CHECK(*HostMem(TEST_ADDR + 7) == 0xFF);
+	CHECK(*HostMem(TEST_ADDR + 8 + TEST_PROG_SIZE) == 0xFF);
+	CHECK(memcmp(HostMem(TEST_ADDR + 0x20000), testData, 64) == 0);
+	CHECK(modelCmds[FLASH_CMD_PROGRAM_SECTION] > 0);
+
+	//The verify fails at the first sector, which was programmed
+	CHECK(verify.Count == 1);
+	CHECK(verify.Last.Result == FLASH_ERR_MGSTAT0);
+	CHECK(verify.Last.FailAddr == TEST_ADDR);
+
+	//The same program through FlashProgram gives the same contents
+	CHECK(flash->FlashProgram(TEST_ADDR + 0x10008, testData, TEST_PROG_SIZE) == FLASH_OK);
+	CHECK(memcmp(HostMem(TEST_ADDR + 0x10000), HostMem(TEST_ADDR), 0x2000) == 0);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests a blocking command finishes the queued jobs first, when
+the interrupt can't be serviced
+*/
+static void TestSync(CFlash* flash)
+{
+	CJobRecord rec;
+
+	ModelReset();
+	FillFlash(TEST_ADDR + 0x30000, 0x2000);
+	modelDelay = true;
+	CHECK(flash->FlashEraseRangeAsync(TEST_ADDR + 0x30000, 0x2000, &rec.Callback) == FLASH_OK);
+
+	//Complete the first command with the interrupt held off
+	IRQ_DISABLE;
+	modelDelay = false;
+	ModelStep();
+	IRQ_ENABLE;
+	CHECK(rec.Count == 0);
+
+	CHECK(flash->FlashProgram(TEST_ADDR + 0x10000, testData, 100) == FLASH_OK);
+	CHECK(rec.Count == 1);
+	CHECK(rec.Last.Result == FLASH_OK);
+	CHECK(ModelBlank(TEST_ADDR + 0x30000, 0x2000));
+	CHECK(memcmp(HostMem(TEST_ADDR + 0x10000), testData, 100) == 0);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests CFlashData erases a used store in the background, and
+waits for it before writing
+*/
+static void TestFlashData(CFlash* flash)
+{
+	uint32 value = 0xDEADBEEF;
+	uint32 readValue = 0;
+
+	ModelReset();
+	FillFlash(0xF0000, 0x8000);
+
+	CFlashData data(flash, 0xF0000, 0x8000);
+	CHECK(data.IsBusy());
+	CHECK(data.Write(&value, sizeof(value)));
+	CHECK(!data.IsBusy());
+	CHECK(data.Read(&readValue, sizeof(readValue)) == sizeof(readValue));
+	CHECK(readValue == value);
+}
+
+//==============================================================================
+int main(int argc, char** argv)
+{
+	ModelInit();
+	for(uint32 idx = 0; idx < sizeof(testData); idx++)
+		testData[idx] = (uint8)((idx * 13) + 1);
+
+	CFlash flash;
+	TestErase(&flash);
+	TestProgram(&flash);
+	TestSync(&flash);
+	TestFlashData(&flash);
+
+	return HostResult();
+}
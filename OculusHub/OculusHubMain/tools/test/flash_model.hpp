@@ -0,0 +1,484 @@
+/*==============================================================================
+Header of a model of the FTFE flash controller, its program flash and FlexRAM,
+used to run the CFlash driver (and the modules built on it) on a Linux (x86-64)
+host.
+
+Program flash, the FlexRAM and the FMC/FTFE, DWT and SCB/NVIC register pages
+are mapped at their real addresses (apart from the first page of flash, which
+can't be mapped without privileges, so is only mapped by tests that need it
+with ModelMapFirstPage). Each command launched is carried out on
+the mapped flash the way the FTFE does: programming can only clear bits, and
+reports MGSTAT0 if the flash doesn't then read back as the data, erases set
+whole sectors or blocks back to 0xFF, and the verify commands report MGSTAT0
+if the flash doesn't read as erased. Misaligned or out of range commands set
+ACCERR. The swap command steps through the swap states (each change showing
+after the status has been reported a couple of times, as the FTFE updates the
+indicator in the background), and ModelSwapReset exchanges the halves of flash
+the way a reset does once a swap is complete. Setting modelPowerCmds models the
+power being cut after that many more commands, every later command failing.
+Each command advances a modelled time by its typical duration from the data
+sheet, which is written into the DWT cycle counter (at MODEL_CLK_FREQ) so the
+driver's statistics measure it.
+
+The RAM resident command list routine (ExecuteListRam), the list routine run
+from flash (ExecuteListRww), the launch of a single command for background
+jobs (LaunchCmd) and the polling of the controller (Poll) can't run against
+memory that doesn't behave like registers, so run_tests.sh weakens them in the
+driver's object file (see FLASH_MODEL_SYMS there), and the host versions here
+load the registers the same way, then carry out the command. Background job
+commands run straight away (the jobs then being stepped on by Wait or Poll),
+unless modelDelay is set, when they are held in progress (CCIF clear) until
+ModelStep is called, which then raises the command complete interrupt (unless
+held off with g_irqLockCnt). A held command finishes at its modelled time, so
+ModelWait can model the processor doing other work (such as receiving data)
+while the flash is busy, completing the commands due in that time. Poll
+completes a held command first, as the processor would spin until it finished.
+Setting modelListIrq models an interrupt handler running part way through the
+next command list that leaves interrupts open (after its first command from
+RAM, or straight away from flash), and a command launched while a held one is
+still in progress is counted in modelClashes.
+
+Tests including this must link the flash driver's object file built by
+run_tests.sh, and com.cpp.
+
+14/03/2018 - Created v1.0 of file
+==============================================================================*/
+//Prevent multiple inclusions of this file
+#ifndef FLASH_MODEL_HPP
+#define FLASH_MODEL_HPP
+
+#include "flash.hpp"
+#include "host_model.hpp"
+
+//Interrupt handler connected in flash.cpp
+extern "C" void ISR_FTFE(void);
+
+//==============================================================================
+//Register model
+//==============================================================================
+#define MODEL_PAGE				0x1000
+#define MODEL_CLK_FREQ			120000000				/*!< Processor clock the cycle counter is modelled at */
+#define MODEL_FLASH_START		MODEL_PAGE				/*!< Lowest flash address mapped */
+#define MODEL_FLEXRAM_SIZE		0x4000
+#define MODEL_VERIFY_UNIT		16						/*!< Bytes counted by each unit of a Verify Section command (128 bits) */
+#define MODEL_SECTION_UNIT		16						/*!< Bytes counted by each unit of a Program Section command (128 bits) */
+
+//Typical command times from the K60 data sheet, in microseconds
+#define MODEL_US_PHRASE			50.0
+#define MODEL_US_SECTION_KB		5000.0
+#define MODEL_US_CHECK			45.0
+#define MODEL_US_ERASE_SECTOR	14000.0
+#define MODEL_US_ERASE_BLOCK	122000.0
+#define MODEL_US_VERIFY_4KB		100.0
+#define MODEL_US_VERIFY_BLOCK	1700.0
+#define MODEL_US_SWAP			100.0
+
+#define MODEL_FSTAT_ERRORS		(FTFE_FSTAT_ACCERR_MASK | FTFE_FSTAT_FPVIOL_MASK | FTFE_FSTAT_MGSTAT0_MASK)
+
+static double modelUs;					/*!< Modelled time spent running commands */
+static uint32 modelCmds[0x100];			/*!< Commands carried out, by command code */
+static bool modelDelay;					/*!< True if background job commands are held in progress until stepped */
+static bool modelPending;				/*!< True if a held command is in progress */
+static double modelDoneUs;				/*!< Modelled time the held command finishes */
+static uint8 modelSwapState;			/*!< Swap state (EFlashSwapState) */
+static int modelSwapNext = -1;			/*!< Swap state being moved to, or -1 */
+static uint8 modelSwapReports;			/*!< Status reports left before the swap state moves on */
+static uint8 modelSwapBlock;			/*!< Half of flash currently at address 0 */
+static uint32 modelSwapIndicator;		/*!< Address of the swap indicator, once set */
+static uint32 modelFlashStart = MODEL_FLASH_START;	/*!< Lowest flash address mapped, zero once the first page is mapped */
+static int32 modelPowerCmds = -1;		/*!< Commands carried out before the power is cut, or -1 */
+static void (*modelListIrq)();			/*!< Interrupt handler run part way through the next command list, or NULL */
+static uint32 modelClashes;				/*!< Commands launched while a held command was in progress */
+
+#define MODEL_SWAP_REPORTS		2		/*!< Status reports before a swap state change shows */
+
+/*!-----------------------------------------------------------------------------
+Function that returns the address in the FCCOB1 to FCCOB3 registers
+*/
+static uint32 ModelAddr(FLASH_Type* flash)
+{
+	return ((uint32)flash->FCCOB1 << 16) | ((uint32)flash->FCCOB2 << 8) | flash->FCCOB3;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that programs bytes into the mapped flash, which can only clear bits.
+Returns false if the flash doesn't then read back as the data.
+*/
+static bool ModelProgram(uint32 addr, puint8 data, uint32 size)
+{
+	bool ok = true;
+	for(uint32 idx = 0; idx < size; idx++) {
+		puint8 cell = HostMem(addr + idx);
+		*cell &= data[idx];
+		if(*cell != data[idx])
+			ok = false;
+	}
+	return ok;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns true if a range of the mapped flash reads as erased
+*/
+static bool ModelBlank(uint32 addr, uint32 size)
+{
+	for(uint32 idx = 0; idx < size; idx++) {
+		if(*HostMem(addr + idx) != 0xFF)
+			return false;
+	}
+	return true;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns the typical time, in microseconds, the command loaded
+into the FCCOB registers takes
+*/
+static double ModelDuration(FLASH_Type* flash)
+{
+	uint32 units = ((uint32)flash->FCCOB4 << 8) | flash->FCCOB5;
+
+	switch(flash->FCCOB0) {
+		case FLASH_CMD_PROGRAM_PHRASE : return MODEL_US_PHRASE;
+		case FLASH_CMD_PROGRAM_SECTION : return (MODEL_US_SECTION_KB * units * MODEL_SECTION_UNIT) / 1024;
+		case FLASH_CMD_PROGRAM_CHECK : return MODEL_US_CHECK;
+		case FLASH_CMD_ERASE_SECTOR : return MODEL_US_ERASE_SECTOR;
+		case FLASH_CMD_ERASE_BLOCK : return MODEL_US_ERASE_BLOCK;
+		case FLASH_CMD_VERIFY_SECTION : return (MODEL_US_VERIFY_4KB * units * MODEL_VERIFY_UNIT) / 4096;
+		case FLASH_CMD_VERIFY_BLOCK : return MODEL_US_VERIFY_BLOCK;
+		case FLASH_CMD_PFLASH_SWAP : return MODEL_US_SWAP;
+		default : return 0;
+	}
+}
+
+/*!-----------------------------------------------------------------------------
+Function that carries out the command loaded into the FCCOB registers, then
+sets the status flags, advancing the modelled time by its duration
+*/
+static void ModelExec(FLASH_Type* flash)
+{
+	uint32 addr = ModelAddr(flash);
+	uint32 size;
+	bool accerr = false;
+	bool ok = true;
+
+	modelUs += ModelDuration(flash);
+	DWT->CYCCNT = (uint32)(modelUs * (MODEL_CLK_FREQ / 1000000));
+
+	//Once the power has been cut, commands do nothing
+	if(modelPowerCmds == 0) {
+		SET_BITS(flash->FSTAT, FTFE_FSTAT_ACCERR_MASK | FTFE_FSTAT_CCIF_MASK);
+		return;
+	}
+	if(modelPowerCmds > 0)
+		modelPowerCmds--;
+
+	modelCmds[flash->FCCOB0]++;
+	switch(flash->FCCOB0) {
+		case FLASH_CMD_PROGRAM_PHRASE : {
+			uint8 data[FLASH_PHRASE_SIZE] = { flash->FCCOB7, flash->FCCOB6, flash->FCCOB5, flash->FCCOB4, flash->FCCOBB, flash->FCCOBA, flash->FCCOB9, flash->FCCOB8 };
+			accerr = ((addr % FLASH_PHRASE_SIZE) != 0) || (addr < modelFlashStart) || (addr >= FLASH_SIZE);
+			if(!accerr)
+				ok = ModelProgram(addr, data, FLASH_PHRASE_SIZE);
+			break;
+		}
+		case FLASH_CMD_PROGRAM_SECTION : {
+			size = (((uint32)flash->FCCOB4 << 8) | flash->FCCOB5) * MODEL_SECTION_UNIT;
+			accerr = ((addr % MODEL_SECTION_UNIT) != 0) || (size == 0) || (size > MODEL_FLEXRAM_SIZE) || (addr < modelFlashStart)
+				|| ((addr % FLASH_SECTOR_SIZE) + size > FLASH_SECTOR_SIZE) || IS_BITS_CLR(flash->FCNFG, FTFE_FCNFG_RAMRDY_MASK);
+			if(!accerr)
+				ok = ModelProgram(addr, HostMem(FLASH_FLEXRAM_START), size);
+			break;
+		}
+		case FLASH_CMD_PROGRAM_CHECK : {
+			uint8 data[FLASH_LONGWORD_SIZE] = { flash->FCCOBB, flash->FCCOBA, flash->FCCOB9, flash->FCCOB8 };
+			accerr = ((addr % FLASH_LONGWORD_SIZE) != 0) || (addr < modelFlashStart) || (addr >= FLASH_SIZE);
+			if(!accerr)
+				ok = (memcmp(HostMem(addr), data, FLASH_LONGWORD_SIZE) == 0);
+			break;
+		}
+		case FLASH_CMD_ERASE_SECTOR : {
+			accerr = ((addr % FLASH_DPHRASE_SIZE) != 0) || (addr < modelFlashStart) || (addr >= FLASH_SIZE);
+			if(!accerr)
+				memset(HostMem(addr & ~(FLASH_SECTOR_SIZE - 1)), 0xFF, FLASH_SECTOR_SIZE);
+			//Erasing the indicator sector in the inactive half readies the swap
+			if((modelSwapState == FLASH_SWAP_UPDATE) && (modelSwapNext < 0)
+				&& ((addr & ~(FLASH_SECTOR_SIZE - 1)) == ((modelSwapIndicator + FLASH_HALF_SIZE) & ~(FLASH_SECTOR_SIZE - 1))))
+				modelSwapState = FLASH_SWAP_UPDATE_ERASED;
+			break;
+		}
+		case FLASH_CMD_ERASE_BLOCK : {
+			addr &= ~(FLASH_BLOCK_SIZE - 1);
+			accerr = (addr < FLASH_BLOCK_SIZE) || (addr >= FLASH_SIZE);
+			if(!accerr)
+				memset(HostMem(addr), 0xFF, FLASH_BLOCK_SIZE);
+			break;
+		}
+		case FLASH_CMD_VERIFY_SECTION : {
+			size = (((uint32)flash->FCCOB4 << 8) | flash->FCCOB5) * MODEL_VERIFY_UNIT;
+			accerr = ((addr % MODEL_VERIFY_UNIT) != 0) || (size == 0) || (addr < modelFlashStart)
+				|| ((addr / FLASH_BLOCK_SIZE) != ((addr + size - 1) / FLASH_BLOCK_SIZE));
+			if(!accerr)
+				ok = ModelBlank(addr, size);
+			break;
+		}
+		case FLASH_CMD_VERIFY_BLOCK : {
+			addr &= ~(FLASH_BLOCK_SIZE - 1);
+			accerr = (addr < FLASH_BLOCK_SIZE) || (addr >= FLASH_SIZE);
+			if(!accerr)
+				ok = ModelBlank(addr, FLASH_BLOCK_SIZE);
+			break;
+		}
+		case FLASH_CMD_PFLASH_SWAP : {
+			uint8 swapCmd = flash->FCCOB4;
+
+			//A state change shows once the status has been reported enough times
+			if((modelSwapNext >= 0) && (swapCmd == FLASH_SWAP_REPORT_STATUS) && (--modelSwapReports == 0)) {
+				modelSwapState = (uint8)modelSwapNext;
+				modelSwapNext = -1;
+			}
+
+			if(((addr % FLASH_DPHRASE_SIZE) != 0) || (addr >= FLASH_HALF_SIZE))
+				accerr = true;
+			else if((modelSwapState != FLASH_SWAP_UNINIT) && (addr != modelSwapIndicator))
+				accerr = true;
+			else if(swapCmd == FLASH_SWAP_REPORT_STATUS)
+				accerr = false;
+			else if(modelSwapNext >= 0)
+				accerr = true;
+			else if((swapCmd == FLASH_SWAP_SET_INDICATOR_ADDR) && (modelSwapState == FLASH_SWAP_UNINIT)) {
+				modelSwapIndicator = addr;
+				modelSwapNext = FLASH_SWAP_READY;
+				modelSwapReports = MODEL_SWAP_REPORTS;
+			}
+			else if((swapCmd == FLASH_SWAP_SET_IN_PREPARE) && (modelSwapState == FLASH_SWAP_READY)) {
+				modelSwapNext = FLASH_SWAP_UPDATE;
+				modelSwapReports = MODEL_SWAP_REPORTS;
+			}
+			else if((swapCmd == FLASH_SWAP_SET_IN_COMPLETE) && (modelSwapState == FLASH_SWAP_UPDATE_ERASED)) {
+				modelSwapNext = FLASH_SWAP_COMPLETE;
+				modelSwapReports = MODEL_SWAP_REPORTS;
+			}
+			else
+				accerr = true;
+
+			flash->FCCOB5 = modelSwapState;
+			flash->FCCOB6 = modelSwapBlock;
+			flash->FCCOB7 = (modelSwapState == FLASH_SWAP_COMPLETE) ? !modelSwapBlock : modelSwapBlock;
+			break;
+		}
+		default : {
+			accerr = true;
+			break;
+		}
+	}
+
+	if(accerr)
+		SET_BITS(flash->FSTAT, FTFE_FSTAT_ACCERR_MASK);
+	else if(!ok)
+		SET_BITS(flash->FSTAT, FTFE_FSTAT_MGSTAT0_MASK);
+	SET_BITS(flash->FSTAT, FTFE_FSTAT_CCIF_MASK);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that launches the command loaded into the FCCOB registers, clearing
+the error flags, and carries it out straight away
+*/
+static void ModelLaunch(FLASH_Type* flash)
+{
+	if(modelPending)
+		modelClashes++;
+	CLR_BITS(flash->FSTAT, MODEL_FSTAT_ERRORS | FTFE_FSTAT_CCIF_MASK);
+	ModelExec(flash);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that completes the held command, at its modelled finishing time (or
+now, if that has passed), and raises the command complete interrupt if it's
+enabled and interrupts aren't held off.
+Returns false if there was no command held.
+*/
+static bool ModelStep()
+{
+	if(!modelPending)
+		return false;
+
+	modelPending = false;
+	if(modelUs < modelDoneUs)
+		modelUs = modelDoneUs;
+	modelUs -= ModelDuration(FTFE);
+	ModelExec(FTFE);
+	if(IS_BITS_SET(FTFE->FCNFG, FTFE_FCNFG_CCIE_MASK) && (g_irqLockCnt == 0))
+		ISR_FTFE();
+	return true;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that steps through held commands until there are none
+*/
+static void ModelRun()
+{
+	while(ModelStep()) {}
+}
+
+/*!-----------------------------------------------------------------------------
+Function that models the processor spending a time on other work, while held
+commands (and the ones their interrupts launch) finish as their times pass
+*/
+static void ModelWait(double us)
+{
+	double end = modelUs + us;
+
+	while(modelPending && (modelDoneUs <= end) && (g_irqLockCnt == 0))
+		ModelStep();
+	modelUs = end;
+	DWT->CYCCNT = (uint32)(modelUs * (MODEL_CLK_FREQ / 1000000));
+}
+
+/*!-----------------------------------------------------------------------------
+Function that maps the flash and registers, with the flash erased and the
+FlexRAM available as RAM
+*/
+static void ModelInit()
+{
+	HostMap(MODEL_FLASH_START, FLASH_SIZE - MODEL_FLASH_START, 0xFF);
+	HostMap(FLASH_FLEXRAM_START, MODEL_FLEXRAM_SIZE, 0);
+	HostMap(FMC_BASE, 2 * MODEL_PAGE, 0);
+	HostMap(DWT_BASE & ~(MODEL_PAGE - 1), MODEL_PAGE, 0);
+	HostMap(SCS_BASE, MODEL_PAGE, 0);
+
+	FTFE->FSTAT = FTFE_FSTAT_CCIF_MASK;
+	FTFE->FCNFG = FTFE_FCNFG_RAMRDY_MASK;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that maps the first page of flash, returning false if it can't be
+*/
+static bool ModelMapFirstPage()
+{
+	void* ptr = mmap((void*)0, MODEL_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+	if(ptr == MAP_FAILED)
+		return false;
+	memset(ptr, 0xFF, MODEL_PAGE);
+	modelFlashStart = 0;
+	return true;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that erases the whole of the mapped flash, and clears the counters
+*/
+static void ModelReset()
+{
+	memset(HostMem(modelFlashStart), 0xFF, FLASH_SIZE - modelFlashStart);
+	memset(modelCmds, 0, sizeof(modelCmds));
+	modelPending = false;
+	modelPowerCmds = -1;
+	modelListIrq = NULL;
+	modelClashes = 0;
+	modelSwapState = FLASH_SWAP_UNINIT;
+	modelSwapNext = -1;
+	modelSwapBlock = 0;
+	modelSwapIndicator = 0;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that models the flash side of a reset, exchanging the halves of flash
+if a swap was complete, and returning the swap system to ready. The whole of
+the lower half must be mapped, including the first page.
+*/
+static void ModelSwapReset()
+{
+	static uint8 half[FLASH_HALF_SIZE];
+
+	if(modelSwapNext >= 0) {
+		modelSwapState = (uint8)modelSwapNext;
+		modelSwapNext = -1;
+	}
+	if(modelSwapState == FLASH_SWAP_COMPLETE) {
+		memcpy(half, HostMem(0), FLASH_HALF_SIZE);
+		memcpy(HostMem(0), HostMem(FLASH_HALF_SIZE), FLASH_HALF_SIZE);
+		memcpy(HostMem(FLASH_HALF_SIZE), half, FLASH_HALF_SIZE);
+		modelSwapBlock = !modelSwapBlock;
+	}
+	if(modelSwapState != FLASH_SWAP_UNINIT)
+		modelSwapState = FLASH_SWAP_READY;
+
+	modelPending = false;
+	FTFE->FSTAT = FTFE_FSTAT_CCIF_MASK;
+	FTFE->FCNFG = FTFE_FCNFG_RAMRDY_MASK;
+}
+
+//==============================================================================
+//Host versions of the driver's command launch routines
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that runs a list of commands as the RAM resident routine does
+*/
+void CFlash::ExecuteListRam(FLASH_Type* flash, PFlashCmd cmds, uint16 count, bool irqWindow, puint16 done)
+{
+	uint16 idx;
+
+	for(idx = 0; idx < count; idx++) {
+		*((volatile uint32*)&flash->FCCOB3) = cmds[idx].Cmd;
+		*((volatile uint32*)&flash->FCCOB7) = cmds[idx].Param1;
+		*((volatile uint32*)&flash->FCCOBB) = cmds[idx].Param2;
+		ModelLaunch(flash);
+
+		if(IS_BITS_SET(flash->FSTAT, MODEL_FSTAT_ERRORS))
+			break;
+
+		//Pending interrupts are serviced between commands
+		if(irqWindow && modelListIrq) {
+			void (*handler)() = modelListIrq;
+			modelListIrq = NULL;
+			handler();
+		}
+	}
+
+	*done = idx;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that runs a list of commands as the routine run from flash does
+*/
+void CFlash::ExecuteListRww(FLASH_Type* flash, PFlashCmd cmds, uint16 count, puint16 done)
+{
+	//Interrupts are left enabled throughout
+	if((g_irqLockCnt == 0) && modelListIrq) {
+		void (*handler)() = modelListIrq;
+		modelListIrq = NULL;
+		handler();
+	}
+	CFlash::ExecuteListRam(flash, cmds, count, false, done);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that launches a background job's command, holding it in progress if
+modelDelay is set
+*/
+void CFlash::LaunchCmd()
+{
+	if(modelDelay) {
+		CLR_BITS(_flash->FSTAT, MODEL_FSTAT_ERRORS | FTFE_FSTAT_CCIF_MASK);
+		modelPending = true;
+		modelDoneUs = modelUs + ModelDuration(_flash);
+	}
+	else {
+		ModelLaunch(_flash);
+	}
+}
+
+/*!-----------------------------------------------------------------------------
+Function that services the controller as the driver's version does, first
+completing a held command, which the processor would spin waiting for
+*/
+void CFlash::Poll()
+{
+	ModelStep();
+	if(IS_BITS_SET(_flash->FSTAT, FTFE_FSTAT_CCIF_MASK)) {
+		IRQ_DISABLE;
+		this->DoISR();
+		IRQ_ENABLE;
+	}
+}
+
+//==============================================================================
+#endif
@@ -0,0 +1,581 @@
+/*==============================================================================
+Host test and benchmark of CFlashProg programming scratch memory, on the FTFE
+model (flash_model.hpp).
+
+Checked is that ProgInit only starts erasing the first sector of scratch
+memory, that blocks are accepted straight away while scratch memory is erased
+just ahead of them in the background, that erasing stops at the program length
+(leaving the rest of scratch memory as it was), that scratch memory then holds
+the program ProgUpdate accepts (recorded at the length older bootloaders
+read), and that a background job failing is reported
+by the next block. Windowed blocks already programmed are checked to be
+acknowledged, and blocks any distance beyond the window refused. Blocks are
+checked to be accepted while the staging buffer before them is programmed in
+the background, only waiting for it once the other buffer fills, and not at
+all over a link slower than the flash.
+Compressed programs, plain and encrypted, sent as windowed blocks with each
+pair out of order, are checked to be decompressed into scratch memory, and a
+corrupt stream to be rejected. Delta programs, patched
+against the program installed in the main section, are checked the same way,
+and refused when no program was recorded there or the patch was made against a
+different one. The modelled flash time before the first block can be
+acknowledged, and for the whole program, is then measured against erasing all
+of scratch memory up front, and the time to send a program over links of
+different speeds (with the block framing and decoding time modelled) is
+compared with the link and flash times alone.
+
+Build and run with run_tests.sh, which builds the flash driver with the
+routines the model replaces weakened.
+
+14/03/2018 - Created v1.0 of file
+==============================================================================*/
+#include "flash_model.hpp"
+#include "flash_prog.hpp"
+#include "lz.hpp"
+#include "delta.hpp"
+#include "tea.hpp"
+
+#define TEST_BLOCK_SIZE		128						/*!< Size of the blocks sent, as PROG_BLOCK commands carry */
+#define TEST_PROG_SIZE		(120 * 1024 + 100)		/*!< A program much smaller than scratch memory, ending part way into a sector */
+#define TEST_FRAME_SIZE		16						/*!< Bytes of framing sent around each block, and each acknowledgement */
+#define TEST_US_DECODE		0.45					/*!< Processor time per byte to decode, checksum and hash a block */
+
+static uint8 testData[FLASH_SCRATCH_SIZE];
+static uint8 testComp[FLASH_SCRATCH_SIZE + 1024];
+static uint8 testImage[FLASH_SCRATCH_SIZE];
+static uint8 testPatch[(FLASH_SCRATCH_SIZE * 2) + 1024];
+
+//==============================================================================
+//Models
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that fills scratch memory with an old program, so it needs erasing
+*/
+static void FillScratch()
+{
+	for(uint32 idx = 0; idx < FLASH_SCRATCH_SIZE; idx++)
+		*HostMem(FLASH_SCRATCH_START + idx) = (uint8)((idx * 13) + 5);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that starts programming a program, with the hash the sender signs the
+programming parameters with
+*/
+static EFlashProgReturn SendInit(CFlashProg* prog, puint8 data, uint32 length, EFlashProgDataFormat format)
+{
+	TFlashProgInit init;
+	char hashStr[256];
+
+	memset(&init, 0, sizeof(init));
+	init.Section = FLASH_SECTION_MAIN;
+	init.DataFormat = format;
+	init.Length = length;
+	init.Checksum = CCrc32::CalcBuffer(data, length, CRC32_GEN_POLY, 0);
+
+	int hashStrLen = snprintf(hashStr, sizeof(hashStr), "%s-%.5u-%u-%u-%.6u-%u-%u-%.8X", FLASH_HASH_KEY, init.PartNumber,
+		init.PartRevMin, init.PartRevMax, init.SerialNumber, init.DataFormat, init.Length, init.Checksum);
+	CSha1::Calc((puint8)hashStr, hashStrLen, init.Hash);
+
+	return prog->ProgInit(&init);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that sends a binary program in blocks, padding the last to a whole
+number of words. Returns the first failure, or FPROG_OK.
+*/
+static EFlashProgReturn SendBlocks(CFlashProg* prog, puint8 data, uint32 length)
+{
+	uint8 block[TEST_BLOCK_SIZE];
+
+	for(uint32 offset = 0; offset < length; offset += TEST_BLOCK_SIZE) {
+		uint32 size = length - offset;
+		if(size > TEST_BLOCK_SIZE)
+			size = TEST_BLOCK_SIZE;
+		memset(block, 0, sizeof(block));
+		memcpy(block, data + offset, size);
+
+		EFlashProgReturn result = prog->ProgScratch(block, (size + 3) & ~3);
+		if(result != FPROG_OK)
+			return result;
+	}
+	return FPROG_OK;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that sends a binary program in blocks over a modelled link, taking the
+time to receive and decode each block, and to send its acknowledgement, while
+the flash carries on in the background. The time spent waiting on the flash to
+accept blocks is added to waitUs. Returns the first failure, or FPROG_OK.
+*/
+static EFlashProgReturn SendLink(CFlashProg* prog, puint8 data, uint32 length, double usPerByte, double* waitUs)
+{
+	uint8 block[TEST_BLOCK_SIZE];
+
+	for(uint32 offset = 0; offset < length; offset += TEST_BLOCK_SIZE) {
+		uint32 size = length - offset;
+		if(size > TEST_BLOCK_SIZE)
+			size = TEST_BLOCK_SIZE;
+		memset(block, 0, sizeof(block));
+		memcpy(block, data + offset, size);
+		size = (size + 3) & ~3;
+
+		ModelWait(((size + TEST_FRAME_SIZE) * usPerByte) + (size * TEST_US_DECODE));
+		double start = modelUs;
+		EFlashProgReturn result = prog->ProgScratch(block, size);
+		*waitUs += modelUs - start;
+		if(result != FPROG_OK)
+			return result;
+		ModelWait(TEST_FRAME_SIZE * usPerByte);
+	}
+	return FPROG_OK;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that encrypts a block as the sender does, with the key ProgDecode
+decrypts it with for its sequence number
+*/
+static void EncryptBlock(uint16 seq, puint8 data, uint16 length)
+{
+	uint8 key[16];
+
+	int len = snprintf((pchar)key, 14+1, FLASH_HASH_KEY);
+	for(int idx = len; idx < 14; idx++)
+		key[idx] = 0;
+	key[14] = (uint8)(seq & 0xFF);
+	key[15] = (uint8)((seq >> 8) & 0xFF);
+	CXxTea::Encrypt((puint32)data, length / 4, (puint32)key);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that sends a stream as windowed blocks, swapping each pair so the
+second is staged until the first arrives, and encrypting them if required.
+Returns the first failure, or FPROG_OK.
+*/
+static EFlashProgReturn SendWindowed(CFlashProg* prog, puint8 data, uint32 length, bool encrypt)
+{
+	uint8 block[2][TEST_BLOCK_SIZE];
+	uint16 blockLength[2];
+	uint32 blocks = (length + TEST_BLOCK_SIZE - 1) / TEST_BLOCK_SIZE;
+
+	for(uint32 seq = 0; seq < blocks; seq += 2) {
+		for(uint32 idx = 0; idx < 2; idx++) {
+			uint32 offset = (seq + idx) * TEST_BLOCK_SIZE;
+			uint32 size = (offset < length) ? (length - offset) : 0;
+			if(size > TEST_BLOCK_SIZE)
+				size = TEST_BLOCK_SIZE;
+			memset(block[idx], 0, TEST_BLOCK_SIZE);
+			memcpy(block[idx], data + offset, size);
+			blockLength[idx] = (uint16)((size < 8) ? 8 : ((size + 3) & ~3));
+			if(encrypt)
+				EncryptBlock((uint16)(seq + idx), block[idx], blockLength[idx]);
+		}
+
+		EFlashProgReturn result = FPROG_OK;
+		if((seq + 1) < blocks)
+			result = prog->ProgScratchBlock((uint16)(seq + 1), block[1], blockLength[1]);
+		if(result == FPROG_OK)
+			result = prog->ProgScratchBlock((uint16)seq, block[0], blockLength[0]);
+		if(result != FPROG_OK)
+			return result;
+	}
+	return FPROG_OK;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that installs a program in the main section, recording its checksum
+(or not, if it isn't valid) as a completed update does
+*/
+static void Install(CFlashProg* prog, puint8 data, uint32 length, bool valid, uint32 checksum)
+{
+	TFlashProgInfo info;
+
+	memset(HostMem(FLASH_MAIN_START), 0xFF, FLASH_MAIN_SIZE);
+	memcpy(HostMem(FLASH_MAIN_START), data, length);
+	memset(&info, 0, sizeof(info));
+	info.Firmware[FLASH_SECTION_MAIN].Valid = valid;
+	info.Firmware[FLASH_SECTION_MAIN].Checksum = checksum;
+	CHECK(prog->WriteInfo(&info));
+}
+
+//==============================================================================
+//Tests
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that tests ProgInit only queues an erase of the first sector, and
+returns while it is still running
+*/
+static void TestInit(CFlash* flash)
+{
+	ModelReset();
+	FillScratch();
+	CFlashProg prog(flash, FLASH_PROGINFO_START, FLASH_PROGINFO_SIZE);
+	modelDelay = true;
+
+	CHECK(SendInit(&prog, testData, TEST_PROG_SIZE, FPROG_DATA_BINARY) == FPROG_OK);
+	CHECK(prog.IsBusy());
+	CHECK(modelCmds[FLASH_CMD_ERASE_SECTOR] == 0);
+
+	ModelRun();
+	modelDelay = false;
+
+	CHECK(!prog.IsBusy());
+	CHECK(modelCmds[FLASH_CMD_ERASE_SECTOR] == 1);
+	CHECK(ModelBlank(FLASH_SCRATCH_START, FLASH_SECTOR_SIZE));
+	CHECK(*HostMem(FLASH_SCRATCH_START + FLASH_SECTOR_SIZE) != 0xFF);
+	prog.ProgReset();
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests a program is accepted block by block, with scratch memory
+only erased up to the end of the program
+*/
+static void TestProgram(CFlash* flash)
+{
+	uint8 hash[SHA1_HASH_SIZE];
+	uint32 progEnd = (TEST_PROG_SIZE + FLASH_SECTOR_SIZE - 1) & ~(FLASH_SECTOR_SIZE - 1);
+
+	ModelReset();
+	FillScratch();
+	CFlashProg prog(flash, FLASH_PROGINFO_START, FLASH_PROGINFO_SIZE);
+
+	CHECK(SendInit(&prog, testData, TEST_PROG_SIZE, FPROG_DATA_BINARY) == FPROG_OK);
+	CHECK(SendBlocks(&prog, testData, TEST_PROG_SIZE) == FPROG_OK);
+	CSha1::Calc(testData, TEST_PROG_SIZE, hash);
+	CHECK(prog.ProgUpdate(hash) == FPROG_REBOOT_NOW);
+
+	printf("program: %u sector erases for %u bytes\n", modelCmds[FLASH_CMD_ERASE_SECTOR], TEST_PROG_SIZE);
+	CHECK(memcmp(HostMem(FLASH_SCRATCH_START), testData, TEST_PROG_SIZE) == 0);
+	CHECK(ModelBlank(FLASH_SCRATCH_START + TEST_PROG_SIZE, progEnd - TEST_PROG_SIZE));
+	CHECK(modelCmds[FLASH_CMD_ERASE_SECTOR] == (progEnd / FLASH_SECTOR_SIZE));
+	CHECK(modelCmds[FLASH_CMD_ERASE_BLOCK] == 0);
+	CHECK(*HostMem(FLASH_SCRATCH_START + progEnd) == (uint8)((progEnd * 13) + 5));
+
+	//The update is recorded for the bootloader to copy
+	TFlashProgInfo info;
+	CHECK(prog.ReadInfo(&info));
+	CHECK(info.FlashUpdate.Update);
+	CHECK(info.FlashUpdate.SrcLength == TEST_PROG_SIZE);
+
+	//At the length bootloaders built before the Swap field require
+	CFlashData store(flash, FLASH_PROGINFO_START, FLASH_PROGINFO_SIZE);
+	CHECK(store.GetReadLength() == offsetof(TFlashProgInfo, Swap));
+	prog.UpdateClear();
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests a background program failing is reported by the next block
+*/
+static void TestFail(CFlash* flash)
+{
+	ModelReset();
+	FillScratch();
+	CFlashProg prog(flash, FLASH_PROGINFO_START, FLASH_PROGINFO_SIZE);
+
+	//Spoil the first sector once it's been erased, so programming it fails
+	CHECK(SendInit(&prog, testData, TEST_PROG_SIZE, FPROG_DATA_BINARY) == FPROG_OK);
+	flash->Wait();
+	*HostMem(FLASH_SCRATCH_START + 0x100) = 0;
+
+	EFlashProgReturn result = SendBlocks(&prog, testData, 2 * FLASH_SECTOR_SIZE);
+	CHECK(result == FPROG_FLASH_ERROR);
+	CHECK(prog.ProgScratch(testData, TEST_BLOCK_SIZE) == FPROG_INIT_ERROR);
+	flash->Wait();
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests windowed blocks already programmed are acknowledged, and
+blocks beyond the window refused, however far ahead they are
+*/
+static void TestWindow(CFlash* flash)
+{
+	uint8 block[8];
+	uint16 next;
+	uint32 staged;
+
+	ModelReset();
+	CFlashProg prog(flash, FLASH_PROGINFO_START, FLASH_PROGINFO_SIZE);
+	CHECK(SendInit(&prog, testData, TEST_PROG_SIZE, FPROG_DATA_BINARY) == FPROG_OK);
+
+	memcpy(block, testData, sizeof(block));
+	CHECK(prog.ProgScratchBlock(0, block, sizeof(block)) == FPROG_OK);
+	memcpy(block, testData + 8, sizeof(block));
+	CHECK(prog.ProgScratchBlock(2, block, sizeof(block)) == FPROG_OK);
+
+	//A retransmission of the block programmed is ignored
+	CHECK(prog.ProgScratchBlock(0, block, sizeof(block)) == FPROG_OK);
+
+	//Blocks beyond the window are refused, including those half the sequence
+	//range or more ahead, which small blocks can reach
+	CHECK(prog.ProgScratchBlock(1 + FLASH_PROG_WINDOW_SLOTS + 1, block, sizeof(block)) == FPROG_WINDOW_ERROR);
+	CHECK(prog.ProgScratchBlock(0x8001, block, sizeof(block)) == FPROG_WINDOW_ERROR);
+	CHECK(prog.ProgScratchBlock(0xFFFF, block, sizeof(block)) == FPROG_WINDOW_ERROR);
+
+	prog.ProgWindowAck(&next, &staged);
+	CHECK(next == 1);
+	CHECK(staged == BIT(0));
+
+	//The block missing lets the staged one be programmed
+	memcpy(block, testData + 8, sizeof(block));
+	CHECK(prog.ProgScratchBlock(1, block, sizeof(block)) == FPROG_OK);
+	prog.ProgWindowAck(&next, &staged);
+	CHECK(next == 3);
+	CHECK(staged == 0);
+	prog.ProgReset();
+	flash->Wait();
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests blocks are accepted while the staging buffer before them is
+programmed in the background, only waiting for it once the other buffer fills
+*/
+static void TestStaging(CFlash* flash)
+{
+	uint8 hash[SHA1_HASH_SIZE];
+	double waitUs = 0;
+
+	ModelReset();
+	FillScratch();
+	CFlashProg prog(flash, FLASH_PROGINFO_START, FLASH_PROGINFO_SIZE);
+	modelDelay = true;
+	CHECK(SendInit(&prog, testData, TEST_PROG_SIZE, FPROG_DATA_BINARY) == FPROG_OK);
+
+	//Once the first buffer is queued, the next block is accepted straight away
+	CHECK(SendLink(&prog, testData, FLASH_PROG_STAGE_SIZE + TEST_BLOCK_SIZE, 0, &waitUs) == FPROG_OK);
+	CHECK(waitUs == 0);
+	CHECK(flash->IsBusy(FLASH_SCRATCH_START, FLASH_PROG_STAGE_SIZE));
+	CHECK(*HostMem(FLASH_SCRATCH_START) != testData[0]);
+
+	//Filling the second buffer waits for the first to be programmed, but not
+	//for the second
+	CHECK(SendLink(&prog, testData + FLASH_PROG_STAGE_SIZE + TEST_BLOCK_SIZE, FLASH_PROG_STAGE_SIZE - TEST_BLOCK_SIZE, 0, &waitUs) == FPROG_OK);
+	CHECK(waitUs > 0);
+	CHECK(memcmp(HostMem(FLASH_SCRATCH_START), testData, FLASH_PROG_STAGE_SIZE) == 0);
+	CHECK(flash->IsBusy(FLASH_SCRATCH_START + FLASH_PROG_STAGE_SIZE, FLASH_PROG_STAGE_SIZE));
+
+	//Over a link slower than the flash, no block waits, and the update
+	//programs the last part-filled buffer
+	waitUs = 0;
+	CHECK(SendLink(&prog, testData + (2 * FLASH_PROG_STAGE_SIZE), TEST_PROG_SIZE - (2 * FLASH_PROG_STAGE_SIZE), 100, &waitUs) == FPROG_OK);
+	CHECK(waitUs == 0);
+	CSha1::Calc(testData, TEST_PROG_SIZE, hash);
+	CHECK(prog.ProgUpdate(hash) == FPROG_REBOOT_NOW);
+	CHECK(!flash->IsBusy());
+	modelDelay = false;
+
+	CHECK(memcmp(HostMem(FLASH_SCRATCH_START), testData, TEST_PROG_SIZE) == 0);
+	prog.UpdateClear();
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests compressed programs, plain and encrypted, are decompressed
+into scratch memory, and a corrupt stream is rejected
+*/
+static void TestCompressed(CFlash* flash)
+{
+	EFlashProgDataFormat formats[] = { FPROG_DATA_COMPRESSED, FPROG_DATA_ENCCOMP };
+	uint8 hash[SHA1_HASH_SIZE];
+
+	//A program that compresses, with runs between the random data
+	for(uint32 idx = 0; idx < TEST_PROG_SIZE; idx++) {
+		if((idx % 3000) < 1000)
+			testData[idx] = (uint8)(idx / 100);
+	}
+	uint32 compLength = CLz::Compress(testData, TEST_PROG_SIZE, testComp, sizeof(testComp), FLASH_PROG_LZ_WINDOW);
+	CHECK(compLength > 0);
+	printf("compressed: %u byte program sent as %u bytes\n", TEST_PROG_SIZE, compLength);
+
+	for(uint32 idx = 0; idx < 2; idx++) {
+		ModelReset();
+		FillScratch();
+		CFlashProg prog(flash, FLASH_PROGINFO_START, FLASH_PROGINFO_SIZE);
+
+		CHECK(SendInit(&prog, testData, TEST_PROG_SIZE, formats[idx]) == FPROG_OK);
+		CHECK(SendWindowed(&prog, testComp, compLength, (formats[idx] == FPROG_DATA_ENCCOMP)) == FPROG_OK);
+		CSha1::Calc(testData, TEST_PROG_SIZE, hash);
+		CHECK(prog.ProgUpdate(hash) == FPROG_REBOOT_NOW);
+		CHECK(memcmp(HostMem(FLASH_SCRATCH_START), testData, TEST_PROG_SIZE) == 0);
+		prog.UpdateClear();
+	}
+
+	//A match referring back before the start of the stream
+	ModelReset();
+	CFlashProg prog(flash, FLASH_PROGINFO_START, FLASH_PROGINFO_SIZE);
+	CHECK(SendInit(&prog, testData, TEST_PROG_SIZE, FPROG_DATA_COMPRESSED) == FPROG_OK);
+	testComp[0] = 0x10;
+	testComp[2] = 0x40;
+	testComp[3] = 0x00;
+	CHECK(SendBlocks(&prog, testComp, TEST_BLOCK_SIZE) == FPROG_DATA_ERROR);
+	CHECK(prog.ProgUpdate(hash) == FPROG_INIT_ERROR);
+	flash->Wait();
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests delta programs are patched against the installed program,
+and refused when it isn't the one the patch was made against
+*/
+static void TestDelta(CFlash* flash)
+{
+	EFlashProgDataFormat formats[] = { FPROG_DATA_COMPDELTA, FPROG_DATA_ENCCOMPDELTA };
+	uint8 hash[SHA1_HASH_SIZE];
+	uint32 insert = 40 * 1024;
+
+	//The new program has a few bytes changed, and 256 bytes inserted
+	uint32 checksum = CCrc32::CalcBuffer(testData, TEST_PROG_SIZE, CRC32_GEN_POLY, 0);
+	memcpy(testImage, testData, insert);
+	for(uint32 idx = 0; idx < 256; idx++)
+		testImage[insert + idx] = (uint8)(idx * 5);
+	memcpy(testImage + insert + 256, testData + insert, TEST_PROG_SIZE - insert);
+	testImage[100] ^= 0x01;
+	testImage[TEST_PROG_SIZE - 10] ^= 0x80;
+	uint32 length = TEST_PROG_SIZE + 256;
+
+	uint32 patchLength = CDelta::Diff(testData, TEST_PROG_SIZE, checksum, testImage, length, testPatch, sizeof(testPatch));
+	uint32 compLength = CLz::Compress(testPatch, patchLength, testComp, sizeof(testComp), FLASH_PROG_LZ_WINDOW);
+	uint32 fullLength = CLz::Compress(testImage, length, testPatch, sizeof(testPatch), FLASH_PROG_LZ_WINDOW);
+	CHECK(compLength > 0);
+	printf("delta: %u byte program sent as %u bytes, against %u compressed\n", length, compLength, fullLength);
+	CHECK(compLength < (fullLength / 10));
+
+	for(uint32 idx = 0; idx < 2; idx++) {
+		ModelReset();
+		FillScratch();
+		CFlashProg prog(flash, FLASH_PROGINFO_START, FLASH_PROGINFO_SIZE);
+		Install(&prog, testData, TEST_PROG_SIZE, true, checksum);
+
+		CHECK(SendInit(&prog, testImage, length, formats[idx]) == FPROG_OK);
+		CHECK(SendWindowed(&prog, testComp, compLength, (formats[idx] == FPROG_DATA_ENCCOMPDELTA)) == FPROG_OK);
+		CSha1::Calc(testImage, length, hash);
+		CHECK(prog.ProgUpdate(hash) == FPROG_REBOOT_NOW);
+		CHECK(memcmp(HostMem(FLASH_SCRATCH_START), testImage, length) == 0);
+		prog.UpdateClear();
+	}
+
+	//A different program recorded as installed
+	ModelReset();
+	CFlashProg prog(flash, FLASH_PROGINFO_START, FLASH_PROGINFO_SIZE);
+	Install(&prog, testData, TEST_PROG_SIZE, true, checksum ^ 1);
+	CHECK(SendInit(&prog, testImage, length, FPROG_DATA_COMPDELTA) == FPROG_OK);
+	CHECK(SendWindowed(&prog, testComp, compLength, false) == FPROG_DATA_ERROR);
+	flash->Wait();
+
+	//No program recorded as installed
+	Install(&prog, testData, TEST_PROG_SIZE, false, checksum);
+	CHECK(SendInit(&prog, testImage, length, FPROG_DATA_COMPDELTA) == FPROG_INIT_ERROR);
+	flash->Wait();
+}
+
+//==============================================================================
+//Benchmark
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that measures the modelled flash time taken before the first block is
+acknowledged, and for the whole program, against erasing scratch memory up front
+*/
+static void Bench(CFlash* flash)
+{
+	uint32 sizes[] = { 120 * 1024, FLASH_SCRATCH_SIZE };
+	uint8 hash[SHA1_HASH_SIZE];
+	double totalUs[2];
+
+	ModelReset();
+	FillScratch();
+	double start = modelUs;
+	CHECK(flash->FlashEraseRange(FLASH_SCRATCH_START, FLASH_SCRATCH_SIZE) == FLASH_OK);
+	double eraseUs = modelUs - start;
+	printf("bench: erasing all of scratch memory up front takes %.1f ms\n", eraseUs / 1000);
+
+	for(uint32 idx = 0; idx < 2; idx++) {
+		ModelReset();
+		FillScratch();
+		CFlashProg prog(flash, FLASH_PROGINFO_START, FLASH_PROGINFO_SIZE);
+
+		start = modelUs;
+		CHECK(SendInit(&prog, testData, sizes[idx], FPROG_DATA_BINARY) == FPROG_OK);
+		CHECK(prog.ProgScratch(testData, TEST_BLOCK_SIZE) == FPROG_OK);
+		double firstUs = modelUs - start;
+
+		CHECK(SendBlocks(&prog, testData + TEST_BLOCK_SIZE, sizes[idx] - TEST_BLOCK_SIZE) == FPROG_OK);
+		CSha1::Calc(testData, sizes[idx], hash);
+		CHECK(prog.ProgUpdate(hash) == FPROG_REBOOT_NOW);
+		totalUs[idx] = modelUs - start;
+		prog.UpdateClear();
+
+		printf("bench: %u byte program, first block acknowledged after %.1f ms, all programmed after %.1f ms\n",
+			sizes[idx], firstUs / 1000, totalUs[idx] / 1000);
+		CHECK(firstUs < (MODEL_US_ERASE_SECTOR * 2));
+	}
+	CHECK(totalUs[0] < (totalUs[1] / 2));
+}
+
+/*!-----------------------------------------------------------------------------
+Function that measures the modelled time to send a program over links of
+different speeds, against the link time and the flash time (with an infinitely
+fast link), as blocks are received while the flash programs the ones before
+*/
+static void BenchLink(CFlash* flash)
+{
+	double usPerByte[] = { 0, 10e6 / 115200, 10e6 / 460800, 10e6 / 921600, 10e6 / 3000000 };
+	uint32 blocks = (TEST_PROG_SIZE + TEST_BLOCK_SIZE - 1) / TEST_BLOCK_SIZE;
+	uint8 hash[SHA1_HASH_SIZE];
+	double flashUs = 0;
+
+	CSha1::Calc(testData, TEST_PROG_SIZE, hash);
+	printf("bench link: %u byte program in %u byte blocks\n", TEST_PROG_SIZE, TEST_BLOCK_SIZE);
+	for(uint32 idx = 0; idx < 5; idx++) {
+		double waitUs = 0;
+
+		ModelReset();
+		FillScratch();
+		CFlashProg prog(flash, FLASH_PROGINFO_START, FLASH_PROGINFO_SIZE);
+		modelDelay = true;
+
+		double start = modelUs;
+		CHECK(SendInit(&prog, testData, TEST_PROG_SIZE, FPROG_DATA_BINARY) == FPROG_OK);
+		CHECK(SendLink(&prog, testData, TEST_PROG_SIZE, usPerByte[idx], &waitUs) == FPROG_OK);
+		CHECK(prog.ProgUpdate(hash) == FPROG_REBOOT_NOW);
+		double totalUs = modelUs - start;
+		modelDelay = false;
+		CHECK(memcmp(HostMem(FLASH_SCRATCH_START), testData, TEST_PROG_SIZE) == 0);
+		prog.UpdateClear();
+
+		double linkUs = (TEST_PROG_SIZE + (blocks * 2 * TEST_FRAME_SIZE)) * usPerByte[idx];
+		if(idx == 0) {
+			flashUs = totalUs;
+			printf("  flash only: %.1f ms\n", flashUs / 1000);
+			continue;
+		}
+		printf("  %7.0f baud: link %.1f ms, all programmed after %.1f ms (%.1f ms waiting on the flash)\n",
+			10e6 / usPerByte[idx], linkUs / 1000, totalUs / 1000, waitUs / 1000);
+
+		//The link and flash overlap, so the upload runs at the speed of the
+		//slower of them, and the link only waits on a flash slower than it
+		CHECK(totalUs < (linkUs + flashUs));
+		CHECK(totalUs < (((linkUs > flashUs) ? linkUs : flashUs) * 1.1));
+		if(idx == 1)
+			CHECK(waitUs == 0);
+	}
+}
+
+//==============================================================================
+int main(int argc, char** argv)
+{
+	ModelInit();
+	uint32 seed = 3;
+	for(uint32 idx = 0; idx < sizeof(testData); idx++) {
+		seed = (seed * 1103515245) + 12345;
+		testData[idx] = (uint8)(seed >> 16);
+	}
+
+	CFlash flash;
+	TestInit(&flash);
+	TestProgram(&flash);
+	TestFail(&flash);
+	TestWindow(&flash);
+	TestStaging(&flash);
+	TestCompressed(&flash);
+	TestDelta(&flash);
+	Bench(&flash);
+	BenchLink(&flash);
+
+	return HostResult();
+}
@@ -0,0 +1,267 @@
+/*==============================================================================
+Host test of CFlash running command lists with interrupts left enabled when
+they don't address the blocks code is read from, on the FTFE model
+(flash_model.hpp).
+
+Checked is that lists on scratch memory and settings storage run from flash
+(counted as RwwLists), that lists on a code block, or a range reaching into
+one, run from RAM, and that moving the vector table moves the protected block.
+An interrupt handler is then modelled queuing a background job part way
+through the lists of a blocking function, both from flash with interrupts
+enabled throughout and from RAM in the window between commands, with the job's
+commands held in progress. The job must not be started until the function has
+finished, so it never launches a command over one of the list's, nor stages
+its data in the FlexRAM while the function is using it, and both end up with
+the right contents.
+
+Build and run with run_tests.sh, which builds the flash driver with the
+routines the model replaces weakened.
+
+14/03/2018 - Created v1.0 of file
+==============================================================================*/
+#include "flash_model.hpp"
+
+#define TEST_ADDR			0x80000				/*!< Start of scratch memory, in block 2 */
+#define TEST_CODE_ADDR		0x40000				/*!< An address in block 1, which code is read from */
+#define TEST_JOB_ADDR		0xC0000				/*!< Where jobs queued by the interrupt handler work, in block 3 */
+#define TEST_SIZE			0x4000
+
+static uint8 testData[TEST_SIZE];
+static uint8 testJobData[FLASH_SECTOR_SIZE];
+
+//==============================================================================
+//Models
+//==============================================================================
+/*!
+Class that records the jobs reported finished
+*/
+class CJobRecord {
+	public:
+		uint32 Count;								/*!< Number of jobs reported */
+		TFlashJob Last;								/*!< The last job reported */
+		CFlashJobCallback Callback;
+
+		CJobRecord() { Count = 0; Callback.Set(this, &CJobRecord::OnDone); }
+
+		void OnDone(PFlashJob job) {
+			Count++;
+			Last = *job;
+		}
+};
+
+static CFlash* testFlash;						/*!< Driver the modelled interrupt handlers queue jobs on */
+static CJobRecord* testRec;						/*!< Record of the jobs they queue */
+static EFlashReturn testQueued;					/*!< Result of queuing the job */
+static bool testStarted;						/*!< True if the job was launched straight away */
+
+/*!-----------------------------------------------------------------------------
+Function that fills a range of the mapped flash with a non-blank pattern
+*/
+static void FillFlash(uint32 addr, uint32 size)
+{
+	for(uint32 idx = 0; idx < size; idx++)
+		*HostMem(addr + idx) = (uint8)((addr + idx) * 7);
+}
+
+/*!-----------------------------------------------------------------------------
+Interrupt handler that queues a program job, which stages its data in the FlexRAM
+*/
+static void QueueProgram()
+{
+	testQueued = testFlash->FlashProgramAsync(TEST_JOB_ADDR, testJobData, sizeof(testJobData), &testRec->Callback);
+	testStarted = modelPending;
+}
+
+/*!-----------------------------------------------------------------------------
+Interrupt handler that queues an erase job
+*/
+static void QueueErase()
+{
+	testQueued = testFlash->FlashEraseRangeAsync(TEST_JOB_ADDR, 2 * FLASH_SECTOR_SIZE, &testRec->Callback);
+	testStarted = modelPending;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that runs a blocking function with the interrupt handler set to run part
+way through its first list, then checks the job it queued was only started
+once the function finished, and completes it
+*/
+static void CheckHeld(CJobRecord* rec)
+{
+	CHECK(modelListIrq == NULL);
+	CHECK(testQueued == FLASH_OK);
+	CHECK(!testStarted);
+	CHECK(modelClashes == 0);
+
+	//The job was started as the function finished
+	CHECK(modelPending);
+	ModelRun();
+	modelDelay = false;
+	CHECK(rec->Count == 1);
+	CHECK(rec->Last.Result == FLASH_OK);
+	CHECK(!testFlash->IsBusy());
+}
+
+//==============================================================================
+//Tests
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that tests which lists are run from flash with interrupts enabled
+*/
+static void TestBlocks(CFlash* flash)
+{
+	TFlashStats stats;
+
+	//Scratch memory and settings storage are run from flash
+	ModelReset();
+	FillFlash(TEST_ADDR, 2 * FLASH_SECTOR_SIZE);
+	flash->GetStats(NULL, true);
+	CHECK(flash->FlashEraseRange(TEST_ADDR, 2 * FLASH_SECTOR_SIZE) == FLASH_OK);
+	CHECK(flash->FlashProgram(0xF0000, testData, 64) == FLASH_OK);
+	CHECK(flash->FlashCheck(0xF0000, testData, 64, FLASH_MARGIN_USER) == FLASH_OK);
+	flash->GetStats(&stats, true);
+	CHECK(ModelBlank(TEST_ADDR, 2 * FLASH_SECTOR_SIZE));
+	CHECK(stats.Lists > 0);
+	CHECK(stats.RwwLists == stats.Lists);
+
+	//The code blocks (0 and 1, as the linker gives no end of program here) are
+	//run from RAM
+	FillFlash(TEST_CODE_ADDR, 2 * FLASH_SECTOR_SIZE);
+	CHECK(flash->FlashEraseRange(TEST_CODE_ADDR, 2 * FLASH_SECTOR_SIZE) == FLASH_OK);
+	CHECK(flash->FlashProgram(0x20000, testData, 64) == FLASH_OK);
+	flash->GetStats(&stats, true);
+	CHECK(ModelBlank(TEST_CODE_ADDR, 2 * FLASH_SECTOR_SIZE));
+	CHECK(stats.Lists > 0);
+	CHECK(stats.RwwLists == 0);
+
+	//A range reaching into a code block runs that block's lists from RAM
+	FillFlash(TEST_ADDR - FLASH_SECTOR_SIZE, 2 * FLASH_SECTOR_SIZE);
+	CHECK(flash->FlashEraseRange(TEST_ADDR - FLASH_SECTOR_SIZE, 2 * FLASH_SECTOR_SIZE) == FLASH_OK);
+	flash->GetStats(&stats, true);
+	CHECK(ModelBlank(TEST_ADDR - FLASH_SECTOR_SIZE, 2 * FLASH_SECTOR_SIZE));
+	CHECK(stats.RwwLists > 0);
+	CHECK(stats.RwwLists < stats.Lists);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests a job queued by an interrupt while FlashProgram runs its
+lists from flash isn't started until it has finished, as it stages sections in
+the FlexRAM between lists
+*/
+static void TestIrqRww(CFlash* flash)
+{
+	CJobRecord rec;
+	TFlashStats stats;
+
+	ModelReset();
+	testFlash = flash;
+	testRec = &rec;
+	testQueued = FLASH_ERR_BUSY;
+	modelDelay = true;
+	modelListIrq = QueueProgram;
+	flash->SetSectionEnable(true);
+	flash->GetStats(NULL, true);
+
+	CHECK(flash->FlashProgram(TEST_ADDR, testData, TEST_SIZE) == FLASH_OK);
+	flash->GetStats(&stats, true);
+	CHECK(stats.Lists > 1);
+	CHECK(stats.RwwLists == stats.Lists);
+	CheckHeld(&rec);
+
+	CHECK(memcmp(HostMem(TEST_ADDR), testData, TEST_SIZE) == 0);
+	CHECK(memcmp(HostMem(TEST_JOB_ADDR), testJobData, sizeof(testJobData)) == 0);
+	flash->SetSectionEnable(FLASH_PGMSEC_ENABLE);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests a job queued by an interrupt in the window between the
+commands of a list run from RAM isn't started until the function has finished,
+so doesn't launch a command over the list's
+*/
+static void TestIrqRam(CFlash* flash)
+{
+	CJobRecord rec;
+	TFlashStats stats;
+
+	ModelReset();
+	FillFlash(TEST_JOB_ADDR, 2 * FLASH_SECTOR_SIZE);
+	testFlash = flash;
+	testRec = &rec;
+	testQueued = FLASH_ERR_BUSY;
+	modelDelay = true;
+	modelListIrq = QueueErase;
+	flash->SetSectionEnable(false);
+	flash->GetStats(NULL, true);
+
+	CHECK(flash->FlashProgram(TEST_CODE_ADDR, testData, 0x200) == FLASH_OK);
+	flash->GetStats(&stats, true);
+	CHECK(stats.Lists > 1);
+	CHECK(stats.RwwLists == 0);
+	CheckHeld(&rec);
+
+	CHECK(memcmp(HostMem(TEST_CODE_ADDR), testData, 0x200) == 0);
+	CHECK(ModelBlank(TEST_JOB_ADDR, 2 * FLASH_SECTOR_SIZE));
+
+	//The same for a check, which reads the flash between its lists
+	FillFlash(TEST_JOB_ADDR, 2 * FLASH_SECTOR_SIZE);
+	rec.Count = 0;
+	testQueued = FLASH_ERR_BUSY;
+	modelDelay = true;
+	modelListIrq = QueueErase;
+	CHECK(flash->FlashCheck(TEST_CODE_ADDR + 1, testData + 1, 0x100, FLASH_MARGIN_USER) == FLASH_OK);
+	CheckHeld(&rec);
+	CHECK(ModelBlank(TEST_JOB_ADDR, 2 * FLASH_SECTOR_SIZE));
+	flash->SetSectionEnable(FLASH_PGMSEC_ENABLE);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests the block holding the vector table is protected, when the
+program runs from scratch memory's block
+*/
+static void TestVectors()
+{
+	TFlashStats stats;
+
+	ModelReset();
+	SCB->VTOR = TEST_ADDR + 0x10000;
+	CFlash flash;
+
+	FillFlash(TEST_ADDR, FLASH_SECTOR_SIZE);
+	FillFlash(0x10000, FLASH_SECTOR_SIZE);
+	flash.GetStats(NULL, true);
+	CHECK(flash.FlashEraseRange(TEST_ADDR, FLASH_SECTOR_SIZE) == FLASH_OK);
+	flash.GetStats(&stats, true);
+	CHECK(stats.Lists > 0);
+	CHECK(stats.RwwLists == 0);
+
+	CHECK(flash.FlashEraseRange(0x10000, FLASH_SECTOR_SIZE) == FLASH_OK);
+	flash.GetStats(&stats, true);
+	CHECK(stats.Lists > 0);
+	CHECK(stats.RwwLists == stats.Lists);
+	CHECK(ModelBlank(TEST_ADDR, FLASH_SECTOR_SIZE));
+	CHECK(ModelBlank(0x10000, FLASH_SECTOR_SIZE));
+	SCB->VTOR = 0;
+}
+
+//==============================================================================
+int main(int argc, char** argv)
+{
+	ModelInit();
+	uint32 seed = 7;
+	for(uint32 idx = 0; idx < sizeof(testData); idx++) {
+		seed = (seed * 1103515245) + 12345;
+		testData[idx] = (uint8)(seed >> 16);
+	}
+	for(uint32 idx = 0; idx < sizeof(testJobData); idx++)
+		testJobData[idx] = (uint8)((idx * 13) + 1);
+
+	{
+		CFlash flash;
+		TestBlocks(&flash);
+		TestIrqRww(&flash);
+		TestIrqRam(&flash);
+	}
+	TestVectors();
+
+	return HostResult();
+}
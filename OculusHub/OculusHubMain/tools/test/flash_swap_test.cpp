@@ -0,0 +1,201 @@
+/*==============================================================================
+Host test of CFlashProg updating firmware by swapping the halves of program
+flash (FLASH_SWAP_ENABLE), on the FTFE model (flash_model.hpp) with its swap
+command, resetting the model between each modelled boot of the program.
+
+Checked is that an update programs the inactive half and completes the swap
+(copying the bootloader and settings across), that another update is refused
+until the device has been reset, that a program confirming itself stays in
+place however often it then boots, that a program which never confirms itself
+is swapped back out after FLASH_SWAP_TRIAL_BOOTS boots, and that the device
+can be updated again after swapping back.
+
+The bootloader is copied from address 0, so the first page must be mapped,
+which needs privileges (see /proc/sys/vm/mmap_min_addr). Without them the
+test is skipped.
+
+Build and run with run_tests.sh, which builds the flash driver with the
+routines the model replaces weakened, and this with FLASH_SWAP_ENABLE set.
+
+14/03/2018 - Created v1.0 of file
+==============================================================================*/
+#include "flash_model.hpp"
+#include "flash_prog.hpp"
+
+#define TEST_BLOCK_SIZE		1024
+
+static uint8 testData[FLASH_MAIN_SIZE];
+static uint8 oldMain[FLASH_MAIN_SIZE];
+
+//==============================================================================
+//Models
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that sends a binary program as an update, with the hash the sender
+signs the programming parameters with, and returns the result of ProgUpdate
+*/
+static EFlashProgReturn Update(CFlash* flash, uint32 length, uint8 seed)
+{
+	CFlashProg prog(flash, FLASH_PROGINFO_START, FLASH_PROGINFO_SIZE);
+	TFlashProgInit init;
+	char hashStr[256];
+	EFlashProgReturn result;
+
+	for(uint32 idx = 0; idx < length; idx++)
+		testData[idx] = (uint8)((idx * 7) + seed);
+
+	memset(&init, 0, sizeof(init));
+	init.Section = FLASH_SECTION_MAIN;
+	init.DataFormat = FPROG_DATA_BINARY;
+	init.Length = length;
+	init.Checksum = CCrc32::CalcBuffer(testData, length, CRC32_GEN_POLY, 0);
+	int hashStrLen = snprintf(hashStr, sizeof(hashStr), "%s-%.5u-%u-%u-%.6u-%u-%u-%.8X", FLASH_HASH_KEY, init.PartNumber,
+		init.PartRevMin, init.PartRevMax, init.SerialNumber, init.DataFormat, init.Length, init.Checksum);
+	CSha1::Calc((puint8)hashStr, hashStrLen, init.Hash);
+
+	result = prog.ProgInit(&init);
+	for(uint32 offset = 0; (result == FPROG_OK) && (offset < length); offset += TEST_BLOCK_SIZE) {
+		uint32 size = length - offset;
+		if(size > TEST_BLOCK_SIZE)
+			size = TEST_BLOCK_SIZE;
+		result = prog.ProgScratch(testData + offset, size);
+	}
+	if(result == FPROG_OK)
+		result = prog.ProgUpdate();
+
+	return result;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that models a reset then a boot of the program, as COculusHub::Run
+starts up, confirming the program (as the first command from the host does)
+if required. Returns false if the program was swapped back out and rebooted.
+*/
+static bool Boot(CFlash* flash, bool confirm, PFlashProgInfo info)
+{
+	ModelSwapReset();
+
+	CFlashProg prog(flash, FLASH_PROGINFO_START, FLASH_PROGINFO_SIZE);
+	if(!prog.SwapBootCheck())
+		return false;
+	prog.UpdateFirmwareInfo();
+	if(confirm)
+		CHECK(prog.SwapConfirm());
+	CHECK(prog.ReadInfo(info));
+	return true;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns true if an area of flash is the same in both halves
+*/
+static bool SameHalves(uint32 addr, uint32 size)
+{
+	return (memcmp(HostMem(addr), HostMem(addr + FLASH_HALF_SIZE), size) == 0);
+}
+
+//==============================================================================
+//Tests
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that tests an update is swapped in, and stays once confirmed
+*/
+static void TestUpdate(CFlash* flash)
+{
+	TFlashProgInfo info;
+
+	memcpy(oldMain, HostMem(FLASH_MAIN_START), FLASH_MAIN_SIZE);
+	uint32 cmds = modelCmds[FLASH_CMD_PFLASH_SWAP];
+	CHECK(Update(flash, 100 * 1024, 0x11) == FPROG_REBOOT_NOW);
+	printf("update: %u swap commands, swap state %u\n", modelCmds[FLASH_CMD_PFLASH_SWAP] - cmds, modelSwapState);
+	CHECK(modelSwapState == FLASH_SWAP_COMPLETE);
+
+	//The inactive half can't be changed again until the halves have swapped
+	CHECK(Update(flash, 1024, 0x22) == FPROG_INIT_ERROR);
+
+	//The first boot runs the new program on trial
+	CHECK(Boot(flash, false, &info));
+	CHECK(modelSwapBlock == 1);
+	CHECK(*HostMem(FLASH_MAIN_START + 5) == (uint8)((5 * 7) + 0x11));
+	CHECK(SameHalves(FLASH_BOOT_START, FLASH_BOOT_SIZE));
+	CHECK(SameHalves(FLASH_SETTINGS_START, FLASH_SETTINGS_SIZE));
+	CHECK(memcmp(HostMem(FLASH_MAIN_START + FLASH_HALF_SIZE), oldMain, FLASH_MAIN_SIZE) == 0);
+	CHECK(info.Swap.Trial);
+	CHECK(info.Swap.Boots == 1);
+
+	//Once confirmed, it stays however often it boots
+	CHECK(Boot(flash, true, &info));
+	CHECK(!info.Swap.Trial);
+	CHECK(info.Swap.Boots == 0);
+	CHECK(info.Firmware[FLASH_SECTION_MAIN].VersionMaj == FIRMWARE_VERSION_MAJOR);
+	for(uint32 idx = 0; idx < (FLASH_SWAP_TRIAL_BOOTS + 2); idx++)
+		CHECK(Boot(flash, false, &info));
+	CHECK(modelSwapBlock == 1);
+	CHECK(!info.Swap.Trial);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests an update that never confirms itself is swapped back out
+*/
+static void TestRollback(CFlash* flash)
+{
+	TFlashProgInfo info;
+	uint32 boots = 0;
+	bool swappedBack = false;
+
+	memcpy(oldMain, HostMem(FLASH_MAIN_START), FLASH_MAIN_SIZE);
+	CHECK(Update(flash, 200 * 1024, 0x33) == FPROG_REBOOT_NOW);
+
+	while(!swappedBack && (boots < 10)) {
+		boots++;
+		swappedBack = !Boot(flash, false, &info);
+		if(boots == 1)
+			CHECK(*HostMem(FLASH_MAIN_START + 9) == (uint8)((9 * 7) + 0x33));
+	}
+	printf("rollback: swapped back on boot %u\n", boots);
+	CHECK(swappedBack);
+	CHECK(boots == (FLASH_SWAP_TRIAL_BOOTS + 1));
+
+	//The previous program runs at the next boot, and isn't on trial
+	CHECK(Boot(flash, false, &info));
+	CHECK(modelSwapBlock == 1);
+	CHECK(memcmp(HostMem(FLASH_MAIN_START), oldMain, FLASH_MAIN_SIZE) == 0);
+	CHECK(!info.Swap.Trial);
+
+	//And can be updated again
+	CHECK(Update(flash, 50 * 1024, 0x44) == FPROG_REBOOT_NOW);
+	CHECK(Boot(flash, true, &info));
+	CHECK(modelSwapBlock == 0);
+	CHECK(*HostMem(FLASH_MAIN_START + 3) == (uint8)((3 * 7) + 0x44));
+	CHECK(!info.Swap.Trial);
+}
+
+//==============================================================================
+int main(int argc, char** argv)
+{
+	TFlashProgInfo info;
+
+	if(!ModelMapFirstPage()) {
+		printf("skipped, the first page of flash can't be mapped without privileges\n");
+		return 0;
+	}
+	ModelInit();
+	ModelReset();
+
+	//The factory program, with its bootloader and settings, in the lower half
+	for(uint32 addr = FLASH_BOOT_START; addr < 0x8000; addr++)
+		*HostMem(addr) = (uint8)((addr * 3) + 1);
+	for(uint32 addr = 0; addr < 0x20000; addr++)
+		*HostMem(FLASH_MAIN_START + addr) = (uint8)(0xA0 ^ addr);
+	for(uint32 addr = 0; addr < 0x100; addr++)
+		*HostMem(FLASH_SETTINGS_START + addr) = (uint8)addr;
+
+	CFlash flash;
+	CHECK(Boot(&flash, true, &info));
+	CHECK(info.Firmware[FLASH_SECTION_MAIN].Valid);
+	CHECK(!info.Swap.Trial);
+
+	TestUpdate(&flash);
+	TestRollback(&flash);
+
+	return HostResult();
+}
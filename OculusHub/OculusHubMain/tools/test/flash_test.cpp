@@ -0,0 +1,444 @@
+/*==============================================================================
+Host test and benchmark of CFlash programming, on the FTFE model
+(flash_model.hpp).
+
+Checked is that FlashProgramSection rejects misaligned, oversized and sector
+crossing runs, that FlashProgram programs aligned runs with Program Section
+commands (clipped at sector boundaries) and the unaligned edges with phrases,
+and falls back to phrases when sections are disabled or the FlexRAM isn't
+ready, that random unaligned programs match a reference image with either
+path, and that reprogramming flash reports MGSTAT0 at the failing address.
+Commands are checked to be launched in lists of up to FLASH_CMD_LIST_SIZE,
+with each section ending its list, and a command failing part way through a
+list to stop it there and be reported at its own address.
+FlashEraseRange is checked to skip blank sectors (finding sectors dirty
+anywhere in them, not just at the start), to erase a covered block with one
+command when enough of its sectors need erasing, and to leave the flash
+outside the range alone.
+The programming rate of both paths is then measured in modelled microseconds
+per KB, from the driver's own statistics, the lists launched for programming,
+checking and erasing are counted against the commands in them, and the
+modelled time to erase scratch memory over images of different sizes is compared with erasing every
+sector.
+
+Build and run with run_tests.sh, which builds the flash driver with the
+routines the model replaces weakened.
+
+14/03/2018 - Created v1.0 of file
+==============================================================================*/
+#include "flash_model.hpp"
+
+#define TEST_ADDR			0x80000				/*!< Start of the area programmed (scratch memory) */
+#define TEST_SIZE			0x40000
+#define BENCH_SIZE			0x10000
+#define SCRATCH_ADDR		0x80000				/*!< Scratch memory, erased ahead of a program update */
+#define SCRATCH_SIZE		0x70000
+
+static uint8 testData[TEST_SIZE];
+static uint8 refImage[TEST_SIZE];
+
+/*!-----------------------------------------------------------------------------
+Function that fills the test data with a pseudo random sequence
+*/
+static void FillData(uint32 seed)
+{
+	for(uint32 idx = 0; idx < sizeof(testData); idx++) {
+		seed = (seed * 1103515245) + 12345;
+		testData[idx] = (uint8)(seed >> 16);
+	}
+}
+
+//==============================================================================
+//Tests
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that tests programming single sections
+*/
+static void TestSection(CFlash* flash)
+{
+	ModelReset();
+	CHECK(flash->FlashProgramSection(TEST_ADDR, testData, FLASH_PGMSEC_SIZE) == FLASH_OK);
+	CHECK(modelCmds[FLASH_CMD_PROGRAM_SECTION] == 1);
+	CHECK(memcmp(HostMem(TEST_ADDR), testData, FLASH_PGMSEC_SIZE) == 0);
+	CHECK(*HostMem(TEST_ADDR + FLASH_PGMSEC_SIZE) == 0xFF);
+
+	//Misaligned, oversized and sector crossing runs are refused before launching
+	CHECK(flash->FlashProgramSection(TEST_ADDR + 0x1008, testData, 16) == FLASH_ERR_ADDR);
+	CHECK(flash->FlashProgramSection(TEST_ADDR + 0x1000, testData, 24) == FLASH_ERR_ADDR);
+	CHECK(flash->FlashProgramSection(TEST_ADDR + 0x1000, testData, FLASH_PGMSEC_SIZE + 16) == FLASH_ERR_SIZE);
+	CHECK(flash->FlashProgramSection(TEST_ADDR + 0x1FF0, testData, 32) == FLASH_ERR_SIZE);
+	CHECK(flash->FlashProgramSection(FLASH_SIZE - 16, testData, 32) == FLASH_ERR_SIZE);
+	CHECK(modelCmds[FLASH_CMD_PROGRAM_SECTION] == 1);
+
+	//The FlexRAM must be available to stage the data
+	CLR_BITS(FTFE->FCNFG, FTFE_FCNFG_RAMRDY_MASK);
+	CHECK(flash->FlashProgramSection(TEST_ADDR + 0x1000, testData, 16) == FLASH_ERR_ACCERR);
+	SET_BITS(FTFE->FCNFG, FTFE_FCNFG_RAMRDY_MASK);
+
+	//Programming over programmed flash fails
+	CHECK(flash->FlashProgramSection(TEST_ADDR, testData + 1, 16) == FLASH_ERR_MGSTAT0);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests the commands FlashProgram uses for aligned and unaligned runs
+*/
+static void TestCommands(CFlash* flash)
+{
+	//A whole sector is four sections
+	ModelReset();
+	flash->SetSectionEnable(true);
+	CHECK(flash->FlashProgram(TEST_ADDR, testData, FLASH_SECTOR_SIZE) == FLASH_OK);
+	CHECK(modelCmds[FLASH_CMD_PROGRAM_SECTION] == (FLASH_SECTOR_SIZE / FLASH_PGMSEC_SIZE));
+	CHECK(modelCmds[FLASH_CMD_PROGRAM_PHRASE] == 0);
+	CHECK(memcmp(HostMem(TEST_ADDR), testData, FLASH_SECTOR_SIZE) == 0);
+
+	//A run starting on a phrase boundary between sections needs one phrase to
+	//align it, and sections are clipped at the sector boundary, leaving 8 bytes
+	ModelReset();
+	CHECK(flash->FlashProgram(TEST_ADDR + 0x1008, testData, 0x1000) == FLASH_OK);
+	CHECK(modelCmds[FLASH_CMD_PROGRAM_PHRASE] == 2);
+	CHECK(modelCmds[FLASH_CMD_PROGRAM_SECTION] == 4);
+	CHECK(memcmp(HostMem(TEST_ADDR + 0x1008), testData, 0x1000) == 0);
+	CHECK(*HostMem(TEST_ADDR + 0x1007) == 0xFF);
+	CHECK(*HostMem(TEST_ADDR + 0x2008) == 0xFF);
+
+	//Unaligned edges are padded with the flash's existing contents
+	ModelReset();
+	CHECK(flash->FlashProgram(TEST_ADDR + 3, testData, 45) == FLASH_OK);
+	CHECK(modelCmds[FLASH_CMD_PROGRAM_PHRASE] == 2);
+	CHECK(modelCmds[FLASH_CMD_PROGRAM_SECTION] == 1);
+	CHECK(memcmp(HostMem(TEST_ADDR + 3), testData, 45) == 0);
+	CHECK(*HostMem(TEST_ADDR + 2) == 0xFF);
+	CHECK(*HostMem(TEST_ADDR + 48) == 0xFF);
+
+	//Only phrases are used with sections disabled, or without the FlexRAM
+	ModelReset();
+	flash->SetSectionEnable(false);
+	CHECK(flash->FlashProgram(TEST_ADDR, testData, FLASH_SECTOR_SIZE) == FLASH_OK);
+	CHECK(modelCmds[FLASH_CMD_PROGRAM_PHRASE] == (FLASH_SECTOR_SIZE / FLASH_PHRASE_SIZE));
+	CHECK(modelCmds[FLASH_CMD_PROGRAM_SECTION] == 0);
+
+	ModelReset();
+	flash->SetSectionEnable(true);
+	CLR_BITS(FTFE->FCNFG, FTFE_FCNFG_RAMRDY_MASK);
+	CHECK(flash->FlashProgram(TEST_ADDR, testData, FLASH_SECTOR_SIZE) == FLASH_OK);
+	CHECK(modelCmds[FLASH_CMD_PROGRAM_SECTION] == 0);
+	CHECK(memcmp(HostMem(TEST_ADDR), testData, FLASH_SECTOR_SIZE) == 0);
+	SET_BITS(FTFE->FCNFG, FTFE_FCNFG_RAMRDY_MASK);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests random unaligned programs, with either path, against a
+reference image
+*/
+static void TestRandom(CFlash* flash)
+{
+	static bool used[TEST_SIZE];
+	uint32 seed = 3;
+	uint32 runs = 0;
+	uint32 bad = 0;
+
+	ModelReset();
+	memset(refImage, 0xFF, sizeof(refImage));
+	memset(used, 0, sizeof(used));
+
+	for(uint32 pass = 0; pass < 400; pass++) {
+		seed = (seed * 1103515245) + 12345;
+		uint32 offset = (seed >> 8) % (TEST_SIZE - 6000);
+		seed = (seed * 1103515245) + 12345;
+		uint32 size = (seed >> 8) % 6000;
+
+		//Only program bytes that haven't been programmed yet
+		bool clash = false;
+		for(uint32 idx = offset; (idx < offset + size) && !clash; idx++)
+			clash = used[idx];
+		if(clash)
+			continue;
+
+		flash->SetSectionEnable((seed & 0x10000) != 0);
+		if(flash->FlashProgram(TEST_ADDR + offset, testData + offset, size) != FLASH_OK)
+			bad++;
+		memcpy(refImage + offset, testData + offset, size);
+		memset(used + offset, 1, size);
+		runs++;
+	}
+
+	printf("random: %u programs, %u section and %u phrase commands, %u failed\n", runs,
+		modelCmds[FLASH_CMD_PROGRAM_SECTION], modelCmds[FLASH_CMD_PROGRAM_PHRASE], bad);
+	CHECK(bad == 0);
+	CHECK(memcmp(HostMem(TEST_ADDR), refImage, TEST_SIZE) == 0);
+	CHECK(modelCmds[FLASH_CMD_PROGRAM_SECTION] > 0);
+	flash->SetSectionEnable(FLASH_PGMSEC_ENABLE);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests reprogramming flash fails at the first changed address
+*/
+static void TestReprogram(CFlash* flash)
+{
+	uint32 failAddr = 0;
+
+	ModelReset();
+	CHECK(flash->FlashProgram(TEST_ADDR, testData, FLASH_SECTOR_SIZE) == FLASH_OK);
+
+	//Programming the same data again clears no more bits, so succeeds
+	CHECK(flash->FlashProgram(TEST_ADDR + 0x100, testData + 0x100, 0x200) == FLASH_OK);
+
+	//Different data fails in the first section
+	CHECK(flash->FlashProgram(TEST_ADDR, testData + 1, FLASH_SECTOR_SIZE, &failAddr) == FLASH_ERR_MGSTAT0);
+	CHECK(failAddr == TEST_ADDR);
+
+	//or the phrase it's in
+	CHECK(flash->FlashProgram(TEST_ADDR + 0x803, testData + 1, 6, &failAddr) == FLASH_ERR_MGSTAT0);
+	CHECK(failAddr == (TEST_ADDR + 0x800));
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests commands are launched in lists, and a command failing part
+way through a list is reported at its address
+*/
+static void TestLists(CFlash* flash)
+{
+	static uint8 data[0x100];
+	TFlashStats stats;
+	uint32 failAddr = 0;
+
+	//Phrases are programmed a full list at a time
+	ModelReset();
+	flash->SetSectionEnable(false);
+	flash->GetStats(NULL, true);
+	CHECK(flash->FlashProgram(TEST_ADDR, testData, 0x3000) == FLASH_OK);
+	flash->GetStats(&stats, true);
+	CHECK(stats.Commands == (0x3000 / FLASH_PHRASE_SIZE));
+	CHECK(stats.Lists == (stats.Commands / FLASH_CMD_LIST_SIZE));
+
+	//as are long word checks, with a partly filled list for the last
+	CHECK(flash->FlashCheck(TEST_ADDR + 3, testData + 3, 0x2000, FLASH_MARGIN_USER) == FLASH_OK);
+	flash->GetStats(&stats, true);
+	CHECK(stats.Commands == ((0x2000 / FLASH_PGMCHK_ALIGN_SIZE) + 1));
+	CHECK(stats.Lists == ((stats.Commands + FLASH_CMD_LIST_SIZE - 1) / FLASH_CMD_LIST_SIZE));
+
+	//A failing check stops its list, and is reported at its long word
+	testData[3 + 0x1235] ^= 0x04;
+	CHECK(flash->FlashCheck(TEST_ADDR + 3, testData + 3, 0x2000, FLASH_MARGIN_USER, &failAddr) == FLASH_ERR_MGSTAT0);
+	testData[3 + 0x1235] ^= 0x04;
+	flash->GetStats(&stats, true);
+	CHECK(failAddr == ((TEST_ADDR + 3 + 0x1235) & ~(FLASH_PGMCHK_ALIGN_SIZE - 1)));
+	CHECK(stats.Commands == (((failAddr - TEST_ADDR) / FLASH_PGMCHK_ALIGN_SIZE) + 1));
+	CHECK(stats.Lists == ((stats.Commands + FLASH_CMD_LIST_SIZE - 1) / FLASH_CMD_LIST_SIZE));
+
+	//A phrase failing part way through a list stops it there, leaving the
+	//phrases after it in the list unprogrammed
+	memset(data, 0x5A, sizeof(data));
+	*HostMem(TEST_ADDR + 0x4048) = 0;
+	modelCmds[FLASH_CMD_PROGRAM_PHRASE] = 0;
+	CHECK(flash->FlashProgram(TEST_ADDR + 0x4000, data, sizeof(data), &failAddr) == FLASH_ERR_MGSTAT0);
+	flash->GetStats(&stats, true);
+	CHECK(failAddr == (TEST_ADDR + 0x4048));
+	CHECK(modelCmds[FLASH_CMD_PROGRAM_PHRASE] == ((0x48 / FLASH_PHRASE_SIZE) + 1));
+	CHECK(stats.Commands == ((0x48 / FLASH_PHRASE_SIZE) + 1));
+	CHECK(stats.Lists == 1);
+	CHECK(memcmp(HostMem(TEST_ADDR + 0x4000), data, 0x48) == 0);
+	CHECK(ModelBlank(TEST_ADDR + 0x4050, sizeof(data) - 0x50));
+
+	//Each section ends its list, so an aligning phrase shares the first
+	ModelReset();
+	flash->SetSectionEnable(true);
+	flash->GetStats(NULL, true);
+	CHECK(flash->FlashProgram(TEST_ADDR + 0x1008, testData, 0x1000) == FLASH_OK);
+	flash->GetStats(&stats, true);
+	CHECK(stats.Commands == 6);
+	CHECK(stats.Lists == 5);
+	flash->SetSectionEnable(FLASH_PGMSEC_ENABLE);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that dirties a byte of each of a number of sectors, at an offset into them
+*/
+static void Dirty(uint32 addr, uint32 sectors, uint32 offset)
+{
+	for(uint32 idx = 0; idx < sectors; idx++)
+		*HostMem(addr + (idx * FLASH_SECTOR_SIZE) + offset) = 0x5A;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that erases a range, returning the statistics
+*/
+static EFlashReturn EraseRange(CFlash* flash, uint32 addr, uint32 size, PFlashStats stats)
+{
+	flash->GetStats(NULL, true);
+	EFlashReturn result = flash->FlashEraseRange(addr, size);
+	flash->GetStats(stats, true);
+	return result;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests erasing ranges, skipping blank sectors
+*/
+static void TestEraseRange(CFlash* flash)
+{
+	TFlashStats stats;
+
+	//A blank block is checked with one command, and nothing is erased
+	ModelReset();
+	CHECK(EraseRange(flash, SCRATCH_ADDR, SCRATCH_SIZE, &stats) == FLASH_OK);
+	CHECK(modelCmds[FLASH_CMD_VERIFY_BLOCK] == 1);
+	CHECK(modelCmds[FLASH_CMD_VERIFY_SECTION] == ((SCRATCH_SIZE - FLASH_BLOCK_SIZE) / FLASH_SECTOR_SIZE));
+	CHECK(modelCmds[FLASH_CMD_ERASE_SECTOR] == 0);
+	CHECK(stats.SectorsSkipped == (SCRATCH_SIZE / FLASH_SECTOR_SIZE));
+
+	//Sectors dirty only near their end are found and erased, and flash either
+	//side of the range is left alone
+	ModelReset();
+	Dirty(SCRATCH_ADDR, 3, FLASH_SECTOR_SIZE - 1);
+	Dirty(SCRATCH_ADDR + 0x5000, 1, 0x900);
+	Dirty(SCRATCH_ADDR + 0x7000, 1, 0);
+	*HostMem(SCRATCH_ADDR - 1) = 0;
+	*HostMem(SCRATCH_ADDR + 0x8000) = 0;
+	CHECK(EraseRange(flash, SCRATCH_ADDR, 0x8000, &stats) == FLASH_OK);
+	CHECK(stats.SectorsErased == 5);
+	CHECK(stats.SectorsSkipped == 3);
+	CHECK(modelCmds[FLASH_CMD_ERASE_SECTOR] == 5);
+	CHECK(ModelBlank(SCRATCH_ADDR, 0x8000));
+	CHECK(*HostMem(SCRATCH_ADDR - 1) == 0);
+	CHECK(*HostMem(SCRATCH_ADDR + 0x8000) == 0);
+
+	//A single sector verify finds a sector dirty past its first 512 bytes
+	ModelReset();
+	Dirty(SCRATCH_ADDR, 1, 0x200);
+	CHECK(flash->FlashVerifySector(SCRATCH_ADDR, FLASH_MARGIN_NORMAL) == FLASH_ERR_MGSTAT0);
+	CHECK(flash->FlashVerifySectors(SCRATCH_ADDR + FLASH_SECTOR_SIZE, 2, FLASH_MARGIN_NORMAL) == FLASH_OK);
+	Dirty(SCRATCH_ADDR + (2 * FLASH_SECTOR_SIZE), 1, FLASH_SECTOR_SIZE - 1);
+	CHECK(flash->FlashVerifySectors(SCRATCH_ADDR + FLASH_SECTOR_SIZE, 2, FLASH_MARGIN_NORMAL) == FLASH_ERR_MGSTAT0);
+
+	//A covered block with enough dirty sectors is erased with one command,
+	//but not one with only a few
+	ModelReset();
+	Dirty(SCRATCH_ADDR, FLASH_ERASE_BLOCK_SECTORS, 0x800);
+	Dirty(SCRATCH_ADDR + FLASH_BLOCK_SIZE, 2, 0x800);
+	CHECK(EraseRange(flash, SCRATCH_ADDR, SCRATCH_SIZE, &stats) == FLASH_OK);
+	CHECK(modelCmds[FLASH_CMD_ERASE_BLOCK] == 1);
+	CHECK(modelCmds[FLASH_CMD_ERASE_SECTOR] == 2);
+	CHECK(stats.SectorsErased == (FLASH_BLOCK_SECTORS + 2));
+	CHECK(ModelBlank(SCRATCH_ADDR, SCRATCH_SIZE));
+
+	//A range past the end of flash is refused
+	CHECK(flash->FlashEraseRange(FLASH_SIZE - FLASH_SECTOR_SIZE, 2 * FLASH_SECTOR_SIZE) == FLASH_ERR_RANGE);
+}
+
+//==============================================================================
+//Benchmark
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that measures the modelled programming rate of both paths
+*/
+static void Bench(CFlash* flash)
+{
+	TFlashStats stats[2];
+
+	for(uint32 pass = 0; pass < 2; pass++) {
+		ModelReset();
+		flash->SetSectionEnable(pass == 1);
+		flash->GetStats(NULL, true);
+		CHECK(flash->FlashProgram(TEST_ADDR, testData, BENCH_SIZE) == FLASH_OK);
+		flash->GetStats(&stats[pass], true);
+		CHECK(memcmp(HostMem(TEST_ADDR), testData, BENCH_SIZE) == 0);
+		CHECK(stats[pass].Bytes == BENCH_SIZE);
+	}
+
+	uint32 phraseUs = stats[0].GetMicrosecondsPerKb(MODEL_CLK_FREQ);
+	uint32 sectionUs = stats[1].GetMicrosecondsPerKb(MODEL_CLK_FREQ);
+	printf("bench %u KB: phrases %u commands %u us/KB, sections %u commands %u us/KB\n",
+		BENCH_SIZE / 1024, stats[0].Commands, phraseUs, stats[1].Commands, sectionUs);
+	CHECK(stats[0].Commands == (BENCH_SIZE / FLASH_PHRASE_SIZE));
+	CHECK(stats[1].Commands == (BENCH_SIZE / FLASH_PGMSEC_SIZE));
+	CHECK(sectionUs < phraseUs);
+	flash->SetSectionEnable(FLASH_PGMSEC_ENABLE);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that counts the lists launched to program, check and erase, against
+the commands in them (each of which was launched on its own before lists)
+*/
+static void BenchLists(CFlash* flash)
+{
+	const char* names[] = { "program phrases", "program sections", "check", "erase range" };
+	TFlashStats stats;
+
+	printf("bench lists %u KB:\n", BENCH_SIZE / 1024);
+	ModelReset();
+	for(uint32 idx = 0; idx < 4; idx++) {
+		flash->SetSectionEnable(idx == 1);
+		flash->GetStats(NULL, true);
+		switch(idx) {
+			case 0 : { CHECK(flash->FlashProgram(TEST_ADDR, testData, BENCH_SIZE) == FLASH_OK); break; }
+			case 1 : { CHECK(flash->FlashProgram(TEST_ADDR + BENCH_SIZE, testData, BENCH_SIZE) == FLASH_OK); break; }
+			case 2 : { CHECK(flash->FlashCheck(TEST_ADDR, testData, BENCH_SIZE, FLASH_MARGIN_USER) == FLASH_OK); break; }
+			default : { CHECK(flash->FlashEraseRange(TEST_ADDR + FLASH_SECTOR_SIZE, 2 * BENCH_SIZE) == FLASH_OK); break; }
+		}
+		flash->GetStats(&stats, true);
+		printf("  %-16s %5u commands in %4u lists (%.1f per list)\n", names[idx], stats.Commands, stats.Lists,
+			(double)stats.Commands / stats.Lists);
+		CHECK(stats.Lists > 0);
+		CHECK(stats.Commands <= (stats.Lists * FLASH_CMD_LIST_SIZE));
+		if((idx == 0) || (idx == 2))
+			CHECK(stats.Lists == (stats.Commands / FLASH_CMD_LIST_SIZE));
+
+		//Verifying stops its list at each dirty sector, but the erases fill theirs
+		if(idx == 3)
+			CHECK(stats.Lists < stats.Commands);
+	}
+	CHECK(ModelBlank(TEST_ADDR + FLASH_SECTOR_SIZE, 2 * BENCH_SIZE));
+	flash->SetSectionEnable(FLASH_PGMSEC_ENABLE);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that measures the modelled time to erase scratch memory holding
+images of different sizes, against erasing every sector
+*/
+static void BenchErase(CFlash* flash)
+{
+	const uint32 images[] = { 0, 120 * 1024, 300 * 1024, SCRATCH_SIZE };
+
+	printf("bench erase %u KB scratch:\n", SCRATCH_SIZE / 1024);
+	for(uint32 idx = 0; idx < (sizeof(images) / sizeof(images[0])); idx++) {
+		TFlashStats stats;
+
+		ModelReset();
+		Dirty(SCRATCH_ADDR, images[idx] / FLASH_SECTOR_SIZE, 0);
+		double start = modelUs;
+		for(uint32 addr = SCRATCH_ADDR; addr < (SCRATCH_ADDR + SCRATCH_SIZE); addr += FLASH_SECTOR_SIZE)
+			CHECK(flash->FlashEraseSector(addr) == FLASH_OK);
+		double oldUs = modelUs - start;
+
+		Dirty(SCRATCH_ADDR, images[idx] / FLASH_SECTOR_SIZE, 0);
+		start = modelUs;
+		CHECK(EraseRange(flash, SCRATCH_ADDR, SCRATCH_SIZE, &stats) == FLASH_OK);
+		double newUs = modelUs - start;
+
+		printf("  image %3u KB: every sector %.1f ms, planned %.1f ms (%u erased, %u skipped)\n",
+			images[idx] / 1024, oldUs / 1000, newUs / 1000, stats.SectorsErased, stats.SectorsSkipped);
+		CHECK(ModelBlank(SCRATCH_ADDR, SCRATCH_SIZE));
+		CHECK(newUs < oldUs);
+	}
+}
+
+//==============================================================================
+int main(int argc, char** argv)
+{
+	ModelInit();
+	FillData(1);
+
+	CFlash flash;
+	TestSection(&flash);
+	TestCommands(&flash);
+	TestRandom(&flash);
+	TestReprogram(&flash);
+	TestLists(&flash);
+	TestEraseRange(&flash);
+	Bench(&flash);
+	BenchLists(&flash);
+	BenchErase(&flash);
+
+	return HostResult();
+}
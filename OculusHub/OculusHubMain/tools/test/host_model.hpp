@@ -0,0 +1,85 @@
+/*==============================================================================
+Header of helpers shared by the host tests, which build firmware modules for a
+Linux (x86-64) host and run them against models of the hardware they use.
+
+Peripherals are modelled by mapping memory at their real addresses (which the
+tests are linked to allow, see run_tests.sh), so the firmware's register
+accesses land in memory the model can inspect and update.
+
+14/03/2018 - Created v1.0 of file
+==============================================================================*/
+//Prevent multiple inclusions of this file
+#ifndef HOST_MODEL_HPP
+#define HOST_MODEL_HPP
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "common.h"
+
+//==============================================================================
+/*! The interrupt lock count used by IRQ_DISABLE and IRQ_ENABLE (see macros.h),
+while non-zero the models hold off calling interrupt handlers */
+volatile uint8 g_irqLockCnt;
+
+/*! Number of failed checks */
+static int g_fails = 0;
+
+/*! Macro that reports a failed check, and counts it */
+#define CHECK(cond) \
+	do { \
+		if(!(cond)) { \
+			printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+			g_fails++; \
+		} \
+	} while(0)
+
+/*!-----------------------------------------------------------------------------
+Function that maps zero or more pages of memory at a fixed address, filled
+with the specified value
+*/
+static void HostMap(uint32 addr, uint32 size, int fill)
+{
+	void* ptr = mmap((void*)(uintptr_t)addr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+	if(ptr == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	memset(ptr, fill, size);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns a pointer to an address in the mapped memory
+*/
+static inline puint8 HostMem(uint32 addr)
+{
+	return (puint8)(uintptr_t)addr;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns a monotonic time, in microseconds
+*/
+static double HostTimeUs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1e6) + (ts.tv_nsec / 1e3);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that prints the test result, and returns the exit code for it
+*/
+static int HostResult()
+{
+	if(g_fails)
+		printf("FAILED %d\n", g_fails);
+	else
+		printf("all passed\n");
+	return (g_fails != 0) ? 1 : 0;
+}
+
+//==============================================================================
+#endif
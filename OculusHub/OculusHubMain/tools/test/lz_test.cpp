@@ -0,0 +1,217 @@
+/*==============================================================================
+Host test of CLz and CLzDecoder.
+
+The compressor is checked against known streams for small inputs, and the
+decoder against hand built streams (overlapping matches, and literal and match
+lengths carried on in extra bytes). Random and repetitive data is then
+compressed and decompressed again through windows of 256 bytes and a sector,
+fed to the decoder in pieces of every size from a byte to a sector, with
+padding after the end of some streams. Streams referring back beyond their
+start or the window are rejected. The compression of this test's own
+executable is printed, as an example of program code.
+
+Build and run with run_tests.sh, or (Linux, from OculusHub):
+	g++ -O1 -std=gnu++11 -w -Dinterrupt= '-D__asm(x)='
+		-IBpClasses/headers -IOculusHub/headers -IOculusHubMain/headers
+		-o lz_test OculusHubMain/tools/test/lz_test.cpp BpClasses/src/lz.cpp
+
+14/03/2018 - Created v1.0 of file
+==============================================================================*/
+#include "host_model.hpp"
+#include "lz.hpp"
+
+#define TEST_SIZE			100000
+#define TEST_EXE_MAX		0x200000
+
+static uint8 testData[TEST_SIZE];
+static uint8 testComp[(TEST_SIZE * 2) + 64];
+static uint8 testOut[TEST_SIZE];
+
+//==============================================================================
+//Models
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that decompresses a stream, fed to the decoder in pieces of up to the
+specified size. Returns the number of bytes decoded, or -1 if the decoder
+failed, handed back more than a window, or didn't reach the end of the stream.
+*/
+static int32 Decompress(puint8 comp, uint32 compLength, uint32 windowSize, uint32 pieceMax, puint8 out, uint32 outSize)
+{
+	CLzDecoder decoder(windowSize);
+	uint32 seed = compLength;
+	uint32 pos = 0;
+	uint32 used;
+	puint8 data;
+	uint32 dataLength;
+
+	for(uint32 offset = 0; offset < compLength; offset += dataLength) {
+		seed = (seed * 1103515245) + 12345;
+		dataLength = 1 + ((seed >> 16) % pieceMax);
+		if(dataLength > (compLength - offset))
+			dataLength = compLength - offset;
+
+		puint8 src = comp + offset;
+		uint32 srcLength = dataLength;
+		do {
+			if(!decoder.Decode(src, srcLength, &used, &data, &seed))
+				return -1;
+			if((seed > windowSize) || ((pos + seed) > outSize))
+				return -1;
+			memcpy(out + pos, data, seed);
+			pos += seed;
+			src += used;
+			srcLength -= used;
+		} while((used > 0) || (seed > 0));
+
+		if(srcLength > 0)
+			return -1;
+	}
+
+	if(!decoder.IsEnd() || (decoder.GetTotal() != pos))
+		return -1;
+	return pos;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that checks data compresses to the expected stream
+*/
+static void Known(const char* data, uint32 length, const uint8* expect, uint32 expectLength)
+{
+	uint8 comp[64];
+	uint32 compLength = CLz::Compress((puint8)data, length, comp, sizeof(comp), 4096);
+	CHECK(compLength == expectLength);
+	CHECK(memcmp(comp, expect, expectLength) == 0);
+	CHECK(Decompress(comp, compLength, 256, 1, testOut, sizeof(testOut)) == (int32)length);
+	CHECK(memcmp(testOut, data, length) == 0);
+}
+
+//==============================================================================
+//Tests
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that tests known streams
+*/
+static void TestKnown()
+{
+	//Empty input is just the end of stream
+	const uint8 empty[] = { 0x00, 0x00, 0x00 };
+	Known("", 0, empty, sizeof(empty));
+
+	//Too short to match
+	const uint8 abc[] = { 0x30, 'a', 'b', 'c', 0x00, 0x00 };
+	Known("abc", 3, abc, sizeof(abc));
+
+	//A run, as a literal followed by a match overlapping it
+	const uint8 run[] = { 0x15, 'a', 0x01, 0x00, 0x00, 0x00, 0x00 };
+	Known("aaaaaaaaaa", 10, run, sizeof(run));
+
+	//Literal count carried on in an extra byte
+	const uint8 lit[] = { 0xF0, 0x05, 'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P', 'Q', 'R', 'S', 'T', 0x00, 0x00 };
+	Known("ABCDEFGHIJKLMNOPQRST", 20, lit, sizeof(lit));
+
+	//Repeat of an earlier phrase overlapping itself, then a last literal
+	const uint8 repeat[] = { 0x56, 'h', 'e', 'l', 'l', 'o', 0x05, 0x00, 0x10, '!', 0x00, 0x00 };
+	Known("hellohellohello!", 16, repeat, sizeof(repeat));
+
+	//Match length carried on in extra bytes (15 + 255 + 2 + LZ_MATCH_MIN), and
+	//padding after the end ignored
+	const uint8 longMatch[] = { 0x1F, 'x', 0x01, 0x00, 0xFF, 0x02, 0x00, 0x00, 0x00, 0xA5, 0xA5, 0xA5 };
+	CHECK(Decompress((puint8)longMatch, sizeof(longMatch), 256, 1, testOut, sizeof(testOut)) == 277);
+	uint32 same = 0;
+	while((same < 277) && (testOut[same] == 'x'))
+		same++;
+	CHECK(same == 277);
+
+	//Offset beyond the start of the stream
+	const uint8 early[] = { 0x10, 'a', 0x05, 0x00 };
+	CHECK(Decompress((puint8)early, sizeof(early), 256, 1, testOut, sizeof(testOut)) < 0);
+
+	//Offset beyond a 256 byte window, once 291 bytes have been decoded
+	const uint8 far[] = { 0x1F, 'y', 0x01, 0x00, 0xFF, 0x10, 0x00, 0x01, 0x01, 0x00, 0x00, 0x00 };
+	CHECK(Decompress((puint8)far, sizeof(far), 4096, 1, testOut, sizeof(testOut)) > 0);
+	CHECK(Decompress((puint8)far, sizeof(far), 256, 1, testOut, sizeof(testOut)) < 0);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests data compresses and decompresses again, through different
+windows and piece sizes
+*/
+static void TestRoundTrip()
+{
+	uint32 lengths[] = { 1, 7, 3000, TEST_SIZE };
+	uint32 windows[] = { 256, 4096 };
+	uint32 pieces[] = { 1, 7, 128, 4096 };
+	uint32 bad = 0;
+	uint32 seed = 4;
+
+	for(uint32 kind = 0; kind < 4; kind++) {
+		for(uint32 idx = 0; idx < TEST_SIZE; idx++) {
+			seed = (seed * 1103515245) + 12345;
+			switch(kind) {
+				case 0 : { testData[idx] = (uint8)(seed >> 16); break; }
+				case 1 : { testData[idx] = 0xFF; break; }
+				case 2 : { testData[idx] = ((idx % 1000) < 500) ? (uint8)(idx % 7) : (uint8)(seed >> 16); break; }
+				default : { testData[idx] = (uint8)((idx / 3) + (seed >> 29)); break; }
+			}
+		}
+
+		for(uint32 len = 0; len < 4; len++) {
+			for(uint32 win = 0; win < 2; win++) {
+				uint32 compLength = CLz::Compress(testData, lengths[len], testComp, sizeof(testComp), windows[win]);
+				if(compLength == 0) {
+					bad++;
+					continue;
+				}
+
+				//Pad some streams to a whole number of words, as the sender does
+				if(kind & 1) {
+					while(compLength & 3)
+						testComp[compLength++] = 0xA5;
+				}
+
+				for(uint32 piece = 0; piece < 4; piece++) {
+					int32 outLength = Decompress(testComp, compLength, windows[win], pieces[piece], testOut, sizeof(testOut));
+					if((outLength != (int32)lengths[len]) || (memcmp(testOut, testData, lengths[len]) != 0))
+						bad++;
+				}
+			}
+		}
+	}
+	printf("round trip: %u failed\n", bad);
+	CHECK(bad == 0);
+
+	//A stream that doesn't fit is refused
+	CHECK(CLz::Compress(testData, TEST_SIZE, testComp, 100, 4096) == 0);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that compresses this test's executable, as an example of program code
+*/
+static void TestProgram(const char* path)
+{
+	static uint8 exe[TEST_EXE_MAX];
+	static uint8 comp[TEST_EXE_MAX * 2];
+	static uint8 out[TEST_EXE_MAX];
+	FILE* file = fopen(path, "rb");
+	if(!file)
+		return;
+	uint32 length = fread(exe, 1, sizeof(exe), file);
+	fclose(file);
+
+	uint32 compLength = CLz::Compress(exe, length, comp, sizeof(comp), 4096);
+	printf("program: %u bytes compressed to %u (%.2f:1)\n", length, compLength, (double)length / compLength);
+	CHECK(compLength > 0);
+	CHECK(compLength < length);
+	CHECK(Decompress(comp, compLength, 4096, 128, out, sizeof(out)) == (int32)length);
+	CHECK(memcmp(out, exe, length) == 0);
+}
+
+//==============================================================================
+int main(int argc, char** argv)
+{
+	TestKnown();
+	TestRoundTrip();
+	TestProgram(argv[0]);
+
+	return HostResult();
+}
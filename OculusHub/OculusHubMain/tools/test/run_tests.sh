@@ -0,0 +1,217 @@
+#!/bin/bash
+#===============================================================================
+# Script that builds and runs the host tests and benchmarks, which compile
+# firmware modules for a Linux (x86-64) host, and run them against models of
+# the hardware they use (see host_model.hpp).
+#
+# Usage:
+#	run_tests.sh [test name ...]
+# With no names, all the tests are run. The executables are built into the
+# directory given by $BUILD (default /tmp/oculushub_test). Each test prints
+# "all passed" and exits with 0 when it succeeds, and benchmarks print their
+# measurements as they go.
+#
+# 14/03/2018 - Created v1.0 of file
+#===============================================================================
+TEST_DIR=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(cd "$TEST_DIR/../../.." && pwd)
+BUILD=${BUILD:-/tmp/oculushub_test}
+mkdir -p "$BUILD"
+cd "$ROOT"
+
+#The firmware is built as it is for the target, except for the interrupt
+#attributes and assembler, and linked at low addresses so the 32-bit pointers
+#the drivers store in registers still work
+CXXFLAGS="-O1 -no-pie -std=gnu++11 -fno-rtti -fno-exceptions -fpermissive -w -Dinterrupt= -D__asm(x)="
+INCLUDES="-IBpClasses/headers -IBpApplication/headers -IBpDevices_K60/headers -IOculusHub/headers -IOculusHubMain/headers -I$TEST_DIR"
+
+#Routines of the flash driver the FTFE model replaces (ExecuteListRam,
+#ExecuteListRww, LaunchCmd and Poll)
+FLASH_MODEL_SYMS="_ZN6CFlash14ExecuteListRamEP9FTFE_TypeP9TFlashCmdtbPt _ZN6CFlash14ExecuteListRwwEP9FTFE_TypeP9TFlashCmdtPt _ZN6CFlash9LaunchCmdEv _ZN6CFlash4PollEv"
+
+PASSED=0
+FAILED=0
+FAILED_NAMES=""
+
+#-------------------------------------------------------------------------------
+# Function that builds a test, from its name, extra flags and source files
+build() {
+	local name=$1
+	shift
+	g++ $CXXFLAGS $INCLUDES "$@" -o "$BUILD/$name" 2> "$BUILD/$name.log"
+}
+
+# Function that builds (if not already) and runs a test, with the remaining arguments
+run() {
+	local name=$1
+	shift
+	echo "=== $name"
+	if [ ! -x "$BUILD/$name" ]; then
+		echo "Build failed, see $BUILD/$name.log"
+		grep -m 10 -E "error|undefined" "$BUILD/$name.log"
+		FAILED=$((FAILED + 1))
+		FAILED_NAMES="$FAILED_NAMES $name"
+		return
+	fi
+	if "$BUILD/$name" "$@"; then
+		PASSED=$((PASSED + 1))
+	else
+		FAILED=$((FAILED + 1))
+		FAILED_NAMES="$FAILED_NAMES $name"
+	fi
+}
+
+# Function that builds the flash driver for the FTFE model (flash_model.hpp),
+# from the object's name and extra flags, weakening the routines the model
+# replaces so its versions are linked instead
+flash_obj() {
+	local name=$1
+	shift
+	g++ $CXXFLAGS $INCLUDES "$@" -c BpDevices_K60/src/flash.cpp -o "$BUILD/$name.o" 2> "$BUILD/$name.log" &&
+		objcopy $(printf -- "-W %s " $FLASH_MODEL_SYMS) "$BUILD/$name.o"
+}
+
+# Function that returns true if a test has been selected on the command line
+selected() {
+	[ ${#SELECT[@]} -eq 0 ] && return 0
+	local sel
+	for sel in "${SELECT[@]}"; do
+		[ "$sel" = "$1" ] && return 0
+	done
+	return 1
+}
+
+SELECT=("$@")
+
+#-------------------------------------------------------------------------------
+if selected spsc_test; then
+	rm -f "$BUILD/spsc_test"
+	build spsc_test -O2 -pthread "$TEST_DIR/spsc_test.cpp"
+	run spsc_test
+fi
+
+#-------------------------------------------------------------------------------
+if selected crc32_test; then
+	rm -f "$BUILD/crc32_test"
+	build crc32_test "$TEST_DIR/crc32_test.cpp" BpClasses/src/crc32.cpp
+	run crc32_test
+fi
+
+#-------------------------------------------------------------------------------
+if selected crc16_test; then
+	rm -f "$BUILD/crc16_test"
+	build crc16_test "$TEST_DIR/crc16_test.cpp" BpClasses/src/crc16.cpp
+	run crc16_test
+fi
+
+#-------------------------------------------------------------------------------
+if selected sha1_test; then
+	rm -f "$BUILD/sha1_test"
+	build sha1_test "$TEST_DIR/sha1_test.cpp" BpClasses/src/sha1.cpp
+	run sha1_test
+fi
+
+#-------------------------------------------------------------------------------
+if selected lz_test; then
+	rm -f "$BUILD/lz_test"
+	build lz_test "$TEST_DIR/lz_test.cpp" BpClasses/src/lz.cpp
+	run lz_test
+fi
+
+#-------------------------------------------------------------------------------
+if selected delta_test; then
+	rm -f "$BUILD/delta_test"
+	build delta_test "$TEST_DIR/delta_test.cpp" BpClasses/src/delta.cpp BpClasses/src/lz.cpp BpClasses/src/crc32.cpp
+	run delta_test
+fi
+
+#Tests of the serial port drivers, on the UART register model (uart_model.hpp)
+UART_SRC="-DUART0_CONNECT_IRQ=true -DUART0_CONNECT_DMA=true BpDevices_K60/src/com_uart.cpp BpDevices_K60/src/com.cpp"
+
+#-------------------------------------------------------------------------------
+for name in uart_dma_test com_bench; do
+	if selected $name; then
+		rm -f "$BUILD/$name"
+		build $name "$TEST_DIR/$name.cpp" $UART_SRC
+		run $name
+	fi
+done
+
+#-------------------------------------------------------------------------------
+if selected dlog_test; then
+	rm -f "$BUILD/dlog_test"
+	build dlog_test "$TEST_DIR/dlog_test.cpp" BpApplication/src/dlog.cpp BpApplication/src/service.cpp BpApplication/src/ticktimer.cpp BpClasses/src/crc16.cpp BpDevices_K60/src/com.cpp
+	run dlog_test
+fi
+
+#-------------------------------------------------------------------------------
+if selected cmd_bench; then
+	rm -f "$BUILD/cmd_bench"
+	build cmd_bench -pthread "$TEST_DIR/cmd_bench.cpp" BpApplication/src/cmd_engine.cpp BpApplication/src/service.cpp BpApplication/src/ticktimer.cpp BpClasses/src/crc16.cpp BpClasses/src/serialize.cpp BpDevices_K60/src/com.cpp
+	run cmd_bench
+fi
+
+#Tests of the flash driver, on the FTFE model (flash_model.hpp)
+FLASH_TESTS="flash_test flash_job_test flash_data_test flash_rww_test flash_prog_test flash_copy_test flash_swap_test"
+FLASH_SRC="$BUILD/flash_model.o BpDevices_K60/src/com.cpp"
+PROG_SRC="BpApplication/src/flash_prog.cpp BpApplication/src/flash_data.cpp BpClasses/src/crc16.cpp BpClasses/src/crc32.cpp BpClasses/src/sha1.cpp BpClasses/src/tea.cpp BpClasses/src/lz.cpp BpClasses/src/delta.cpp BpClasses/src/serialize.cpp"
+for name in $FLASH_TESTS; do
+	if selected $name; then
+		rm -f "$BUILD/flash_model.o"
+		flash_obj flash_model
+		break
+	fi
+done
+
+#-------------------------------------------------------------------------------
+if selected flash_test; then
+	rm -f "$BUILD/flash_test"
+	build flash_test "$TEST_DIR/flash_test.cpp" $FLASH_SRC
+	run flash_test
+fi
+
+#-------------------------------------------------------------------------------
+if selected flash_job_test; then
+	rm -f "$BUILD/flash_job_test"
+	build flash_job_test "$TEST_DIR/flash_job_test.cpp" $FLASH_SRC BpApplication/src/flash_data.cpp BpClasses/src/crc16.cpp
+	run flash_job_test
+fi
+
+#-------------------------------------------------------------------------------
+if selected flash_data_test; then
+	rm -f "$BUILD/flash_data_test"
+	build flash_data_test "$TEST_DIR/flash_data_test.cpp" $FLASH_SRC BpApplication/src/flash_data.cpp BpClasses/src/crc16.cpp
+	run flash_data_test
+fi
+
+#-------------------------------------------------------------------------------
+if selected flash_rww_test; then
+	rm -f "$BUILD/flash_rww_test"
+	build flash_rww_test "$TEST_DIR/flash_rww_test.cpp" $FLASH_SRC
+	run flash_rww_test
+fi
+
+#-------------------------------------------------------------------------------
+if selected flash_prog_test; then
+	rm -f "$BUILD/flash_prog_test"
+	build flash_prog_test "$TEST_DIR/flash_prog_test.cpp" $FLASH_SRC $PROG_SRC
+	run flash_prog_test
+fi
+
+#-------------------------------------------------------------------------------
+if selected flash_copy_test; then
+	rm -f "$BUILD/flash_copy_test"
+	build flash_copy_test "$TEST_DIR/flash_copy_test.cpp" $FLASH_SRC $PROG_SRC
+	run flash_copy_test
+fi
+
+#-------------------------------------------------------------------------------
+if selected flash_swap_test; then
+	rm -f "$BUILD/flash_swap_test"
+	build flash_swap_test -DFLASH_SWAP_ENABLE=true "$TEST_DIR/flash_swap_test.cpp" $FLASH_SRC $PROG_SRC
+	run flash_swap_test
+fi
+
+#-------------------------------------------------------------------------------
+echo "=== $PASSED passed, $FAILED failed$FAILED_NAMES"
+[ $FAILED -eq 0 ]
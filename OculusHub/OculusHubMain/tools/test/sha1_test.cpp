@@ -0,0 +1,239 @@
+/*==============================================================================
+Host test and benchmark of CSha1 and CSha1Context.
+
+Both the one-shot CSha1::Calc and the streaming CSha1Context are checked
+against the FIPS 180 known answers (including the million 'a' message, fed in
+pieces), and against the implementation they replaced (with its 80 word
+message schedule, kept here as the reference) for random lengths split into
+random pieces. The speed of the old and new paths is then measured.
+
+Build and run with run_tests.sh, or (Linux, from OculusHub):
+	g++ -O1 -std=gnu++11 -w -Dinterrupt= '-D__asm(x)='
+		-IBpClasses/headers -IOculusHub/headers -IOculusHubMain/headers
+		-o sha1_test OculusHubMain/tools/test/sha1_test.cpp BpClasses/src/sha1.cpp
+
+14/03/2018 - Created v1.0 of file
+==============================================================================*/
+#include "host_model.hpp"
+#include "sha1.hpp"
+
+#define BENCH_SIZE			65536
+#define BENCH_PASSES		200
+
+static uint8 testData[BENCH_SIZE];
+
+//==============================================================================
+//Reference implementation
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that rotates a value left
+*/
+static inline uint32 OldRotateLeft(uint32 value, uint32 steps)
+{
+	return (value << steps) | (value >> (32 - steps));
+}
+
+/*!-----------------------------------------------------------------------------
+Function that hashes a block as CSha1::InnerHash did, expanding the message
+schedule to 80 words
+*/
+static void OldInnerHash(puint32 result, puint32 w)
+{
+	uint32 a = result[0];
+	uint32 b = result[1];
+	uint32 c = result[2];
+	uint32 d = result[3];
+	uint32 e = result[4];
+
+	for(uint32 round = 0; round < 80; round++) {
+		uint32 func, val;
+		if(round >= 16)
+			w[round] = OldRotateLeft(w[round - 3] ^ w[round - 8] ^ w[round - 14] ^ w[round - 16], 1);
+		if(round < 20) { func = (b & c) | (~b & d); val = 0x5a827999; }
+		else if(round < 40) { func = b ^ c ^ d; val = 0x6ed9eba1; }
+		else if(round < 60) { func = (b & c) | (b & d) | (c & d); val = 0x8f1bbcdc; }
+		else { func = b ^ c ^ d; val = 0xca62c1d6; }
+
+		uint32 t = OldRotateLeft(a, 5) + func + e + val + w[round];
+		e = d;
+		d = c;
+		c = OldRotateLeft(b, 30);
+		b = a;
+		a = t;
+	}
+
+	result[0] += a;
+	result[1] += b;
+	result[2] += c;
+	result[3] += d;
+	result[4] += e;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that hashes a message in one call, as CSha1::Calc did. The old code
+also hashed an extra block when the padding exactly filled the last one (for
+lengths of 55 bytes modulo 64), giving a non-standard hash, which is left
+out here so the reference gives the standard hash for every length.
+*/
+static void OldCalc(puint8 src, uint32 bytes, puint8 hash)
+{
+	uint32 result[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+	uint32 w[80];
+	uint32 remaining = bytes;
+
+	while(remaining >= 64) {
+		for(uint32 idx = 0; idx < 16; idx++, src += 4)
+			w[idx] = (src[0] << 24) | (src[1] << 16) | (src[2] << 8) | src[3];
+		OldInnerHash(result, w);
+		remaining -= 64;
+	}
+
+	//Pad the last partial block with a one bit, then the length in bits
+	memset(w, 0, 16 * sizeof(uint32));
+	uint32 byte = 0;
+	for(; byte < remaining; byte++, src++)
+		w[byte / 4] |= ((uint32)*src) << ((3 - (byte % 4)) * 8);
+	w[byte / 4] |= 0x80 << ((3 - (byte % 4)) * 8);
+	byte++;
+	if(byte > 56) {
+		OldInnerHash(result, w);
+		memset(w, 0, 16 * sizeof(uint32));
+	}
+	uint64 bits = (uint64)bytes * 8;
+	w[14] = (uint32)(bits >> 32);
+	w[15] = (uint32)bits;
+	OldInnerHash(result, w);
+
+	for(byte = 0; byte < SHA1_HASH_SIZE; byte++)
+		hash[byte] = (uint8)(result[byte / 4] >> ((3 - (byte % 4)) * 8));
+}
+
+//==============================================================================
+//Tests
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that checks the hash of a message repeated a number of times, streamed
+a repeat at a time, and (for single messages) in one call
+*/
+static void Known(const char* msg, uint32 repeats, const char* expect)
+{
+	CSha1Context ctx;
+	uint8 hash[SHA1_HASH_SIZE];
+	char hex[41];
+	uint32 len = strlen(msg);
+
+	for(uint32 idx = 0; idx < repeats; idx++)
+		ctx.Update((puint8)msg, len);
+	CHECK(ctx.GetLength() == ((uint64)len * repeats));
+	ctx.Final(hash);
+	CSha1::ToHexString(hash, hex);
+	if(strcmp(hex, expect) != 0)
+		printf("FAIL streamed \"%.16s\" x%u: %s, expected %s\n", msg, repeats, hex, expect);
+	CHECK(strcmp(hex, expect) == 0);
+
+	if(repeats == 1) {
+		CSha1::Calc((puint8)msg, len, hash);
+		CSha1::ToHexString(hash, hex);
+		CHECK(strcmp(hex, expect) == 0);
+	}
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests the FIPS 180 known answers
+*/
+static void TestKnown()
+{
+	Known("", 1, "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+	Known("abc", 1, "a9993e364706816aba3e25717850c26c9cd0d89d");
+	Known("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1, "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
+	Known("abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu", 1, "a49b2446a02c645bf419f995b67091253a04a259");
+	Known("a", 1000000, "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+	Known("a", 55, "c1c8bbdc22796e28c0e15163d20899b65621d65a");
+	Known("0123456701234567012345670123456701234567012345670123456701234567", 10, "dea356a2cddd90c7a7ecedc5ebb563934f460452");
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests random messages, streamed in random pieces, against the
+one-shot and reference paths, covering every padding case
+*/
+static void TestMatch()
+{
+	uint32 seed = 2;
+	uint32 bad = 0;
+	for(uint32 idx = 0; idx < sizeof(testData); idx++) {
+		seed = (seed * 1103515245) + 12345;
+		testData[idx] = (uint8)(seed >> 16);
+	}
+
+	for(uint32 pass = 0; pass < 3000; pass++) {
+		seed = (seed * 1103515245) + 12345;
+		uint32 len = (pass < 200) ? pass : ((seed >> 8) % 5000);
+		uint8 expect[SHA1_HASH_SIZE], oneShot[SHA1_HASH_SIZE], streamed[SHA1_HASH_SIZE];
+
+		OldCalc(testData, len, expect);
+		CSha1::Calc(testData, len, oneShot);
+
+		CSha1Context ctx;
+		uint32 pos = 0;
+		while(pos < len) {
+			seed = (seed * 1103515245) + 12345;
+			uint32 piece = (seed >> 16) % 200;
+			if(piece > (len - pos))
+				piece = len - pos;
+			ctx.Update(testData + pos, piece);
+			pos += piece;
+		}
+		ctx.Final(streamed);
+
+		if(memcmp(expect, oneShot, SHA1_HASH_SIZE) || memcmp(expect, streamed, SHA1_HASH_SIZE))
+			bad++;
+	}
+	printf("match: %u mismatches against the reference\n", bad);
+	CHECK(bad == 0);
+}
+
+//==============================================================================
+//Benchmark
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that measures the old and new paths, and streaming in the 128 byte
+blocks the programmer receives
+*/
+static void Bench()
+{
+	uint8 hash[SHA1_HASH_SIZE];
+	double bytes = (double)BENCH_SIZE * BENCH_PASSES;
+
+	double start = HostTimeUs();
+	for(uint32 pass = 0; pass < BENCH_PASSES; pass++)
+		OldCalc(testData, BENCH_SIZE, hash);
+	double oldUs = HostTimeUs() - start;
+
+	start = HostTimeUs();
+	for(uint32 pass = 0; pass < BENCH_PASSES; pass++)
+		CSha1::Calc(testData, BENCH_SIZE, hash);
+	double newUs = HostTimeUs() - start;
+
+	start = HostTimeUs();
+	for(uint32 pass = 0; pass < BENCH_PASSES; pass++) {
+		CSha1Context ctx;
+		for(uint32 pos = 0; pos < BENCH_SIZE; pos += 128)
+			ctx.Update(testData + pos, 128);
+		ctx.Final(hash);
+	}
+	double streamUs = HostTimeUs() - start;
+
+	printf("bench: old %.1f MB/s, new %.1f MB/s (%.1fx), streamed in 128 byte blocks %.1f MB/s\n",
+		bytes / oldUs, bytes / newUs, oldUs / newUs, bytes / streamUs);
+	CHECK(newUs < oldUs);
+}
+
+//==============================================================================
+int main(int argc, char** argv)
+{
+	TestKnown();
+	TestMatch();
+	Bench();
+
+	return HostResult();
+}
@@ -0,0 +1,282 @@
+/*==============================================================================
+Host stress test and throughput benchmark of CSpscFifoBuffer.
+
+The stress test runs a producer and a consumer thread against each other
+through small buffers (so the indices wrap and the buffer fills and empties
+constantly), with each side picking at random between element, block and span
+access, and checks the consumer sees the producer's sequence exactly.
+
+The benchmark moves data through a buffer on one thread, in the way the serial
+port used each buffer, comparing CSpscFifoBuffer with CFifoBuffer (with the
+interrupt masking CFifoBuffer needed around each access from the main loop).
+
+Build and run with run_tests.sh, or (Linux, from OculusHub):
+	g++ -O2 -std=gnu++11 -pthread -w -Dinterrupt= '-D__asm(x)='
+		-IBpClasses/headers -IOculusHub/headers -IOculusHubMain/headers
+		-o spsc_test OculusHubMain/tools/test/spsc_test.cpp
+
+14/03/2018 - Created v1.0 of file
+==============================================================================*/
+#include <thread>
+#include <atomic>
+
+#include "spscfifobuffer.hpp"
+#include "fifobuffer.hpp"
+#include "host_model.hpp"
+
+#define STRESS_COUNT			2000000
+
+//==============================================================================
+//Stress test
+//==============================================================================
+static std::atomic<bool> stressFailed(false);
+
+/*!-----------------------------------------------------------------------------
+Function that returns a pseudo-random number, from a per-thread state
+*/
+static inline uint32 Random(uint32* state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that produces the sequence 0, 1, 2 ... into the buffer
+*/
+template <class T>
+static void Producer(CSpscFifoBuffer<T>* fifo, uint32 total)
+{
+	uint32 seed = 0x12345678;
+	uint32 next = 0;
+	T block[64];
+
+	while(next < total) {
+		uint32 mode = Random(&seed) % 3;
+		uint32 want = (Random(&seed) % 64) + 1;
+		if(want > (total - next))
+			want = total - next;
+
+		if(mode == 0) {
+			if(fifo->Push((T)next))
+				next++;
+		}
+		else if(mode == 1) {
+			for(uint32 idx = 0; idx < want; idx++)
+				block[idx] = (T)(next + idx);
+			next += fifo->PushBlock(block, want);
+		}
+		else {
+			T* span;
+			uint32 count = fifo->ReserveSpan(&span);
+			if(count > want)
+				count = want;
+			for(uint32 idx = 0; idx < count; idx++)
+				span[idx] = (T)(next + idx);
+			fifo->CommitWrite(count);
+			next += count;
+		}
+
+		//Let the consumer run if the buffer is full (the host may have one core)
+		if(fifo->IsFull())
+			std::this_thread::yield();
+	}
+}
+
+/*!-----------------------------------------------------------------------------
+Function that consumes the buffer, checking the sequence 0, 1, 2 ...
+*/
+template <class T>
+static void Consumer(CSpscFifoBuffer<T>* fifo, uint32 total)
+{
+	uint32 seed = 0x87654321;
+	uint32 next = 0;
+	T block[64];
+
+	while((next < total) && !stressFailed) {
+		uint32 mode = Random(&seed) % 3;
+		uint32 want = (Random(&seed) % 64) + 1;
+		uint32 count = 0;
+		T value;
+		T* data = block;
+
+		if(mode == 0) {
+			if(fifo->Pop(&value)) {
+				block[0] = value;
+				count = 1;
+			}
+		}
+		else if(mode == 1) {
+			count = fifo->PopBlock(block, want);
+		}
+		else {
+			count = fifo->PeekSpan(&data);
+			if(count > want)
+				count = want;
+		}
+
+		for(uint32 idx = 0; idx < count; idx++) {
+			if(data[idx] != (T)(next + idx)) {
+				printf("FAIL sequence broken at %u, got %u\n", next + idx, (uint32)data[idx]);
+				stressFailed = true;
+				break;
+			}
+		}
+		if(mode == 2)
+			fifo->CommitRead(count);
+		next += count;
+
+		if(count == 0)
+			std::this_thread::yield();
+	}
+}
+
+/*!-----------------------------------------------------------------------------
+Function that runs the producer and consumer against each other
+*/
+template <class T>
+static void Stress(uint32 capacity, const char* name)
+{
+	CSpscFifoBuffer<T> fifo(capacity);
+	double start = HostTimeUs();
+	std::thread consumer(Consumer<T>, &fifo, (uint32)STRESS_COUNT);
+	std::thread producer(Producer<T>, &fifo, (uint32)STRESS_COUNT);
+	producer.join();
+	consumer.join();
+	double us = HostTimeUs() - start;
+
+	printf("stress %-6s capacity %4u: %u elements in %.0f ms\n", name, fifo.GetCapacity(), STRESS_COUNT, us / 1000);
+	CHECK(!stressFailed);
+	CHECK(fifo.IsEmpty());
+}
+
+//==============================================================================
+//Benchmark
+//==============================================================================
+#define BENCH_CAPACITY		1024
+#define BENCH_TOTAL			(64 * 1024 * 1024)
+
+static volatile uint32 benchSink;
+
+/*!-----------------------------------------------------------------------------
+Function that reports a benchmark result
+*/
+static void BenchReport(const char* name, double us)
+{
+	printf("bench %-36s: %7.1f MB/s\n", name, BENCH_TOTAL / us);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that moves data a byte at a time, as the receive interrupt and main
+loop ReadByte did, masking interrupts around each main loop access of CFifoBuffer
+*/
+static double BenchOldBytes()
+{
+	CByteFifoBuffer fifo(BENCH_CAPACITY);
+	uint8 value;
+	uint32 sum = 0;
+	double start = HostTimeUs();
+	for(uint32 pass = 0; pass < BENCH_TOTAL; pass += 256) {
+		for(uint32 idx = 0; idx < 256; idx++)
+			fifo.Push((uint8)idx);
+		for(uint32 idx = 0; idx < 256; idx++) {
+			IRQ_DISABLE;
+			fifo.Pop(&value);
+			IRQ_ENABLE;
+			sum += value;
+		}
+	}
+	benchSink = sum;
+	return HostTimeUs() - start;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that moves data a byte at a time through CSpscFifoBuffer
+*/
+static double BenchNewBytes()
+{
+	CByteSpscFifoBuffer fifo(BENCH_CAPACITY);
+	uint8 value;
+	uint32 sum = 0;
+	double start = HostTimeUs();
+	for(uint32 pass = 0; pass < BENCH_TOTAL; pass += 256) {
+		for(uint32 idx = 0; idx < 256; idx++)
+			fifo.Push((uint8)idx);
+		for(uint32 idx = 0; idx < 256; idx++) {
+			fifo.Pop(&value);
+			sum += value;
+		}
+	}
+	benchSink = sum;
+	return HostTimeUs() - start;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that moves data in blocks through CFifoBuffer, masking interrupts
+around each access
+*/
+static double BenchOldBlocks()
+{
+	CByteFifoBuffer fifo(BENCH_CAPACITY);
+	uint8 buf[200];
+	memset(buf, 0x55, sizeof(buf));
+	double start = HostTimeUs();
+	for(uint32 pass = 0; pass < BENCH_TOTAL; pass += sizeof(buf)) {
+		IRQ_DISABLE;
+		fifo.PushBlock(buf, sizeof(buf));
+		IRQ_ENABLE;
+		IRQ_DISABLE;
+		fifo.PopBlock(buf, sizeof(buf));
+		IRQ_ENABLE;
+	}
+	benchSink = buf[0];
+	return HostTimeUs() - start;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that moves data in blocks through CSpscFifoBuffer, filling it through
+a span (as the DMA receive drain does) and emptying it with PopBlock
+*/
+static double BenchNewBlocks()
+{
+	CByteSpscFifoBuffer fifo(BENCH_CAPACITY);
+	uint8 buf[200];
+	memset(buf, 0x55, sizeof(buf));
+	double start = HostTimeUs();
+	for(uint32 pass = 0; pass < BENCH_TOTAL; pass += sizeof(buf)) {
+		uint32 count = sizeof(buf);
+		while(count > 0) {
+			puint8 span;
+			uint32 run = fifo.ReserveSpan(&span);
+			if(run > count)
+				run = count;
+			memcpy(span, buf + sizeof(buf) - count, run);
+			fifo.CommitWrite(run);
+			count -= run;
+		}
+		fifo.PopBlock(buf, sizeof(buf));
+	}
+	benchSink = buf[0];
+	return HostTimeUs() - start;
+}
+
+//==============================================================================
+int main(int argc, char** argv)
+{
+	Stress<uint8>(2, "uint8");
+	Stress<uint8>(61, "uint8");
+	Stress<uint32>(16, "uint32");
+	Stress<uint32>(1000, "uint32");
+
+	double oldBytes = BenchOldBytes();
+	double newBytes = BenchNewBytes();
+	double oldBlocks = BenchOldBlocks();
+	double newBlocks = BenchNewBlocks();
+	BenchReport("CFifoBuffer Push/Pop", oldBytes);
+	BenchReport("CSpscFifoBuffer Push/Pop", newBytes);
+	BenchReport("CFifoBuffer PushBlock/PopBlock", oldBlocks);
+	BenchReport("CSpscFifoBuffer ReserveSpan/PopBlock", newBlocks);
+
+	return HostResult();
+}
@@ -0,0 +1,37 @@
+/*==============================================================================
+Header of a model of the SysTick time base for the host tests, for modules
+(such as services, through CTickTimer) that read the time but don't need it to
+advance. Tests can set CSysTick::_clkTicks to move time on.
+
+Include once, in the test's main source file, after host_model.hpp.
+
+14/03/2018 - Created v1.0 of file
+==============================================================================*/
+//Prevent multiple inclusions of this file
+#ifndef SYSTICK_MODEL_HPP
+#define SYSTICK_MODEL_HPP
+
+#include "systick.hpp"
+
+//==============================================================================
+double CSysTick::_clkFrequency = 1000.0;
+volatile TTimeTicks CSysTick::_clkTicks = 0;
+
+/*!-----------------------------------------------------------------------------
+Function that returns the modelled tick frequency
+*/
+double CSysTick::GetFrequency()
+{
+	return _clkFrequency;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that returns the modelled tick count
+*/
+TTimeTicks CSysTick::GetTicks()
+{
+	return _clkTicks;
+}
+
+//==============================================================================
+#endif
@@ -0,0 +1,259 @@
+/*==============================================================================
+Host test and benchmark of the CComUart DMA mode, against the register model of
+UART0 and the eDMA controller (see uart_model.hpp).
+
+Tested are ring wrapping, the receive ring being lapped while interrupts are
+held off, a byte arriving while the idle-line interrupt clears its flags, and
+DMA transmission. The benchmark counts the interrupts and register accesses
+per KB received, against the interrupt per byte mode.
+
+Build and run with run_tests.sh, or (Linux x86-64, from OculusHub):
+	g++ -O1 -no-pie -std=gnu++11 -fno-rtti -fno-exceptions -fpermissive -w
+		-Dinterrupt= '-D__asm(x)=' -DUART0_CONNECT_IRQ=true -DUART0_CONNECT_DMA=true
+		-IBpClasses/headers -IBpDevices_K60/headers -IOculusHub/headers -IOculusHubMain/headers
+		-o uart_dma_test OculusHubMain/tools/test/uart_dma_test.cpp
+		BpDevices_K60/src/com_uart.cpp BpDevices_K60/src/com.cpp
+
+14/03/2018 - Created v1.0 of file
+==============================================================================*/
+#include "uart_model.hpp"
+
+//==============================================================================
+//Tests
+//==============================================================================
+/*!-----------------------------------------------------------------------------
+Function that reads everything held by the port
+*/
+static std::vector<uint8> ReadAll(CComUart* uart)
+{
+	std::vector<uint8> data;
+	uint8 buf[256];
+	uint32 count;
+	while((count = uart->ReadBlock(buf, sizeof(buf))) > 0)
+		data.insert(data.end(), buf, buf + count);
+	return data;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that opens a port in the specified mode on UART0
+*/
+static CComUart* Open(EUartMode mode, uint32 ringSize, uint32 rxBufSize)
+{
+	ModelReset();
+	CComUart* uart = new CComUart(0, rxBufSize, 1024);
+	uart->SetMode(mode);
+	uart->SetDmaRxRingSize(ringSize);
+	uart->SetBaudRate(BAUD_921600);
+	uart->Open();
+	return uart;
+}
+
+static uint8 Pattern(uint32 idx)
+{
+	return (uint8)((idx * 7) + (idx >> 8));
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests the receive ring wrapping, with and without idle lines
+*/
+static void TestWrap()
+{
+	CComUart* uart = Open(UART_MODE_DMA, 64, 4096);
+	std::vector<uint8> sent, got;
+
+	//Reading part way through, so the reader wraps at different places
+	for(uint32 idx = 0; idx < 3000; idx++) {
+		sent.push_back(Pattern(idx));
+		ModelRx(sent.back());
+		if((idx % 97) == 0)
+			ModelIdle();
+		if((idx % 251) == 0) {
+			std::vector<uint8> part = ReadAll(uart);
+			got.insert(got.end(), part.begin(), part.end());
+		}
+	}
+	ModelIdle();
+	std::vector<uint8> part = ReadAll(uart);
+	got.insert(got.end(), part.begin(), part.end());
+
+	TComUartStats stats;
+	uart->GetStats(&stats, true);
+	printf("wrap: sent %u, received %u, ring interrupts %u, laps %u\n", (uint32)sent.size(), (uint32)got.size(), stats.DmaIsrCount, stats.DmaRxLaps);
+	CHECK(got == sent);
+	CHECK(stats.RxBytes == sent.size());
+	CHECK(stats.DmaRxLaps == 0);
+	CHECK(stats.DmaIsrCount > 0);
+	CHECK(uart->GetFlags(true) == 0);
+	delete uart;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests the ring being lapped while interrupts are held off
+*/
+static void TestLap()
+{
+	//Held off for less than the ring, nothing is lost
+	CComUart* uart = Open(UART_MODE_DMA, 64, 4096);
+	std::vector<uint8> sent;
+	g_irqLockCnt = 1;
+	for(uint32 idx = 0; idx < 60; idx++) {
+		sent.push_back(Pattern(idx));
+		ModelRx(sent.back());
+	}
+	g_irqLockCnt = 0;
+	ModelRun();
+	TComUartStats stats;
+	uart->GetStats(&stats, false);
+	CHECK(ReadAll(uart) == sent);
+	CHECK(stats.DmaRxLaps == 0);
+	delete uart;
+
+	//Held off for the ring and a bit, so the ring interrupts merge and the
+	//position alone looks like only a few bytes have arrived
+	uart = Open(UART_MODE_DMA, 64, 4096);
+	g_irqLockCnt = 1;
+	for(uint32 idx = 0; idx < 74; idx++)
+		ModelRx(Pattern(idx));
+	g_irqLockCnt = 0;
+	ModelRun();
+	std::vector<uint8> got = ReadAll(uart);
+	uart->GetStats(&stats, false);
+	printf("lap: received %u of 74, laps %u, drops %u\n", (uint32)got.size(), stats.DmaRxLaps, stats.RxBufferDrops);
+	CHECK(stats.DmaRxLaps == 1);
+	CHECK(stats.RxBytes == 74);
+	CHECK(got.size() == 0);
+	CHECK(uart->GetFlags(true) & UART_OVERRUN_ERR_MASK);
+
+	//Afterwards reception carries on in order
+	sent.clear();
+	for(uint32 idx = 0; idx < 200; idx++) {
+		sent.push_back(Pattern(idx));
+		ModelRx(sent.back());
+	}
+	ModelIdle();
+	CHECK(ReadAll(uart) == sent);
+	uart->GetStats(&stats, false);
+	CHECK(stats.DmaRxLaps == 1);
+
+	//A main loop that polls with interrupts held off is also caught
+	g_irqLockCnt = 1;
+	for(uint32 idx = 0; idx < 100; idx++)
+		ModelRx(Pattern(idx));
+	CHECK(uart->GetRxBufferCount() == 0);
+	g_irqLockCnt = 0;
+	ModelRun();
+	uart->GetStats(&stats, false);
+	CHECK(stats.DmaRxLaps == 2);
+	delete uart;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests a byte arriving while the idle-line interrupt is clearing
+its flags, after each of the status register reads the handler makes
+*/
+static void TestIdleRace()
+{
+	for(uint32 at = 1; at <= 2; at++) {
+		CComUart* uart = Open(UART_MODE_DMA, 64, 4096);
+		std::vector<uint8> sent;
+		for(uint32 idx = 0; idx < 40; idx++) {
+			sent.push_back(Pattern(idx));
+			ModelRx(sent.back());
+		}
+
+		//The idle interrupt is entered, and another byte arrives part way through
+		ModelProtect(false);
+		UART0->S1 |= UART_S1_IDLE_MASK;
+		modelInjectAt = modelS1Reads + at;
+		modelInjectByte = 0xA5;
+		ModelProtect(true);
+		sent.push_back(0xA5);
+		ModelRun();
+		CHECK(modelInjectAt == 0);
+
+		for(uint32 idx = 40; idx < 80; idx++) {
+			sent.push_back(Pattern(idx));
+			ModelRx(sent.back());
+		}
+		ModelIdle();
+
+		std::vector<uint8> got = ReadAll(uart);
+		printf("idle race at status read %u: sent %u, received %u\n", at, (uint32)sent.size(), (uint32)got.size());
+		CHECK(got == sent);
+		CHECK(modelLost == 0);
+		delete uart;
+	}
+}
+
+/*!-----------------------------------------------------------------------------
+Function that tests DMA transmission, across the end of the transmit buffer
+*/
+static void TestTx()
+{
+	CComUart* uart = Open(UART_MODE_DMA, 64, 4096);
+	std::vector<uint8> sent;
+	for(uint32 block = 0; block < 10; block++) {
+		uint8 buf[300];
+		for(uint32 idx = 0; idx < sizeof(buf); idx++)
+			buf[idx] = Pattern(sent.size() + idx);
+		sent.insert(sent.end(), buf, buf + sizeof(buf));
+		uart->WriteBlock(buf, sizeof(buf));
+		ModelRun();
+	}
+	TComUartStats stats;
+	uart->GetStats(&stats, false);
+	printf("tx: sent %u, on the line %u, DMA interrupts %u\n", (uint32)sent.size(), (uint32)modelLineOut.size(), stats.DmaIsrCount);
+	CHECK(modelLineOut == sent);
+	CHECK(stats.TxBytes == sent.size());
+	CHECK(uart->GetTxBufferCount() == 0);
+	delete uart;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that measures the cost of receiving in each mode, in frames of 57
+bytes separated by idle lines
+*/
+static void Bench(EUartMode mode, const char* name)
+{
+	const uint32 total = 16384;
+	CComUart* uart = Open(mode, 256, 4096);
+	uint32 received = 0;
+	uint8 buf[256];
+
+	double start = HostTimeUs();
+	for(uint32 idx = 0; idx < total; idx++) {
+		ModelRx(Pattern(idx));
+		if((idx % 57) == 56) {
+			ModelIdle();
+			received += uart->ReadBlock(buf, sizeof(buf));
+		}
+	}
+	ModelIdle();
+	received += uart->ReadBlock(buf, sizeof(buf));
+	double us = HostTimeUs() - start;
+
+	TComUartStats stats;
+	uart->GetStats(&stats, false);
+	double kb = total / 1024.0;
+	printf("bench %-4s: %u bytes, %.1f interrupts/KB, %.1f register accesses/KB, %.0f us/KB modelled\n",
+		name, received, (stats.IsrCount + stats.DmaIsrCount) / kb, modelAccesses / kb, us / kb);
+	CHECK(received == total);
+	CHECK(stats.OverrunErrors == 0);
+	delete uart;
+}
+
+//==============================================================================
+int main(int argc, char** argv)
+{
+	ModelInit();
+
+	TestWrap();
+	TestLap();
+	TestIdleRace();
+	TestTx();
+
+	Bench(UART_MODE_IRQ, "irq");
+	Bench(UART_MODE_DMA, "dma");
+
+	return HostResult();
+}
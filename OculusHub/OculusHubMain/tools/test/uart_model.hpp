@@ -0,0 +1,299 @@
+/*==============================================================================
+Header of a register model of UART0 and the eDMA controller, used to run the
+CComUart driver on a Linux (x86-64) host.
+
+The UART and DMA control register pages are mapped without access, so each
+register access the firmware makes faults. The fault handler opens the page,
+single-steps the access, then applies its side effects the way the hardware
+does (reading the data register after the status register clears the flags
+seen, DMA channel requests are set and cleared by writes to SERQ/CERQ/CINT and
+so on), before closing the page again. The DMA controller moves a byte into the
+receive ring whenever the UART requests it (running the linked lap counting
+channel at the end of each pass round the ring), and interrupt handlers are
+called by ModelRun unless interrupts are held off with g_irqLockCnt. The
+transmitter is modelled as instant.
+
+The model runs the DMA controller late, so a byte can arrive in the data
+register while an interrupt handler is part way through reading it, and in
+DMA mode any read of the data register clears the request, as the controller's
+own read does.
+
+Tests including this must define UART0_CONNECT_IRQ and UART0_CONNECT_DMA as
+true when compiling com_uart.cpp.
+
+14/03/2018 - Created v1.0 of file
+==============================================================================*/
+//Prevent multiple inclusions of this file
+#ifndef UART_MODEL_HPP
+#define UART_MODEL_HPP
+
+#include <signal.h>
+#include <ucontext.h>
+#include <stddef.h>
+#include <vector>
+
+#include "com_uart.hpp"
+#include "host_model.hpp"
+
+//Clock frequencies the UART is opened with (normally set by CMcg)
+uint32 CMcg::ClkSysFreq = 120000000;
+uint32 CMcg::ClkIntBusFreq = 60000000;
+
+//Interrupt handlers connected in com_uart.cpp
+extern "C" void ISR_UART0_RX_TX(void);
+extern "C" void ISR_DMA0(void);
+extern "C" void ISR_DMA1(void);
+
+//==============================================================================
+//Register model
+//==============================================================================
+#define MODEL_PAGE				0x1000
+#define MODEL_UART_PAGE			(UART0_BASE & ~(MODEL_PAGE - 1))
+#define MODEL_DMA_PAGE			(DMA_BASE & ~(MODEL_PAGE - 1))		/*!< Control registers, the TCDs are on the next page */
+#define MODEL_S1_FLAGS			(UART_S1_RDRF_MASK | UART_S1_IDLE_MASK | UART_S1_OR_MASK | UART_S1_NF_MASK | UART_S1_FE_MASK | UART_S1_PF_MASK)
+
+static uintptr_t modelAddr;				/*!< Address of the access being single-stepped */
+static bool modelWrite;
+static uint8 modelSeenS1;				/*!< Flags seen by the last status register read */
+static uint32 modelAccesses;			/*!< Register accesses trapped */
+static uint32 modelS1Reads;
+static uint32 modelInjectAt;			/*!< Status register read to deliver modelInjectByte after (0 for none) */
+static uint8 modelInjectByte;
+static uint32 modelLost;				/*!< Bytes lost to UART overruns */
+static std::vector<uint8> modelLineOut;	/*!< Bytes transmitted */
+
+static void ModelArrive(uint8 data);
+
+/*!-----------------------------------------------------------------------------
+Function that opens or closes the modelled register pages to access
+*/
+static void ModelProtect(bool trap)
+{
+	int prot = trap ? PROT_NONE : (PROT_READ | PROT_WRITE);
+	mprotect((void*)(uintptr_t)MODEL_UART_PAGE, MODEL_PAGE, prot);
+	mprotect((void*)(uintptr_t)MODEL_DMA_PAGE, MODEL_PAGE, prot);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that applies the side effects of a register access, once made
+*/
+static void ModelAccess(uintptr_t addr, bool write)
+{
+	modelAccesses++;
+	if((addr & ~(uintptr_t)(MODEL_PAGE - 1)) == MODEL_DMA_PAGE) {
+		uint32 off = addr - DMA_BASE;
+		if(!write)
+			return;
+		if(off == offsetof(DMA_Type, CINT))
+			DMA0->INT &= ~(1u << DMA0->CINT);
+		else if(off == offsetof(DMA_Type, CERQ))
+			DMA0->ERQ &= ~(1u << DMA0->CERQ);
+		else if(off == offsetof(DMA_Type, SERQ))
+			DMA0->ERQ |= (1u << DMA0->SERQ);
+		return;
+	}
+
+	uint32 off = addr - UART0_BASE;
+	if((off == offsetof(UART_Type, S1)) && !write) {
+		modelSeenS1 = UART0->S1;
+		modelS1Reads++;
+		if(modelInjectAt && (modelS1Reads == modelInjectAt)) {
+			modelInjectAt = 0;
+			ModelArrive(modelInjectByte);
+		}
+	}
+	else if(off == offsetof(UART_Type, D)) {
+		if(write) {
+			modelLineOut.push_back((uint8)UART0->D);
+		}
+		else {
+			//Reading clears the flags seen by the last status read, and in
+			//DMA mode clears the request (taking the byte from the controller)
+			uint8 clear = modelSeenS1 & MODEL_S1_FLAGS;
+			if(UART0->C5 & UART_C5_RDMAS_MASK)
+				clear |= UART_S1_RDRF_MASK;
+			UART0->S1 &= ~clear;
+			modelSeenS1 = 0;
+		}
+	}
+}
+
+/*!-----------------------------------------------------------------------------
+Signal handler for a register access, that opens the pages and single-steps it
+*/
+static void ModelFault(int sig, siginfo_t* info, void* context)
+{
+	ucontext_t* uc = (ucontext_t*)context;
+	modelAddr = (uintptr_t)info->si_addr;
+	modelWrite = (uc->uc_mcontext.gregs[REG_ERR] & 2) != 0;
+	ModelProtect(false);
+	uc->uc_mcontext.gregs[REG_EFL] |= 0x100;
+}
+
+/*!-----------------------------------------------------------------------------
+Signal handler for the end of a single-stepped register access
+*/
+static void ModelStep(int sig, siginfo_t* info, void* context)
+{
+	ucontext_t* uc = (ucontext_t*)context;
+	uc->uc_mcontext.gregs[REG_EFL] &= ~0x100;
+	ModelAccess(modelAddr, modelWrite);
+	ModelProtect(true);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that maps the peripherals and installs the register trap
+*/
+static void ModelInit()
+{
+	HostMap(MODEL_DMA_PAGE, 2 * MODEL_PAGE, 0);
+	HostMap(DMAMUX0_BASE & ~(MODEL_PAGE - 1), MODEL_PAGE, 0);
+	HostMap(SIM_BASE, 2 * MODEL_PAGE, 0);
+	HostMap(MODEL_UART_PAGE, MODEL_PAGE, 0);
+	HostMap(0xE000E000, MODEL_PAGE, 0);
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_flags = SA_SIGINFO;
+	sa.sa_sigaction = ModelFault;
+	sigaction(SIGSEGV, &sa, NULL);
+	sa.sa_sigaction = ModelStep;
+	sigaction(SIGTRAP, &sa, NULL);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that resets the modelled registers, with the transmitter idle
+*/
+static void ModelReset()
+{
+	ModelProtect(false);
+	memset((void*)(uintptr_t)MODEL_UART_PAGE, 0, MODEL_PAGE);
+	memset((void*)(uintptr_t)MODEL_DMA_PAGE, 0, 2 * MODEL_PAGE);
+	UART0->S1 = UART_S1_TDRE_MASK | UART_S1_TC_MASK;
+	modelSeenS1 = 0;
+	modelAccesses = 0;
+	modelS1Reads = 0;
+	modelInjectAt = 0;
+	modelLost = 0;
+	modelLineOut.clear();
+	ModelProtect(true);
+}
+
+/*!-----------------------------------------------------------------------------
+Function that moves a byte into the UART data register from the line.
+Must be called with the pages open.
+*/
+static void ModelArrive(uint8 data)
+{
+	if(UART0->S1 & UART_S1_RDRF_MASK) {
+		UART0->S1 |= UART_S1_OR_MASK;
+		modelLost++;
+	}
+	else {
+		UART0->D = data;
+		UART0->S1 |= UART_S1_RDRF_MASK;
+	}
+}
+
+/*!-----------------------------------------------------------------------------
+Function that runs the DMA channels of UART0, for any requests the UART raises.
+Must be called with the pages open.
+*/
+static void ModelDma()
+{
+	DMA_Type* dma = DMA0;
+
+	//Receive channel, moves the data register into the ring
+	if((dma->ERQ & 1) && (UART0->C5 & UART_C5_RDMAS_MASK) && (UART0->S1 & UART_S1_RDRF_MASK)) {
+		HostMem(dma->TCD[0].DADDR)[0] = UART0->D;
+		UART0->S1 &= ~UART_S1_RDRF_MASK;
+		dma->TCD[0].DADDR += dma->TCD[0].DOFF;
+		uint16 citer = dma->TCD[0].CITER_ELINKNO - 1;
+		if((citer == (dma->TCD[0].BITER_ELINKNO / 2)) && (dma->TCD[0].CSR & DMA_CSR_INTHALF_MASK))
+			dma->INT |= 1;
+		if(citer == 0) {
+			if(dma->TCD[0].CSR & DMA_CSR_INTMAJOR_MASK)
+				dma->INT |= 1;
+			citer = dma->TCD[0].BITER_ELINKNO;
+			dma->TCD[0].DADDR += dma->TCD[0].DLAST_SGA;
+
+			//Run a minor loop of the linked channel (the lap count)
+			if(dma->TCD[0].CSR & DMA_CSR_MAJORELINK_MASK) {
+				uint8 link = (dma->TCD[0].CSR & DMA_CSR_MAJORLINKCH_MASK) >> DMA_CSR_MAJORLINKCH_SHIFT;
+				HostMem(dma->TCD[link].DADDR)[0] = HostMem(dma->TCD[link].SADDR)[0];
+				if(--dma->TCD[link].CITER_ELINKNO == 0)
+					dma->TCD[link].CITER_ELINKNO = dma->TCD[link].BITER_ELINKNO;
+			}
+		}
+		dma->TCD[0].CITER_ELINKNO = citer;
+	}
+
+	//Transmit channel, sends a whole segment as the line is modelled as instant
+	if((dma->ERQ & 2) && (UART0->C5 & UART_C5_TDMAS_MASK) && (UART0->C2 & UART_C2_TIE_MASK)) {
+		uint32 count = dma->TCD[1].CITER_ELINKNO;
+		modelLineOut.insert(modelLineOut.end(), HostMem(dma->TCD[1].SADDR), HostMem(dma->TCD[1].SADDR) + count);
+		dma->TCD[1].SADDR += count;
+		dma->TCD[1].CITER_ELINKNO = dma->TCD[1].BITER_ELINKNO;
+		dma->INT |= 2;
+		if(dma->TCD[1].CSR & DMA_CSR_DREQ_MASK)
+			dma->ERQ &= ~2;
+	}
+}
+
+/*!-----------------------------------------------------------------------------
+Function that runs the DMA controller, then calls the interrupt handlers until
+none are pending (unless interrupts are held off)
+*/
+static void ModelRun()
+{
+	for(uint32 loops = 0; loops < 1000; loops++) {
+		ModelProtect(false);
+		ModelDma();
+		uint8 s1 = UART0->S1;
+		uint8 c2 = UART0->C2;
+		uint8 c5 = UART0->C5;
+		uint32 irqs = DMA0->INT;
+		ModelProtect(true);
+
+		if(g_irqLockCnt)
+			return;
+		if(irqs & 1)
+			ISR_DMA0();
+		else if(irqs & 2)
+			ISR_DMA1();
+		else if(((c2 & UART_C2_ILIE_MASK) && (s1 & UART_S1_IDLE_MASK))
+			|| ((c2 & UART_C2_RIE_MASK) && (s1 & UART_S1_RDRF_MASK) && !(c5 & UART_C5_RDMAS_MASK))
+			|| ((c2 & UART_C2_TIE_MASK) && (s1 & UART_S1_TDRE_MASK) && !(c5 & UART_C5_TDMAS_MASK))
+			|| ((c2 & UART_C2_TCIE_MASK) && (s1 & UART_S1_TC_MASK)))
+			ISR_UART0_RX_TX();
+		else
+			return;
+	}
+	printf("Interrupts still pending\n");
+	g_fails++;
+}
+
+/*!-----------------------------------------------------------------------------
+Function that receives a byte from the line, and runs the model
+*/
+static void ModelRx(uint8 data)
+{
+	ModelProtect(false);
+	ModelArrive(data);
+	ModelProtect(true);
+	ModelRun();
+}
+
+/*!-----------------------------------------------------------------------------
+Function that idles the receive line, and runs the model
+*/
+static void ModelIdle()
+{
+	ModelProtect(false);
+	UART0->S1 |= UART_S1_IDLE_MASK;
+	ModelProtect(true);
+	ModelRun();
+}
+
+//==============================================================================
+#endif